@@ -0,0 +1,590 @@
+/*
+  2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017 Stef Bon <stefbon@gmail.com>
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#ifndef _REENTRANT
+#define _REENTRANT
+#endif
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+
+#include <inttypes.h>
+#include <ctype.h>
+#include <sys/types.h>
+
+#include <time.h>
+#include <pthread.h>
+#include <poll.h>
+
+#include "global-defines.h"
+
+#include "utils.h"
+#include "logging.h"
+#include "beventloop.h"
+#include "beventloop-xdata.h"
+#include "beventloop-iouring.h"
+
+extern int lock_beventloop(struct beventloop_s *loop);
+extern int unlock_beventloop(struct beventloop_s *loop);
+
+#ifdef HAVE_LIBURING
+
+#include <liburing.h>
+
+/*
+    user data of the sqe's:
+    - a poll or a read of an xdata: the tag of the xdata (high 32 bits) and the fd (low 32 bits)
+    - the timeout of the timer: IOURING_USERDATA_TIMER and the generation of the timer in the low bits
+    - others (removes): IOURING_USERDATA_NOFD, the completion is ignored
+    the tag is different for every xdata added to the loop, so a completion for an xdata removed meanwhile
+    is recognized also when its fd is reused by a new xdata, and dropped
+*/
+
+#define IOURING_USERDATA_NOFD			UINT64_MAX
+#define IOURING_USERDATA_TIMER			((uint64_t) 0xFFFFFFFE << 32)
+#define IOURING_TAG_MAX				0x7FFFFFFF
+
+#define IOURING_POLL_MASK			(POLLIN | POLLOUT | POLLPRI | POLLERR | POLLHUP | POLLRDHUP)
+
+/*
+    readiness:
+    - default a one shot poll, armed again after the callback, like a level triggered epoll
+    - when the xdata is added with EPOLLET a multishot poll, which stays armed (edge triggered, like epoll)
+    reads: an xdata with a read callback gets a read with a buffer selected by the kernel from a ring of
+    provided buffers; the buffer is given back after the callback
+    the timer of the loop is a timeout with an absolute time, in place of a timerfd
+
+    the submission queue is protected by the mutex of the backend (taken after the eventloop lock and the
+    mutex of the timers), completions are only handled by the thread running the loop
+    arming again after the callbacks is not submitted right away, but together for the whole batch before
+    the loop waits again
+    waiting with a timeout does not use the submission queue (IORING_FEAT_EXT_ARG is required)
+*/
+
+struct beventloop_iouring_s {
+    struct io_uring				ring;
+    pthread_mutex_t				mutex;
+    uint32_t					tags;
+    uint32_t					timer;
+    unsigned char				timerset;
+    unsigned char				pending;
+    struct io_uring_buf_ring			*br;
+    char					*buffers;
+};
+
+static uint64_t get_iouring_userdata(struct bevent_xdata_s *xdata)
+{
+    return (((uint64_t) xdata->tag) << 32) | (uint32_t) xdata->fd;
+}
+
+static struct io_uring_sqe *get_iouring_sqe(struct io_uring *ring)
+{
+    struct io_uring_sqe *sqe=io_uring_get_sqe(ring);
+
+    if (sqe==NULL) {
+
+	/* submission queue full: flush and try again */
+
+	io_uring_submit(ring);
+	sqe=io_uring_get_sqe(ring);
+
+    }
+
+    return sqe;
+}
+
+/* call with eventloop locked; with submit zero the sqe is left for the next wait of the loop */
+
+static int _iouring_arm(struct beventloop_s *loop, struct bevent_xdata_s *xdata, unsigned char submit)
+{
+    struct beventloop_iouring_s *iouring=(struct beventloop_iouring_s *) loop->backend.data;
+    struct io_uring_sqe *sqe=NULL;
+    int result=0;
+
+    pthread_mutex_lock(&iouring->mutex);
+    sqe=get_iouring_sqe(&iouring->ring);
+
+    if (sqe==NULL) {
+
+	pthread_mutex_unlock(&iouring->mutex);
+	errno=EBUSY;
+	return -1;
+
+    }
+
+    if (xdata->read && iouring->br) {
+
+	io_uring_prep_read(sqe, xdata->fd, NULL, BEVENTLOOP_IOURING_BUFSIZE, (uint64_t) -1);
+	sqe->flags |= IOSQE_BUFFER_SELECT;
+	sqe->buf_group=BEVENTLOOP_IOURING_BGID;
+
+    } else if (xdata->events & EPOLLET) {
+
+	io_uring_prep_poll_multishot(sqe, xdata->fd, xdata->events & IOURING_POLL_MASK);
+
+    } else {
+
+	io_uring_prep_poll_add(sqe, xdata->fd, xdata->events & IOURING_POLL_MASK);
+
+    }
+
+    io_uring_sqe_set_data64(sqe, get_iouring_userdata(xdata));
+    xdata->status |= BEVENT_OPTION_ARMED;
+
+    if (submit) {
+
+	result=io_uring_submit(&iouring->ring);
+
+    } else {
+
+	iouring->pending=1;
+
+    }
+
+    pthread_mutex_unlock(&iouring->mutex);
+
+    if (result<0) {
+
+	xdata->status &= ~BEVENT_OPTION_ARMED;
+	errno=-result;
+	return -1;
+
+    }
+
+    return 0;
+
+}
+
+static int _iouring_add(struct beventloop_s *loop, struct bevent_xdata_s *xdata, uint32_t events)
+{
+    struct beventloop_iouring_s *iouring=(struct beventloop_iouring_s *) loop->backend.data;
+
+    iouring->tags=(iouring->tags % IOURING_TAG_MAX) + 1;
+    xdata->tag=iouring->tags;
+    xdata->events=events;
+    return _iouring_arm(loop, xdata, 1);
+}
+
+static void _iouring_remove(struct beventloop_s *loop, struct bevent_xdata_s *xdata)
+{
+    struct beventloop_iouring_s *iouring=(struct beventloop_iouring_s *) loop->backend.data;
+
+    if (xdata->status & BEVENT_OPTION_ARMED) {
+	struct io_uring_sqe *sqe=NULL;
+
+	pthread_mutex_lock(&iouring->mutex);
+	sqe=get_iouring_sqe(&iouring->ring);
+
+	if (sqe) {
+
+	    /* a read is cancelled, a poll removed; a completion still on its way has a tag nobody has anymore */
+
+	    if (xdata->read && iouring->br) {
+
+		io_uring_prep_cancel64(sqe, get_iouring_userdata(xdata), 0);
+
+	    } else {
+
+		io_uring_prep_poll_remove(sqe, get_iouring_userdata(xdata));
+
+	    }
+
+	    io_uring_sqe_set_data64(sqe, IOURING_USERDATA_NOFD);
+	    io_uring_submit(&iouring->ring);
+
+	}
+
+	pthread_mutex_unlock(&iouring->mutex);
+	xdata->status &= ~BEVENT_OPTION_ARMED;
+
+    }
+
+    xdata->tag=0;
+
+}
+
+/* give a provided buffer back to the ring, only by the thread of the loop */
+
+static void put_iouring_buffer(struct beventloop_iouring_s *iouring, unsigned int id)
+{
+    io_uring_buf_ring_add(iouring->br, iouring->buffers + id * BEVENTLOOP_IOURING_BUFSIZE, BEVENTLOOP_IOURING_BUFSIZE, id, io_uring_buf_ring_mask(BEVENTLOOP_IOURING_BUFFERS), 0);
+    io_uring_buf_ring_advance(iouring->br, 1);
+}
+
+static int _iouring_wait(struct beventloop_s *loop, struct bevent_s *bevents, unsigned int max, int timeout)
+{
+    struct beventloop_iouring_s *iouring=(struct beventloop_iouring_s *) loop->backend.data;
+    struct io_uring *ring=&iouring->ring;
+    struct xdata_table_s *table=&loop->xdata_table;
+    struct io_uring_cqe *cqe=NULL;
+    unsigned int head=0;
+    unsigned int nr=0;
+    unsigned char expired=0;
+    int count=0;
+    int result=0;
+
+    if (iouring->pending) {
+
+	/* submit what is armed again after the previous batch */
+
+	pthread_mutex_lock(&iouring->mutex);
+	iouring->pending=0;
+	result=io_uring_submit(ring);
+	pthread_mutex_unlock(&iouring->mutex);
+	if (result<0) logoutput_warning("_iouring_wait: error %i submitting (%s)", -result, strerror(-result));
+
+    }
+
+    if (timeout==0) {
+
+	result=io_uring_peek_cqe(ring, &cqe);
+
+    } else if (timeout<0) {
+
+	result=io_uring_wait_cqe(ring, &cqe);
+
+    } else {
+	struct __kernel_timespec ts;
+
+	ts.tv_sec=timeout / 1000;
+	ts.tv_nsec=(timeout % 1000) * 1000000;
+	result=io_uring_wait_cqe_timeout(ring, &cqe, &ts);
+
+    }
+
+    if (result==-EAGAIN || result==-ETIME || result==-EINTR) {
+
+	return 0;
+
+    } else if (result<0) {
+
+	errno=-result;
+	return -1;
+
+    }
+
+    lock_beventloop(loop);
+
+    io_uring_for_each_cqe(ring, head, cqe) {
+	uint64_t userdata=io_uring_cqe_get_data64(cqe);
+	uint32_t tag=(uint32_t) (userdata >> 32);
+	uint32_t fd=(uint32_t) userdata;
+	struct bevent_xdata_s *xdata=NULL;
+
+	if (count==max) break;
+	nr++;
+
+	if (userdata==IOURING_USERDATA_NOFD) {
+
+	    continue;
+
+	} else if ((userdata & IOURING_USERDATA_TIMER)==IOURING_USERDATA_TIMER) {
+
+	    /* only the timeout set last counts, an earlier one may have expired before it was removed */
+
+	    pthread_mutex_lock(&iouring->mutex);
+
+	    if (fd==iouring->timer && cqe->res==-ETIME) {
+
+		iouring->timerset=0;
+		expired=1;
+
+	    } else if (fd==iouring->timer && cqe->res!=-ECANCELED) {
+
+		logoutput_warning("_iouring_wait: error %i timeout (%s)", -cqe->res, strerror(-cqe->res));
+		iouring->timerset=0;
+
+	    }
+
+	    pthread_mutex_unlock(&iouring->mutex);
+	    continue;
+
+	}
+
+	if (fd < table->size) xdata=table->fdindex[fd];
+
+	if (xdata==NULL || xdata->tag!=tag || (xdata->status & BEVENT_OPTION_ARMED)==0 || cqe->res==-ECANCELED) {
+
+	    /* stale: the xdata is removed, maybe the fd reused by another */
+
+	    if (cqe->flags & IORING_CQE_F_BUFFER) put_iouring_buffer(iouring, cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+	    continue;
+
+	}
+
+	/* a multishot poll stays armed as long as the kernel says so */
+
+	if ((cqe->flags & IORING_CQE_F_MORE)==0) xdata->status &= ~BEVENT_OPTION_ARMED;
+
+	bevents[count].xdata=xdata;
+	bevents[count].fd=xdata->fd;
+	bevents[count].tag=tag;
+	bevents[count].read=0;
+	bevents[count].size=0;
+	bevents[count].buffer=NULL;
+	bevents[count].id=0;
+
+	if (xdata->read && iouring->br) {
+
+	    bevents[count].events=EPOLLIN;
+	    bevents[count].read=1;
+	    bevents[count].size=cqe->res;
+
+	    if (cqe->flags & IORING_CQE_F_BUFFER) {
+
+		bevents[count].id=cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+		bevents[count].buffer=iouring->buffers + bevents[count].id * BEVENTLOOP_IOURING_BUFSIZE;
+
+	    }
+
+	} else {
+
+	    bevents[count].events=(cqe->res<0) ? EPOLLERR : (uint32_t) cqe->res;
+
+	}
+
+	count++;
+
+    }
+
+    io_uring_cq_advance(ring, nr);
+    unlock_beventloop(loop);
+
+    if (expired) (* loop->timer_list.run_expired)(loop);
+    return count;
+
+}
+
+static void _iouring_rearm(struct beventloop_s *loop, struct bevent_s *bevent)
+{
+    struct beventloop_iouring_s *iouring=(struct beventloop_iouring_s *) loop->backend.data;
+    struct xdata_table_s *table=&loop->xdata_table;
+
+    if (bevent->buffer) put_iouring_buffer(iouring, bevent->id);
+
+    lock_beventloop(loop);
+
+    /* only arm again when the xdata is still there for this fd, and is the same */
+
+    if (bevent->fd>=0 && (unsigned int) bevent->fd < table->size && table->fdindex[bevent->fd]==bevent->xdata && bevent->xdata->tag==bevent->tag) {
+	struct bevent_xdata_s *xdata=bevent->xdata;
+
+	/* a read is not done again after end of file or an error */
+
+	if (bevent->read && bevent->size<=0 && bevent->size!=-ENOBUFS && bevent->size!=-EAGAIN && bevent->size!=-EINTR) goto unlock;
+
+	if ((xdata->status & BEVENT_OPTION_ADDED_EVENTLOOP) && (xdata->status & BEVENT_OPTION_ARMED)==0) {
+
+	    if (_iouring_arm(loop, xdata, 0)==-1) logoutput_warning("_iouring_rearm: error %i arming fd %i (%s)", errno, xdata->fd, strerror(errno));
+
+	}
+
+    }
+
+    unlock:
+
+    unlock_beventloop(loop);
+}
+
+/* the timer of the loop: remove the timeout set before (if any) and set a new one with the next generation */
+
+static int _iouring_settimer(struct beventloop_s *loop, struct timespec *expire)
+{
+    struct beventloop_iouring_s *iouring=(struct beventloop_iouring_s *) loop->backend.data;
+    struct io_uring_sqe *sqe=NULL;
+    struct __kernel_timespec ts;
+    int result=0;
+
+    if (iouring==NULL) return -1; /* loop closed */
+
+    pthread_mutex_lock(&iouring->mutex);
+
+    if (iouring->timerset) {
+
+	sqe=get_iouring_sqe(&iouring->ring);
+
+	if (sqe) {
+
+	    io_uring_prep_timeout_remove(sqe, IOURING_USERDATA_TIMER | iouring->timer, 0);
+	    io_uring_sqe_set_data64(sqe, IOURING_USERDATA_NOFD);
+
+	}
+
+	iouring->timerset=0;
+
+    }
+
+    iouring->timer++;
+
+    if (expire->tv_sec>0 || expire->tv_nsec>0) {
+
+	sqe=get_iouring_sqe(&iouring->ring);
+
+	if (sqe==NULL) {
+
+	    result=-EBUSY;
+	    goto unlock;
+
+	}
+
+	/* the timespec is copied by the kernel when submitted, below */
+
+	ts.tv_sec=expire->tv_sec;
+	ts.tv_nsec=expire->tv_nsec;
+	io_uring_prep_timeout(sqe, &ts, 0, IORING_TIMEOUT_ABS | IORING_TIMEOUT_REALTIME);
+	io_uring_sqe_set_data64(sqe, IOURING_USERDATA_TIMER | iouring->timer);
+	iouring->timerset=1;
+
+    }
+
+    result=io_uring_submit(&iouring->ring);
+
+    unlock:
+
+    pthread_mutex_unlock(&iouring->mutex);
+
+    if (result<0) {
+
+	errno=-result;
+	return -1;
+
+    }
+
+    return 0;
+
+}
+
+static void _iouring_close(struct beventloop_s *loop)
+{
+    struct beventloop_iouring_s *iouring=(struct beventloop_iouring_s *) loop->backend.data;
+
+    if (iouring) {
+
+	if (iouring->br) io_uring_free_buf_ring(&iouring->ring, iouring->br, BEVENTLOOP_IOURING_BUFFERS, BEVENTLOOP_IOURING_BGID);
+	io_uring_queue_exit(&iouring->ring);
+	pthread_mutex_destroy(&iouring->mutex);
+	free(iouring->buffers);
+	free(iouring);
+	loop->backend.data=NULL;
+
+    }
+
+    loop->fd=0;
+}
+
+/* the ring of provided buffers for reads; without it (older kernels) an xdata with a read callback is polled */
+
+static void init_iouring_buffers(struct beventloop_iouring_s *iouring)
+{
+    int result=0;
+
+    iouring->buffers=malloc(BEVENTLOOP_IOURING_BUFFERS * BEVENTLOOP_IOURING_BUFSIZE);
+    if (iouring->buffers==NULL) return;
+
+    iouring->br=io_uring_setup_buf_ring(&iouring->ring, BEVENTLOOP_IOURING_BUFFERS, BEVENTLOOP_IOURING_BGID, 0, &result);
+
+    if (iouring->br==NULL) {
+
+	logoutput_warning("init_beventloop_iouring: error %i setting up provided buffers (%s), reads are polled", -result, strerror(-result));
+	free(iouring->buffers);
+	iouring->buffers=NULL;
+	return;
+
+    }
+
+    for (unsigned int i=0; i<BEVENTLOOP_IOURING_BUFFERS; i++) {
+
+	io_uring_buf_ring_add(iouring->br, iouring->buffers + i * BEVENTLOOP_IOURING_BUFSIZE, BEVENTLOOP_IOURING_BUFSIZE, i, io_uring_buf_ring_mask(BEVENTLOOP_IOURING_BUFFERS), i);
+
+    }
+
+    io_uring_buf_ring_advance(iouring->br, BEVENTLOOP_IOURING_BUFFERS);
+
+}
+
+int init_beventloop_iouring(struct beventloop_s *loop, unsigned int *error)
+{
+    struct beventloop_iouring_s *iouring=malloc(sizeof(struct beventloop_iouring_s));
+    int result=0;
+
+    if (iouring==NULL) {
+
+	*error=ENOMEM;
+	return -1;
+
+    }
+
+    memset(iouring, 0, sizeof(struct beventloop_iouring_s));
+    result=io_uring_queue_init(BEVENTLOOP_IOURING_ENTRIES, &iouring->ring, 0);
+
+    if (result<0) {
+
+	logoutput_warning("init_beventloop_iouring: error %i creating io_uring (%s)", -result, strerror(-result));
+	free(iouring);
+	*error=-result;
+	return -1;
+
+    }
+
+    if ((iouring->ring.features & IORING_FEAT_EXT_ARG)==0) {
+
+	logoutput_warning("init_beventloop_iouring: kernel does not support waiting with a timeout without sqe");
+	io_uring_queue_exit(&iouring->ring);
+	free(iouring);
+	*error=ENOSYS;
+	return -1;
+
+    }
+
+    pthread_mutex_init(&iouring->mutex, NULL);
+    init_iouring_buffers(iouring);
+
+    loop->fd=iouring->ring.ring_fd;
+    loop->backend.type=BEVENTLOOP_BACKEND_IOURING;
+    loop->backend.add=_iouring_add;
+    loop->backend.remove=_iouring_remove;
+    loop->backend.wait=_iouring_wait;
+    loop->backend.rearm=_iouring_rearm;
+    loop->backend.settimer=_iouring_settimer;
+    loop->backend.close=_iouring_close;
+    loop->backend.data=(void *) iouring;
+
+    return 0;
+
+}
+
+#else
+
+int init_beventloop_iouring(struct beventloop_s *loop, unsigned int *error)
+{
+    logoutput_warning("init_beventloop_iouring: not supported (no liburing)");
+    *error=ENOSYS;
+    return -1;
+}
+
+#endif
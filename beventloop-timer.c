@@ -69,39 +69,34 @@ struct timerentry_s *get_containing_timerentry(struct list_element_s *list)
 static int set_timer(struct beventloop_s *loop)
 {
     struct timerentry_s *timerentry=NULL;
-    struct itimerspec new_value;
-    int fd=0;
+    struct timespec expire;
     int result=-1;
     struct list_element_s *list=NULL;
 
     if (! loop) loop=get_mainloop();
 
-    fd=loop->timer_list.fd;
     list=loop->timer_list.header.head;
 
     if (list) {
 
 	timerentry=get_containing_timerentry(list);
-	new_value.it_value.tv_sec=timerentry->expire.tv_sec;
-	new_value.it_value.tv_nsec=timerentry->expire.tv_nsec;
+	expire.tv_sec=timerentry->expire.tv_sec;
+	expire.tv_nsec=timerentry->expire.tv_nsec;
 
     } else {
 
-	new_value.it_value.tv_sec=0;
-	new_value.it_value.tv_nsec=0;
+	expire.tv_sec=0;
+	expire.tv_nsec=0;
 
     }
 
-    new_value.it_interval.tv_sec=0;
-    new_value.it_interval.tv_nsec=0;
-
-    /* (re) set the timer
+    /* (re) set the timer (a timerfd or a timeout of the io_uring, depending on the backend)
     note:
     - the expired time is in absolute format (required to compare timerentries with each other )
     - when the timerentry is empty, then this still does what it should do: 
       in that case it disarms the timer */
 
-    if (fd>0) result=timerfd_settime(fd, TFD_TIMER_ABSTIME, &new_value, NULL);
+    if (loop->backend.settimer) result=(* loop->backend.settimer)(loop, &expire);
     if (timerentry) timerentry->status=(result==-1) ? TIMERENTRY_STATUS_INACTIVE : TIMERENTRY_STATUS_ACTIVE;
 
     return result;
@@ -110,21 +105,14 @@ static int set_timer(struct beventloop_s *loop)
 
 static void disable_timer(struct beventloop_s *loop)
 {
-    struct itimerspec value;
-    int fd=0;
+    struct timespec expire;
 
     if ( ! loop) loop=get_mainloop();
 
-    fd=loop->timer_list.fd;
-
-    memset(&value, 0, sizeof(struct itimerspec));
-    value.it_value.tv_sec=0;
-    value.it_value.tv_nsec=0;
+    expire.tv_sec=0;
+    expire.tv_nsec=0;
 
-    value.it_interval.tv_sec=0;
-    value.it_interval.tv_nsec=0;
-
-    if (fd>0) timerfd_settime(fd, TFD_TIMER_ABSTIME, &value, NULL);
+    if (loop->backend.settimer) (* loop->backend.settimer)(loop, &expire);
 
 }
 
@@ -148,9 +136,7 @@ static unsigned char insert_timerentry(struct beventloop_s *loop, struct timeren
 
     if (timerentry) {
 
-	add_list_element_before(&loop->timer_list.header, &new->list, &timerentry->list);
-	/* reset only if the first has been changed */
-	reset=(list_element_is_first(&timerentry->list)==0) ? 1 : 0;
+	add_list_element_before(&loop->timer_list.header, &timerentry->list, &new->list);
 
     } else {
 
@@ -158,6 +144,9 @@ static unsigned char insert_timerentry(struct beventloop_s *loop, struct timeren
 
     }
 
+    /* reset only if the first has been changed */
+
+    reset=(list_element_is_first(&new->list)==0) ? 1 : 0;
     return reset;
 
 }
@@ -244,8 +233,8 @@ static void _run_expired_thread(void *ptr)
 
     if (! list) {
 
+	loop->timer_list.threadid=0;
 	pthread_mutex_unlock(&loop->timer_list.mutex);
-	set_timer(loop);
 	return;
 
     }
@@ -256,8 +245,9 @@ static void _run_expired_thread(void *ptr)
 
     if (timerentry->expire.tv_sec>rightnow.tv_sec || (timerentry->expire.tv_sec==rightnow.tv_sec && timerentry->expire.tv_nsec>rightnow.tv_nsec)) {
 
-	/* timer is in future and since the linked list is ordered we're ready */
+	/* timer is in future and since the linked list is ordered we're ready: arm the timer for it */
 	loop->timer_list.threadid=0;
+	set_timer(loop);
 	pthread_mutex_unlock(&loop->timer_list.mutex);
 	return;
 
@@ -326,6 +316,19 @@ int enable_beventloop_timer(struct beventloop_s *loop, unsigned int *error)
     int fd=0;
 
     if (! loop) loop=get_mainloop();
+
+    if (loop->backend.type==BEVENTLOOP_BACKEND_IOURING) {
+
+	/* timeouts of the io_uring in place of a timerfd: the loop calls run_expired */
+
+	loop->timer_list.run_expired=run_expired;
+	loop->timer_list.fd=0;
+	loop->options|=BEVENTLOOP_OPTION_TIMER;
+	*error=0;
+	return 0;
+
+    }
+
     fd=timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK);
     *error=errno;
     if (fd == -1) goto error;
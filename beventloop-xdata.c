@@ -51,15 +51,23 @@
 extern int lock_beventloop(struct beventloop_s *loop);
 extern int unlock_beventloop(struct beventloop_s *loop);
 
-struct bevent_xdata_s *get_containing_xdata(struct list_element_s *list)
-{
-    return (struct bevent_xdata_s *) ( ((char *) list) - offsetof(struct bevent_xdata_s, list));
-}
+static void add_xdata_name_index(struct xdata_table_s *table, struct bevent_xdata_s *xdata);
+static void remove_xdata_name_index(struct xdata_table_s *table, struct bevent_xdata_s *xdata);
 
 unsigned int set_bevent_name(struct bevent_xdata_s *xdata, char *name, unsigned int *error)
 {
     unsigned int copied=0;
     unsigned int len=strlen(name);
+    struct beventloop_s *loop=(xdata->status & BEVENT_OPTION_ADDED_LIST) ? xdata->loop : NULL;
+
+    if (loop) {
+
+	/* name is part of the name index: remove and add again with new name */
+
+	lock_beventloop(loop);
+	remove_xdata_name_index(&loop->xdata_table, xdata);
+
+    }
 
     memset(&xdata->name, '\0', BEVENT_NAME_LEN);
     if (error) *error=0;
@@ -77,6 +85,13 @@ unsigned int set_bevent_name(struct bevent_xdata_s *xdata, char *name, unsigned
 
     }
 
+    if (loop) {
+
+	add_xdata_name_index(&loop->xdata_table, xdata);
+	unlock_beventloop(loop);
+
+    }
+
     return copied;
 
 }
@@ -105,6 +120,150 @@ int strcmp_bevent(struct bevent_xdata_s *xdata, char *name, unsigned int *error)
 
 }
 
+static unsigned int hash_xdata_name(char *name)
+{
+    unsigned int hash=0;
+
+    while (*name) {
+
+	hash=(hash << 5) + hash + (unsigned char) *name;
+	name++;
+
+    }
+
+    return hash % BEVENT_XDATA_NAME_HASHSIZE;
+
+}
+
+static void add_xdata_name_index(struct xdata_table_s *table, struct bevent_xdata_s *xdata)
+{
+    unsigned int hash=hash_xdata_name(xdata->name);
+
+    xdata->name_next=table->names[hash];
+    table->names[hash]=xdata;
+}
+
+static void remove_xdata_name_index(struct xdata_table_s *table, struct bevent_xdata_s *xdata)
+{
+    unsigned int hash=hash_xdata_name(xdata->name);
+    struct bevent_xdata_s **p=&table->names[hash];
+
+    while (*p) {
+
+	if (*p==xdata) {
+
+	    *p=xdata->name_next;
+	    break;
+
+	}
+
+	p=&(*p)->name_next;
+
+    }
+
+    xdata->name_next=NULL;
+}
+
+void init_xdata_table(struct xdata_table_s *table)
+{
+    memset(table, 0, sizeof(struct xdata_table_s));
+    table->fdindex=NULL;
+    table->size=0;
+    table->dense=NULL;
+    table->count=0;
+    table->max=0;
+}
+
+void free_xdata_table(struct xdata_table_s *table)
+{
+    if (table->fdindex) {
+
+	free(table->fdindex);
+	table->fdindex=NULL;
+
+    }
+
+    if (table->dense) {
+
+	free(table->dense);
+	table->dense=NULL;
+
+    }
+
+    table->size=0;
+    table->count=0;
+    table->max=0;
+    memset(table->names, 0, sizeof(table->names));
+}
+
+/* make room in the fd index for fd, grow to the next power of two */
+
+static int grow_xdata_fdindex(struct xdata_table_s *table, int fd)
+{
+    unsigned int size=(table->size>0) ? table->size : BEVENT_XDATA_TABLE_SIZE;
+    struct bevent_xdata_s **fdindex=NULL;
+
+    while (size <= (unsigned int) fd) size = 2 * size;
+
+    fdindex=realloc(table->fdindex, size * sizeof(struct bevent_xdata_s *));
+    if (fdindex==NULL) return -1;
+
+    memset(&fdindex[table->size], 0, (size - table->size) * sizeof(struct bevent_xdata_s *));
+    table->fdindex=fdindex;
+    table->size=size;
+    return 0;
+}
+
+static int add_xdata_table(struct xdata_table_s *table, struct bevent_xdata_s *xdata)
+{
+
+    if (xdata->fd<0) return -1;
+
+    if ((unsigned int) xdata->fd >= table->size) {
+
+	if (grow_xdata_fdindex(table, xdata->fd)==-1) return -1;
+
+    }
+
+    if (table->count==table->max) {
+	unsigned int max=(table->max>0) ? 2 * table->max : BEVENT_XDATA_TABLE_SIZE;
+	struct bevent_xdata_s **dense=realloc(table->dense, max * sizeof(struct bevent_xdata_s *));
+
+	if (dense==NULL) return -1;
+	table->dense=dense;
+	table->max=max;
+
+    }
+
+    table->fdindex[xdata->fd]=xdata;
+    xdata->pos=table->count;
+    table->dense[table->count]=xdata;
+    table->count++;
+    add_xdata_name_index(table, xdata);
+    return 0;
+
+}
+
+/* remove from the table: the last one in the dense array takes the place of the removed one */
+
+static void remove_xdata_table(struct xdata_table_s *table, struct bevent_xdata_s *xdata)
+{
+    struct bevent_xdata_s *last=NULL;
+
+    if (xdata->pos>=table->count || table->dense[xdata->pos]!=xdata) return;
+
+    if (xdata->fd>=0 && (unsigned int) xdata->fd < table->size && table->fdindex[xdata->fd]==xdata) table->fdindex[xdata->fd]=NULL;
+
+    table->count--;
+    last=table->dense[table->count];
+    table->dense[xdata->pos]=last;
+    last->pos=xdata->pos;
+    table->dense[table->count]=NULL;
+
+    remove_xdata_name_index(table, xdata);
+    xdata->pos=0;
+}
+
 static int xdata_dummy_cb(int fd, void *data, uint32_t events)
 {
     logoutput("xdata_dummy_cb");
@@ -121,15 +280,19 @@ void init_xdata(struct bevent_xdata_s *xdata)
     xdata->data=NULL;
     xdata->status=0;
     xdata->callback=xdata_dummy_cb;
-    init_list_element(&xdata->list, NULL);
+    xdata->events=0;
+    xdata->pos=0;
+    xdata->name_next=NULL;
     xdata->loop=NULL;
+    xdata->tag=0;
+    xdata->read=NULL;
 
     memset(&xdata->name, '\0', BEVENT_NAME_LEN);
     set_bevent_name(xdata, "unknown", &error);
 
 }
 
-static void add_xdata_to_list(struct bevent_xdata_s *xdata)
+static int add_xdata_to_list(struct bevent_xdata_s *xdata)
 {
     struct beventloop_s *loop=xdata->loop;
 
@@ -140,16 +303,14 @@ static void add_xdata_to_list(struct bevent_xdata_s *xdata)
 
     }
 
-    init_list_element(&xdata->list, NULL);
-    add_list_element_last(&loop->xdata_list.header, &xdata->list);
+    if (add_xdata_table(&loop->xdata_table, xdata)==-1) return -1;
     xdata->status |= BEVENT_OPTION_ADDED_LIST;
+    return 0;
 
 }
 
-struct bevent_xdata_s *add_to_beventloop(int fd, uint32_t events, bevent_cb callback, void *data, struct bevent_xdata_s *xdata, struct beventloop_s *loop)
+static struct bevent_xdata_s *_add_to_beventloop(int fd, uint32_t events, bevent_cb callback, bevent_read_cb read, void *data, struct bevent_xdata_s *xdata, struct beventloop_s *loop)
 {
-    struct epoll_event e_event;
-
     logoutput("add_to_beventloop: fd %i", fd);
 
     if ( ! loop) loop=get_mainloop();
@@ -175,30 +336,40 @@ struct bevent_xdata_s *add_to_beventloop(int fd, uint32_t events, bevent_cb call
 
     }
 
-    e_event.events=events;
-    e_event.data.ptr=(void *) xdata;
+    xdata->fd=fd;
+    xdata->loop=loop;
+    xdata->callback=callback;
+    xdata->read=read;
+    xdata->data=data;
+    xdata->events=events;
 
-    if (epoll_ctl(loop->fd, EPOLL_CTL_ADD, fd, &e_event)==-1) {
+    /* add to table first: a backend may find the xdata using the fd */
 
-        if (xdata->status & BEVENT_OPTION_ALLOCATED) free(xdata);
+    if (add_xdata_to_list(xdata)==-1) {
+
+	logoutput("add_to_beventloop: error adding fd %i to table", fd);
+	if (xdata->status & BEVENT_OPTION_ALLOCATED) free(xdata);
 	xdata=NULL;
-	logoutput("add_to_beventloop: error %i adding fd %i (%s)", errno, fd, strerror(errno));
 	goto unlock;
 
+    }
+
+    if ((* loop->backend.add)(loop, xdata, events)==-1) {
+
+	logoutput("add_to_beventloop: error %i adding fd %i (%s)", errno, fd, strerror(errno));
+
+	remove_xdata_table(&loop->xdata_table, xdata);
+	xdata->status-=BEVENT_OPTION_ADDED_LIST;
+	if (xdata->status & BEVENT_OPTION_ALLOCATED) free(xdata);
+	xdata=NULL;
+
     } else {
 
 	logoutput("add_to_beventloop: added fd %i", fd);
-
-	xdata->fd=fd;
-	xdata->loop=loop;
-	xdata->callback=callback;
-	xdata->data=data;
 	xdata->status|=BEVENT_OPTION_ADDED_EVENTLOOP;
 
     }
 
-    add_xdata_to_list(xdata);
-
     unlock:
 
     unlock_beventloop(loop);
@@ -206,6 +377,23 @@ struct bevent_xdata_s *add_to_beventloop(int fd, uint32_t events, bevent_cb call
 
 }
 
+struct bevent_xdata_s *add_to_beventloop(int fd, uint32_t events, bevent_cb callback, void *data, struct bevent_xdata_s *xdata, struct beventloop_s *loop)
+{
+    return _add_to_beventloop(fd, events, callback, NULL, data, xdata, loop);
+}
+
+/*
+    add an fd whose data is read by the loop and given to the read callback
+    with io_uring the read is done by the kernel into a buffer provided by the loop, with epoll the loop
+    reads when the fd is readable
+    the callback should remove the xdata at end of file or an error
+*/
+
+struct bevent_xdata_s *add_to_beventloop_read(int fd, bevent_read_cb read, void *data, struct bevent_xdata_s *xdata, struct beventloop_s *loop)
+{
+    return _add_to_beventloop(fd, EPOLLIN, xdata_dummy_cb, read, data, xdata, loop);
+}
+
 void remove_xdata_from_beventloop(struct bevent_xdata_s *xdata)
 {
     struct beventloop_s *loop=NULL;
@@ -218,14 +406,14 @@ void remove_xdata_from_beventloop(struct bevent_xdata_s *xdata)
 
     if (xdata->status & BEVENT_OPTION_ADDED_EVENTLOOP) {
 
-	if (loop->fd>0) epoll_ctl(loop->fd, EPOLL_CTL_DEL, xdata->fd, NULL);
+	if (loop->fd>0) (* loop->backend.remove)(loop, xdata);
 	xdata->status-=BEVENT_OPTION_ADDED_EVENTLOOP;
 
     }
 
     if (xdata->status & BEVENT_OPTION_ADDED_LIST) {
 
-	remove_list_element(&xdata->list);
+	remove_xdata_table(&loop->xdata_table, xdata);
 	xdata->status-=BEVENT_OPTION_ADDED_LIST;
 
     }
@@ -235,19 +423,75 @@ void remove_xdata_from_beventloop(struct bevent_xdata_s *xdata)
 
 struct bevent_xdata_s *get_next_xdata(struct beventloop_s *loop, struct bevent_xdata_s *xdata)
 {
-    struct list_element_s *list=NULL;
+    struct xdata_table_s *table=NULL;
+    unsigned int pos=0;
 
     if (xdata) {
 
-	list=xdata->list.n;
+	loop=xdata->loop;
+	if (! loop || ! (xdata->status & BEVENT_OPTION_ADDED_LIST)) return NULL;
+	pos=xdata->pos + 1;
 
     } else {
 
 	if ( ! loop) loop=get_mainloop();
-	list=loop->xdata_list.header.head;
 
     }
 
-    return (list) ? get_containing_xdata(list) : NULL;
+    table=&loop->xdata_table;
+    return (pos < table->count) ? table->dense[pos] : NULL;
+
+}
+
+/* xdata is the only one in its loop, and that's not the mainloop: nothing else is served by the thread of the loop */
+
+unsigned char xdata_has_loop_alone(struct bevent_xdata_s *xdata)
+{
+    struct beventloop_s *loop=xdata->loop;
+
+    if ( ! loop || loop==get_mainloop() || ! (xdata->status & BEVENT_OPTION_ADDED_LIST)) return 0;
+    return (__atomic_load_n(&loop->xdata_table.count, __ATOMIC_RELAXED)==1) ? 1 : 0;
+}
+
+/* lookup by fd */
+
+struct bevent_xdata_s *lookup_xdata_fd(struct beventloop_s *loop, int fd)
+{
+    struct xdata_table_s *table=NULL;
+    struct bevent_xdata_s *xdata=NULL;
+
+    if ( ! loop) loop=get_mainloop();
+    table=&loop->xdata_table;
+
+    lock_beventloop(loop);
+    if (fd>=0 && (unsigned int) fd < table->size) xdata=table->fdindex[fd];
+    unlock_beventloop(loop);
+
+    return xdata;
+
+}
+
+/* lookup by name, returns the first one found with this name */
+
+struct bevent_xdata_s *lookup_xdata_name(struct beventloop_s *loop, char *name)
+{
+    struct bevent_xdata_s *xdata=NULL;
+    unsigned int error=0;
+
+    if ( ! loop) loop=get_mainloop();
+
+    lock_beventloop(loop);
+
+    xdata=loop->xdata_table.names[hash_xdata_name(name)];
+
+    while (xdata) {
+
+	if (strcmp_bevent(xdata, name, &error)==0) break;
+	xdata=xdata->name_next;
+
+    }
+
+    unlock_beventloop(loop);
+    return xdata;
 
 }
@@ -22,14 +22,21 @@
 
 /* Prototypes */
 
-struct bevent_xdata_s *get_containing_xdata(struct list_element_s *list);
+void init_xdata_table(struct xdata_table_s *table);
+void free_xdata_table(struct xdata_table_s *table);
 
 void init_xdata(struct bevent_xdata_s *xdata);
 struct bevent_xdata_s *get_next_xdata(struct beventloop_s *loop, struct bevent_xdata_s *xdata);
 
 struct bevent_xdata_s *add_to_beventloop(int fd, uint32_t events, bevent_cb callback, void *data, struct bevent_xdata_s *xdata, struct beventloop_s *loop);
+struct bevent_xdata_s *add_to_beventloop_read(int fd, bevent_read_cb read, void *data, struct bevent_xdata_s *xdata, struct beventloop_s *loop);
 void remove_xdata_from_beventloop(struct bevent_xdata_s *bevent_xdata);
 
+unsigned char xdata_has_loop_alone(struct bevent_xdata_s *xdata);
+
+struct bevent_xdata_s *lookup_xdata_fd(struct beventloop_s *loop, int fd);
+struct bevent_xdata_s *lookup_xdata_name(struct beventloop_s *loop, char *name);
+
 unsigned int set_bevent_name(struct bevent_xdata_s *xdata, char *name, unsigned int *error);
 char *get_bevent_name(struct bevent_xdata_s *xdata);
 int strcmp_bevent(struct bevent_xdata_s *xdata, char *name, unsigned int *error);
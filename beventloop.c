@@ -49,13 +49,13 @@
 #include "beventloop-xdata.h"
 #include "beventloop-timer.h"
 #include "beventloop-signal.h"
+#include "beventloop-iouring.h"
 #include "utils.h"
 #include "logging.h"
 
 static struct beventloop_s beventloop_main;
 static pthread_mutex_t global_mutex=PTHREAD_MUTEX_INITIALIZER;
 static unsigned char init=0;
-static char *name="beventloop";
 
 int lock_beventloop(struct beventloop_s *loop)
 {
@@ -76,6 +76,105 @@ static void _run_expired_dummy(struct beventloop_s *loop)
 {
 }
 
+/* epoll backend */
+
+static int _epoll_add(struct beventloop_s *loop, struct bevent_xdata_s *xdata, uint32_t events)
+{
+    struct epoll_event e_event;
+
+    e_event.events=events;
+    e_event.data.ptr=(void *) xdata;
+
+    return epoll_ctl(loop->fd, EPOLL_CTL_ADD, xdata->fd, &e_event);
+}
+
+static void _epoll_remove(struct beventloop_s *loop, struct bevent_xdata_s *xdata)
+{
+    if (xdata->fd>0) epoll_ctl(loop->fd, EPOLL_CTL_DEL, xdata->fd, NULL);
+}
+
+static int _epoll_wait(struct beventloop_s *loop, struct bevent_s *bevents, unsigned int max, int timeout)
+{
+    struct epoll_event epoll_events[MAX_EPOLL_NREVENTS];
+    int count=0;
+
+    if (max>MAX_EPOLL_NREVENTS) max=MAX_EPOLL_NREVENTS;
+    count=epoll_wait(loop->fd, epoll_events, max, timeout);
+
+    for (int i=0; i<count; i++) {
+
+	bevents[i].xdata=(struct bevent_xdata_s *) epoll_events[i].data.ptr;
+	bevents[i].fd=bevents[i].xdata->fd;
+	bevents[i].events=epoll_events[i].events;
+	bevents[i].tag=0;
+	bevents[i].read=0;
+	bevents[i].size=0;
+	bevents[i].buffer=NULL;
+	bevents[i].id=0;
+
+    }
+
+    return count;
+}
+
+static void _epoll_rearm(struct beventloop_s *loop, struct bevent_s *bevent)
+{
+    /* epoll keeps watching: nothing to do */
+}
+
+/* the timer is a timerfd watched like any other fd (see beventloop-timer.c) */
+
+static int _epoll_settimer(struct beventloop_s *loop, struct timespec *expire)
+{
+    struct itimerspec value;
+
+    if (loop->timer_list.fd<=0) return -1;
+
+    value.it_value.tv_sec=expire->tv_sec;
+    value.it_value.tv_nsec=expire->tv_nsec;
+    value.it_interval.tv_sec=0;
+    value.it_interval.tv_nsec=0;
+
+    return timerfd_settime(loop->timer_list.fd, TFD_TIMER_ABSTIME, &value, NULL);
+}
+
+static void _epoll_close(struct beventloop_s *loop)
+{
+
+    if (loop->fd>0) {
+
+	close(loop->fd);
+	loop->fd=0;
+
+    }
+
+}
+
+static int init_beventloop_epoll(struct beventloop_s *loop, unsigned int *error)
+{
+
+    loop->fd=epoll_create(MAX_EPOLL_NRFDS);
+
+    if (loop->fd==-1) {
+
+	logoutput_warning("init_beventloop_epoll: error %i creating epoll instance (%s)", errno, strerror(errno));
+	*error=errno;
+	return -1;
+
+    }
+
+    loop->backend.type=BEVENTLOOP_BACKEND_EPOLL;
+    loop->backend.add=_epoll_add;
+    loop->backend.remove=_epoll_remove;
+    loop->backend.wait=_epoll_wait;
+    loop->backend.rearm=_epoll_rearm;
+    loop->backend.settimer=_epoll_settimer;
+    loop->backend.close=_epoll_close;
+    loop->backend.data=NULL;
+    return 0;
+
+}
+
 static void clear_eventloop(struct beventloop_s *loop)
 {
     struct timer_list_s *timers=&loop->timer_list;
@@ -83,10 +182,12 @@ static void clear_eventloop(struct beventloop_s *loop)
     memset(loop, 0, sizeof(struct beventloop_s));
     loop->status=0;
     loop->options=0;
-    init_list_header(&loop->xdata_list.header, SIMPLE_LIST_TYPE_EMPTY, NULL);
+    init_xdata_table(&loop->xdata_table);
     loop->cb_signal=signal_cb_dummy;
     loop->fd=0;
 
+    memset(&loop->busypoll, 0, sizeof(struct beventloop_busypoll_s));
+
     init_list_header(&timers->header, SIMPLE_LIST_TYPE_EMPTY, NULL);
     timers->fd=0;
     timers->run_expired=_run_expired_dummy;
@@ -94,8 +195,9 @@ static void clear_eventloop(struct beventloop_s *loop)
     timers->threadid=0;
 }
 
-int init_beventloop(struct beventloop_s *loop, unsigned int *error)
+int init_beventloop_backend(struct beventloop_s *loop, unsigned char type, unsigned int *error)
 {
+    int result=-1;
 
     if (! loop) loop=&beventloop_main;
 
@@ -110,21 +212,28 @@ int init_beventloop(struct beventloop_s *loop, unsigned int *error)
 
     pthread_mutex_unlock(&global_mutex);
 
-    /* create an epoll instance */
+    /* create the backend: an epoll instance or an io_uring */
 
-    loop->fd=epoll_create(MAX_EPOLL_NRFDS);
+    if (type==BEVENTLOOP_BACKEND_IOURING) {
 
-    if (loop->fd==-1) {
+	result=init_beventloop_iouring(loop, error);
 
-	logoutput_warning("init_beventloop: error %i creating epoll instance (%s)", errno, strerror(errno));
-	*error=errno;
+    } else {
+
+	result=init_beventloop_epoll(loop, error);
+
+    }
+
+    if (result==-1) {
+
+	logoutput_warning("init_beventloop_backend: error %i creating backend %i (%s)", *error, type, strerror(*error));
 	goto error;
 
     }
 
     loop->status=BEVENTLOOP_STATUS_SETUP;
-    init_list_header(&loop->xdata_list.header, SIMPLE_LIST_TYPE_EMPTY, NULL);
-    loop->xdata_list.header.name=name;
+    init_xdata_table(&loop->xdata_table);
+    memset(&loop->busypoll, 0, sizeof(struct beventloop_busypoll_s));
     init_list_header(&loop->timer_list.header, SIMPLE_LIST_TYPE_EMPTY, NULL);
     return 0;
 
@@ -147,9 +256,89 @@ int init_beventloop(struct beventloop_s *loop, unsigned int *error)
 
 }
 
+int init_beventloop(struct beventloop_s *loop, unsigned int *error)
+{
+    return init_beventloop_backend(loop, BEVENTLOOP_BACKEND_EPOLL, error);
+}
+
+static uint64_t get_nsec_elapsed(struct timespec *start, struct timespec *end)
+{
+    return (uint64_t) (end->tv_sec - start->tv_sec) * 1000000000 + end->tv_nsec - start->tv_nsec;
+}
+
+/* spin on a non blocking wait for at most window usec
+    returns the number of events found, 0 when window has passed without events */
+
+static int busypoll_beventloop(struct beventloop_s *loop, struct bevent_s *bevents)
+{
+    struct beventloop_busypoll_s *busypoll=&loop->busypoll;
+    uint64_t window=(uint64_t) busypoll->window * 1000;
+    struct timespec start;
+    struct timespec now;
+    uint64_t elapsed=0;
+    int count=0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while (loop->status==BEVENTLOOP_STATUS_UP) {
+
+	count=(* loop->backend.wait)(loop, bevents, MAX_EPOLL_NREVENTS, 0);
+	busypoll->polls++;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed=get_nsec_elapsed(&start, &now);
+
+	if (count!=0) {
+
+	    if (count>0) busypoll->hits++;
+	    break;
+
+	} else if (elapsed >= window) {
+
+	    busypoll->idletime+=elapsed;
+	    break;
+
+	}
+
+    }
+
+    busypoll->spintime+=elapsed;
+    return count;
+
+}
+
+/* an xdata with a read callback: the data is read by the backend already (io_uring), or is read here */
+
+static void read_bevent(struct beventloop_s *loop, struct bevent_s *bevent)
+{
+    struct bevent_xdata_s *xdata=bevent->xdata;
+
+    if (bevent->read) {
+
+	/* no buffer available or interrupted: the backend reads again at rearm */
+
+	if (bevent->size==-ENOBUFS || bevent->size==-EAGAIN || bevent->size==-EINTR) return;
+	(* xdata->read)(xdata->fd, xdata->data, bevent->buffer, bevent->size);
+
+    } else {
+	char buffer[BEVENTLOOP_READ_SIZE];
+	int size=read(xdata->fd, buffer, BEVENTLOOP_READ_SIZE);
+
+	if (size==-1) {
+
+	    if (errno==EAGAIN || errno==EWOULDBLOCK || errno==EINTR) return;
+	    size=-errno;
+
+	}
+
+	(* xdata->read)(xdata->fd, xdata->data, (size>0) ? buffer : NULL, size);
+
+    }
+
+}
+
 int start_beventloop(struct beventloop_s *loop)
 {
-    struct epoll_event epoll_events[MAX_EPOLL_NREVENTS];
+    struct bevent_s bevents[MAX_EPOLL_NREVENTS];
     int count=0;
     struct bevent_xdata_s *xdata;
     int result=0;
@@ -159,7 +348,25 @@ int start_beventloop(struct beventloop_s *loop)
 
     while (loop->status==BEVENTLOOP_STATUS_UP) {
 
-        count=epoll_wait(loop->fd, epoll_events, MAX_EPOLL_NREVENTS, -1);
+	count=0;
+
+	if (loop->options & BEVENTLOOP_OPTION_BUSYPOLL) {
+
+	    count=busypoll_beventloop(loop, bevents);
+
+	    if (count==0 && loop->status==BEVENTLOOP_STATUS_UP) {
+
+		loop->busypoll.sleeps++;
+		count=(* loop->backend.wait)(loop, bevents, MAX_EPOLL_NREVENTS, -1);
+		if (count>0) loop->busypoll.wakeups++;
+
+	    }
+
+	} else {
+
+	    count=(* loop->backend.wait)(loop, bevents, MAX_EPOLL_NREVENTS, -1);
+
+	}
 
         if (count<0) {
 
@@ -170,22 +377,27 @@ int start_beventloop(struct beventloop_s *loop)
 
         for (unsigned int i=0; i<count; i++) {
 
-            xdata=(struct bevent_xdata_s *) epoll_events[i].data.ptr;
-	    result=(*xdata->callback) (xdata->fd, xdata->data, epoll_events[i].events);
+            xdata=bevents[i].xdata;
 
-        }
+	    if (xdata->read) {
 
-    }
+		read_bevent(loop, &bevents[i]);
 
-    loop->status=BEVENTLOOP_STATUS_DOWN;
+	    } else {
 
-    if (loop->fd>0) {
+		result=(*xdata->callback) (xdata->fd, xdata->data, bevents[i].events);
 
-	close(loop->fd);
-	loop->fd=0;
+	    }
+
+	    (* loop->backend.rearm)(loop, &bevents[i]);
+
+        }
 
     }
 
+    loop->status=BEVENTLOOP_STATUS_DOWN;
+    if (loop->fd>0) (* loop->backend.close)(loop);
+
     out:
 
     return 0;
@@ -200,33 +412,31 @@ void stop_beventloop(struct beventloop_s *loop)
 
 void clear_beventloop(struct beventloop_s *loop)
 {
+    struct xdata_table_s *table=NULL;
     struct list_element_s *list=NULL;
     int res;
 
     if (! loop) loop=&beventloop_main;
+    table=&loop->xdata_table;
 
     lock_beventloop(loop);
 
-    getxdata:
-
-    list=get_list_head(&loop->xdata_list.header, SIMPLE_LIST_FLAG_REMOVE);
+    /* walk the table from the end, no need to move other xdata's around */
 
-    if (list) {
-	struct bevent_xdata_s *xdata=get_containing_xdata(list);
+    while (table->count>0) {
+	struct bevent_xdata_s *xdata=table->dense[table->count - 1];
 
 	if (xdata->status & BEVENT_OPTION_ADDED_EVENTLOOP) {
 
-	    if (loop->fd>0 && xdata->fd>0) epoll_ctl(loop->fd, EPOLL_CTL_DEL, xdata->fd, NULL);
+	    if (loop->fd>0) (* loop->backend.remove)(loop, xdata);
 	    xdata->status-=BEVENT_OPTION_ADDED_EVENTLOOP;
 
 	}
 
-	if (xdata->status & BEVENT_OPTION_ADDED_LIST) {
-
-	    remove_list_element(&xdata->list);
-	    xdata->status-=BEVENT_OPTION_ADDED_LIST;
-
-	}
+	if (xdata->fd>=0 && (unsigned int) xdata->fd < table->size) table->fdindex[xdata->fd]=NULL;
+	table->dense[table->count - 1]=NULL;
+	table->count--;
+	xdata->status &= ~BEVENT_OPTION_ADDED_LIST;
 
 	if (xdata->status & BEVENT_OPTION_ALLOCATED) {
 
@@ -235,16 +445,11 @@ void clear_beventloop(struct beventloop_s *loop)
 
 	}
 
-	goto getxdata;
-
     }
 
-    if (loop->fd>0) {
+    free_xdata_table(table);
 
-	close(loop->fd);
-	loop->fd=0;
-
-    }
+    if (loop->fd>0) (* loop->backend.close)(loop);
 
     /* free any timer still in queue */
 
@@ -273,3 +478,51 @@ struct beventloop_s *get_mainloop()
 {
     return &beventloop_main;
 }
+
+/* enable busy polling with a window of usec, a window of zero disables it
+    only usefull for a loop running in a dedicated thread: it keeps a cpu busy */
+
+void set_beventloop_busypoll(struct beventloop_s *loop, unsigned int window)
+{
+    if (! loop) loop=&beventloop_main;
+
+    lock_beventloop(loop);
+
+    loop->busypoll.window=window;
+
+    if (window>0) {
+
+	loop->options |= BEVENTLOOP_OPTION_BUSYPOLL;
+
+    } else {
+
+	loop->options &= ~BEVENTLOOP_OPTION_BUSYPOLL;
+
+    }
+
+    unlock_beventloop(loop);
+}
+
+unsigned char beventloop_is_busypoll(struct beventloop_s *loop)
+{
+    if (! loop) loop=&beventloop_main;
+    return (loop->options & BEVENTLOOP_OPTION_BUSYPOLL) ? 1 : 0;
+}
+
+void get_beventloop_busypoll_stats(struct beventloop_s *loop, struct beventloop_busypoll_s *stats)
+{
+    if (! loop) loop=&beventloop_main;
+    memcpy(stats, &loop->busypoll, sizeof(struct beventloop_busypoll_s));
+}
+
+void log_beventloop_busypoll_stats(struct beventloop_s *loop)
+{
+    struct beventloop_busypoll_s stats;
+    uint64_t usefull=0;
+
+    get_beventloop_busypoll_stats(loop, &stats);
+    usefull=(stats.spintime > stats.idletime) ? stats.spintime - stats.idletime : 0;
+
+    logoutput("log_beventloop_busypoll_stats: window %u usec polls %lu hits %lu sleeps %lu wakeups %lu", stats.window, (unsigned long) stats.polls, (unsigned long) stats.hits, (unsigned long) stats.sleeps, (unsigned long) stats.wakeups);
+    logoutput("log_beventloop_busypoll_stats: spin %lu usec (idle %lu usec, with result %lu usec)", (unsigned long) (stats.spintime / 1000), (unsigned long) (stats.idletime / 1000), (unsigned long) (usefull / 1000));
+}
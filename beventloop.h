@@ -39,6 +39,10 @@
 
 #define BEVENTLOOP_OPTION_TIMER			1
 #define BEVENTLOOP_OPTION_SIGNAL		2
+#define BEVENTLOOP_OPTION_BUSYPOLL		4
+
+#define BEVENTLOOP_BACKEND_EPOLL		1
+#define BEVENTLOOP_BACKEND_IOURING		2
 
 #define TIMERENTRY_STATUS_NOTSET		0
 #define TIMERENTRY_STATUS_ACTIVE		1
@@ -50,11 +54,21 @@
 #define BEVENT_OPTION_ADDED_LIST		4
 #define BEVENT_OPTION_TIMER			8
 #define BEVENT_OPTION_SIGNAL			16
+#define BEVENT_OPTION_ARMED			32
 
 #define BEVENT_NAME_LEN				32
 
+#define BEVENT_XDATA_TABLE_SIZE			64
+#define BEVENT_XDATA_NAME_HASHSIZE		64
+
 typedef int (*bevent_cb)(int fd, void *data, uint32_t events);
 
+/* callback with data read by the loop: size is the number of bytes, 0 at end of file, or -errno */
+
+typedef void (*bevent_read_cb)(int fd, void *data, char *buffer, int size);
+
+#define BEVENTLOOP_READ_SIZE			16384
+
 #define TIMERID_TYPE_PTR			1
 #define TIMERID_TYPE_UNIQUE			2
 
@@ -94,13 +108,73 @@ struct bevent_xdata_s {
     void 					*data;
     unsigned char 				status;
     bevent_cb 					callback;
+    uint32_t					events;
     char 					name[BEVENT_NAME_LEN];
-    struct list_element_s			list;
+    unsigned int				pos;
+    struct bevent_xdata_s			*name_next;
     struct beventloop_s 			*loop;
+    uint32_t					tag;
+    bevent_read_cb				read;
 };
 
-struct xdata_list_s {
-    struct list_header_s			header;
+/* table of xdata's added to the eventloop:
+    - fdindex: lookup by fd, array is indexed by fd
+    - dense: all xdata's packed together, to walk through them
+    - names: small hash of names */
+
+struct xdata_table_s {
+    struct bevent_xdata_s			**fdindex;
+    unsigned int				size;
+    struct bevent_xdata_s			**dense;
+    unsigned int				count;
+    unsigned int				max;
+    struct bevent_xdata_s			*names[BEVENT_XDATA_NAME_HASHSIZE];
+};
+
+/* event as reported by the backend
+    for an xdata with a read callback the backend may have done the read already (read is set): size and
+    buffer are the result, id is the buffer for the backend to take back at rearm */
+
+struct bevent_s {
+    struct bevent_xdata_s			*xdata;
+    int						fd;
+    uint32_t					events;
+    uint32_t					tag;
+    unsigned char				read;
+    int						size;
+    char					*buffer;
+    unsigned int				id;
+};
+
+/* backend doing the actual waiting for events: epoll or io_uring
+    - add/remove: start/stop watching fd of xdata
+    - wait: wait at most timeout msec (-1 is forever) and fill bevents
+    - rearm: called after the callback, for backends which watch an fd only once (io_uring poll)
+	note the callback may have removed and freed the xdata, so do not use bevent->xdata before checking
+    - settimer: (re)set the timer of the loop to an absolute time (CLOCK_REALTIME), zero disarms it */
+
+struct beventloop_backend_s {
+    unsigned char				type;
+    int						(* add)(struct beventloop_s *loop, struct bevent_xdata_s *xdata, uint32_t events);
+    void					(* remove)(struct beventloop_s *loop, struct bevent_xdata_s *xdata);
+    int						(* wait)(struct beventloop_s *loop, struct bevent_s *bevents, unsigned int max, int timeout);
+    void					(* rearm)(struct beventloop_s *loop, struct bevent_s *bevent);
+    int						(* settimer)(struct beventloop_s *loop, struct timespec *expire);
+    void					(* close)(struct beventloop_s *loop);
+    void					*data;
+};
+
+/* busy poll: spin with a non blocking wait for window usec before sleeping
+    counters to compare cpu time spend spinning against events found */
+
+struct beventloop_busypoll_s {
+    unsigned int				window;
+    uint64_t					polls;
+    uint64_t					hits;
+    uint64_t					sleeps;
+    uint64_t					wakeups;
+    uint64_t					spintime;
+    uint64_t					idletime;
 };
 
 /* eventloop */
@@ -108,19 +182,27 @@ struct xdata_list_s {
 struct beventloop_s {
     unsigned char 				status;
     unsigned int				options;
-    struct xdata_list_s				xdata_list;
+    struct xdata_table_s			xdata_table;
     void 					(*cb_signal) (struct beventloop_s *loop, void *data, struct signalfd_siginfo *fdsi);
     int 					fd;
+    struct beventloop_backend_s			backend;
     struct timer_list_s				timer_list;
+    struct beventloop_busypoll_s		busypoll;
 };
 
 /* Prototypes */
 
 int init_beventloop(struct beventloop_s *b, unsigned int *error);
+int init_beventloop_backend(struct beventloop_s *b, unsigned char type, unsigned int *error);
 int start_beventloop(struct beventloop_s *b);
 void stop_beventloop(struct beventloop_s *b);
 void clear_beventloop(struct beventloop_s *b);
 
 struct beventloop_s *get_mainloop();
 
+void set_beventloop_busypoll(struct beventloop_s *loop, unsigned int window);
+unsigned char beventloop_is_busypoll(struct beventloop_s *loop);
+void get_beventloop_busypoll_stats(struct beventloop_s *loop, struct beventloop_busypoll_s *stats);
+void log_beventloop_busypoll_stats(struct beventloop_s *loop);
+
 #endif
@@ -0,0 +1,87 @@
+/*
+  2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017 Stef Bon <stefbon@gmail.com>
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include "global-defines.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "epoch.h"
+
+static unsigned int stripe_ctr=0;
+static __thread int thread_stripe=-1;
+
+/* number of the thread to choose a stripe with (modulo the number of stripes), every thread gets the next one */
+
+unsigned int get_thread_stripe()
+{
+    if (thread_stripe==-1) thread_stripe=(int) (__atomic_fetch_add(&stripe_ctr, 1, __ATOMIC_RELAXED) & 0x7FFFFFFF);
+    return (unsigned int) thread_stripe;
+}
+
+void init_epoch(struct epoch_s *epoch)
+{
+    memset(epoch, 0, sizeof(struct epoch_s));
+}
+
+/* readers announce themselves in the stripe of the thread, in the counter of the current epoch */
+
+unsigned int *enter_epoch(struct epoch_s *epoch)
+{
+    struct epoch_stripe_s *stripe=&epoch->stripes[get_thread_stripe() % EPOCH_STRIPES];
+    unsigned int *readers=&stripe->readers[__atomic_load_n(&epoch->epoch, __ATOMIC_SEQ_CST) & 1];
+
+    __atomic_add_fetch(readers, 1, __ATOMIC_SEQ_CST);
+    return readers;
+}
+
+void leave_epoch(unsigned int *readers)
+{
+    __atomic_sub_fetch(readers, 1, __ATOMIC_RELEASE);
+}
+
+static unsigned int count_epoch_readers(struct epoch_s *epoch, unsigned int parity)
+{
+    unsigned int readers=0;
+
+    for (unsigned int i=0; i<EPOCH_STRIPES; i++) readers+=__atomic_load_n(&epoch->stripes[i].readers[parity], __ATOMIC_ACQUIRE);
+    return readers;
+}
+
+/* wait for a grace period: every reader active at the moment of calling has left */
+
+void wait_epoch_grace(struct epoch_s *epoch)
+{
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    for (unsigned char round=0; round<2; round++) {
+	unsigned int parity=__atomic_fetch_add(&epoch->epoch, 1, __ATOMIC_SEQ_CST) & 1;
+
+	while (count_epoch_readers(epoch, parity)>0) sched_yield();
+
+    }
+
+}
@@ -0,0 +1,52 @@
+/*
+  2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017 Stef Bon <stefbon@gmail.com>
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#ifndef SB_COMMON_UTILS_EPOCH_H
+#define SB_COMMON_UTILS_EPOCH_H
+
+#define EPOCH_STRIPES					16
+
+/*
+    epochs for readers which do not take any lock (lockfree skiplist, inode hashtable)
+
+    a reader announces itself in the counter of the current epoch, in the stripe of the thread (every stripe
+    on its own cacheline), and leaves it when done
+    a writer which has unlinked something waits for a grace period before freeing it: the epoch is flipped and
+    the readers of the old epoch drain, twice, since a reader may have read the epoch just before the first flip
+*/
+
+struct epoch_stripe_s {
+    unsigned int				readers[2];
+} __attribute__((aligned(64)));
+
+struct epoch_s {
+    struct epoch_stripe_s			stripes[EPOCH_STRIPES];
+    unsigned int				epoch;
+};
+
+/* prototypes */
+
+unsigned int get_thread_stripe();
+
+void init_epoch(struct epoch_s *epoch);
+unsigned int *enter_epoch(struct epoch_s *epoch);
+void leave_epoch(unsigned int *readers);
+void wait_epoch_grace(struct epoch_s *epoch);
+
+#endif
@@ -47,6 +47,8 @@
 #include "beventloop.h"
 
 #include "fuse-dentry.h"
+#include "fuse-directory.h"
+#include "fuse-utils.h"
 
 #include "options.h"
 #include "utils.h"
@@ -100,15 +102,36 @@ struct watchbackend_struct fssync_watchbackend = {0, NULL, NULL, NULL};
     function to synchronize the cache with the backend
     full sync
     typically called when not synced before
+
+    the directory is read completely first, the entries are sorted and inserted in one pass
+    (insert_sorted_entries_batch), which is a lot cheaper than a search for every entry in large directories
 */
 
+struct fssync_direntry_s {
+    struct entry_s				*entry;
+    struct inode_s				*inode;
+    struct stat					st;
+};
+
+static int compare_fssync_direntry(const void *a, const void *b)
+{
+    struct fssync_direntry_s *x=(struct fssync_direntry_s *) a;
+    struct fssync_direntry_s *y=(struct fssync_direntry_s *) b;
+    return compare_entry_name(x->entry, &y->entry->name);
+}
+
 static void synchronize_directory_full(struct workspace_object_struct *object, struct entry_s *parent, struct directory_s *directory, unsigned int fd, struct readdir_struct *readdir, struct timespec *synctime, unsigned int len, struct fssynccb_struct *fssynccb, uint32_t fssync_mask, unsigned int *error)
 {
-    struct name_s xname={NULL, 0, 0};
+    struct name_s xname={NULL, 0, 0, 0};
     unsigned char dtype=0;
     int res;
     struct stat st;
-    struct entry_s *entry=NULL, *result=NULL;
+    struct fssync_direntry_s *direntries=NULL;
+    struct entry_s **entries=NULL;
+    struct entry_s **result=NULL;
+    unsigned int count=0, size=0;
+    unsigned int error_insert=0;
+    struct entry_s *entry=NULL;
     struct inode_s *inode;
 
     while(1) {
@@ -124,103 +147,148 @@ static void synchronize_directory_full(struct workspace_object_struct *object, s
 
 	if (fstatat(fd, xname.name, &st, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT)==-1) continue;
 
+	if (count==size) {
+	    struct fssync_direntry_s *tmp=realloc(direntries, (size + 256) * sizeof(struct fssync_direntry_s));
+
+	    if (tmp==NULL) {
+
+		*error=ENOMEM;
+		break;
+
+	    }
+
+	    direntries=tmp;
+	    size+=256;
+
+	}
+
 	xname.len=strlen(xname.name);
 	calculate_nameindex(&xname);
 
 	entry=create_entry(parent, &xname);
-	inode=create_inode(0);
+	inode=create_inode_slabs(get_entry_slabs(entry), 0);
 
-	*error=0;
+	if (entry==NULL || inode==NULL) {
 
-	if (entry && inode) {
+	    if (entry) destroy_entry(entry);
+	    if (inode) free_inode(inode);
+
+	    *error=ENOMEM;
+	    break;
 
-	    result=insert_entry_batch(directory, entry, error, 0);
+	}
 
-	    if (result==entry) {
+	direntries[count].entry=entry;
+	direntries[count].inode=inode;
+	memcpy(&direntries[count].st, &st, sizeof(struct stat));
+	count++;
 
-		/* new entry */
+    }
 
-		memcpy(&entry->synctime, synctime, sizeof(struct timespec));
+    if (count==0) {
 
-		entry->inode=inode;
-		inode->alias=entry;
+	if (direntries) free(direntries);
+	goto out;
 
-		add_inode_hashtable(inode, increase_inodes_workspace, (void *) object->workspace_mount);
+    }
 
-		adjust_pathmax(object->workspace_mount, len + 1 + xname.len);
+    entries=malloc(count * sizeof(struct entry_s *));
+    result=malloc(count * sizeof(struct entry_s *));
 
-		inode->nlookup=1;
-		inode->mode=st.st_mode;
-		inode->nlink=st.st_nlink;
-		inode->uid=st.st_uid;
-		inode->gid=st.st_gid;
+    if (entries==NULL || result==NULL) {
 
-		inode->rdev = st.st_rdev;
+	*error=ENOMEM;
+	goto error;
 
-		inode->mtim.tv_sec = st.st_mtim.tv_sec;
-		inode->mtim.tv_nsec = st.st_mtim.tv_nsec;
-		inode->ctim.tv_sec = st.st_ctim.tv_sec;
-		inode->ctim.tv_nsec = st.st_ctim.tv_nsec;
+    }
 
-		if (! S_ISDIR(st.st_mode)) inode->size=st.st_size;
+    qsort(direntries, count, sizeof(struct fssync_direntry_s), compare_fssync_direntry);
+    for (unsigned int i=0; i<count; i++) entries[i]=direntries[i].entry;
 
-		(* fssynccb->create)(object, entry, fssync_mask);
+    /* also when reading stopped with an error: add what has been read */
 
-	    } else {
+    if (insert_sorted_entries_batch(directory, entries, result, count, &error_insert)<count && error_insert>0) *error=error_insert;
 
-		/* result != entry */
+    for (unsigned int i=0; i<count; i++) {
 
-		if (*error==EEXIST) {
-		    uint32_t event_mask=0;
+	entry=direntries[i].entry;
+	inode=direntries[i].inode;
 
-		    free(entry);
-		    entry=result;
+	if (result[i]==entry) {
 
-		    free(inode);
-		    inode=entry->inode;
+	    /* new entry */
 
-		    event_mask=determine_fsnotify_mask(inode, &st);
-		    memcpy(&entry->synctime, synctime, sizeof(struct timespec));
+	    memcpy(&entry->synctime, synctime, sizeof(struct timespec));
 
-		    (* fssynccb->change)(object, entry, event_mask, fssync_mask);
+	    entry->inode=inode;
+	    inode->alias=entry;
 
-		} else {
+	    add_inode_hashtable(inode, increase_inodes_workspace, (void *) object->workspace_mount);
 
-		    destroy_entry(entry);
-		    entry=NULL;
+	    adjust_pathmax(object->workspace_mount, len + 1 + entry->name.len);
 
-		    free(inode);
-		    inode=NULL;
+	    inode->nlookup=1;
+	    inode->mode=direntries[i].st.st_mode;
+	    inode->nlink=direntries[i].st.st_nlink;
+	    inode->uid=direntries[i].st.st_uid;
+	    inode->gid=direntries[i].st.st_gid;
 
-		    break;
+	    inode->rdev = direntries[i].st.st_rdev;
 
-		}
+	    inode->mtim.tv_sec = direntries[i].st.st_mtim.tv_sec;
+	    inode->mtim.tv_nsec = direntries[i].st.st_mtim.tv_nsec;
+	    inode->ctim.tv_sec = direntries[i].st.st_ctim.tv_sec;
+	    inode->ctim.tv_nsec = direntries[i].st.st_ctim.tv_nsec;
 
-	    }
+	    if (! S_ISDIR(direntries[i].st.st_mode)) inode->size=direntries[i].st.st_size;
 
-	} else {
+	    (* fssynccb->create)(object, entry, fssync_mask);
 
-	    if (entry) {
+	} else if (result[i]) {
+	    uint32_t event_mask=0;
 
-		destroy_entry(entry);
-		entry=NULL;
+	    /* already there */
 
-	    }
+	    destroy_entry(entry);
+	    entry=result[i];
 
-	    if (inode) {
+	    free_inode(inode);
+	    inode=entry->inode;
 
-		free(inode);
-		inode=NULL;
+	    event_mask=determine_fsnotify_mask(inode, &direntries[i].st);
+	    memcpy(&entry->synctime, synctime, sizeof(struct timespec));
 
-	    }
+	    (* fssynccb->change)(object, entry, event_mask, fssync_mask);
 
-	    *error=ENOMEM;
-	    break;
+	} else {
+
+	    destroy_entry(entry);
+	    free_inode(inode);
 
 	}
 
     }
 
+    free(entries);
+    free(result);
+    free(direntries);
+    goto out;
+
+    error:
+
+    for (unsigned int i=0; i<count; i++) {
+
+	destroy_entry(direntries[i].entry);
+	free(direntries[i].inode);
+
+    }
+
+    if (entries) free(entries);
+    if (result) free(result);
+    free(direntries);
+
+    out:
+
     if (*error>0) {
 
 	logoutput_error("synchronize_directory_full: error %i:%s", *error, strerror(*error));
@@ -237,7 +305,7 @@ static void synchronize_directory_full(struct workspace_object_struct *object, s
 
 static void synchronize_directory_simple(struct workspace_object_struct *object, struct entry_s *parent, struct directory_s *directory, unsigned int fd, struct readdir_struct *readdir, struct timespec *synctime, unsigned int len, struct fssynccb_struct *fssynccb, uint32_t fssync_mask, unsigned int *error)
 {
-    struct name_s xname={NULL, 0, 0};
+    struct name_s xname={NULL, 0, 0, 0};
     unsigned char dtype=0;
     int res;
     struct stat st;
@@ -268,7 +336,7 @@ static void synchronize_directory_simple(struct workspace_object_struct *object,
 	if (! entry) {
 
 	    entry=create_entry(parent, &xname);
-	    inode=create_inode(0);
+	    inode=create_inode_slabs(get_entry_slabs(entry), 0);
 
 	    *error=0;
 
@@ -313,10 +381,10 @@ static void synchronize_directory_simple(struct workspace_object_struct *object,
 		    if (*error==EEXIST) {
 			uint32_t event_mask=0;
 
-			free(entry);
+			destroy_entry(entry);
 			entry=result;
 
-			free(inode);
+			free_inode(inode);
 			inode=entry->inode;
 
 			event_mask=determine_fsnotify_mask(inode, &st);
@@ -329,7 +397,7 @@ static void synchronize_directory_simple(struct workspace_object_struct *object,
 			destroy_entry(entry);
 			entry=NULL;
 
-			free(inode);
+			free_inode(inode);
 			inode=NULL;
 
 			break;
@@ -349,7 +417,7 @@ static void synchronize_directory_simple(struct workspace_object_struct *object,
 
 		if (inode) {
 
-		    free(inode);
+		    free_inode(inode);
 		    inode=NULL;
 
 		}
@@ -362,10 +430,10 @@ static void synchronize_directory_simple(struct workspace_object_struct *object,
 	} else {
 	    uint32_t event_mask=0;
 
-	    free(entry);
+	    destroy_entry(entry);
 	    entry=result;
 
-	    free(inode);
+	    free_inode(inode);
 	    inode=entry->inode;
 
 	    event_mask=determine_fsnotify_mask(inode, &st);
@@ -696,6 +764,8 @@ void fssync_create_entry_cb_ignore(struct workspace_object_struct *object, struc
 void fssync_change_entry_cb(struct workspace_object_struct *object, struct entry_s *entry, uint32_t event_mask, uint32_t mask)
 {
     unsigned int error=0;
+
+    mark_inode_changed(entry->inode);
     if (mask & (IN_ATTRIB | IN_MODIFY)) queue_change(object, entry, event_mask, &error);
 }
 
@@ -125,6 +125,7 @@ static int complete_fa_unknown(struct fanotify_fsevent_s *fa, struct fsevent_s *
     xname->name=NULL;
     xname->len=0;
     xname->index=0;
+    xname->hash=0;
 
     if (fsevent->backend.linuxfanotify.mask & FAN_CLOSE) {
 
@@ -150,6 +151,7 @@ static int complete_fa_unknown_name(struct fanotify_fsevent_s *fa, struct fseven
 	xname->name=fsevent->backend.linuxfanotify.path;
 	xname->len=fsevent->backend.linuxfanotify.pathlen;
 	xname->index=0;
+	xname->hash=0;
 
 	fsevent->watch=watch;
 
@@ -581,6 +583,8 @@ void initialize_fanotify(struct beventloop_s *loop, unsigned int *error)
 
     }
 
+    profile_simple_locking(&group_fanotify_fsevent.locking, "fanotify hash");
+
     check_version_cb=check_version_init;
     mainpid=getpid();
 
@@ -514,6 +514,8 @@ void initialize_inotify(struct beventloop_s *loop, unsigned int *error)
 
     }
 
+    profile_simple_locking(&group_watches_inotify.locking, "inotify hash");
+
     return;
 
     error:
@@ -554,7 +554,7 @@ static void process_fseventqueue(void *data)
     pthread_mutex_unlock(&fseventqueue_mutex);
 
     if (fsevent) {
-	struct name_s xname={NULL, 0, 0};
+	struct name_s xname={NULL, 0, 0, 0};
 	unsigned int mask=0;
 
 	if ((*fsevent->functions->complete) (fsevent, &mask, &xname)==0) {
@@ -0,0 +1,411 @@
+/*
+  2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017 Stef Bon <stefbon@gmail.com>
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include "global-defines.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+
+#include <inttypes.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include "logging.h"
+#include "fuse-dentry.h"
+#include "fuse-interface.h"
+#include "fuse-block-cache.h"
+
+struct block_cache_s {
+    pthread_mutex_t				mutex;
+    unsigned int				nrframes;
+    unsigned int				used;
+    unsigned int				hand;
+    unsigned int				hashsize;
+    int						*hash;
+    struct block_cache_frame_s			*frames;
+    uint64_t					hits;
+    uint64_t					misses;
+    uint64_t					evictions;
+    uint64_t					invalidations;
+};
+
+static struct block_cache_s block_cache={PTHREAD_MUTEX_INITIALIZER, 0, 0, 0, 0, NULL, NULL, 0, 0, 0, 0};
+
+static unsigned int get_block_hashvalue(uint64_t ino, uint64_t block)
+{
+    uint64_t hash=(ino * 0x9E3779B97F4A7C15ULL) ^ (block * 0xC2B2AE3D27D4EB4FULL);
+    return (unsigned int) (hash ^ (hash >> 29)) & (block_cache.hashsize - 1);
+}
+
+static int find_block_frame(uint64_t ino, uint64_t block)
+{
+    int i=block_cache.hash[get_block_hashvalue(ino, block)];
+
+    while (i!=BLOCK_CACHE_NOFRAME) {
+	struct block_cache_frame_s *frame=&block_cache.frames[i];
+
+	if (frame->ino==ino && frame->block==block) break;
+	i=frame->next;
+
+    }
+
+    return i;
+
+}
+
+static void unhash_block_frame(int i)
+{
+    struct block_cache_frame_s *frame=&block_cache.frames[i];
+    int *p=&block_cache.hash[get_block_hashvalue(frame->ino, frame->block)];
+
+    while (*p!=BLOCK_CACHE_NOFRAME) {
+
+	if (*p==i) {
+
+	    *p=frame->next;
+	    break;
+
+	}
+
+	p=&block_cache.frames[*p].next;
+
+    }
+
+    frame->next=BLOCK_CACHE_NOFRAME;
+    frame->flags=0;
+
+}
+
+/* a block is only valid as long as the file has the same size, mtime and generation as when it was filled */
+
+static unsigned char check_block_frame(struct block_cache_frame_s *frame, struct inode_s *inode)
+{
+    return (frame->generation==__atomic_load_n(&inode->cachegen, __ATOMIC_ACQUIRE) && frame->size==inode->st.st_size &&
+	    frame->mtim.tv_sec==inode->st.st_mtim.tv_sec && frame->mtim.tv_nsec==inode->st.st_mtim.tv_nsec);
+}
+
+/* a free frame: one never used before, or the first one the hand finds without its clock bit */
+
+static int get_block_frame()
+{
+    struct block_cache_frame_s *frame=NULL;
+    int i=BLOCK_CACHE_NOFRAME;
+
+    if (block_cache.used < block_cache.nrframes) {
+
+	frame=&block_cache.frames[block_cache.used];
+	frame->data=malloc(BLOCK_CACHE_BLOCKSIZE);
+
+	if (frame->data) {
+
+	    i=(int) block_cache.used;
+	    block_cache.used++;
+	    return i;
+
+	}
+
+	if (block_cache.used==0) return BLOCK_CACHE_NOFRAME;
+
+    }
+
+    for (unsigned int count=0; count < 2 * block_cache.used; count++) {
+
+	frame=&block_cache.frames[block_cache.hand];
+	i=(int) block_cache.hand;
+	block_cache.hand=(block_cache.hand + 1) % block_cache.used;
+
+	if ((frame->flags & BLOCK_CACHE_FLAG_VALID)==0) return i;
+
+	if (frame->clock) {
+
+	    frame->clock=0;
+	    continue;
+
+	}
+
+	unhash_block_frame(i);
+	block_cache.evictions++;
+	return i;
+
+    }
+
+    return BLOCK_CACHE_NOFRAME;
+
+}
+
+static void clear_block_cache()
+{
+
+    if (block_cache.frames) {
+
+	for (unsigned int i=0; i<block_cache.used; i++) free(block_cache.frames[i].data);
+	free(block_cache.frames);
+	block_cache.frames=NULL;
+
+    }
+
+    if (block_cache.hash) {
+
+	free(block_cache.hash);
+	block_cache.hash=NULL;
+
+    }
+
+    __atomic_store_n(&block_cache.nrframes, 0, __ATOMIC_RELEASE);
+    block_cache.used=0;
+    block_cache.hand=0;
+    block_cache.hashsize=0;
+
+}
+
+/* (re)create the cache with a budget in bytes, all cached blocks are dropped */
+
+int set_block_cache_budget(uint64_t budget, unsigned int *error)
+{
+    unsigned int nrframes=(unsigned int) (budget / BLOCK_CACHE_BLOCKSIZE);
+    unsigned int hashsize=1;
+    int result=-1;
+
+    if (budget>0 && nrframes==0) {
+
+	*error=EINVAL;
+	return -1;
+
+    }
+
+    while (hashsize < 2 * nrframes) hashsize=hashsize << 1;
+
+    pthread_mutex_lock(&block_cache.mutex);
+    clear_block_cache();
+
+    if (nrframes==0) {
+
+	result=0;
+	goto unlock;
+
+    }
+
+    block_cache.frames=malloc(nrframes * sizeof(struct block_cache_frame_s));
+    block_cache.hash=malloc(hashsize * sizeof(int));
+
+    if (block_cache.frames==NULL || block_cache.hash==NULL) {
+
+	clear_block_cache();
+	*error=ENOMEM;
+	goto unlock;
+
+    }
+
+    memset(block_cache.frames, 0, nrframes * sizeof(struct block_cache_frame_s));
+    for (unsigned int i=0; i<nrframes; i++) block_cache.frames[i].next=BLOCK_CACHE_NOFRAME;
+    for (unsigned int i=0; i<hashsize; i++) block_cache.hash[i]=BLOCK_CACHE_NOFRAME;
+
+    block_cache.hashsize=hashsize;
+    __atomic_store_n(&block_cache.nrframes, nrframes, __ATOMIC_RELEASE);
+    result=0;
+
+    unlock:
+
+    pthread_mutex_unlock(&block_cache.mutex);
+    logoutput("set_block_cache_budget: %u blocks of %u bytes", nrframes, BLOCK_CACHE_BLOCKSIZE);
+    return result;
+
+}
+
+void free_block_cache()
+{
+    pthread_mutex_lock(&block_cache.mutex);
+    clear_block_cache();
+    pthread_mutex_unlock(&block_cache.mutex);
+}
+
+/*
+    serve a read from the cache when all the blocks it needs are there
+    returns 1 when the reply is send, 0 when the read has to go to the backend
+*/
+
+int read_block_cache(struct inode_s *inode, struct fuse_request_s *request, size_t size, off_t offset)
+{
+    uint64_t fsize=inode->st.st_size;
+    uint64_t start=(uint64_t) offset;
+    uint64_t end=start + size;
+    uint64_t pos=start;
+    char *buffer=NULL;
+
+    if (__atomic_load_n(&block_cache.nrframes, __ATOMIC_ACQUIRE)==0 || size==0 || start>=fsize) return 0;
+    if (end > fsize) end=fsize;
+
+    buffer=malloc(end - start);
+    if (buffer==NULL) return 0;
+
+    pthread_mutex_lock(&block_cache.mutex);
+
+    while (block_cache.frames && pos < end) {
+	uint64_t block=pos / BLOCK_CACHE_BLOCKSIZE;
+	uint64_t bstart=block * BLOCK_CACHE_BLOCKSIZE;
+	uint64_t bend=((bstart + BLOCK_CACHE_BLOCKSIZE) < end) ? bstart + BLOCK_CACHE_BLOCKSIZE : end;
+	struct block_cache_frame_s *frame=NULL;
+	int i=find_block_frame(inode->st.st_ino, block);
+
+	if (i==BLOCK_CACHE_NOFRAME) break;
+	frame=&block_cache.frames[i];
+
+	if (check_block_frame(frame, inode)==0) {
+
+	    /* file changed */
+
+	    unhash_block_frame(i);
+	    block_cache.invalidations++;
+	    break;
+
+	}
+
+	if (bstart + frame->len < bend) break;
+
+	memcpy(buffer + (pos - start), frame->data + (pos - bstart), bend - pos);
+	frame->clock=1;
+	pos=bend;
+
+    }
+
+    if (pos < end) {
+
+	block_cache.misses++;
+	pthread_mutex_unlock(&block_cache.mutex);
+	free(buffer);
+	return 0;
+
+    }
+
+    block_cache.hits++;
+    pthread_mutex_unlock(&block_cache.mutex);
+
+    reply_VFS_data(request, buffer, end - start);
+    free(buffer);
+    return 1;
+
+}
+
+/* the generation to give to store_block_cache, taken before the read is send to the backend */
+
+uint32_t get_block_cache_generation(struct inode_s *inode)
+{
+    return __atomic_load_n(&inode->cachegen, __ATOMIC_ACQUIRE);
+}
+
+/*
+    keep the data read from the backend, only the blocks which are completely in it (or up to the end of the file)
+    generation is the one of the inode when the read was send: the data is not kept when it changed since
+*/
+
+void store_block_cache(struct inode_s *inode, uint32_t generation, off_t offset, char *buffer, size_t size)
+{
+    uint64_t fsize=inode->st.st_size;
+    uint64_t start=(uint64_t) offset;
+    uint64_t end=start + size;
+    uint64_t block=(start + BLOCK_CACHE_BLOCKSIZE - 1) / BLOCK_CACHE_BLOCKSIZE;
+
+    if (__atomic_load_n(&block_cache.nrframes, __ATOMIC_ACQUIRE)==0 || size==0) return;
+    if (generation!=get_block_cache_generation(inode)) return;
+
+    pthread_mutex_lock(&block_cache.mutex);
+
+    while (block_cache.frames) {
+	uint64_t bstart=block * BLOCK_CACHE_BLOCKSIZE;
+	uint64_t bend=bstart + BLOCK_CACHE_BLOCKSIZE;
+	struct block_cache_frame_s *frame=NULL;
+	int i=BLOCK_CACHE_NOFRAME;
+
+	if (bstart >= end) break;
+
+	if (bend > end) {
+
+	    /* a part of a block is only complete at the end of the file */
+
+	    if (end!=fsize) break;
+	    bend=end;
+
+	}
+
+	i=find_block_frame(inode->st.st_ino, block);
+
+	if (i==BLOCK_CACHE_NOFRAME) {
+
+	    i=get_block_frame();
+	    if (i==BLOCK_CACHE_NOFRAME) break;
+
+	    frame=&block_cache.frames[i];
+	    frame->ino=inode->st.st_ino;
+	    frame->block=block;
+	    frame->clock=0;
+	    frame->next=block_cache.hash[get_block_hashvalue(frame->ino, block)];
+	    block_cache.hash[get_block_hashvalue(frame->ino, block)]=i;
+
+	} else {
+
+	    frame=&block_cache.frames[i];
+
+	}
+
+	memcpy(frame->data, buffer + (bstart - start), bend - bstart);
+	frame->len=(unsigned int) (bend - bstart);
+	frame->size=fsize;
+	frame->mtim.tv_sec=inode->st.st_mtim.tv_sec;
+	frame->mtim.tv_nsec=inode->st.st_mtim.tv_nsec;
+	frame->generation=generation;
+	frame->flags=BLOCK_CACHE_FLAG_VALID;
+	block++;
+
+    }
+
+    pthread_mutex_unlock(&block_cache.mutex);
+
+}
+
+/*
+    the data of the file is changed here (write, truncate) or somewhere else (change notify)
+    call it before and after the change reaches the backend: the blocks are not removed here but found invalid by
+    read_block_cache (and taken by the hand in time)
+*/
+
+void invalidate_block_cache(struct inode_s *inode)
+{
+    __atomic_add_fetch(&inode->cachegen, 1, __ATOMIC_RELEASE);
+}
+
+void get_block_cache_stat(struct block_cache_stat_s *stat)
+{
+    pthread_mutex_lock(&block_cache.mutex);
+
+    stat->budget=(uint64_t) block_cache.nrframes * BLOCK_CACHE_BLOCKSIZE;
+    stat->resident=(uint64_t) block_cache.used * BLOCK_CACHE_BLOCKSIZE;
+    stat->hits=block_cache.hits;
+    stat->misses=block_cache.misses;
+    stat->evictions=block_cache.evictions;
+    stat->invalidations=block_cache.invalidations;
+
+    pthread_mutex_unlock(&block_cache.mutex);
+}
@@ -0,0 +1,82 @@
+/*
+  2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017 Stef Bon <stefbon@gmail.com>
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#ifndef SB_COMMON_UTILS_FUSE_BLOCK_CACHE_H
+#define SB_COMMON_UTILS_FUSE_BLOCK_CACHE_H
+
+#define BLOCK_CACHE_BLOCKSIZE				65536		/* power of 2 */
+#define BLOCK_CACHE_NOFRAME				-1
+
+#define BLOCK_CACHE_FLAG_VALID				1
+
+/*
+    cache of file data in userspace, in blocks of BLOCK_CACHE_BLOCKSIZE bytes by (ino, block)
+
+    all inodes share one pool of frames, as many as fit in the budget (set_block_cache_budget, zero is no cache)
+    the data of a frame is allocated at first use; when all frames are used, one is taken with CLOCK:
+    a frame read since the last pass of the hand gets a second chance
+    a block remembers the size and mtime of the inode when filled, and it's only used when these are still the
+    same: a changed size or mtime (from getattr, lookup or readdir) invalidates the blocks without a walk
+    a block also remembers the generation of the inode (cachegen) the read was send in: writes, truncates and change
+    notifies make the generation one higher, before and after the data changes at the backend, so all the blocks of
+    the inode are invalid without a walk, also those of a read which was in progress with the old data
+
+    a read is served from the cache only when all the blocks it needs are there, otherwise it goes to the backend,
+    and the reply of the backend fills the blocks it covers completely (or to the end of the file)
+    inos are never reused, blocks of forgotten inodes are taken by the hand in time
+*/
+
+struct block_cache_frame_s {
+    uint64_t					ino;
+    uint64_t					block;
+    uint64_t					size;
+    struct inode_time_s				mtim;
+    uint32_t					generation;
+    unsigned int				len;
+    unsigned char				flags;
+    unsigned char				clock;
+    int						next;
+    char					*data;
+};
+
+struct block_cache_stat_s {
+    uint64_t					budget;
+    uint64_t					resident;
+    uint64_t					hits;
+    uint64_t					misses;
+    uint64_t					evictions;
+    uint64_t					invalidations;
+};
+
+struct inode_s;
+struct fuse_request_s;
+
+/* prototypes */
+
+int set_block_cache_budget(uint64_t budget, unsigned int *error);
+void free_block_cache();
+
+int read_block_cache(struct inode_s *inode, struct fuse_request_s *request, size_t size, off_t offset);
+uint32_t get_block_cache_generation(struct inode_s *inode);
+void store_block_cache(struct inode_s *inode, uint32_t generation, off_t offset, char *buffer, size_t size);
+void invalidate_block_cache(struct inode_s *inode);
+
+void get_block_cache_stat(struct block_cache_stat_s *stat);
+
+#endif
@@ -108,7 +108,7 @@ static struct service_context_s *get_context_root_inode(struct inode_s *inode)
 static void service_fs_lookup(struct service_context_s *context, struct fuse_request_s *request, struct inode_s *pinode, const char *name, unsigned int len)
 {
     unsigned int error=0;
-    struct name_s xname={(char *)name, len, 0};
+    struct name_s xname={(char *)name, len, 0, 0};
     struct entry_s *entry=NULL;
     unsigned int pathlen=xname.len + 1;
     char path[pathlen + 1];
@@ -246,7 +246,7 @@ static void service_fs_setattr(struct service_context_s *context, struct fuse_re
 static void service_fs_mkdir(struct service_context_s *context, struct fuse_request_s *request, struct inode_s *pinode, const char *name, unsigned int len, mode_t mode, mode_t mask)
 {
     unsigned int error=0;
-    struct name_s xname={(char *)name, len-1, 0};
+    struct name_s xname={(char *)name, len-1, 0, 0};
     mode_t dirtype=(mode & S_IFMT);
     mode_t dirperm=0;
     struct entry_s *entry=NULL;
@@ -326,7 +326,7 @@ static void service_fs_mkdir(struct service_context_s *context, struct fuse_requ
 static void service_fs_mknod(struct service_context_s *context, struct fuse_request_s *request, struct inode_s *pinode, const char *name, unsigned int len, mode_t mode, dev_t rdev, mode_t mask)
 {
     unsigned int error=0;
-    struct name_s xname={(char *)name, len-1, 0};
+    struct name_s xname={(char *)name, len-1, 0, 0};
     mode_t filetype=(mode & S_IFMT);
     mode_t fileperm=0;
     struct entry_s *entry=NULL;
@@ -418,7 +418,7 @@ static void service_fs_mknod(struct service_context_s *context, struct fuse_requ
 static void service_fs_symlink(struct service_context_s *context, struct fuse_request_s *request, struct inode_s *pinode, const char *name, unsigned int len0, const char *target, unsigned int len1)
 {
     unsigned int error=0;
-    struct name_s xname={(char *)name, len0, 0};
+    struct name_s xname={(char *)name, len0, 0, 0};
     struct entry_s *entry=NULL;
     struct stat st;
     struct directory_s *directory=NULL;
@@ -497,7 +497,7 @@ static void service_fs_symlink(struct service_context_s *context, struct fuse_re
 static void service_fs_unlink(struct service_context_s *context, struct fuse_request_s *request, struct inode_s *pinode, const char *name, unsigned int len)
 {
     unsigned int error=ENOENT;
-    struct name_s xname={(char *)name, len, 0};
+    struct name_s xname={(char *)name, len, 0, 0};
     struct entry_s *entry=NULL;
     struct directory_s *directory=NULL;
 
@@ -547,7 +547,7 @@ static void service_fs_unlink(struct service_context_s *context, struct fuse_req
 static void service_fs_rmdir(struct service_context_s *context, struct fuse_request_s *request, struct inode_s *pinode, const char *name, unsigned int len)
 {
     unsigned int error=ENOENT;
-    struct name_s xname={(char *)name, len, 0};
+    struct name_s xname={(char *)name, len, 0, 0};
     struct entry_s *entry=NULL;
     struct directory_s *directory=NULL;
 
@@ -616,7 +616,7 @@ static void service_fs_rename(struct service_context_s *context, struct fuse_req
 static void service_fs_rename_keep(struct service_context_s *context, struct fuse_request_s *request, struct inode_s *inode, const char *name, struct inode_s *n_inode, const char *n_name, unsigned int flags)
 {
     unsigned int error=ENOENT;
-    struct name_s xname={(char *)name, strlen(name), 0};
+    struct name_s xname={(char *)name, strlen(name), 0, 0};
     struct entry_s *entry=NULL;
     struct directory_s *directory=NULL;
 
@@ -638,7 +638,7 @@ static void service_fs_rename_keep(struct service_context_s *context, struct fus
 	char path[pathlen + 1];
 	struct directory_s *sub_directory=NULL, *n_directory=NULL;
 	char *pathstart=NULL;
-	struct name_s n_xname={(char *)n_name, strlen(n_name), 0};
+	struct name_s n_xname={(char *)n_name, strlen(n_name), 0, 0};
 	struct entry_s *n_entry=NULL;
 	union datalink_u *link=NULL;
 
@@ -738,7 +738,7 @@ static void service_fs_create(struct fuse_openfile_s *openfile, struct fuse_requ
 {
     struct service_context_s *context=openfile->context;
     unsigned int error=0;
-    struct name_s xname={(char *)name, len-1, 0};
+    struct name_s xname={(char *)name, len-1, 0, 0};
     mode_t filetype=(mode & S_IFMT);
     mode_t fileperm=0;
     struct entry_s *entry=NULL;
@@ -812,11 +812,15 @@ static void service_fs_create(struct fuse_openfile_s *openfile, struct fuse_requ
 	    openfile->context=context;
 	    openfile->inode=entry->inode; /* now it's pointing to the right inode */
 
+	    /* count the handle before the reply is send, like open does, the release may follow immediatly */
+
+	    __atomic_add_fetch(&openfile->inode->nopen, 1, __ATOMIC_RELAXED);
 	    (* fs->create)(openfile, request, &pathinfo, &st, flags);
 
 	    if (openfile->error>0) {
 		struct inode_s *inode=openfile->inode;
 
+		__atomic_sub_fetch(&inode->nopen, 1, __ATOMIC_RELAXED);
 		queue_inode_2forget(context->unique, inode->st.st_ino, 0, 0);
 		openfile->inode=NULL;
 
@@ -49,6 +49,7 @@
 
 #include "fuse-dentry.h"
 #include "fuse-directory.h"
+#include "fuse-directory-negative.h"
 #include "fuse-utils.h"
 
 #include "fuse-fs.h"
@@ -87,10 +88,45 @@ static void service_fs_forget(struct inode_s *inode)
 
 /* LOOKUP */
 
+struct negative_lookup_s {
+    struct service_context_s			*context;
+    struct directory_s				*directory;
+    struct name_s				*xname;
+    uint64_t					generation;
+};
+
+/* the backend did not find the name: remember that (when the directory did not change meanwhile) and give the VFS a negative entry */
+
+static unsigned char cb_error_negative_lookup(struct fuse_request_s *request, unsigned int error)
+{
+    struct negative_lookup_s *negative=(struct negative_lookup_s *) request->data;
+    struct timespec ttl;
+
+    request->data=NULL;
+    if (error!=ENOENT) return 0;
+
+    if (negative->directory->generation==negative->generation) {
+
+	add_negative_cache(negative->directory, negative->xname, &ttl);
+
+    } else {
+
+	/* an entry is added or removed while the backend was looking: the name may just have been created */
+
+	ttl.tv_sec=0;
+	ttl.tv_nsec=NEGATIVE_TTL_MIN * 1000000;
+
+    }
+
+    _fs_common_negative_lookup(negative->context, request, &ttl);
+    return 1;
+
+}
+
 static void service_fs_lookup(struct service_context_s *context, struct fuse_request_s *request, struct inode_s *pinode, const char *name, unsigned int len)
 {
     unsigned int error=0;
-    struct name_s xname={(char *)name, len, 0};
+    struct name_s xname={(char *)name, len, 0, 0};
     struct entry_s *entry=NULL;
     struct pathcalls_s *pathcalls=NULL;
     unsigned int pathlen=get_pathmax(context->workspace) + xname.len + 1;
@@ -98,6 +134,7 @@ static void service_fs_lookup(struct service_context_s *context, struct fuse_req
     struct pathinfo_s pathinfo=PATHINFO_INIT;
     struct directory_s *directory=NULL;
     struct fuse_path_s fpath;
+    struct timespec ttl;
 
     logoutput("service_fs_lookup");
 
@@ -111,6 +148,18 @@ static void service_fs_lookup(struct service_context_s *context, struct fuse_req
 
     }
 
+    calculate_nameindex(&xname);
+    entry=find_entry(directory, &xname, &error);
+
+    if (entry==NULL && lookup_negative_cache(directory, &xname, &ttl)==1) {
+
+	/* not found recently, and the directory did not change since */
+
+	_fs_common_negative_lookup(context, request, &ttl);
+	return;
+
+    }
+
     pathcalls=get_pathcalls(directory);
     pathinfo.len=add_name_path(&fpath, &xname);
 
@@ -119,9 +168,6 @@ static void service_fs_lookup(struct service_context_s *context, struct fuse_req
     unlock_pathcalls(pathcalls);
 
     pathinfo.path=fpath.pathstart;
-
-    calculate_nameindex(&xname);
-    entry=find_entry(directory, &xname, &error);
     context=fpath.context;
 
     logoutput("LOOKUP %s (thread %i) %s", context->name, (int) gettid(), pathinfo.path);
@@ -133,9 +179,18 @@ static void service_fs_lookup(struct service_context_s *context, struct fuse_req
 
     } else {
 	struct service_fs_s *fs=context->service.filesystem.fs;
+	struct negative_lookup_s negative={context, directory, &xname, directory->generation};
+
+	/* the reply is sent before lookup_new returns, so the data on the stack is still valid */
+
+	request->cb_error=cb_error_negative_lookup;
+	request->data=(void *) &negative;
 
 	(* fs->lookup_new)(context, request, pinode, &xname, &pathinfo);
 
+	request->cb_error=NULL;
+	request->data=NULL;
+
     }
 
 }
@@ -252,7 +307,7 @@ static void service_fs_setattr(struct service_context_s *context, struct fuse_re
 static void service_fs_mkdir(struct service_context_s *context, struct fuse_request_s *request, struct inode_s *pinode, const char *name, unsigned int len, mode_t mode, mode_t mask)
 {
     unsigned int error=0;
-    struct name_s xname={(char *)name, len-1, 0};
+    struct name_s xname={(char *)name, len-1, 0, 0};
     mode_t dirtype=(mode & S_IFMT);
     mode_t dirperm=0;
     struct entry_s *entry=NULL;
@@ -327,7 +382,7 @@ static void service_fs_mkdir(struct service_context_s *context, struct fuse_requ
 static void service_fs_mknod(struct service_context_s *context, struct fuse_request_s *request, struct inode_s *pinode, const char *name, unsigned int len, mode_t mode, dev_t rdev, mode_t mask)
 {
     unsigned int error=0;
-    struct name_s xname={(char *)name, len-1, 0};
+    struct name_s xname={(char *)name, len-1, 0, 0};
     mode_t filetype=(mode & S_IFMT);
     mode_t fileperm=0;
     struct entry_s *entry=NULL;
@@ -411,7 +466,7 @@ static void service_fs_mknod(struct service_context_s *context, struct fuse_requ
 static void service_fs_symlink(struct service_context_s *context, struct fuse_request_s *request, struct inode_s *pinode, const char *name, unsigned int len0, const char *target, unsigned int len1)
 {
     unsigned int error=0;
-    struct name_s xname={(char *)name, len0-1, 0};
+    struct name_s xname={(char *)name, len0-1, 0, 0};
     struct entry_s *entry=NULL;
     struct stat st;
     struct directory_s *directory=NULL;
@@ -490,7 +545,7 @@ static void service_fs_symlink(struct service_context_s *context, struct fuse_re
 static void service_fs_unlink(struct service_context_s *context, struct fuse_request_s *request, struct inode_s *pinode, const char *name, unsigned int len)
 {
     unsigned int error=0;
-    struct name_s xname={(char *)name, len, 0};
+    struct name_s xname={(char *)name, len, 0, 0};
     struct entry_s *entry=NULL;
     struct directory_s *directory=NULL;
 
@@ -530,6 +585,7 @@ static void service_fs_unlink(struct service_context_s *context, struct fuse_req
 
 	logoutput("UNLINK %s (thread %i) %s", context->name, (int) gettid(), pathinfo.path);
 	(* fs->unlink)(context, request, &entry, &pathinfo);
+	if (entry==NULL) change_negative_cache(directory, NULL);
 
     } else {
 
@@ -545,7 +601,7 @@ static void service_fs_unlink(struct service_context_s *context, struct fuse_req
 static void service_fs_rmdir(struct service_context_s *context, struct fuse_request_s *request, struct inode_s *pinode, const char *name, unsigned int len)
 {
     unsigned int error=0;
-    struct name_s xname={(char *)name, len, 0};
+    struct name_s xname={(char *)name, len, 0, 0};
     struct entry_s *entry=NULL;
     struct directory_s *directory=NULL;
 
@@ -590,7 +646,13 @@ static void service_fs_rmdir(struct service_context_s *context, struct fuse_requ
 	logoutput("RMDIR %s (thread %i) %s", context->name, (int) gettid(), pathinfo.path);
 
 	(* fs->rmdir)(context, request, &entry, &pathinfo);
-	if (entry==NULL && directory) destroy_directory(directory);
+
+	if (entry==NULL) {
+
+	    change_negative_cache(directory, NULL);
+	    destroy_directory(directory);
+
+	}
 
     } else {
 
@@ -693,7 +755,7 @@ static void service_fs_create(struct fuse_openfile_s *openfile, struct fuse_requ
 {
     struct service_context_s *context=openfile->context;
     unsigned int error=0;
-    struct name_s xname={(char *)name, len-1, 0};
+    struct name_s xname={(char *)name, len-1, 0, 0};
     struct directory_s *directory=NULL;
     mode_t filetype=(mode & S_IFMT);
     mode_t fileperm=0;
@@ -773,12 +835,17 @@ static void service_fs_create(struct fuse_openfile_s *openfile, struct fuse_requ
 	logoutput("CREATE %s (thread %i): %s", context->name, (int) gettid(), pathinfo.path);
 
 	openfile->inode=entry->inode; /* now it's pointing to the right inode */
+
+	/* count the handle before the reply is send, like open does, the release may follow immediatly */
+
+	__atomic_add_fetch(&openfile->inode->nopen, 1, __ATOMIC_RELAXED);
 	fs=context->service.filesystem.fs;
 	(* fs->create)(openfile, request, &pathinfo, &st, flags);
 
 	if (openfile->error>0) {
 	    struct inode_s *inode=entry->inode;
 
+	    __atomic_sub_fetch(&inode->nopen, 1, __ATOMIC_RELAXED);
 	    inode->flags|=FORGET_INODE_FLAG_DELETED;
 	    queue_inode_2forget(context->unique, inode->st.st_ino, 0, 0);
 	    openfile->inode=NULL;
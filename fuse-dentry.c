@@ -33,6 +33,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <pthread.h>
+#include <sched.h>
 #include <time.h>
 
 #ifndef ENOATTR
@@ -49,91 +50,96 @@
 
 #include "workspaces.h"
 #include "workspace-context.h"
-
-#ifndef SIZE_INODE_HASHTABLE
-#define SIZE_INODE_HASHTABLE				10240
-#endif
+#include "path-caching.h"
 
 #include "logging.h"
 
-static struct inode_s **inode_hash_table=NULL;
-static pthread_mutex_t inode_table_mutex=PTHREAD_MUTEX_INITIALIZER;
-
 static uint64_t inoctr=FUSE_ROOT_ID;
-static pthread_mutex_t inodectrmutex=PTHREAD_MUTEX_INITIALIZER;
-static unsigned long long nrinodes=0;
 
-struct inode_2delete_s {
+/*
+    forgets (and other work for the forget thread) go through a ring of FORGET_RING_SIZE items, preallocated
+    producers reserve positions with one atomic add (a FORGET_MULTI reserves all its items at once), and
+    publish every item by setting its sequence number; there is one consumer, the forget thread, which takes
+    up to FORGET_RING_BATCH published items at once, in the order they were queued
+*/
+
+#define FORGET_RING_SIZE					8192		/* power of 2 */
+#define FORGET_RING_BATCH					256
+
+struct inode_2forget_s {
+    uint64_t				seq;
     ino_t				ino;
     dev_t 				unique;
     unsigned int			flags;
     uint64_t				forget;
-    struct inode_2delete_s		*next;
+    void				(* cb)(void *ptr);
+    void				*ptr;
+    struct inode_s			*inode;
 };
 
-static pthread_t inode_2delete_threadid=0;
-static struct inode_2delete_s *inode_2delete_list=NULL;
-static pthread_mutex_t inode_2delete_mutex=PTHREAD_MUTEX_INITIALIZER;
+static struct inode_2forget_s forget_ring[FORGET_RING_SIZE];
+static pthread_once_t forget_ring_once=PTHREAD_ONCE_INIT;
+static uint64_t forget_ring_head=0;
+static uint64_t forget_ring_tail=0;
+static unsigned char forget_thread_running=0;
 
-#define NAMEINDEX_ROOT1						92			/* number of valid chars*/
-#define NAMEINDEX_ROOT2						8464			/* 92 ^ 2 */
-#define NAMEINDEX_ROOT3						778688			/* 92 ^ 3 */
-#define NAMEINDEX_ROOT4						71639296		/* 92 ^ 4 */
-#define NAMEINDEX_ROOT5						6590815232		/* 92 ^ 5 */
-
-void calculate_nameindex(struct name_s *name)
-{
-    char buffer[6];
+/*
+    the index of a name is the first 8 bytes of the name, big endian and padded with zeros, so comparing
+    the indices gives the same order as comparing the first 8 bytes
+    the hash covers the whole name: names with the same first 8 bytes (like "part-00001" and "part-00002") are
+    almost always told apart by the hash, without looking at the names themselves
 
-    memset(buffer, 32, 6);
+    the hash is computed 8 bytes at a time (multiply and xorshift)
+*/
 
-    if (name->len>5) {
+#define NAMEHASH_SEED						0x9E3779B97F4A7C15ULL
+#define NAMEHASH_MUL1						0xFF51AFD7ED558CCDULL
+#define NAMEHASH_MUL2						0xC4CEB9FE1A85EC53ULL
 
-	memcpy(buffer, name->name, 6);
+static uint32_t calculate_namehash(char *name, size_t len)
+{
+    uint64_t hash=NAMEHASH_SEED ^ (uint64_t) len;
+    uint64_t word=0;
 
-    } else {
+    while (len>=8) {
 
-	memcpy(buffer, name->name, name->len);
+	memcpy(&word, name, 8);
+	hash=(hash ^ word) * NAMEHASH_MUL1;
+	hash^=hash >> 32;
+	name+=8;
+	len-=8;
 
     }
 
-    unsigned char firstletter=*buffer-32;
-    unsigned char secondletter=*(buffer+1)-32;
-    unsigned char thirdletter=*(buffer+2)-32;
-    unsigned char fourthletter=*(buffer+3)-32;
-    unsigned char fifthletter=*(buffer+4)-32;
-    unsigned char sixthletter=*(buffer+5)-32;
-
-    name->index=(firstletter * NAMEINDEX_ROOT5) + (secondletter * NAMEINDEX_ROOT4) + (thirdletter * NAMEINDEX_ROOT3) + (fourthletter * NAMEINDEX_ROOT2) + (fifthletter * NAMEINDEX_ROOT1) + sixthletter;
-
-}
-
-int init_inode_hashtable(unsigned int *error)
-{
-    int result=0;
-
-    inode_hash_table = calloc(SIZE_INODE_HASHTABLE, sizeof(struct inode_s *));
+    if (len>0) {
 
-    if ( ! inode_hash_table ) {
-
-	*error=ENOMEM;
-	result=-1;
+	word=0;
+	memcpy(&word, name, len);
+	hash=(hash ^ word) * NAMEHASH_MUL1;
+	hash^=hash >> 32;
 
     }
 
-    return result;
+    hash^=hash >> 29;
+    hash*=NAMEHASH_MUL2;
+    hash^=hash >> 32;
+
+    return (uint32_t) hash;
 
 }
 
-void free_inode_hashtable()
+void calculate_nameindex(struct name_s *name)
 {
+    unsigned char buffer[8];
+    unsigned long long index=0;
 
-    if (inode_hash_table) {
+    memset(buffer, 0, 8);
+    memcpy(buffer, name->name, (name->len > 8) ? 8 : name->len);
 
-	free(inode_hash_table);
-	inode_hash_table=NULL;
+    for (unsigned int i=0; i<8; i++) index=(index << 8) | buffer[i];
 
-    }
+    name->index=index;
+    name->hash=calculate_namehash(name->name, name->len);
 
 }
 
@@ -141,28 +147,25 @@ void free_inode_hashtable()
     function to assign an ino number to the inode and add the inode
     to the inode hash table
 
-    this can be done using one mutex
-
-    note that the ino is required to add to the hash table, so first get a new ino, and than add to the table
-
+    the ino comes from an atomic counter, the table has a lock per shard
 */
 
 void add_inode_hashtable(struct inode_s *inode, void (*cb) (void *data), void *data)
 {
-    size_t hash = 0;
+    unsigned int error=0;
+
+    inode->st.st_ino=(ino_t) __atomic_add_fetch(&inoctr, 1, __ATOMIC_RELAXED);
 
-    pthread_mutex_lock(&inode_table_mutex);
+    if (insert_inode_hashtable(inode, &error)==0) {
 
-    inoctr++;
-    inode->st.st_ino=inoctr;
+	inode->flags|=INODE_FLAG_HASHED;
+	inode->clock=1;
 
-    hash = inoctr % SIZE_INODE_HASHTABLE;
+    } else {
 
-    inode->id_next = inode_hash_table[hash];
-    inode->id_next = NULL;
-    inode_hash_table[hash] = inode;
+	logoutput_warning("add_inode_hashtable: unable to add ino %li (error %i:%s)", inode->st.st_ino, error, strerror(error));
 
-    pthread_mutex_unlock(&inode_table_mutex);
+    }
 
     (* cb) (data);
 
@@ -175,6 +178,7 @@ void init_entry(struct entry_s *entry)
     entry->name.name=NULL;
     entry->name.len=0;
     entry->name.index=0;
+    entry->name.hash=0;
 
     entry->parent=NULL;
     entry->name_next=NULL;
@@ -185,20 +189,156 @@ void init_entry(struct entry_s *entry)
 }
 
 /*
+    slabs for the dentries
 
-    allocate an entry and name
+    entries, inodes, directories and names are taken from slab caches (see slab-cache.c), by default
+    the global set, a workspace can have its own set (set_workspace_slabs)
+    an entry is created in the slabs of its parent, so a tree stays in one set, and the set is found
+    by the address of the entry
 
-    TODO: for the name is now a seperate pointer used entry->name.name, but it would
-    be better to use an array for the name
+    names are stored in size classes of 16 to 256 bytes (enough for NAME_MAX), longer ones use malloc
+    inodes with a cache of 0, 64 and 256 bytes, bigger ones use malloc
 */
 
-struct entry_s *create_entry(struct entry_s *parent, struct name_s *xname)
+static const unsigned int inode_cache_classes[DENTRY_SLABS_INODECLASSES]={0, 64, 256};
+
+static struct dentry_slabs_s default_slabs;
+static pthread_once_t default_slabs_once=PTHREAD_ONCE_INIT;
+
+static void init_dentry_slabs(struct dentry_slabs_s *slabs, void *data, void (* cb_inode_freed)(void *data))
+{
+
+    init_slab_cache(&slabs->entries, sizeof(struct entry_s), (void *) slabs);
+    init_slab_cache(&slabs->directories, sizeof(struct directory_s), (void *) slabs);
+
+    for (unsigned int i=0; i<DENTRY_SLABS_INODECLASSES; i++) init_slab_cache(&slabs->inodes[i], sizeof(struct inode_s) + inode_cache_classes[i], (void *) slabs);
+    for (unsigned int i=0; i<DENTRY_SLABS_NAMECLASSES; i++) init_slab_cache(&slabs->names[i], DENTRY_SLABS_NAMEMIN << i, (void *) slabs);
+
+    slabs->data=data;
+    slabs->cb_inode_freed=cb_inode_freed;
+
+}
+
+static void init_default_slabs()
+{
+    init_dentry_slabs(&default_slabs, NULL, NULL);
+}
+
+struct dentry_slabs_s *get_default_dentry_slabs()
+{
+    pthread_once(&default_slabs_once, init_default_slabs);
+    return &default_slabs;
+}
+
+/*
+    create a set of slabs, for example for a workspace
+    cb_inode_freed is called with data when a hashed inode is freed (when its ino has been counted)
+*/
+
+struct dentry_slabs_s *create_dentry_slabs(void *data, void (* cb_inode_freed)(void *data), unsigned int *error)
+{
+    struct dentry_slabs_s *slabs=malloc(sizeof(struct dentry_slabs_s));
+
+    if (slabs) {
+
+	init_dentry_slabs(slabs, data, cb_inode_freed);
+
+    } else {
+
+	*error=ENOMEM;
+
+    }
+
+    return slabs;
+
+}
+
+/* release all objects of a set at once, everything taken from it is invalid after this */
+
+void free_dentry_slabs(struct dentry_slabs_s *slabs)
+{
+
+    if (slabs==NULL || slabs==&default_slabs) return;
+
+    clear_slab_cache(&slabs->entries);
+    clear_slab_cache(&slabs->directories);
+
+    for (unsigned int i=0; i<DENTRY_SLABS_INODECLASSES; i++) clear_slab_cache(&slabs->inodes[i]);
+    for (unsigned int i=0; i<DENTRY_SLABS_NAMECLASSES; i++) clear_slab_cache(&slabs->names[i]);
+
+    free(slabs);
+
+}
+
+uint64_t get_dentry_slabs_memory(struct dentry_slabs_s *slabs)
+{
+    uint64_t size=get_slab_cache_memory(&slabs->entries) + get_slab_cache_memory(&slabs->directories);
+
+    for (unsigned int i=0; i<DENTRY_SLABS_INODECLASSES; i++) size+=get_slab_cache_memory(&slabs->inodes[i]);
+    for (unsigned int i=0; i<DENTRY_SLABS_NAMECLASSES; i++) size+=get_slab_cache_memory(&slabs->names[i]);
+
+    return size;
+
+}
+
+/* the memory of the objects in use, without the free space in the slabs */
+
+uint64_t get_dentry_slabs_resident(struct dentry_slabs_s *slabs)
+{
+    uint64_t size=slabs->entries.inuse * slabs->entries.size + slabs->directories.inuse * slabs->directories.size;
+
+    for (unsigned int i=0; i<DENTRY_SLABS_INODECLASSES; i++) size+=slabs->inodes[i].inuse * slabs->inodes[i].size;
+    for (unsigned int i=0; i<DENTRY_SLABS_NAMECLASSES; i++) size+=slabs->names[i].inuse * slabs->names[i].size;
+
+    return size;
+
+}
+
+/* the set an entry is taken from, without entry the default */
+
+struct dentry_slabs_s *get_entry_slabs(struct entry_s *entry)
+{
+    if (entry) return (struct dentry_slabs_s *) get_slab_cache((void *) entry)->data;
+    return get_default_dentry_slabs();
+}
+
+static char *alloc_entry_name(struct dentry_slabs_s *slabs, unsigned int len)
+{
+
+    for (unsigned int i=0; i<DENTRY_SLABS_NAMECLASSES; i++) {
+
+	if (len + 1 <= (DENTRY_SLABS_NAMEMIN << i)) return (char *) alloc_slab_object(&slabs->names[i]);
+
+    }
+
+    return malloc(len + 1);
+
+}
+
+static void free_entry_name(char *name, unsigned int len)
+{
+
+    if (len + 1 <= (DENTRY_SLABS_NAMEMIN << (DENTRY_SLABS_NAMECLASSES - 1))) {
+
+	free_slab_object((void *) name);
+
+    } else {
+
+	free(name);
+
+    }
+
+}
+
+/* allocate an entry and name */
+
+struct entry_s *create_entry_slabs(struct dentry_slabs_s *slabs, struct entry_s *parent, struct name_s *xname)
 {
     struct entry_s *entry;
     char *name;
 
-    entry = malloc(sizeof(struct entry_s));
-    name = malloc(xname->len + 1);
+    entry = (struct entry_s *) alloc_slab_object(&slabs->entries);
+    name = alloc_entry_name(slabs, xname->len);
 
     if (entry && name) {
 
@@ -211,6 +351,7 @@ struct entry_s *create_entry(struct entry_s *parent, struct name_s *xname)
 
 	entry->name.len=xname->len;
 	entry->name.index=xname->index;
+	entry->name.hash=xname->hash;
 
 	entry->parent = parent;
 
@@ -218,14 +359,14 @@ struct entry_s *create_entry(struct entry_s *parent, struct name_s *xname)
 
 	if (entry) {
 
-	    free(entry);
+	    free_slab_object((void *) entry);
 	    entry=NULL;
 
 	}
 
 	if (name) {
 
-	    free(name);
+	    free_entry_name(name, xname->len);
 	    name=NULL;
 
 	}
@@ -236,19 +377,43 @@ struct entry_s *create_entry(struct entry_s *parent, struct name_s *xname)
 
 }
 
+struct entry_s *create_entry(struct entry_s *parent, struct name_s *xname)
+{
+    return create_entry_slabs(get_entry_slabs(parent), parent, xname);
+}
+
+/* give an entry a new name, the entry takes over name (allocated with malloc)
+    the old name is freed at once: the entry must not be in a directory (lookups compare the name) */
+
 void rename_entry(struct entry_s *entry, char **name, unsigned int len)
 {
+    char *tmp=alloc_entry_name(get_entry_slabs(entry), len);
 
-    if (entry->name.name) free(entry->name.name);
+    if (tmp==NULL) {
 
-    entry->name.name=*name;
-    entry->name.len=len;
-    entry->name.index=0;
+	logoutput_warning("rename_entry: unable to allocate name of %i bytes", len);
+	return;
+
+    }
 
+    memcpy(tmp, *name, len);
+    tmp[len]='\0';
+    free(*name);
     *name=NULL;
 
+    if (entry->name.name) free_entry_name(entry->name.name, entry->name.len);
+
+    entry->name.name=tmp;
+    entry->name.len=len;
+    entry->name.index=0;
+    entry->name.hash=0;
+
     calculate_nameindex(&entry->name);
 
+    /* the cached paths through this entry are not valid anymore */
+
+    invalidate_pathcaches();
+
 }
 
 void destroy_entry(struct entry_s *entry)
@@ -256,7 +421,7 @@ void destroy_entry(struct entry_s *entry)
 
     if ( entry->name.name) {
 
-	free(entry->name.name);
+	free_entry_name(entry->name.name, entry->name.len);
 	entry->name.name=NULL;
 
     }
@@ -268,19 +433,23 @@ void destroy_entry(struct entry_s *entry)
 
     }
 
-    free(entry);
+    free_slab_object((void *) entry);
 
 }
 
 void init_inode(struct inode_s *inode)
 {
-    struct stat *st=&inode->st;
+    struct inode_attr_s *st=&inode->st;
+    unsigned int cache_size=inode->cache_size;
 
-    memset(inode, 0, sizeof(struct inode_s) + inode->cache_size);
+    memset(inode, 0, sizeof(struct inode_s) + cache_size);
 
     inode->flags=0;
-    inode->id_next=NULL;
-    inode->id_prev=NULL;
+    inode->clock=0;
+    inode->timeout=INODE_TIMEOUT_INIT;
+    inode->nopen=0;
+    inode->cachegen=0;
+    inode->cache_size=cache_size;
 
     inode->alias=NULL;
     inode->nlookup=0;
@@ -293,11 +462,8 @@ void init_inode(struct inode_s *inode)
     st->st_size=0;
 
     /* used for context->unique */
-    st->st_rdev=0;
     st->st_dev=0;
-
-    st->st_blksize=0;
-    st->st_blocks=0;
+    inode->rare=NULL;
 
     st->st_mtim.tv_sec=0;
     st->st_mtim.tv_nsec=0;
@@ -315,13 +481,85 @@ void init_inode(struct inode_s *inode)
 
 }
 
+void get_inode_time(struct inode_time_s *time, struct timespec *ts)
+{
+    ts->tv_sec=(time_t) time->tv_sec;
+    ts->tv_nsec=(long) time->tv_nsec;
+}
+
+void set_inode_time(struct inode_time_s *time, struct timespec *ts)
+{
+    time->tv_sec=(int64_t) ts->tv_sec;
+    time->tv_nsec=(uint32_t) ts->tv_nsec;
+}
+
+dev_t get_inode_rdev(struct inode_s *inode)
+{
+    return (inode->rare) ? inode->rare->st_rdev : 0;
+}
+
+int set_inode_rdev(struct inode_s *inode, dev_t rdev)
+{
+
+    if (inode->rare==NULL) {
+
+	if (rdev==0) return 0;
+
+	inode->rare=malloc(sizeof(struct inode_attr_rare_s));
+	if (inode->rare==NULL) return -1;
+
+    }
+
+    inode->rare->st_rdev=rdev;
+    return 0;
+
+}
+
+/* a full struct stat from the compact attributes */
+
 void get_inode_stat(struct inode_s *inode, struct stat *st)
 {
-    memcpy(st, &inode->st, sizeof(struct stat));
+
+    memset(st, 0, sizeof(struct stat));
+
+    st->st_ino=(ino_t) inode->st.st_ino;
+    st->st_mode=(mode_t) inode->st.st_mode;
+    st->st_nlink=(nlink_t) inode->st.st_nlink;
+    st->st_uid=(uid_t) inode->st.st_uid;
+    st->st_gid=(gid_t) inode->st.st_gid;
+    st->st_size=(off_t) inode->st.st_size;
+    st->st_dev=inode->st.st_dev;
+    st->st_rdev=get_inode_rdev(inode);
+
+    st->st_blksize=_DEFAULT_BLOCKSIZE;
+    st->st_blocks=(blkcnt_t) ((inode->st.st_size + 511) / 512);
+
+    get_inode_time(&inode->st.st_atim, &st->st_atim);
+    get_inode_time(&inode->st.st_mtim, &st->st_mtim);
+    get_inode_time(&inode->st.st_ctim, &st->st_ctim);
+
 }
 
 void fill_inode_stat(struct inode_s *inode, struct stat *st)
 {
+
+    /* compare with what the backend reported before (if any) for the timeouts to the VFS */
+
+    if (inode->st.st_ctim.tv_sec>0) {
+
+	if (inode->st.st_mtim.tv_sec==st->st_mtim.tv_sec && inode->st.st_mtim.tv_nsec==(uint32_t) st->st_mtim.tv_nsec &&
+	    inode->st.st_ctim.tv_sec==st->st_ctim.tv_sec && inode->st.st_ctim.tv_nsec==(uint32_t) st->st_ctim.tv_nsec) {
+
+	    mark_inode_stable(inode);
+
+	} else {
+
+	    mark_inode_changed(inode);
+
+	}
+
+    }
+
     //inode->mode=st->st_mode;
     //inode->nlink=st->st_nlink;
 
@@ -330,22 +568,75 @@ void fill_inode_stat(struct inode_s *inode, struct stat *st)
 
     //inode->size=st->st_size;
 
-    inode->st.st_mtim.tv_sec=st->st_mtim.tv_sec;
-    inode->st.st_mtim.tv_nsec=st->st_mtim.tv_nsec;
+    set_inode_time(&inode->st.st_mtim, &st->st_mtim);
+    set_inode_time(&inode->st.st_ctim, &st->st_ctim);
+    set_inode_time(&inode->st.st_atim, &st->st_atim);
+
+}
+
+/* the class of the slab of an inode with this cache size, or -1 for malloc */
+
+static int get_inode_class(unsigned int cache_size)
+{
+
+    for (unsigned int i=0; i<DENTRY_SLABS_INODECLASSES; i++) {
 
-    inode->st.st_ctim.tv_sec=st->st_ctim.tv_sec;
-    inode->st.st_ctim.tv_nsec=st->st_ctim.tv_nsec;
+	if (cache_size <= inode_cache_classes[i]) return (int) i;
+
+    }
 
-    inode->st.st_atim.tv_sec=st->st_atim.tv_sec;
-    inode->st.st_atim.tv_nsec=st->st_atim.tv_nsec;
+    return -1;
 
 }
 
-struct inode_s *create_inode(unsigned int cache_size)
+/* an inode too large for the slabs is malloc'd with this in front of it: the slabs it belongs to, like the data of a slab cache */
+
+struct inode_malloc_s {
+    struct dentry_slabs_s		*slabs;
+} __attribute__((aligned(16)));
+
+static struct inode_s *alloc_inode(struct dentry_slabs_s *slabs, unsigned int cache_size)
+{
+    int class=get_inode_class(cache_size);
+    struct inode_malloc_s *header=NULL;
+
+    if (class>=0) return (struct inode_s *) alloc_slab_object(&slabs->inodes[class]);
+
+    header=malloc(sizeof(struct inode_malloc_s) + sizeof(struct inode_s) + cache_size);
+    if (header==NULL) return NULL;
+
+    header->slabs=slabs;
+    return (struct inode_s *) (header + 1);
+}
+
+static void release_inode(struct inode_s *inode)
 {
-    struct inode_s *inode=NULL;
 
-    inode = malloc(sizeof(struct inode_s) + cache_size);
+    if (get_inode_class(inode->cache_size)>=0) {
+
+	free_slab_object((void *) inode);
+
+    } else {
+
+	free(((struct inode_malloc_s *) inode) - 1);
+
+    }
+
+}
+
+/* the slabs (of the workspace) the inode is allocated for, also when it's malloc'd */
+
+static struct dentry_slabs_s *get_inode_slabs(struct inode_s *inode)
+{
+
+    if (get_inode_class(inode->cache_size)>=0) return (struct dentry_slabs_s *) get_slab_cache((void *) inode)->data;
+    return (((struct inode_malloc_s *) inode) - 1)->slabs;
+
+}
+
+struct inode_s *create_inode_slabs(struct dentry_slabs_s *slabs, unsigned int cache_size)
+{
+    struct inode_s *inode=alloc_inode(slabs, cache_size);
 
     if (inode) {
 
@@ -358,264 +649,601 @@ struct inode_s *create_inode(unsigned int cache_size)
 
 }
 
-void free_inode(struct inode_s *inode)
+struct inode_s *create_inode(unsigned int cache_size)
 {
-    free(inode);
+    return create_inode_slabs(get_default_dentry_slabs(), cache_size);
 }
 
-struct inode_s *realloc_inode(struct inode_s *inode, unsigned int new)
+void free_inode(struct inode_s *inode)
 {
-    struct inode_s *keep=inode;
+    struct dentry_slabs_s *slabs=get_inode_slabs(inode);
 
-    inode=realloc(inode, sizeof(struct inode_s) + new); /* assume always good */
+    /* only inodes which got an ino are counted, whatever their size */
 
-    if (inode != keep) {
-	size_t hash=0;
-	struct inode_s *next=NULL;
-	struct inode_s *prev=NULL;
+    if (slabs->cb_inode_freed && inode->st.st_ino>0) (* slabs->cb_inode_freed)(slabs->data);
 
-	if (inode==NULL) return NULL;
-	hash=inode->st.st_ino % SIZE_INODE_HASHTABLE;
-	next=inode->id_next;
-	prev=inode->id_prev;
+    if (inode->rare) {
 
-	/* repair */
+	free(inode->rare);
+	inode->rare=NULL;
 
-	if (next) next->id_prev=inode;
-	if (prev) {
+    }
 
-	    prev->id_next=inode;
+    release_inode(inode);
 
-	} else {
+}
 
-	    /* no prev means it's the first */
-	    inode_hash_table[hash]=inode;
+static void _release_inode_retired(void *ptr)
+{
+    release_inode((struct inode_s *) ptr);
+}
 
-	}
+/*
+    change the size of the cache of an inode
+    when the slab class stays the same the inode stays where it is, otherwise it's copied
+    a hashed inode can be in use by lockfree lookups: point the table to the copy and
+    retire the old one, it's freed after a grace period (the caller may hold the directory lock)
+*/
 
-	if (inode->alias) {
+struct inode_s *realloc_inode(struct inode_s *inode, unsigned int new)
+{
+    struct inode_s *keep=inode;
+    int class=get_inode_class(keep->cache_size);
+    struct dentry_slabs_s *slabs=get_inode_slabs(keep);
 
-	    struct entry_s *entry=inode->alias;
-	    entry->inode=inode;
+    if (class>=0 && class==get_inode_class(new)) {
 
-	}
+	inode->cache_size=new;
+	return inode;
 
     }
 
+    inode=alloc_inode(slabs, new);
+    if (inode==NULL) return NULL;
+
+    memcpy(inode, keep, sizeof(struct inode_s) + ((new < keep->cache_size) ? new : keep->cache_size));
     inode->cache_size=new;
+    if (inode->alias) inode->alias->inode=inode;
+
+    if (keep->flags & INODE_FLAG_HASHED) {
+
+	replace_inode_hashtable(inode);
+	retire_inode_hashtable((void *) keep, _release_inode_retired);
+	return inode;
+
+    }
+
+    release_inode(keep);
     return inode;
 }
 
-struct inode_s *find_inode(ino_t ino)
+/* mark an inode as used for the eviction sweep, only write when not set already to keep the cacheline clean */
+
+void touch_inode(struct inode_s *inode)
 {
-    size_t hash=ino % SIZE_INODE_HASHTABLE;
-    struct inode_s *inode=NULL;
+    if (__atomic_load_n(&inode->clock, __ATOMIC_RELAXED)==0) __atomic_store_n(&inode->clock, 1, __ATOMIC_RELAXED);
+}
 
-    pthread_mutex_lock(&inode_table_mutex);
-    inode=inode_hash_table[hash];
+/*
+    the inode is seen changing (by the backend or a change notify): short timeouts
+    in the tree as it builds now only fill_inode_stat calls this, the change notify hooks in fuse-netinfo.c and
+    fschangenotify-fssync.c are in files which are not build (they still use the old workspace and inode fields)
+*/
 
-    while(inode) {
+void mark_inode_changed(struct inode_s *inode)
+{
+    __atomic_store_n(&inode->timeout, INODE_TIMEOUT_CHANGED, __ATOMIC_RELAXED);
+}
 
-	if (inode->st.st_ino==ino) break;
-	inode=inode->id_next;
+/* the inode is the same as the last time: double the timeouts, up to the max */
 
-    }
+void mark_inode_stable(struct inode_s *inode)
+{
+    unsigned char level=__atomic_load_n(&inode->timeout, __ATOMIC_RELAXED);
+    if (level < INODE_TIMEOUT_MAX) __atomic_store_n(&inode->timeout, level + 1, __ATOMIC_RELAXED);
+}
 
-    pthread_mutex_unlock(&inode_table_mutex);
-    return inode;
+struct inode_s *find_inode(ino_t ino)
+{
+    struct inode_s *inode=lookup_inode_hashtable((uint64_t) ino);
 
+    if (inode) touch_inode(inode);
+    return inode;
 }
 
-static void inode_2delete_thread(void *ptr)
+/*
+    free inodes which are taken out of the directory and the inode table (unhashed)
+    lookups may still be looking at them: one grace period for all, then free them with their entry
+*/
+
+static void free_unhashed_inodes(struct inode_s **inodes, unsigned int count)
 {
-    struct inode_2delete_s *i2d=NULL;
-    size_t hash=0;
-    struct inode_s *inode=NULL;
 
-    geti2d:
+    if (count==0) return;
+    wait_inode_hashtable_grace();
 
-    pthread_mutex_lock(&inode_2delete_mutex);
+    for (unsigned int i=0; i<count; i++) {
+	struct inode_s *inode=inodes[i];
+	struct entry_s *entry=inode->alias;
 
-    if (inode_2delete_list) {
+	/* call the inode specific forget which will also release the attached data */
 
-	i2d=inode_2delete_list;
-	inode_2delete_list=i2d->next;
+	(* inode->fs->forget)(inode);
 
-    } else {
-
-	inode_2delete_threadid=0;
-	pthread_mutex_unlock(&inode_2delete_mutex);
-	return;
+	entry->inode=NULL;
+	inode->alias=NULL;
+	destroy_entry(entry);
+	free_inode(inode);
 
     }
 
-    pthread_mutex_unlock(&inode_2delete_mutex);
+}
+
+/*
+    what a forget does with an inode, after its lookup count has been lowered:
+    take the entry out of the directory, tell the VFS when the inode is deleted remote, and when the VFS
+    does not know the inode anymore take it out of the inode table
+    returns 1 when the inode is to be freed (by the caller, after a grace period), 0 otherwise
+*/
+
+static unsigned char forget_inode(struct inode_s *inode, struct inode_2forget_s *i2f)
+{
+    struct entry_s *entry=inode->alias;
+    struct entry_s *parent=(entry) ? entry->parent : NULL;
 
-    hash=i2d->ino % SIZE_INODE_HASHTABLE;
+    if (parent) {
+	unsigned int error=0;
+	struct simple_lock_s wlock;
+	struct directory_s *directory=get_directory(parent->inode, &error);
 
-    pthread_mutex_lock(&inode_table_mutex);
-    inode=inode_hash_table[hash];
+	/* remove entry from directory */
 
-    while (inode) {
+	if (wlock_directory(directory, &wlock)==0) {
 
-	if (inode->st.st_ino==i2d->ino) {
-	    struct entry_s *entry=inode->alias;
-	    struct entry_s *parent=(entry) ? entry->parent : NULL;
+	    remove_entry_batch(directory, entry, &error);
+	    unlock_directory(directory, &wlock);
 
-	    if (i2d->flags & FORGET_INODE_FLAG_FORGET) {
+	}
 
-		if (inode->nlookup<=i2d->forget) {
+	entry->parent=NULL;
 
-		    inode->nlookup=0;
+    }
 
-		} else {
+    if ((i2f->flags & FORGET_INODE_FLAG_DELETED) && (inode->flags & INODE_FLAG_DELETED)==0) {
+	struct simple_lock_s rlock;
+	struct service_context_s *context=NULL;
 
-		    inode->nlookup-=i2d->forget;
+	/* inform VFS, only when the VFS is not the initiator  */
 
-		}
+	logoutput("forget_inode: remote deleted ino %lli name %s", i2f->ino, (entry) ? entry->name.name : "-UNKNOWN-");
 
-	    }
+	init_rlock_service_context_hash(&rlock);
+	lock_service_context_hash(&rlock);
+	context=search_service_context(i2f->unique);
+
+	if (context) {
+	    struct service_context_s *root=get_root_context(context);
 
 	    if (parent) {
-		unsigned int error=0;
-		struct simple_lock_s wlock;
-		struct directory_s *directory=get_directory(parent->inode, &error);
 
-		/* remove entry from directory */
+		notify_VFS_delete(root->interface.ptr, parent->inode->st.st_ino, inode->st.st_ino, entry->name.name, entry->name.len);
 
-		if (wlock_directory(directory, &wlock)==0) {
+	    } else if (entry) {
 
-		    remove_entry_batch(directory, entry, &error);
-		    unlock_directory(directory, &wlock);
+		notify_VFS_delete(root->interface.ptr, 0, inode->st.st_ino, entry->name.name, entry->name.len);
 
-		}
+	    } else {
 
-		entry->parent=NULL;
+		notify_VFS_delete(root->interface.ptr, 0, inode->st.st_ino, NULL, 0);
 
 	    }
 
-	    if ((i2d->flags & FORGET_INODE_FLAG_DELETED) && (inode->flags & INODE_FLAG_DELETED)==0) {
-		struct simple_lock_s rlock;
-		struct service_context_s *context=NULL;
+	    unlock_service_context_hash(&rlock);
 
-		/* inform VFS, only when the VFS is not the initiator  */
+	}
 
-		logoutput("inode_2delete_thread: remote deleted ino %lli name %s", i2d->ino, (entry) ? entry->name.name : "-UNKNOWN-");
+	inode->flags|=INODE_FLAG_DELETED;
 
-		init_rlock_service_context_hash(&rlock);
-		lock_service_context_hash(&rlock);
-		context=search_service_context(i2d->unique);
+    }
 
-		if (context) {
-		    struct service_context_s *root=get_root_context(context);
+    /* only when lookup count becomes zero remove it foregood */
 
-		    if (parent) {
+    if (__atomic_load_n(&inode->nlookup, __ATOMIC_ACQUIRE)==0) {
 
-			notify_VFS_delete(root->interface.ptr, parent->inode->st.st_ino, inode->st.st_ino, entry->name.name, entry->name.len);
+	logoutput("forget_inode: forget inode ino %lli name %s", i2f->ino, (entry) ? entry->name.name : "-UNKNOWN-");
 
-		    } else if (entry) {
+	if (inode->flags & INODE_FLAG_HASHED) {
 
-			notify_VFS_delete(root->interface.ptr, 0, inode->st.st_ino, entry->name.name, entry->name.len);
+	    remove_inode_hashtable(inode);
+	    inode->flags-=INODE_FLAG_HASHED;
 
-		    } else {
+	}
 
-			notify_VFS_delete(root->interface.ptr, 0, inode->st.st_ino, NULL, 0);
+	return 1;
 
-		    }
+    }
 
-		    unlock_service_context_hash(&rlock);
+    return 0;
 
-		}
+}
 
-		inode->flags|=INODE_FLAG_DELETED;
+/* sort forgets by shard of the inode table and by ino, so forgets of the same ino are next to each other */
 
-	    }
+static int compare_forget_shard(const void *a, const void *b)
+{
+    struct inode_2forget_s *i2fa=*((struct inode_2forget_s **) a);
+    struct inode_2forget_s *i2fb=*((struct inode_2forget_s **) b);
+    unsigned int shard_a=(unsigned int) (i2fa->ino % INODE_HASHTABLE_SHARDS);
+    unsigned int shard_b=(unsigned int) (i2fb->ino % INODE_HASHTABLE_SHARDS);
+
+    if (shard_a != shard_b) return (shard_a < shard_b) ? -1 : 1;
+    if (i2fa->ino != i2fb->ino) return (i2fa->ino < i2fb->ino) ? -1 : 1;
+    return (i2fa < i2fb) ? -1 : 1;
+}
 
-	    /* only when lookup count becomes zero remove it foregood */
+/*
+    process a batch of forgets:
+    first lower the lookup counts, sorted by shard so the inodes are looked up one shard after the other, with
+    the forgets of the same ino added up in the first of them
+    then do the rest in the order the forgets were queued, once for every ino
+*/
 
-	    if (inode->nlookup==0) {
+static void process_forget_batch(struct inode_2forget_s *batch, unsigned int count)
+{
+    struct inode_2forget_s *sorted[FORGET_RING_BATCH];
+    struct inode_2forget_s *first[FORGET_RING_BATCH];
+    uint64_t inos[FORGET_RING_BATCH];
+    struct inode_s *inodes[FORGET_RING_BATCH];
+    unsigned int nr=0;
 
-		logoutput("inode_2delete_thread: forget inode ino %lli name %s", i2d->ino, (entry) ? entry->name.name : "-UNKNOWN-");
+    for (unsigned int i=0; i<count; i++) {
 
-		if (inode->flags & INODE_FLAG_HASHED) {
-		    struct inode_s *next=inode->id_next;
-		    struct inode_s *prev=inode->id_prev;
+	sorted[i]=&batch[i];
+	batch[i].inode=NULL;
+	if ((batch[i].flags & FORGET_INODE_FLAG_FORGET)==0) batch[i].forget=0;
 
-		    if (next) next->id_prev=prev;
-		    if (prev) {
+    }
 
-			prev->id_next=next;
+    qsort(sorted, count, sizeof(struct inode_2forget_s *), compare_forget_shard);
 
-		    } else {
+    /* the first of a run of the same ino is the first queued (the sort keeps the order of the queue) */
 
-			inode_hash_table[hash]=next;
+    for (unsigned int i=0; i<count; i++) {
+	struct inode_2forget_s *i2f=sorted[i];
 
-		    }
+	if (nr>0 && first[nr-1]->ino==i2f->ino) {
 
-		    inode->id_next=NULL;
-		    inode->id_prev=NULL;
-		    inode->flags-=INODE_FLAG_HASHED;
+	    first[nr-1]->forget+=i2f->forget;
+	    first[nr-1]->flags|=i2f->flags;
+	    continue;
 
-		}
+	}
+
+	first[nr]=i2f;
+	inos[nr]=(uint64_t) i2f->ino;
+	nr++;
 
-		/* call the inode specific forget which will also release the attached data */
+    }
 
-		(* inode->fs->forget)(inode);
+    lookup_inode_hashtable_batch(inos, inodes, nr);
 
-		entry->inode=NULL;
-		inode->alias=NULL;
-		destroy_entry(entry);
-		free_inode(inode);
+    for (unsigned int j=0; j<nr; j++) {
+	struct inode_s *inode=inodes[j];
 
-	    }
+	if (inode==NULL) continue;
+
+	if (first[j]->flags & FORGET_INODE_FLAG_FORGET) {
+	    uint64_t nlookup=__atomic_load_n(&inode->nlookup, __ATOMIC_RELAXED);
+	    uint64_t forget=0;
+
+	    /* lookups may add to it at the same time: lower it in one step, never below zero */
+
+	    do {
 
-	    break;
+		forget=(nlookup<=first[j]->forget) ? nlookup : first[j]->forget;
+
+	    } while (__atomic_compare_exchange_n(&inode->nlookup, &nlookup, nlookup - forget, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)==0);
 
 	}
 
-	inode=inode->id_next;
+	first[j]->inode=inode;
 
     }
 
-    pthread_mutex_unlock(&inode_table_mutex);
-    free(i2d);
-    i2d=NULL;
+    /* inodes is not used anymore for the lookup: collect the inodes to free in it */
+
+    nr=0;
+
+    for (unsigned int i=0; i<count; i++) {
+
+	if (batch[i].inode && forget_inode(batch[i].inode, &batch[i])==1) inodes[nr++]=batch[i].inode;
+
+    }
 
-    goto geti2d;
+    free_unhashed_inodes(inodes, nr);
 
 }
 
+static void init_forget_ring()
+{
+
+    for (uint64_t i=0; i<FORGET_RING_SIZE; i++) {
+
+	memset(&forget_ring[i], 0, sizeof(struct inode_2forget_s));
+	forget_ring[i].seq=i;
+
+    }
+
+}
+
+/*
+    take the published items from the head of the ring, at most max
+    work with a cb (like evict_inodes) is taken alone: it may free inodes a batch of forgets is looking at
+*/
+
+static unsigned int take_forget_ring(struct inode_2forget_s *batch, unsigned int max)
+{
+    unsigned int count=0;
+
+    while (count<max) {
+	uint64_t head=forget_ring_head;
+	struct inode_2forget_s *i2f=&forget_ring[head & (FORGET_RING_SIZE - 1)];
+
+	if (__atomic_load_n(&i2f->seq, __ATOMIC_ACQUIRE) != head + 1) break;
+	if (i2f->cb && count>0) break;
+
+	memcpy(&batch[count], i2f, sizeof(struct inode_2forget_s));
+	count++;
+
+	/* give the slot back to the producers, one round further */
+
+	__atomic_store_n(&forget_ring_head, head + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&i2f->seq, head + FORGET_RING_SIZE, __ATOMIC_RELEASE);
+
+	if (batch[count-1].cb) break;
+
+    }
+
+    return count;
+
+}
+
+static void inode_2forget_thread(void *ptr)
+{
+    struct inode_2forget_s batch[FORGET_RING_BATCH];
+    unsigned int count=0;
+
+    getbatch:
+
+    count=take_forget_ring(batch, FORGET_RING_BATCH);
+
+    if (count==0) {
+	uint64_t head=forget_ring_head;
+
+	__atomic_store_n(&forget_thread_running, 0, __ATOMIC_SEQ_CST);
+
+	/* a producer may have published just before, and have seen this thread still running */
+
+	if (__atomic_load_n(&forget_ring[head & (FORGET_RING_SIZE - 1)].seq, __ATOMIC_SEQ_CST) != head + 1) return;
+	if (__atomic_exchange_n(&forget_thread_running, 1, __ATOMIC_SEQ_CST)==1) return;
+	goto getbatch;
+
+    }
+
+    if (batch[0].cb) {
+
+	(* batch[0].cb)(batch[0].ptr);
+
+    } else {
+
+	process_forget_batch(batch, count);
+
+    }
+
+    goto getbatch;
+
+}
+
+static void start_forget_thread()
+{
+
+    if (__atomic_load_n(&forget_thread_running, __ATOMIC_SEQ_CST)==0 && __atomic_exchange_n(&forget_thread_running, 1, __ATOMIC_SEQ_CST)==0) {
+	unsigned int error=0;
+
+	work_workerthread(NULL, 0, inode_2forget_thread, NULL, &error);
+
+    }
+
+}
+
+/*
+    reserve count positions in the ring, the slots are free when the forget thread has taken the items
+    of the previous round
+*/
+
+static uint64_t reserve_forget_ring(unsigned int count)
+{
+    pthread_once(&forget_ring_once, init_forget_ring);
+    return __atomic_fetch_add(&forget_ring_tail, count, __ATOMIC_RELAXED);
+}
+
+static struct inode_2forget_s *get_forget_slot(uint64_t pos)
+{
+    struct inode_2forget_s *i2f=&forget_ring[pos & (FORGET_RING_SIZE - 1)];
+
+    /* ring full: wait for the forget thread, and make sure it's running */
+
+    while (__atomic_load_n(&i2f->seq, __ATOMIC_ACQUIRE) != pos) {
+
+	start_forget_thread();
+	sched_yield();
+
+    }
+
+    return i2f;
+
+}
+
+static void publish_forget_slot(struct inode_2forget_s *i2f, uint64_t pos)
+{
+    __atomic_store_n(&i2f->seq, pos + 1, __ATOMIC_SEQ_CST);
+}
+
 void queue_inode_2forget(ino_t ino, dev_t dev, unsigned int flags, uint64_t forget)
 {
-    struct inode_2delete_s *i2d=NULL;
+    uint64_t pos=reserve_forget_ring(1);
+    struct inode_2forget_s *i2f=get_forget_slot(pos);
+
+    i2f->ino=ino;
+    i2f->unique=dev;
+    i2f->flags=flags;
+    i2f->forget=forget;
+    i2f->cb=NULL;
+    i2f->ptr=NULL;
+
+    publish_forget_slot(i2f, pos);
+    start_forget_thread();
+
+}
+
+/* queue the forgets of a FORGET_MULTI, with one reservation per part of half the ring */
+
+void queue_inodes_2forget(struct fuse_forget_one *forgets, unsigned int count, dev_t dev)
+{
+
+    while (count>0) {
+	unsigned int part=(count > FORGET_RING_SIZE / 2) ? FORGET_RING_SIZE / 2 : count;
+	uint64_t pos=reserve_forget_ring(part);
+
+	for (unsigned int i=0; i<part; i++) {
+	    struct inode_2forget_s *i2f=get_forget_slot(pos + i);
+
+	    i2f->ino=(ino_t) forgets[i].nodeid;
+	    i2f->unique=dev;
+	    i2f->flags=FORGET_INODE_FLAG_FORGET;
+	    i2f->forget=forgets[i].nlookup;
+	    i2f->cb=NULL;
+	    i2f->ptr=NULL;
+
+	    publish_forget_slot(i2f, pos + i);
+
+	}
+
+	start_forget_thread();
+	forgets+=part;
+	count-=part;
+
+    }
+
+}
+
+/* run cb in the thread which forgets inodes, so it does not race with forgets (like evict_inodes) */
+
+int queue_inode_2forget_cb(void (* cb)(void *ptr), void *ptr)
+{
+    uint64_t pos=reserve_forget_ring(1);
+    struct inode_2forget_s *i2f=get_forget_slot(pos);
 
-    logoutput("queue_inode_2forget: ino %lli forget %lli", ino, forget);
+    i2f->ino=0;
+    i2f->unique=0;
+    i2f->flags=0;
+    i2f->forget=0;
+    i2f->cb=cb;
+    i2f->ptr=ptr;
 
-    i2d=malloc(sizeof(struct inode_2delete_s));
+    publish_forget_slot(i2f, pos);
+    start_forget_thread();
+    return 0;
 
-    if (i2d) {
+}
 
-	i2d->ino=ino;
-	i2d->unique=dev;
-	i2d->flags=flags;
-	i2d->forget=forget;
+/*
+    an inode can be evicted when the VFS does not know it (nlookup is zero), it has no open handles, it has not
+    been used since the sweep selected it, and it's not a directory with its own directory of entries
+*/
 
-	pthread_mutex_lock(&inode_2delete_mutex);
-	i2d->next=inode_2delete_list;
-	inode_2delete_list=i2d;
+static unsigned char check_inode_evictable(struct inode_s *inode)
+{
+    struct entry_s *entry=inode->alias;
 
-	if (inode_2delete_threadid==0) {
-	    unsigned int error=0;
+    if (__atomic_load_n(&inode->nlookup, __ATOMIC_ACQUIRE)>0 || __atomic_load_n(&inode->nopen, __ATOMIC_ACQUIRE)>0) return 0;
+    if (__atomic_load_n(&inode->clock, __ATOMIC_RELAXED)>0) return 0;
+    if ((inode->flags & INODE_FLAG_HASHED)==0 || entry==NULL || entry->parent==NULL) return 0;
 
-	    inode_2delete_threadid=1;
-	    work_workerthread(NULL, 0, inode_2delete_thread, NULL, &error);
+    if (S_ISDIR(inode->st.st_mode)) {
+	struct directory_s *directory=get_directory_dump(inode);
+
+	if (directory && directory!=get_dummy_directory()) return 0;
+
+    }
+
+    return 1;
+
+}
+
+/*
+    remove unused inodes with their entries from the cache, like a forget does
+    call this only in the thread which forgets inodes (see queue_inode_2forget_cb)
+    the inodes are removed from the table in batches, and a batch is freed after one grace period
+    returns the number of inodes evicted
+*/
+
+#define EVICT_INODES_BATCH					64
+
+unsigned int evict_inodes(uint64_t *inos, unsigned int count)
+{
+    struct inode_s *evicted[EVICT_INODES_BATCH];
+    unsigned int total=0;
+    unsigned int i=0;
+
+    while (i<count) {
+	unsigned int nr=0;
+
+	for (; i<count && nr<EVICT_INODES_BATCH; i++) {
+	    struct inode_s *inode=lookup_inode_hashtable(inos[i]);
+	    struct entry_s *entry=NULL;
+	    struct directory_s *directory=NULL;
+	    struct simple_lock_s wlock;
+
+	    if (inode==NULL || check_inode_evictable(inode)==0) continue;
+
+	    entry=inode->alias;
+	    directory=get_directory_dump(entry->parent->inode);
+	    if (directory==NULL || directory==get_dummy_directory()) continue;
+
+	    if (wlock_directory(directory, &wlock)==0) {
+
+		/* look again with the directory locked: a lookup may just have found it */
+
+		if (check_inode_evictable(inode)==1) {
+		    unsigned int error=0;
+
+		    remove_entry_batch(directory, entry, &error);
+
+		    if (error==0) {
+
+			entry->parent=NULL;
+			remove_inode_hashtable(inode);
+			inode->flags-=INODE_FLAG_HASHED;
+			evicted[nr++]=inode;
+
+		    }
+
+		}
+
+		unlock_directory(directory, &wlock);
+
+	    }
 
 	}
 
-	pthread_mutex_unlock(&inode_2delete_mutex);
+	free_unhashed_inodes(evicted, nr);
+	total+=nr;
 
     }
 
+    return total;
+
 }
 
 void log_inode_information(struct inode_s *inode, uint64_t what)
@@ -47,7 +47,13 @@
 #define INODE_FLAG_DELETED					4
 #define INODE_FLAG_REMOVED					8
 
+#define INODE_TIMEOUT_CHANGED					0		/* level of an inode which just changed */
+#define INODE_TIMEOUT_INIT					2		/* level of a new inode: the timeout of the mount */
+#define INODE_TIMEOUT_MAX					8
+
 #include "skiplist.h"
+#include "fuse-inode-hashtable.h"
+#include "slab-cache.h"
 
 union datalink_u {
     void				*ptr;
@@ -59,24 +65,75 @@ struct inode_link_s {
     union datalink_u			link;
 };
 
+/*
+    compact attributes of an inode
+
+    a struct stat is 144 bytes, most of it the same for every inode or not used: the inode only keeps
+    what's needed, with the names of struct stat so code reads the same
+    a time is 12 bytes (a struct timespec is 16), use get_inode_time and set_inode_time to convert
+    st_rdev is only kept (in a seperate struct) for the few inodes which have one
+    get_inode_stat builds a full struct stat
+*/
+
+struct inode_time_s {
+    int64_t				tv_sec;
+    uint32_t				tv_nsec;
+} __attribute__((packed));
+
+struct inode_attr_s {
+    uint64_t				st_ino;
+    uint64_t				st_size;
+    dev_t				st_dev;
+    uint32_t				st_mode;
+    uint32_t				st_nlink;
+    uint32_t				st_uid;
+    uint32_t				st_gid;
+    struct inode_time_s			st_atim;
+    struct inode_time_s			st_mtim;
+    struct inode_time_s			st_ctim;
+};
+
+struct inode_attr_rare_s {
+    dev_t				st_rdev;
+};
+
+/*
+    clock is the referenced bit of the approximate LRU (see workspace-eviction.c): set when the inode is looked up,
+    cleared by the sweep
+    timeout is the level of the attribute and entry timeouts given to the VFS: reset when the inode is seen changing,
+    one higher every time the backend reports the same attributes again (see get_fuse_interface_timeouts)
+    nopen is the number of open handles (files and directories) on the inode, an inode with handles is never evicted
+    cachegen is the generation of the data in the block cache, one higher with every change of the data (see fuse-block-cache.h)
+*/
+
 struct inode_s {
     unsigned char			flags;
+    unsigned char			clock;
+    unsigned char			timeout;
+    uint32_t				nopen;
+    uint32_t				cachegen;
     uint64_t				nlookup;
-    struct inode_s 			*id_next;
-    struct inode_s 			*id_prev;
     struct entry_s 			*alias;
-    struct stat				st;
-    struct timespec			stim;
+    struct inode_attr_s			st;
+    struct inode_time_s			stim;
+    struct inode_attr_rare_s		*rare;
     struct fuse_fs_s			*fs;
     struct inode_link_s			link;
     unsigned int			cache_size;
     char				cache[];
 };
 
+/*
+    index holds the first 8 bytes of the name, hash the hash of the full name (see calculate_nameindex)
+    a directory keeps its entries in the order of compare_entry_name: index, hash, length, then the bytes
+    so readdir lists names alphabetical on the first 8 bytes only, names sharing those come in hash order
+*/
+
 struct name_s {
     char 				*name;
     size_t				len;
     unsigned long long			index;
+    uint32_t				hash;
 };
 
 /*
@@ -94,31 +151,65 @@ struct entry_s {
     unsigned char			flags;
 };
 
+#define DENTRY_SLABS_NAMEMIN					16
+#define DENTRY_SLABS_NAMECLASSES				5		/* 16, 32, 64, 128 and 256 bytes */
+#define DENTRY_SLABS_INODECLASSES				3
+
+struct dentry_slabs_s {
+    struct slab_cache_s			entries;
+    struct slab_cache_s			directories;
+    struct slab_cache_s			inodes[DENTRY_SLABS_INODECLASSES];
+    struct slab_cache_s			names[DENTRY_SLABS_NAMECLASSES];
+    void				*data;
+    void				(* cb_inode_freed)(void *data);
+};
+
 // Prototypes
 
 void calculate_nameindex(struct name_s *name);
 
 int init_hashtables();
 
-int init_inode_hashtable(unsigned int *error);
-void free_inode_hashtable();
+struct dentry_slabs_s *get_default_dentry_slabs();
+struct dentry_slabs_s *create_dentry_slabs(void *data, void (* cb_inode_freed)(void *data), unsigned int *error);
+void free_dentry_slabs(struct dentry_slabs_s *slabs);
+uint64_t get_dentry_slabs_memory(struct dentry_slabs_s *slabs);
+uint64_t get_dentry_slabs_resident(struct dentry_slabs_s *slabs);
+struct dentry_slabs_s *get_entry_slabs(struct entry_s *entry);
 
 void init_entry(struct entry_s *entry);
+struct entry_s *create_entry_slabs(struct dentry_slabs_s *slabs, struct entry_s *parent, struct name_s *xname);
 struct entry_s *create_entry(struct entry_s *parent, struct name_s *xname);
 void destroy_entry(struct entry_s *entry);
 void rename_entry(struct entry_s *entry, char **name, unsigned int len);
 
 void init_inode(struct inode_s *inode);
+struct inode_s *create_inode_slabs(struct dentry_slabs_s *slabs, unsigned int s);
 struct inode_s *create_inode(unsigned int s);
+void free_inode(struct inode_s *inode);
 void add_inode_hashtable(struct inode_s *inode, void (*cb) (void *data), void *data);
 
 void fill_inode_stat(struct inode_s *inode, struct stat *st);
 void get_inode_stat(struct inode_s *inode, struct stat *st);
 
+void get_inode_time(struct inode_time_s *time, struct timespec *ts);
+void set_inode_time(struct inode_time_s *time, struct timespec *ts);
+dev_t get_inode_rdev(struct inode_s *inode);
+int set_inode_rdev(struct inode_s *inode, dev_t rdev);
+
 struct inode_s *realloc_inode(struct inode_s *inode, unsigned int new);
 
 struct inode_s *find_inode(uint64_t ino);
+struct fuse_forget_one;
+
 void queue_inode_2forget(ino_t ino, dev_t dev, unsigned int flags, uint64_t forget);
+void queue_inodes_2forget(struct fuse_forget_one *forgets, unsigned int count, dev_t dev);
+int queue_inode_2forget_cb(void (* cb)(void *ptr), void *ptr);
+
+void touch_inode(struct inode_s *inode);
+void mark_inode_changed(struct inode_s *inode);
+void mark_inode_stable(struct inode_s *inode);
+unsigned int evict_inodes(uint64_t *inos, unsigned int count);
 
 #define INODE_INFORMATION_OWNER						(1 << 0)
 #define INODE_INFORMATION_GROUP						(1 << 1)
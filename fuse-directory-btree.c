@@ -0,0 +1,704 @@
+/*
+  2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017 Stef Bon <stefbon@gmail.com>
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include "global-defines.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+
+#include <inttypes.h>
+#include <ctype.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "logging.h"
+
+#include "skiplist.h"
+#include "simple-locking.h"
+#include "fuse-dentry.h"
+#include "fuse-directory.h"
+#include "fuse-directory-btree.h"
+
+static struct directory_btree_node_s *create_btree_node(unsigned char leaf)
+{
+    size_t size=sizeof(struct directory_btree_node_s) + ((leaf) ? 0 : DIRECTORY_BTREE_FANOUT * sizeof(struct directory_btree_node_s *));
+    struct directory_btree_node_s *node=malloc(size);
+
+    if (node) {
+
+	memset(node, 0, size);
+	node->leaf=leaf;
+
+    }
+
+    return node;
+
+}
+
+static void free_btree_node(struct directory_btree_node_s *node)
+{
+
+    if (node->leaf==0) {
+
+	for (unsigned short i=0; i<node->count; i++) free_btree_node(node->child[i]);
+
+    }
+
+    free(node);
+
+}
+
+/* number of keys in the node smaller than or equal to name */
+
+static unsigned short search_btree_node(struct directory_btree_node_s *node, struct name_s *name)
+{
+    unsigned short lo=0;
+    unsigned short hi=node->count;
+
+    while (lo<hi) {
+	unsigned short mid=(lo + hi) / 2;
+	int diff=0;
+
+	/* only look at the entry itself when the indices are the same */
+
+	if (node->index[mid] < name->index) {
+
+	    diff=-1;
+
+	} else if (node->index[mid] > name->index) {
+
+	    diff=1;
+
+	} else {
+
+	    diff=compare_entry_name(node->entry[mid], name);
+
+	}
+
+	if (diff<=0) {
+
+	    lo=mid+1;
+
+	} else {
+
+	    hi=mid;
+
+	}
+
+    }
+
+    return lo;
+
+}
+
+static void insert_btree_slot(struct directory_btree_node_s *node, unsigned short pos, struct entry_s *entry, struct directory_btree_node_s *child)
+{
+    unsigned short move=node->count - pos;
+
+    memmove(&node->index[pos + 1], &node->index[pos], move * sizeof(unsigned long long));
+    memmove(&node->entry[pos + 1], &node->entry[pos], move * sizeof(struct entry_s *));
+    if (node->leaf==0) memmove(&node->child[pos + 1], &node->child[pos], move * sizeof(struct directory_btree_node_s *));
+
+    node->index[pos]=entry->name.index;
+    node->entry[pos]=entry;
+    if (node->leaf==0) node->child[pos]=child;
+    node->count++;
+
+}
+
+static void remove_btree_slot(struct directory_btree_node_s *node, unsigned short pos)
+{
+    unsigned short move=node->count - pos - 1;
+
+    memmove(&node->index[pos], &node->index[pos + 1], move * sizeof(unsigned long long));
+    memmove(&node->entry[pos], &node->entry[pos + 1], move * sizeof(struct entry_s *));
+    if (node->leaf==0) memmove(&node->child[pos], &node->child[pos + 1], move * sizeof(struct directory_btree_node_s *));
+    node->count--;
+
+}
+
+/* split a full node in two halves, returns the right half */
+
+static struct directory_btree_node_s *split_btree_node(struct directory_btree_node_s *node)
+{
+    struct directory_btree_node_s *right=create_btree_node(node->leaf);
+
+    if (right) {
+	unsigned short half=node->count / 2;
+	unsigned short move=node->count - half;
+
+	memcpy(right->index, &node->index[half], move * sizeof(unsigned long long));
+	memcpy(right->entry, &node->entry[half], move * sizeof(struct entry_s *));
+	if (node->leaf==0) memcpy(right->child, &node->child[half], move * sizeof(struct directory_btree_node_s *));
+
+	right->count=move;
+	node->count=half;
+
+    }
+
+    return right;
+
+}
+
+/* merge child pos + 1 into child pos */
+
+static void merge_btree_nodes(struct directory_btree_node_s *node, unsigned short pos)
+{
+    struct directory_btree_node_s *left=node->child[pos];
+    struct directory_btree_node_s *right=node->child[pos + 1];
+
+    memcpy(&left->index[left->count], right->index, right->count * sizeof(unsigned long long));
+    memcpy(&left->entry[left->count], right->entry, right->count * sizeof(struct entry_s *));
+    if (left->leaf==0) memcpy(&left->child[left->count], right->child, right->count * sizeof(struct directory_btree_node_s *));
+
+    left->count+=right->count;
+    free(right);
+    remove_btree_slot(node, pos + 1);
+
+}
+
+struct directory_btree_s *create_directory_btree(unsigned int *error)
+{
+    struct directory_btree_s *btree=malloc(sizeof(struct directory_btree_s));
+
+    if (btree) {
+
+	btree->root=create_btree_node(1);
+	btree->height=1;
+
+	if (btree->root) return btree;
+	free(btree);
+
+    }
+
+    *error=ENOMEM;
+    return NULL;
+
+}
+
+void free_directory_btree(struct directory_btree_s *btree)
+{
+    if (btree==NULL) return;
+    free_btree_node(btree->root);
+    free(btree);
+}
+
+struct entry_s *find_entry_btree_batch(struct directory_s *directory, struct name_s *xname, unsigned int *error)
+{
+    struct directory_btree_node_s *node=directory->btree->root;
+    unsigned short pos=0;
+
+    while (node->leaf==0) {
+
+	pos=search_btree_node(node, xname);
+	node=node->child[(pos>0) ? pos - 1 : 0];
+
+    }
+
+    pos=search_btree_node(node, xname);
+
+    if (pos>0 && compare_entry_name(node->entry[pos - 1], xname)==0) {
+
+	*error=0;
+	return node->entry[pos - 1];
+
+    }
+
+    *error=ENOENT;
+    return NULL;
+
+}
+
+/*
+    insert an entry
+    full nodes are split on the way down, so there is always room in the parent for a new half
+    and nothing has to be undone when an allocation fails
+*/
+
+struct entry_s *insert_entry_btree_batch(struct directory_s *directory, struct entry_s *entry, unsigned int *error, unsigned short flags)
+{
+    struct directory_btree_s *btree=directory->btree;
+    struct skiplist_struct *sl=&directory->skiplist;
+    struct directory_btree_node_s *node=btree->root;
+    struct directory_btree_node_s *right=NULL;
+    unsigned short pos=0;
+
+    if (node->count==DIRECTORY_BTREE_FANOUT) {
+	struct directory_btree_node_s *root=create_btree_node(0);
+
+	if (root==NULL) goto error;
+	right=split_btree_node(node);
+
+	if (right==NULL) {
+
+	    free(root);
+	    goto error;
+
+	}
+
+	insert_btree_slot(root, 0, node->entry[0], node);
+	insert_btree_slot(root, 1, right->entry[0], right);
+
+	btree->root=root;
+	btree->height++;
+	node=root;
+
+    }
+
+    while (node->leaf==0) {
+	struct directory_btree_node_s *child=NULL;
+
+	pos=search_btree_node(node, &entry->name);
+	if (pos>0) pos--;
+	child=node->child[pos];
+
+	if (child->count==DIRECTORY_BTREE_FANOUT) {
+
+	    right=split_btree_node(child);
+	    if (right==NULL) goto error;
+	    insert_btree_slot(node, pos + 1, right->entry[0], right);
+	    if (compare_entry_name(right->entry[0], &entry->name)<=0) child=right;
+
+	}
+
+	node=child;
+
+    }
+
+    pos=search_btree_node(node, &entry->name);
+
+    if (pos>0 && compare_entry_name(node->entry[pos - 1], &entry->name)==0) {
+
+	*error=EEXIST;
+	return node->entry[pos - 1];
+
+    }
+
+    /* maintain the ordered list of entries, only the leftmost leaf can get a new first key */
+
+    if (pos>0) {
+
+	sl->ops.insert_after((void *) entry, (void *) node->entry[pos - 1], sl);
+
+    } else if (node->count>0) {
+
+	sl->ops.insert_before((void *) entry, (void *) node->entry[0], sl);
+
+    } else {
+
+	sl->ops.insert_after((void *) entry, NULL, sl);
+
+    }
+
+    insert_btree_slot(node, pos, entry, NULL);
+
+    if (pos==0) {
+
+	/* a new smallest entry: correct the keys on the leftmost path */
+
+	for (node=btree->root; node->leaf==0; node=node->child[0]) {
+
+	    node->index[0]=entry->name.index;
+	    node->entry[0]=entry;
+
+	}
+
+    }
+
+    *error=0;
+    return entry;
+
+    error:
+
+    *error=ENOMEM;
+    return NULL;
+
+}
+
+static struct entry_s *remove_btree_node(struct skiplist_struct *sl, struct directory_btree_node_s *node, struct name_s *xname, unsigned int *error)
+{
+    unsigned short pos=search_btree_node(node, xname);
+    struct directory_btree_node_s *child=NULL;
+    struct entry_s *entry=NULL;
+
+    if (pos==0) {
+
+	*error=ENOENT;
+	return NULL;
+
+    }
+
+    pos--;
+
+    if (node->leaf) {
+
+	if (compare_entry_name(node->entry[pos], xname)!=0) {
+
+	    *error=ENOENT;
+	    return NULL;
+
+	}
+
+	entry=node->entry[pos];
+	remove_btree_slot(node, pos);
+	sl->ops.delete((void *) entry, sl);
+
+	*error=0;
+	return entry;
+
+    }
+
+    child=node->child[pos];
+    entry=remove_btree_node(sl, child, xname, error);
+    if (entry==NULL) return NULL;
+
+    if (child->count==0) {
+
+	free(child);
+	remove_btree_slot(node, pos);
+
+    } else {
+
+	/* the smallest entry of the child may have been removed */
+
+	node->index[pos]=child->index[0];
+	node->entry[pos]=child->entry[0];
+
+	/* keep the nodes dense: merge with a neighbour when both fit in half a node */
+
+	if (child->count < DIRECTORY_BTREE_FANOUT / 4) {
+
+	    if (pos + 1 < node->count && child->count + node->child[pos + 1]->count <= DIRECTORY_BTREE_FANOUT / 2) {
+
+		merge_btree_nodes(node, pos);
+
+	    } else if (pos>0 && node->child[pos - 1]->count + child->count <= DIRECTORY_BTREE_FANOUT / 2) {
+
+		merge_btree_nodes(node, pos - 1);
+
+	    }
+
+	}
+
+    }
+
+    return entry;
+
+}
+
+void remove_entry_btree_batch(struct directory_s *directory, struct entry_s *entry, unsigned int *error)
+{
+    struct directory_btree_s *btree=directory->btree;
+
+    remove_btree_node(&directory->skiplist, btree->root, &entry->name, error);
+
+    /* remove levels with only one child */
+
+    while (btree->root->leaf==0 && btree->root->count==1) {
+	struct directory_btree_node_s *root=btree->root;
+
+	btree->root=root->child[0];
+	btree->height--;
+	free(root);
+
+    }
+
+}
+
+/*
+    build a btree bottom up from a sorted array of entries
+    the nodes are filled for three quarters (evenly spread) to leave room for later inserts
+*/
+
+static struct directory_btree_node_s *build_btree_nodes(struct entry_s **entries, unsigned int count, unsigned short *height)
+{
+    unsigned int fill=(DIRECTORY_BTREE_FANOUT * 3) / 4;
+    unsigned int nodes=(count + fill - 1) / fill;
+    struct directory_btree_node_s **level=NULL;
+    struct directory_btree_node_s *root=NULL;
+
+    *height=1;
+    if (nodes<=1) {
+
+	root=create_btree_node(1);
+
+	if (root) {
+
+	    for (unsigned int i=0; i<count; i++) insert_btree_slot(root, i, entries[i], NULL);
+
+	}
+
+	return root;
+
+    }
+
+    level=malloc(nodes * sizeof(struct directory_btree_node_s *));
+    if (level==NULL) return NULL;
+    memset(level, 0, nodes * sizeof(struct directory_btree_node_s *));
+
+    /* leafs */
+
+    for (unsigned int n=0; n<nodes; n++) {
+	unsigned int start=(unsigned int) (((unsigned long) count * n) / nodes);
+	unsigned int end=(unsigned int) (((unsigned long) count * (n + 1)) / nodes);
+
+	level[n]=create_btree_node(1);
+	if (level[n]==NULL) goto error;
+
+	for (unsigned int i=start; i<end; i++) insert_btree_slot(level[n], i - start, entries[i], NULL);
+
+    }
+
+    /* internal nodes, every level is written over the one below in the same array */
+
+    while (nodes>1) {
+	unsigned int parents=(nodes + fill - 1) / fill;
+
+	for (unsigned int n=0; n<parents; n++) {
+	    unsigned int start=(unsigned int) (((unsigned long) nodes * n) / parents);
+	    unsigned int end=(unsigned int) (((unsigned long) nodes * (n + 1)) / parents);
+	    struct directory_btree_node_s *node=create_btree_node(0);
+
+	    if (node==NULL) {
+
+		/* free the children not taken yet, the parents already made own the others */
+
+		for (unsigned int i=start; i<nodes; i++) free_btree_node(level[i]);
+		nodes=n;
+		goto error;
+
+	    }
+
+	    for (unsigned int i=start; i<end; i++) insert_btree_slot(node, i - start, level[i]->entry[0], level[i]);
+	    level[n]=node;
+
+	}
+
+	nodes=parents;
+	(*height)++;
+
+    }
+
+    root=level[0];
+    free(level);
+    return root;
+
+    error:
+
+    for (unsigned int i=0; i<nodes; i++) {
+
+	if (level[i]) free_btree_node(level[i]);
+
+    }
+
+    free(level);
+    return NULL;
+
+}
+
+/*
+    insert a sorted batch of entries, the caller holds the write lock
+    the batch is merged with the entries present in one pass, after that the btree is built again from
+    the merged array, and only when that succeeds the new entries are added to the list
+
+    result[i] is entries[i] when added, the entry already present otherwise
+    returns the number of entries added
+*/
+
+unsigned int insert_entries_btree_batch(struct directory_s *directory, struct entry_s **entries, struct entry_s **result, unsigned int count, unsigned int *error)
+{
+    struct directory_btree_s *btree=directory->btree;
+    struct skiplist_struct *sl=&directory->skiplist;
+    unsigned int size=directory->count + count;
+    struct entry_s **merged=NULL;
+    unsigned char *added=NULL;
+    struct directory_btree_node_s *root=NULL;
+    struct entry_s *search=directory->first;
+    unsigned int total=0, ctr=0;
+    unsigned short height=0;
+
+    *error=0;
+    if (count==0) return 0;
+
+    merged=malloc(size * (sizeof(struct entry_s *) + 1));
+
+    if (merged==NULL) {
+
+	*error=ENOMEM;
+	return 0;
+
+    }
+
+    added=(unsigned char *) (merged + size);
+
+    for (unsigned int i=0; i<count; i++) {
+	int diff=1;
+
+	if (total>0 && compare_entry_name(merged[total - 1], &entries[i]->name)==0) {
+
+	    /* same as the previous one */
+
+	    result[i]=merged[total - 1];
+	    continue;
+
+	}
+
+	while (search) {
+
+	    diff=compare_entry_name(search, &entries[i]->name);
+	    if (diff>=0) break;
+
+	    added[total]=0;
+	    merged[total++]=search;
+	    search=search->name_next;
+
+	}
+
+	if (search && diff==0) {
+
+	    added[total]=0;
+	    merged[total++]=search;
+	    result[i]=search;
+	    search=search->name_next;
+
+	} else {
+
+	    added[total]=1;
+	    merged[total++]=entries[i];
+	    result[i]=entries[i];
+	    ctr++;
+
+	}
+
+    }
+
+    while (search) {
+
+	added[total]=0;
+	merged[total++]=search;
+	search=search->name_next;
+
+    }
+
+    root=build_btree_nodes(merged, total, &height);
+
+    if (root==NULL) {
+
+	for (unsigned int i=0; i<count; i++) result[i]=NULL;
+	free(merged);
+	*error=ENOMEM;
+	return 0;
+
+    }
+
+    /* add the new entries to the list: after the entry before in the merged array */
+
+    for (unsigned int i=0; i<total; i++) {
+
+	if (added[i]==0) continue;
+
+	if (i>0) {
+
+	    sl->ops.insert_after((void *) merged[i], (void *) merged[i - 1], sl);
+
+	} else if (directory->first) {
+
+	    sl->ops.insert_before((void *) merged[i], (void *) directory->first, sl);
+
+	} else {
+
+	    sl->ops.insert_after((void *) merged[i], NULL, sl);
+
+	}
+
+    }
+
+    free_btree_node(btree->root);
+    btree->root=root;
+    btree->height=height;
+
+    free(merged);
+    return ctr;
+
+}
+
+struct entry_s *find_entry_btree(struct directory_s *directory, struct name_s *xname, unsigned int *error)
+{
+    struct simple_lock_s rlock;
+    struct entry_s *entry=NULL;
+
+    if (rlock_directory(directory, &rlock)==0) {
+
+	entry=find_entry_btree_batch(directory, xname, error);
+	unlock_directory(directory, &rlock);
+
+    } else {
+
+	*error=EAGAIN;
+
+    }
+
+    return entry;
+
+}
+
+void remove_entry_btree(struct directory_s *directory, struct entry_s *entry, unsigned int *error)
+{
+    struct simple_lock_s wlock;
+
+    if (wlock_directory(directory, &wlock)==0) {
+
+	remove_entry_btree_batch(directory, entry, error);
+	unlock_directory(directory, &wlock);
+
+    } else {
+
+	*error=EAGAIN;
+
+    }
+
+}
+
+struct entry_s *insert_entry_btree(struct directory_s *directory, struct entry_s *entry, unsigned int *error, unsigned short flags)
+{
+    struct simple_lock_s wlock;
+    struct entry_s *result=NULL;
+
+    if (wlock_directory(directory, &wlock)==0) {
+
+	result=insert_entry_btree_batch(directory, entry, error, flags);
+	unlock_directory(directory, &wlock);
+
+    } else {
+
+	*error=EAGAIN;
+
+    }
+
+    return result;
+
+}
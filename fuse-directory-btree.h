@@ -0,0 +1,63 @@
+/*
+  2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017 Stef Bon <stefbon@gmail.com>
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#ifndef SB_COMMON_UTILS_FUSE_DIRECTORY_BTREE_H
+#define SB_COMMON_UTILS_FUSE_DIRECTORY_BTREE_H
+
+#define DIRECTORY_BTREE_FANOUT				32
+
+/*
+    btree index of the entries in a directory, an alternative to the skiplist for large directories
+
+    every node holds the name indices of its keys in one array, so a search in a node is a binary search
+    over contiguous memory, the entry (and the name) is only looked at when the indices are equal
+    in a leaf the keys are the entries, in an internal node key i is the smallest entry in child i
+
+    the ordered list of entries (directory->first and entry->name_next) is maintained as with the skiplist,
+    readdir walks that list
+*/
+
+struct directory_btree_node_s {
+    unsigned char				leaf;
+    unsigned short				count;
+    unsigned long long				index[DIRECTORY_BTREE_FANOUT];
+    struct entry_s				*entry[DIRECTORY_BTREE_FANOUT];
+    struct directory_btree_node_s		*child[];
+};
+
+struct directory_btree_s {
+    struct directory_btree_node_s		*root;
+    unsigned short				height;
+};
+
+/* prototypes */
+
+struct directory_btree_s *create_directory_btree(unsigned int *error);
+void free_directory_btree(struct directory_btree_s *btree);
+
+struct entry_s *find_entry_btree(struct directory_s *directory, struct name_s *xname, unsigned int *error);
+void remove_entry_btree(struct directory_s *directory, struct entry_s *entry, unsigned int *error);
+struct entry_s *insert_entry_btree(struct directory_s *directory, struct entry_s *entry, unsigned int *error, unsigned short flags);
+
+struct entry_s *find_entry_btree_batch(struct directory_s *directory, struct name_s *xname, unsigned int *error);
+void remove_entry_btree_batch(struct directory_s *directory, struct entry_s *entry, unsigned int *error);
+struct entry_s *insert_entry_btree_batch(struct directory_s *directory, struct entry_s *entry, unsigned int *error, unsigned short flags);
+unsigned int insert_entries_btree_batch(struct directory_s *directory, struct entry_s **entries, struct entry_s **result, unsigned int count, unsigned int *error);
+
+#endif
@@ -0,0 +1,275 @@
+/*
+  2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017 Stef Bon <stefbon@gmail.com>
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include "global-defines.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+
+#include <inttypes.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include "logging.h"
+#include "fuse-dentry.h"
+#include "fuse-directory.h"
+#include "fuse-interface.h"
+#include "fuse-fs.h"
+#include "fuse-directory-dirents.h"
+
+/* protects the listing pointer of every directory and the references, only held shortly */
+
+static pthread_mutex_t dirent_cache_mutex=PTHREAD_MUTEX_INITIALIZER;
+static uint64_t dirent_cache_budget=DIRENT_CACHE_BUDGET;
+static struct dirent_cache_stat_s dirent_cache_stat={0, 0, 0};
+
+/* zero: do not keep listings in the directories (every opendir makes its own) */
+
+void set_dirent_cache_budget(uint64_t budget)
+{
+    __atomic_store_n(&dirent_cache_budget, budget, __ATOMIC_RELAXED);
+}
+
+static void free_dirent_cache_s(struct dirent_cache_s *cache)
+{
+    free(cache->index);
+    free(cache->buffer);
+    free(cache);
+}
+
+/* with the directory read locked: walk the entries twice, first for the size, then to write the records
+    the records follow the order of the directory, which is not strictly alphabetical (see struct name_s) */
+
+static struct dirent_cache_s *build_dirent_cache(struct directory_s *directory, struct fuse_opendir_s *opendir)
+{
+    struct dirent_cache_s *cache=NULL;
+    struct entry_s *entry=NULL;
+    struct name_s xname={NULL, 0, 0, 0};
+    struct stat st;
+    size_t size=0;
+    unsigned int count=0;
+    unsigned int error=0;
+
+    entry=directory->first;
+
+    while (entry) {
+
+	if ((* opendir->skip_file)(opendir, entry->inode)!=0) {
+
+	    size+=(offsetof(struct fuse_dirent, name) + entry->name.len + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+	    count++;
+
+	}
+
+	entry=entry->name_next;
+
+    }
+
+    cache=malloc(sizeof(struct dirent_cache_s));
+    if (cache==NULL) return NULL;
+
+    memset(cache, 0, sizeof(struct dirent_cache_s));
+    cache->index=malloc((count + 1) * sizeof(unsigned int));
+    cache->buffer=malloc(size + 1); /* add_direntry_buffer wants room to spare */
+
+    if (cache->index==NULL || cache->buffer==NULL) {
+
+	free_dirent_cache_s(cache);
+	return NULL;
+
+    }
+
+    cache->refs=1;
+    cache->generation=directory->generation;
+    cache->skip_file=opendir->skip_file;
+    memset(&st, 0, sizeof(struct stat));
+    entry=directory->first;
+
+    while (entry && cache->count<count) {
+	struct inode_s *inode=entry->inode;
+
+	if ((* opendir->skip_file)(opendir, inode)!=0) {
+
+	    st.st_ino=inode->st.st_ino;
+	    st.st_mode=inode->st.st_mode;
+	    xname.name=entry->name.name;
+	    xname.len=entry->name.len;
+
+	    cache->index[cache->count]=cache->size;
+	    cache->size+=add_direntry_buffer(NULL, cache->buffer + cache->size, size + 1 - cache->size, cache->count + 3, &xname, &st, &error);
+	    cache->count++;
+
+	}
+
+	entry=entry->name_next;
+
+    }
+
+    cache->index[cache->count]=cache->size;
+    __atomic_add_fetch(&dirent_cache_stat.builds, 1, __ATOMIC_RELAXED);
+    return cache;
+
+}
+
+/*
+    the listing of the directory for an opendir, with the directory read locked
+    the one kept in the directory when it's of the current generation, otherwise a new one, which replaces
+    the one in the directory when there is room in the budget
+    the caller gets a reference
+*/
+
+struct dirent_cache_s *get_dirent_cache(struct directory_s *directory, struct fuse_opendir_s *opendir)
+{
+    struct dirent_cache_s *cache=NULL;
+    struct dirent_cache_s *old=NULL;
+    uint64_t generation=directory->generation;
+    uint64_t bytes=0;
+
+    pthread_mutex_lock(&dirent_cache_mutex);
+    cache=directory->dirents;
+
+    if (cache && cache->generation==generation && cache->skip_file==opendir->skip_file) {
+
+	cache->refs++;
+	pthread_mutex_unlock(&dirent_cache_mutex);
+	__atomic_add_fetch(&dirent_cache_stat.hits, 1, __ATOMIC_RELAXED);
+	return cache;
+
+    }
+
+    pthread_mutex_unlock(&dirent_cache_mutex);
+
+    cache=build_dirent_cache(directory, opendir);
+    if (cache==NULL) return NULL;
+
+    bytes=cache->size + (cache->count + 1) * sizeof(unsigned int);
+    pthread_mutex_lock(&dirent_cache_mutex);
+
+    old=directory->dirents;
+
+    /* another reader may have built the same listing meanwhile: keep that one, it's equal */
+
+    if (old==NULL || old->generation!=generation || old->skip_file!=opendir->skip_file) {
+
+	if (old) {
+
+	    dirent_cache_stat.bytes-=old->size + (old->count + 1) * sizeof(unsigned int);
+	    directory->dirents=NULL;
+	    old->refs--;
+	    if (old->refs>0) old=NULL;
+
+	}
+
+	if (dirent_cache_stat.bytes + bytes <= __atomic_load_n(&dirent_cache_budget, __ATOMIC_RELAXED)) {
+
+	    directory->dirents=cache;
+	    dirent_cache_stat.bytes+=bytes;
+	    cache->refs++;
+
+	}
+
+    } else {
+
+	old=NULL;
+
+    }
+
+    pthread_mutex_unlock(&dirent_cache_mutex);
+    if (old) free_dirent_cache_s(old);
+    return cache;
+
+}
+
+/*
+    copy the records from offset (of the directory stream, at least 2) which fit in size
+    finish is set when the last record is copied
+*/
+
+size_t copy_dirent_cache(struct dirent_cache_s *cache, char *buffer, size_t size, off_t offset, unsigned char *finish)
+{
+    unsigned int first=(unsigned int) (offset - 2);
+    unsigned int last=first;
+
+    if (offset < 2 || first >= cache->count) {
+
+	*finish=1;
+	return 0;
+
+    }
+
+    /* like add_direntry_buffer, a record fits when there is more room than its size */
+
+    while (last < cache->count && cache->index[last + 1] - cache->index[first] < size) last++;
+
+    memcpy(buffer, cache->buffer + cache->index[first], cache->index[last] - cache->index[first]);
+    *finish=(last==cache->count) ? 1 : 0;
+    return (size_t) (cache->index[last] - cache->index[first]);
+
+}
+
+void put_dirent_cache(struct dirent_cache_s *cache)
+{
+    unsigned int refs=0;
+
+    pthread_mutex_lock(&dirent_cache_mutex);
+    refs=--cache->refs;
+    pthread_mutex_unlock(&dirent_cache_mutex);
+
+    if (refs==0) free_dirent_cache_s(cache);
+
+}
+
+/* the directory is freed: a listing still used by an opendir stays till that's released */
+
+void free_dirent_cache(struct directory_s *directory)
+{
+    struct dirent_cache_s *cache=NULL;
+
+    pthread_mutex_lock(&dirent_cache_mutex);
+    cache=directory->dirents;
+
+    if (cache) {
+
+	dirent_cache_stat.bytes-=cache->size + (cache->count + 1) * sizeof(unsigned int);
+	directory->dirents=NULL;
+	cache->refs--;
+	if (cache->refs>0) cache=NULL;
+
+    }
+
+    pthread_mutex_unlock(&dirent_cache_mutex);
+    if (cache) free_dirent_cache_s(cache);
+
+}
+
+void get_dirent_cache_stat(struct dirent_cache_stat_s *stat)
+{
+    pthread_mutex_lock(&dirent_cache_mutex);
+    stat->hits=dirent_cache_stat.hits;
+    stat->builds=dirent_cache_stat.builds;
+    stat->bytes=dirent_cache_stat.bytes;
+    pthread_mutex_unlock(&dirent_cache_mutex);
+}
@@ -0,0 +1,70 @@
+/*
+  2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017 Stef Bon <stefbon@gmail.com>
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#ifndef SB_COMMON_UTILS_FUSE_DIRECTORY_DIRENTS_H
+#define SB_COMMON_UTILS_FUSE_DIRECTORY_DIRENTS_H
+
+#define DIRENT_CACHE_BUDGET				(32 * 1024 * 1024)	/* bytes kept in all directories together */
+
+/*
+    cache of the listing of a directory, as fuse_dirent records ready for the VFS
+
+    every entry added to or removed from a directory increases the generation of the directory; a listing
+    made at the same generation (and with the same skip_file filter) is still right, and a READDIR is answered
+    with a memcpy from it, also for a new opendir
+    the records start at offset 2 (after . and ..), index has the position of every record, so any offset and
+    size the VFS asks for is found at once
+
+    an opendir keeps the listing it started with (refcounted), so a listing changing during a readdir does not
+    make it skip or repeat entries; the directory keeps only the newest listing, and only while the total
+    is within the budget
+*/
+
+struct directory_s;
+struct fuse_opendir_s;
+struct inode_s;
+
+struct dirent_cache_s {
+    unsigned int				refs;
+    uint64_t					generation;
+    signed char					(* skip_file)(struct fuse_opendir_s *opendir, struct inode_s *inode);
+    unsigned int				count;
+    unsigned int				size;
+    unsigned int				*index;
+    char					*buffer;
+};
+
+struct dirent_cache_stat_s {
+    uint64_t					hits;
+    uint64_t					builds;
+    uint64_t					bytes;
+};
+
+/* prototypes */
+
+void set_dirent_cache_budget(uint64_t budget);
+
+struct dirent_cache_s *get_dirent_cache(struct directory_s *directory, struct fuse_opendir_s *opendir);
+size_t copy_dirent_cache(struct dirent_cache_s *cache, char *buffer, size_t size, off_t offset, unsigned char *finish);
+void put_dirent_cache(struct dirent_cache_s *cache);
+void free_dirent_cache(struct directory_s *directory);
+
+void get_dirent_cache_stat(struct dirent_cache_stat_s *stat);
+
+#endif
@@ -0,0 +1,288 @@
+/*
+  2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017 Stef Bon <stefbon@gmail.com>
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include "global-defines.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+
+#include <inttypes.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "logging.h"
+#include "utils.h"
+#include "fuse-dentry.h"
+#include "fuse-directory.h"
+#include "fuse-directory-negative.h"
+
+static void set_msec(struct timespec *ts, uint64_t msec)
+{
+    ts->tv_sec=(time_t) (msec / 1000);
+    ts->tv_nsec=(long) ((msec % 1000) * 1000000);
+}
+
+static int compare_timespec(struct timespec *a, struct timespec *b)
+{
+    if (a->tv_sec != b->tv_sec) return (a->tv_sec < b->tv_sec) ? -1 : 1;
+    if (a->tv_nsec != b->tv_nsec) return (a->tv_nsec < b->tv_nsec) ? -1 : 1;
+    return 0;
+}
+
+/* half the time between changes, or half the time since the last change when the directory has been quiet longer */
+
+static uint64_t get_negative_ttl(struct negative_cache_s *cache, struct timespec *now)
+{
+    uint64_t since=get_msec_passed(&cache->changed, now);
+    uint64_t ttl=((since > cache->interval) ? since : cache->interval) / 2;
+
+    if (ttl < NEGATIVE_TTL_MIN) ttl=NEGATIVE_TTL_MIN;
+    if (ttl > NEGATIVE_TTL_MAX) ttl=NEGATIVE_TTL_MAX;
+    return ttl;
+}
+
+static int find_negative_name(struct negative_cache_s *cache, struct name_s *xname)
+{
+
+    for (unsigned int i=0; i<NEGATIVE_CACHE_SIZE; i++) {
+	struct negative_name_s *nname=&cache->names[i];
+
+	if (nname->name==NULL || nname->index!=xname->index || nname->hash!=xname->hash || nname->len!=xname->len) continue;
+	if (memcmp(nname->name, xname->name, xname->len)==0) return (int) i;
+
+    }
+
+    return -1;
+
+}
+
+static void clear_negative_name(struct negative_cache_s *cache, unsigned int i)
+{
+    struct negative_name_s *nname=&cache->names[i];
+
+    free(nname->name);
+    nname->name=NULL;
+    nname->len=0;
+    cache->count--;
+}
+
+/* a name not found before and not expired: the ttl is what's left of it */
+
+int lookup_negative_cache(struct directory_s *directory, struct name_s *xname, struct timespec *ttl)
+{
+    struct negative_cache_s *cache=__atomic_load_n(&directory->negative, __ATOMIC_ACQUIRE);
+    struct timespec now;
+    int result=0;
+    int i=0;
+
+    if (cache==NULL) return 0;
+
+    get_current_time(&now);
+    pthread_mutex_lock(&cache->mutex);
+
+    i=find_negative_name(cache, xname);
+
+    if (i>=0) {
+	struct negative_name_s *nname=&cache->names[i];
+
+	if (compare_timespec(&now, &nname->expire) < 0) {
+
+	    set_msec(ttl, get_msec_passed(&now, &nname->expire));
+	    result=1;
+
+	} else {
+
+	    clear_negative_name(cache, (unsigned int) i);
+
+	}
+
+    }
+
+    pthread_mutex_unlock(&cache->mutex);
+    return result;
+
+}
+
+static struct negative_cache_s *get_negative_cache(struct directory_s *directory)
+{
+    struct negative_cache_s *cache=__atomic_load_n(&directory->negative, __ATOMIC_ACQUIRE);
+    struct negative_cache_s *expected=NULL;
+
+    if (cache) return cache;
+
+    cache=malloc(sizeof(struct negative_cache_s));
+    if (cache==NULL) return NULL;
+
+    memset(cache, 0, sizeof(struct negative_cache_s));
+    pthread_mutex_init(&cache->mutex, NULL);
+    get_current_time(&cache->changed);
+    cache->interval=2 * NEGATIVE_TTL_INITIAL;
+
+    if (__atomic_compare_exchange_n(&directory->negative, &expected, cache, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)==0) {
+
+	/* created by another thread at the same time */
+
+	pthread_mutex_destroy(&cache->mutex);
+	free(cache);
+	cache=expected;
+
+    }
+
+    return cache;
+
+}
+
+/* remember name is not found, ttl is the timeout for the VFS (also without a cache) */
+
+void add_negative_cache(struct directory_s *directory, struct name_s *xname, struct timespec *ttl)
+{
+    struct negative_cache_s *cache=get_negative_cache(directory);
+    struct negative_name_s *nname=NULL;
+    struct timespec now;
+    uint64_t msec=NEGATIVE_TTL_MIN;
+    int i=0;
+
+    get_current_time(&now);
+
+    if (cache==NULL) {
+
+	set_msec(ttl, msec);
+	return;
+
+    }
+
+    pthread_mutex_lock(&cache->mutex);
+
+    msec=get_negative_ttl(cache, &now);
+    i=find_negative_name(cache, xname);
+
+    if (i<0) {
+	char *name=malloc(xname->len + 1);
+
+	if (name==NULL) goto unlock;
+
+	/* a free slot, or the oldest one */
+
+	if (cache->count==NEGATIVE_CACHE_SIZE) clear_negative_name(cache, cache->next);
+
+	while (cache->names[cache->next].name) cache->next=(cache->next + 1) % NEGATIVE_CACHE_SIZE;
+	i=(int) cache->next;
+	cache->next=(cache->next + 1) % NEGATIVE_CACHE_SIZE;
+
+	nname=&cache->names[i];
+	memcpy(name, xname->name, xname->len);
+	name[xname->len]='\0';
+	nname->name=name;
+	nname->len=xname->len;
+	nname->index=xname->index;
+	nname->hash=xname->hash;
+	cache->count++;
+
+    }
+
+    nname=&cache->names[i];
+    set_msec(&nname->expire, msec);
+    nname->expire.tv_sec+=now.tv_sec;
+    nname->expire.tv_nsec+=now.tv_nsec;
+
+    if (nname->expire.tv_nsec >= 1000000000) {
+
+	nname->expire.tv_sec++;
+	nname->expire.tv_nsec-=1000000000;
+
+    }
+
+    unlock:
+
+    pthread_mutex_unlock(&cache->mutex);
+    set_msec(ttl, msec);
+
+}
+
+/* an entry is added to or removed from the directory, xname is the name added (NULL when removed) */
+
+void change_negative_cache(struct directory_s *directory, struct name_s *xname)
+{
+    struct negative_cache_s *cache=__atomic_load_n(&directory->negative, __ATOMIC_ACQUIRE);
+    struct timespec now;
+
+    if (cache==NULL) return;
+
+    get_current_time(&now);
+    pthread_mutex_lock(&cache->mutex);
+
+    cache->interval=(3 * cache->interval + get_msec_passed(&cache->changed, &now)) / 4;
+    memcpy(&cache->changed, &now, sizeof(struct timespec));
+
+    if (xname && cache->count>0) {
+	int i=find_negative_name(cache, xname);
+
+	if (i>=0) clear_negative_name(cache, (unsigned int) i);
+
+    }
+
+    pthread_mutex_unlock(&cache->mutex);
+
+}
+
+/* forget all names, for example when many entries are added at once */
+
+void clear_negative_cache(struct directory_s *directory)
+{
+    struct negative_cache_s *cache=__atomic_load_n(&directory->negative, __ATOMIC_ACQUIRE);
+
+    if (cache==NULL) return;
+
+    pthread_mutex_lock(&cache->mutex);
+
+    for (unsigned int i=0; i<NEGATIVE_CACHE_SIZE && cache->count>0; i++) {
+
+	if (cache->names[i].name) clear_negative_name(cache, i);
+
+    }
+
+    pthread_mutex_unlock(&cache->mutex);
+
+}
+
+void free_negative_cache(struct directory_s *directory)
+{
+    struct negative_cache_s *cache=directory->negative;
+
+    if (cache==NULL) return;
+
+    for (unsigned int i=0; i<NEGATIVE_CACHE_SIZE; i++) {
+
+	if (cache->names[i].name) free(cache->names[i].name);
+
+    }
+
+    pthread_mutex_destroy(&cache->mutex);
+    free(cache);
+    directory->negative=NULL;
+
+}
@@ -0,0 +1,67 @@
+/*
+  2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017 Stef Bon <stefbon@gmail.com>
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#ifndef SB_COMMON_UTILS_FUSE_DIRECTORY_NEGATIVE_H
+#define SB_COMMON_UTILS_FUSE_DIRECTORY_NEGATIVE_H
+
+#define NEGATIVE_CACHE_SIZE				64		/* names per directory */
+#define NEGATIVE_TTL_MIN				50		/* milliseconds */
+#define NEGATIVE_TTL_MAX				60000
+#define NEGATIVE_TTL_INITIAL				1000
+
+/*
+    cache of names looked up in a directory and not found by the backend
+
+    a lookup of such a name is answered without the backend, and the VFS gets a negative entry (nodeid zero)
+    with a timeout, so it does not ask again for a while either
+    every entry added to or removed from the directory counts as a change: an added name is removed from the
+    cache, and the time between changes (moving average) determines the timeout: half of that interval, or
+    half of the time since the last change when that's longer, between NEGATIVE_TTL_MIN and NEGATIVE_TTL_MAX
+    a cached name expires with the timeout given to the VFS
+
+    the cache is created at the first miss, and is full when it has NEGATIVE_CACHE_SIZE names: the oldest
+    is replaced
+*/
+
+struct negative_name_s {
+    unsigned long long				index;
+    uint32_t					hash;
+    unsigned int				len;
+    struct timespec				expire;
+    char					*name;
+};
+
+struct negative_cache_s {
+    pthread_mutex_t				mutex;
+    struct timespec				changed;
+    uint64_t					interval;
+    unsigned int				count;
+    unsigned int				next;
+    struct negative_name_s			names[NEGATIVE_CACHE_SIZE];
+};
+
+/* prototypes */
+
+int lookup_negative_cache(struct directory_s *directory, struct name_s *xname, struct timespec *ttl);
+void add_negative_cache(struct directory_s *directory, struct name_s *xname, struct timespec *ttl);
+void change_negative_cache(struct directory_s *directory, struct name_s *xname);
+void clear_negative_cache(struct directory_s *directory);
+void free_negative_cache(struct directory_s *directory);
+
+#endif
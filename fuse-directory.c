@@ -43,10 +43,14 @@
 #include "skiplist-delete.h"
 #include "skiplist-insert.h"
 #include "skiplist-seek.h"
+#include "skiplist-lockfree.h"
 
 #include "simple-locking.h"
 #include "fuse-dentry.h"
 #include "fuse-directory.h"
+#include "fuse-directory-btree.h"
+#include "fuse-directory-negative.h"
+#include "fuse-directory-dirents.h"
 
 #ifndef SIZE_DIRECTORY_HASHTABLE
 #define SIZE_DIRECTORY_HASHTABLE			1024
@@ -59,60 +63,32 @@ extern struct directory_s *get_dummy_directory();
 extern void fs_get_inode_link(struct inode_s *inode, struct inode_link_s **link);
 
 /*
-    callbacks for the skiplist
-    compare two elements to determine the right order
+    compare an entry with a name to determine the right order
+    used by the skiplist callbacks and the btree index
+
+    the order is: the index (the first 8 bytes), then the hash of the full name, then the length and
+    only then the bytes of the name
+    this is not the alphabetical order for names sharing the first 8 bytes, but it is a total order, and
+    almost every comparison is decided by the two numbers
 */
 
-static int compare_entry(void *a, void *b)
+int compare_entry_name(struct entry_s *entry, struct name_s *name)
 {
-    int result=0;
-    struct entry_s *entry=(struct entry_s *) a;
-    struct name_s *name=(struct name_s *) b;
-
-    if (entry->name.index > name->index) {
-
-	result=1; /* entry->name is bigger */
-
-    } else if (entry->name.index==name->index) {
-
-	if (name->len > 6) {
-
-	    if (entry->name.len > 6) {
-
-		result=strcmp(entry->name.name + 6, name->name + 6);
 
-	    } else {
-
-		result=-1; /* name is bigger */
-
-	    }
-
-	} else if (name->len==6) {
-
-	    if (entry->name.len>6) {
-
-		result=1;
-
-	    } else {
-
-		result=0;
-
-	    }
-
-	} else {
+    if (entry->name.index != name->index) return (entry->name.index > name->index) ? 1 : -1;
+    if (entry->name.hash != name->hash) return (entry->name.hash > name->hash) ? 1 : -1;
+    if (entry->name.len != name->len) return (entry->name.len > name->len) ? 1 : -1;
+    if (name->len <= 8) return 0;
 
-	    result=0;
+    return memcmp(entry->name.name + 8, name->name + 8, name->len - 8);
 
-	}
-
-    } else {
-
-	result=-1;
-
-    }
+}
 
-    return result;
+/* callbacks for the skiplist */
 
+static int compare_entry(void *a, void *b)
+{
+    return compare_entry_name((struct entry_s *) a, (struct name_s *) b);
 }
 
 static void *get_next_entry(void *data)
@@ -154,6 +130,7 @@ static void insert_before_entry(void *a, void *b, struct skiplist_struct *sl)
     }
 
     directory->count++;
+    directory->generation++;
 
 }
 
@@ -197,6 +174,7 @@ static void insert_after_entry(void *a, void *b, struct skiplist_struct *sl)
     }
 
     directory->count++;
+    directory->generation++;
 
 }
 
@@ -239,6 +217,7 @@ static void delete_entry(void *a, struct skiplist_struct *sl)
     entry->name_prev=NULL;
 
     directory->count--;
+    directory->generation++;
 
 }
 
@@ -410,10 +389,16 @@ int init_directory(struct directory_s *directory, unsigned int *error)
 
     }
 
+    profile_simple_locking(&directory->locking, "directory");
+
     directory->first=NULL;
     directory->last=NULL;
 
     directory->dops=NULL;
+    directory->btree=NULL;
+    directory->negative=NULL;
+    directory->generation=0;
+    directory->dirents=NULL;
     directory->link.type=0;
     directory->link.link.ptr=NULL;
 
@@ -438,6 +423,16 @@ int init_directory(struct directory_s *directory, unsigned int *error)
 
 }
 
+/*
+    let lookups in this directory proceed without any lock
+    only possible as long as the directory is empty
+*/
+
+int set_directory_lockfree(struct directory_s *directory, unsigned int *error)
+{
+    return set_skiplist_lockfree(&directory->skiplist, error);
+}
+
 /* search the directory using a hash table
     search is misleading a bit here, since it's always defined: a default value is taken (&dummy_directory)*/
 
@@ -523,7 +518,9 @@ struct directory_s *_create_directory(struct inode_s *inode, void (* init_cb)(st
 
     logoutput("_create_directory: inode %li", inode->st.st_ino);
 
-    directory=malloc(sizeof(struct directory_s));
+    /* in the slabs of the entry of the directory */
+
+    directory=(struct directory_s *) alloc_slab_object(&get_entry_slabs(inode->alias)->directories);
 
     if (directory) {
 	int result=0;
@@ -561,6 +558,10 @@ void free_directory(struct directory_s *directory)
     _remove_directory_hashtable(directory);
     clear_skiplist(&directory->skiplist);
     destroy_lock_skiplist(&directory->skiplist);
+    free_directory_btree(directory->btree);
+    directory->btree=NULL;
+    free_negative_cache(directory);
+    free_dirent_cache(directory);
     clear_simple_locking(&directory->locking);
     free_pathcalls(&directory->pathcalls);
 }
@@ -568,7 +569,7 @@ void free_directory(struct directory_s *directory)
 void destroy_directory(struct directory_s *directory)
 {
     free_directory(directory);
-    free(directory);
+    free_slab_object((void *) directory);
 }
 
 int lock_pathcalls(struct pathcalls_s *p)
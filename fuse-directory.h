@@ -31,6 +31,9 @@
 #define _DIRECTORY_LOCK_EXCL					3
 
 struct directory_s;
+struct directory_btree_s;
+struct negative_cache_s;
+struct dirent_cache_s;
 
 struct pathcalls_s {
     void 				*cache;
@@ -40,14 +43,15 @@ struct pathcalls_s {
 };
 
 struct dops_s {
-    struct entry_s 			*(*find_entry)(struct entry_s *parent, struct name_s *xname, unsigned int *error);
-    void 				(*remove_entry)(struct entry_s *entry, unsigned int *error);
+    struct entry_s 			*(*find_entry)(struct directory_s *directory, struct name_s *xname, unsigned int *error);
+    void 				(*remove_entry)(struct directory_s *directory, struct entry_s *entry, unsigned int *error);
     struct entry_s 			*(*insert_entry)(struct directory_s *directory, struct entry_s *entry, unsigned int *error, unsigned short flags);
     struct directory_s			*(*get_directory)(struct inode_s *inode, unsigned int *error);
     struct directory_s			*(*remove_directory)(struct inode_s *inode, unsigned int *error);
     struct entry_s 			*(*find_entry_batch)(struct directory_s *directory, struct name_s *xname, unsigned int *error);
     void 				(*remove_entry_batch)(struct directory_s *directory, struct entry_s *entry, unsigned int *error);
     struct entry_s 			*(*insert_entry_batch)(struct directory_s *directory, struct entry_s *entry, unsigned int *error, unsigned short flags);
+    unsigned int			(*insert_entries_batch)(struct directory_s *directory, struct entry_s **entries, struct entry_s **result, unsigned int count, unsigned int *error);
     void				(* get_inode_link)(struct directory_s *directory, struct inode_s *inode, struct inode_link_s **link);
     struct pathcalls_s 			*(*get_pathcalls)(struct directory_s *d);
 };
@@ -66,9 +70,15 @@ struct directory_s {
     struct dops_s 			*dops;
     struct inode_link_s			link;
     struct pathcalls_s			pathcalls;
+    struct directory_btree_s		*btree;
+    struct negative_cache_s		*negative;
+    uint64_t				generation;
+    struct dirent_cache_s		*dirents;
 };
 
 int init_directory(struct directory_s *directory, unsigned int *error);
+int compare_entry_name(struct entry_s *entry, struct name_s *name);
+int set_directory_lockfree(struct directory_s *directory, unsigned int *error);
 struct directory_s *_create_directory(struct inode_s *inode, void (* init_cb)(struct directory_s *directory), unsigned int *error);
 
 struct directory_s *search_directory(struct inode_s *inode);
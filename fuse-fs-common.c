@@ -55,6 +55,7 @@
 
 #include "fuse-dentry.h"
 #include "fuse-directory.h"
+#include "fuse-directory-dirents.h"
 #include "fuse-utils.h"
 #include "fuse-fs.h"
 #include "workspaces.h"
@@ -165,25 +166,24 @@ struct entry_s *get_target_symlink(struct workspace_mount_s *mount, struct entry
 void _fs_common_cached_lookup(struct service_context_s *context, struct fuse_request_s *request, struct inode_s *inode)
 {
     struct fuse_entry_out entry_out;
-    struct timespec *attr_timeout=NULL;
-    struct timespec *entry_timeout=NULL;
+    struct timespec attr_timeout;
+    struct timespec entry_timeout;
 
     logoutput("_fs_common_cached_lookup: ino %li name %.*s", inode->st.st_ino, inode->alias->name.len, inode->alias->name.name);
 
     context=get_root_context(context);
-    attr_timeout=get_fuse_interface_attr_timeout(context->interface.ptr);
-    entry_timeout=get_fuse_interface_entry_timeout(context->interface.ptr);
+    get_fuse_interface_timeouts(context->interface.ptr, inode, &attr_timeout, &entry_timeout);
 
-    inode->nlookup++;
+    __atomic_add_fetch(&inode->nlookup, 1, __ATOMIC_RELAXED);
 
     entry_out.nodeid=inode->st.st_ino;
     entry_out.generation=0; /* todo: add a generation field to reuse existing inodes */
 
-    entry_out.entry_valid=entry_timeout->tv_sec;
-    entry_out.entry_valid_nsec=entry_timeout->tv_nsec;
+    entry_out.entry_valid=entry_timeout.tv_sec;
+    entry_out.entry_valid_nsec=entry_timeout.tv_nsec;
 
-    entry_out.attr_valid=attr_timeout->tv_sec;
-    entry_out.attr_valid_nsec=attr_timeout->tv_nsec;
+    entry_out.attr_valid=attr_timeout.tv_sec;
+    entry_out.attr_valid_nsec=attr_timeout.tv_nsec;
 
     entry_out.attr.ino=inode->st.st_ino;
     entry_out.attr.size=inode->st.st_size;
@@ -211,6 +211,25 @@ void _fs_common_cached_lookup(struct service_context_s *context, struct fuse_req
 
 }
 
+/*
+    reply to lookup that the name does not exist, in a way the VFS caches it:
+    an entry with nodeid zero and a timeout
+*/
+
+void _fs_common_negative_lookup(struct service_context_s *context, struct fuse_request_s *request, struct timespec *timeout)
+{
+    struct fuse_entry_out entry_out;
+
+    memset(&entry_out, 0, sizeof(struct fuse_entry_out));
+
+    entry_out.nodeid=0;
+    entry_out.entry_valid=timeout->tv_sec;
+    entry_out.entry_valid_nsec=timeout->tv_nsec;
+
+    reply_VFS_data(request, (char *) &entry_out, sizeof(entry_out));
+
+}
+
 void _fs_common_cached_create(struct service_context_s *context, struct fuse_request_s *request, struct fuse_openfile_s *openfile)
 {
     struct inode_s *inode=openfile->inode;
@@ -218,12 +237,11 @@ void _fs_common_cached_create(struct service_context_s *context, struct fuse_req
     struct fuse_open_out open_out;
     unsigned int size_entry_out=sizeof(struct fuse_entry_out);
     unsigned int size_open_out=sizeof(struct fuse_open_out);
-    struct timespec *attr_timeout=NULL;
-    struct timespec *entry_timeout=NULL;
+    struct timespec attr_timeout;
+    struct timespec entry_timeout;
 
     context=get_root_context(context);
-    attr_timeout=get_fuse_interface_attr_timeout(context->interface.ptr);
-    entry_timeout=get_fuse_interface_entry_timeout(context->interface.ptr);
+    get_fuse_interface_timeouts(context->interface.ptr, inode, &attr_timeout, &entry_timeout);
     char buffer[size_entry_out + size_open_out];
 
     // inode->nlookup++;
@@ -231,11 +249,11 @@ void _fs_common_cached_create(struct service_context_s *context, struct fuse_req
     entry_out.nodeid=inode->st.st_ino;
     entry_out.generation=0; /* todo: add a generation field to reuse existing inodes */
 
-    entry_out.entry_valid=entry_timeout->tv_sec;
-    entry_out.entry_valid_nsec=entry_timeout->tv_nsec;
+    entry_out.entry_valid=entry_timeout.tv_sec;
+    entry_out.entry_valid_nsec=entry_timeout.tv_nsec;
 
-    entry_out.attr_valid=attr_timeout->tv_sec;
-    entry_out.attr_valid_nsec=attr_timeout->tv_nsec;
+    entry_out.attr_valid=attr_timeout.tv_sec;
+    entry_out.attr_valid_nsec=attr_timeout.tv_nsec;
 
     entry_out.attr.ino=inode->st.st_ino;
     entry_out.attr.size=inode->st.st_size;
@@ -276,7 +294,7 @@ void _fs_common_cached_create(struct service_context_s *context, struct fuse_req
 void _fs_common_virtual_lookup(struct service_context_s *context, struct fuse_request_s *request, struct inode_s *pinode, const char *name, unsigned int len)
 {
     struct entry_s *parent=pinode->alias, *entry=NULL;
-    struct name_s xname={NULL, 0, 0};
+    struct name_s xname={NULL, 0, 0, 0};
     unsigned int error=0;
     struct directory_s *directory=NULL;
 
@@ -300,7 +318,8 @@ void _fs_common_virtual_lookup(struct service_context_s *context, struct fuse_re
 	log_inode_information(inode, INODE_INFORMATION_NAME | INODE_INFORMATION_NLOOKUP | INODE_INFORMATION_MODE | INODE_INFORMATION_SIZE | INODE_INFORMATION_MTIM | INODE_INFORMATION_INODE_LINK | INODE_INFORMATION_FS_COUNT);
 
 	logoutput("_fs_common_virtual_lookup: found entry %.*s ino %li nlookup %i", entry->name.len, entry->name.name, inode->st.st_ino, inode->nlookup);
-	inode->nlookup++;
+	__atomic_add_fetch(&inode->nlookup, 1, __ATOMIC_RELAXED);
+	touch_inode(inode);
 	fs_get_inode_link(inode, &link);
 
 	if (link->type==INODE_LINK_TYPE_CONTEXT) {
@@ -345,15 +364,15 @@ void _fs_common_virtual_lookup(struct service_context_s *context, struct fuse_re
 void _fs_common_getattr(struct service_context_s *context, struct fuse_request_s *request, struct inode_s *inode)
 {
     struct fuse_attr_out attr_out;
-    struct timespec *attr_timeout=NULL;
+    struct timespec attr_timeout;
 
     logoutput("_fs_common_getattr: context %s", context->name);
 
     context=get_root_context(context);
-    attr_timeout=get_fuse_interface_attr_timeout(context->interface.ptr);
+    get_fuse_interface_timeouts(context->interface.ptr, inode, &attr_timeout, NULL);
 
-    attr_out.attr_valid=attr_timeout->tv_sec;
-    attr_out.attr_valid_nsec=attr_timeout->tv_nsec;
+    attr_out.attr_valid=attr_timeout.tv_sec;
+    attr_out.attr_valid_nsec=attr_timeout.tv_nsec;
 
     attr_out.attr.ino=inode->st.st_ino;
     attr_out.attr.size=inode->st.st_size;
@@ -402,16 +421,22 @@ void _fs_common_virtual_opendir(struct fuse_opendir_s *opendir, struct fuse_requ
 
 }
 
+/*
+    the . and .. entries are made here, the entries of the directory are copied from the listing of the
+    directory (see fuse-directory-dirents.c), which this opendir gets at the first batch and keeps; a batch
+    which starts before the entries (a rewind) gets the listing again
+*/
+
 void _fs_common_virtual_readdir(struct fuse_opendir_s *opendir, struct fuse_request_s *request, size_t size, off_t offset)
 {
     struct stat st;
     size_t pos=0, dirent_size=0;
     struct directory_s *directory=NULL;
-    struct name_s xname={NULL, 0, 0};
+    struct name_s xname={NULL, 0, 0, 0};
     struct inode_s *inode=NULL;
-    struct entry_s *entry=NULL;
     char buff[size];
     unsigned int error=0;
+    unsigned char finish=0;
     struct simple_lock_s rlock;
 
     if (opendir->mode & _FUSE_READDIR_MODE_FINISH) {
@@ -435,90 +460,60 @@ void _fs_common_virtual_readdir(struct fuse_opendir_s *opendir, struct fuse_requ
 
     memset(&st, 0, sizeof(struct stat));
 
-    while (pos<size) {
+    while (offset<2) {
 
-	if (offset==0) {
+	inode=opendir->inode;
 
-	    inode=opendir->inode;
+	if (offset==0) {
 
     	    /* the . entry */
 
-    	    st.st_ino = inode->st.st_ino;
-	    st.st_mode = S_IFDIR;
 	    xname.name = (char *) dotname;
 	    xname.len=1;
 
-    	} else if (offset==1) {
+    	} else {
     	    struct entry_s *parent=NULL;
 
-	    inode=opendir->inode;
-
 	    /* the .. entry */
 
 	    parent=inode->alias;
 	    if (parent->parent) inode=parent->parent->inode;
 
-    	    st.st_ino = inode->st.st_ino;
-	    st.st_mode = S_IFDIR;
 	    xname.name = (char *) dotdotname;
 	    xname.len=2;
 
-    	} else {
-
-	    entry=opendir->entry;
-
-	    if (entry==NULL) {
-
-		readdir:
-
-		entry=(struct entry_s *) opendir->handle.ptr;
-
-		if (entry) {
-
-		    opendir->handle.ptr=(void *) entry->name_next;
-
-		} else {
-
-		    opendir->mode |= _FUSE_READDIR_MODE_FINISH;
-		    break;
-
-		}
-
-	    }
-
-	    inode=entry->inode;
+    	}
 
-	    if ((* opendir->skip_file)(opendir, inode)==0) {
+    	st.st_ino = inode->st.st_ino;
+	st.st_mode = S_IFDIR;
 
-		opendir->entry=NULL;
-		goto readdir;
+	dirent_size=add_direntry_buffer(request->interface->ptr, buff + pos, size - pos, offset + 1, &xname, &st, &error);
+	if (error==ENOBUFS) goto reply;
 
-	    }
+	offset++;
+	pos+=dirent_size;
 
-	    st.st_ino=inode->st.st_ino;
-	    st.st_mode=inode->st.st_mode;
-	    xname.name=entry->name.name;
-	    xname.len=entry->name.len;
+    }
 
-	}
+    if (opendir->dirents==NULL || (offset==2 && pos>0)) {
 
-	// get_inode_stat(inode, &st);
-	dirent_size=add_direntry_buffer(request->interface->ptr, buff + pos, size - pos, offset + 1, &xname, &st, &error);
+	if (opendir->dirents) put_dirent_cache(opendir->dirents);
+	opendir->dirents=get_dirent_cache(directory, opendir);
 
-	if (error==ENOBUFS) {
+	if (opendir->dirents==NULL) {
 
-	    opendir->entry=entry; /* keep it for the next batch */
-	    break;
+	    unlock_directory(directory, &rlock);
+	    reply_VFS_error(request, ENOMEM);
+	    return;
 
 	}
 
-	/* increase counter and clear the various fields */
+    }
 
-	opendir->entry=NULL; /* forget current entry to force readdir */
-	offset++;
-	pos+=dirent_size;
+    pos+=copy_dirent_cache(opendir->dirents, buff + pos, size - pos, offset, &finish);
+    if (finish) opendir->mode |= _FUSE_READDIR_MODE_FINISH;
 
-    }
+    reply:
 
     unlock_directory(directory, &rlock);
     reply_VFS_data(request, buff, pos);
@@ -532,7 +527,7 @@ void _fs_common_virtual_readdirplus(struct fuse_opendir_s *opendir, struct fuse_
     struct stat st;
     size_t pos=0, dirent_size=0;
     struct directory_s *directory=NULL;
-    struct name_s xname={NULL, 0, 0};
+    struct name_s xname={NULL, 0, 0, 0};
     struct inode_s *inode=NULL;
     struct entry_s *entry=NULL;
     char buff[size];
@@ -621,7 +616,7 @@ void _fs_common_virtual_readdirplus(struct fuse_opendir_s *opendir, struct fuse_
 	    st.st_mode=inode->st.st_mode;
 	    xname.name=entry->name.name;
 	    xname.len=entry->name.len;
-	    inode->nlookup++;
+	    __atomic_add_fetch(&inode->nlookup, 1, __ATOMIC_RELAXED);
 
 	    entry=entry->name_next;
 
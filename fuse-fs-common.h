@@ -28,6 +28,7 @@ struct entry_s *get_target_symlink(struct workspace_mount_s *mount, struct entry
 int symlink_generic_validate(struct service_context_s *context, char *target);
 
 void _fs_common_cached_lookup(struct service_context_s *context, struct fuse_request_s *request, struct inode_s *inode);
+void _fs_common_negative_lookup(struct service_context_s *context, struct fuse_request_s *request, struct timespec *timeout);
 void _fs_common_virtual_lookup(struct service_context_s *context, struct fuse_request_s *request, struct inode_s *inode, const char *name, unsigned int len);
 
 void _fs_common_getattr(struct service_context_s *context, struct fuse_request_s *request, struct inode_s *inode);
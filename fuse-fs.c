@@ -49,6 +49,11 @@
 #include "fuse-dentry.h"
 #include "fuse-directory.h"
 #include "fuse-interface.h"
+#include "fuse-singleflight.h"
+#include "fuse-block-cache.h"
+#include "fuse-readahead.h"
+#include "fuse-writeback.h"
+#include "fuse-directory-dirents.h"
 #include "fuse-fs.h"
 #include "workspaces.h"
 #include "workspace-context.h"
@@ -98,103 +103,101 @@ void fuse_fs_forget_multi(struct fuse_request_s *request)
     struct service_context_s *context=NULL;
     struct fuse_batch_forget_in *batch_forget_in=(struct fuse_batch_forget_in *)request->buffer;
     struct fuse_forget_one *forgets=(struct fuse_forget_one *) (request->buffer + sizeof(struct fuse_batch_forget_in));
-    unsigned int i=0;
 
     // logoutput("FORGET_MULTI: (thread %i) count %i", (int) gettid(), batch_forget_in->count);
 
     context=get_service_context(request->interface);
-
-    for (i=0; i<batch_forget_in->count; i++) {
-
-	// logoutput("FORGET_MULTI: ino %lli forget %i", (int) gettid(), forgets[i].nodeid);
-	queue_inode_2forget(forgets[i].nodeid, context->unique, FORGET_INODE_FLAG_FORGET, forgets[i].nlookup);
-
-    }
+    queue_inodes_2forget(forgets, batch_forget_in->count, context->unique);
 
 }
 
 void fuse_fs_lookup(struct fuse_request_s *request)
 {
     char *name=(char *) request->buffer;
+    unsigned int len=strlen(name);
     struct service_context_s *context=get_service_context(request->interface);
+    struct inode_s *inode=NULL;
+    struct fuse_flight_s flight;
 
     logoutput("fuse_fs_lookup");
 
+    /* the same lookup in progress: wait for that and reply the same */
+
+    if (start_fuse_flight(&flight, request, FUSE_LOOKUP, request->ino, name, len)==1) return;
+
     if (request->ino==FUSE_ROOT_ID) {
 	struct workspace_mount_s *workspace=context->workspace;
-	struct inode_s *inode=&workspace->rootinode;
 
-	(* inode->fs->type.dir.lookup)(context, request, inode, name, strlen(name));
+	inode=&workspace->rootinode;
 
     } else {
-	struct inode_s *inode=find_inode(request->ino);
 
-	if (inode) {
+	inode=find_inode(request->ino);
 
-	    (* inode->fs->type.dir.lookup)(context, request, inode, name, strlen(name));
+    }
 
-	} else {
+    if (inode) {
 
-	    logoutput("fuse_fs_lookup: %li not found", request->ino);
-	    reply_VFS_error(request, ENOENT);
+	(* inode->fs->type.dir.lookup)(context, request, inode, name, len);
 
-	}
+    } else {
+
+	logoutput("fuse_fs_lookup: %li not found", request->ino);
+	reply_VFS_error(request, ENOENT);
 
     }
 
+    end_fuse_flight(&flight, request);
+
 }
 
 void fuse_fs_getattr(struct fuse_request_s *request)
 {
     struct fuse_getattr_in *getattr_in=(struct fuse_getattr_in *) request->buffer;
     struct service_context_s *context=get_service_context(request->interface);
+    struct inode_s *inode=NULL;
 
     logoutput("fuse_fs_getattr: ino %li", request->ino);
 
     if (request->ino==FUSE_ROOT_ID) {
 	struct workspace_mount_s *workspace=context->workspace;
-	struct inode_s *inode=&workspace->rootinode;
 
-	if ((getattr_in->getattr_flags & FUSE_GETATTR_FH) && getattr_in->fh>0) {
-	    struct fuse_openfile_s *openfile= (struct fuse_openfile_s *) getattr_in->fh;
+	inode=&workspace->rootinode;
 
-	    // logoutput("fuse_fs_getattr: fgetattr");
-
-	    (* inode->fs->type.nondir.fgetattr) (openfile, request);
+    } else {
 
-	} else {
+	inode=find_inode(request->ino);
 
-	    // logoutput("fuse_fs_getattr: getattr");
+	if (inode==NULL) {
 
-	    (* inode->fs->getattr)(context, request, inode);
+	    reply_VFS_error(request, ENOENT);
+	    return;
 
 	}
 
-    } else {
-	struct inode_s *inode=find_inode(request->ino);
-
-	if (inode) {
+    }
 
-	    if ((getattr_in->getattr_flags & FUSE_GETATTR_FH) && getattr_in->fh>0) {
-		struct fuse_openfile_s *openfile=(struct fuse_openfile_s *) getattr_in->fh;
+    /* the size has to include the writes not yet at the backend */
 
-		// logoutput("fuse_fs_getattr: fgetattr");
+    flush_writeback_inode(inode, NULL);
 
-		(* inode->fs->type.nondir.fgetattr) (openfile, request);
+    if ((getattr_in->getattr_flags & FUSE_GETATTR_FH) && getattr_in->fh>0) {
+	struct fuse_openfile_s *openfile=(struct fuse_openfile_s *) getattr_in->fh;
 
-	    } else {
+	// logoutput("fuse_fs_getattr: fgetattr");
 
-		// logoutput("fuse_fs_getattr: getattr");
+	(* inode->fs->type.nondir.fgetattr) (openfile, request);
 
-		(* inode->fs->getattr)(context, request, inode);
+    } else {
+	struct fuse_flight_s flight;
 
-	    }
+	// logoutput("fuse_fs_getattr: getattr");
 
-	} else {
+	/* the same getattr in progress: wait for that and reply the same */
 
-	    reply_VFS_error(request, ENOENT);
-
-	}
+	if (start_fuse_flight(&flight, request, FUSE_GETATTR, request->ino, NULL, 0)==1) return;
+	(* inode->fs->getattr)(context, request, inode);
+	end_fuse_flight(&flight, request);
 
     }
 
@@ -245,6 +248,9 @@ void fuse_fs_setattr(struct fuse_request_s *request)
 	if (inode) {
 	    struct stat st;
 
+	    flush_writeback_inode(inode, NULL);
+	    if (setattr_in->valid & FATTR_SIZE) invalidate_block_cache(inode);
+
 	    if (setattr_in->valid & FATTR_FH) {
 		struct fuse_openfile_s *openfile=(struct fuse_openfile_s *) setattr_in->fh;
 
@@ -259,6 +265,10 @@ void fuse_fs_setattr(struct fuse_request_s *request)
 
 	    }
 
+	    /* reads send while truncating are not cached */
+
+	    if (setattr_in->valid & FATTR_SIZE) invalidate_block_cache(inode);
+
 	} else {
 
 	    reply_VFS_error(request, ENOENT);
@@ -513,12 +523,19 @@ void fuse_fs_open(struct fuse_request_s *request)
 	    openfile->error=0;
 	    openfile->flock=0;
 
+	    /* count the handle before the reply is send, the release may follow immediatly */
+
+	    __atomic_add_fetch(&inode->nopen, 1, __ATOMIC_RELAXED);
+	    create_writeback(openfile, request, open_in->flags);
+
 	    (* inode->fs->type.nondir.open)(openfile, request, open_in->flags & (O_ACCMODE | O_APPEND | O_TRUNC));
 
 	    if (openfile->error>0) {
 
 		/* subcall has send a reply to VFS already, here only free */
 
+		__atomic_sub_fetch(&inode->nopen, 1, __ATOMIC_RELAXED);
+		free_writeback(openfile);
 		free(openfile);
 		openfile=NULL;
 
@@ -538,6 +555,21 @@ void fuse_fs_open(struct fuse_request_s *request)
 
 }
 
+/* the data the backend replies to a read goes into the block cache, with the generation when it was send */
+
+struct block_cache_read_s {
+    struct inode_s				*inode;
+    uint32_t					generation;
+};
+
+static void cb_data_read(struct fuse_request_s *request, char *buffer, size_t size)
+{
+    struct fuse_read_in *read_in=(struct fuse_read_in *) request->buffer;
+    struct block_cache_read_s *cacheread=(struct block_cache_read_s *) request->data;
+
+    store_block_cache(cacheread->inode, cacheread->generation, read_in->offset, buffer, size);
+}
+
 void fuse_fs_read(struct fuse_request_s *request)
 {
     struct fuse_read_in *read_in=(struct fuse_read_in *) request->buffer;
@@ -547,7 +579,27 @@ void fuse_fs_read(struct fuse_request_s *request)
 	struct inode_s *inode=openfile->inode;
 	uint64_t lock_owner=(read_in->flags & FUSE_READ_LOCKOWNER) ? read_in->lock_owner : 0;
 
-	(* inode->fs->type.nondir.read) (openfile, request, read_in->size, read_in->offset, read_in->flags, lock_owner);
+	flush_writeback_inode(inode, NULL);
+
+	if (read_block_cache(inode, request, read_in->size, read_in->offset)==0 && read_readahead(openfile, request, read_in->size, read_in->offset)==0) {
+	    struct block_cache_read_s cacheread;
+
+	    cacheread.inode=inode;
+	    cacheread.generation=get_block_cache_generation(inode);
+
+	    request->cb_data=cb_data_read;
+	    request->data=(void *) &cacheread;
+
+	    (* inode->fs->type.nondir.read) (openfile, request, read_in->size, read_in->offset, read_in->flags, lock_owner);
+
+	    request->cb_data=NULL;
+	    request->data=NULL;
+
+	}
+
+	/* a sequential reader gets the next data read ahead */
+
+	update_readahead(openfile, request, read_in->size, read_in->offset);
 
     } else {
 
@@ -567,8 +619,20 @@ void fuse_fs_write(struct fuse_request_s *request)
 	char *buffer=(char *) (request->buffer + sizeof(struct fuse_write_in));
 	uint64_t lock_owner=(write_in->flags & FUSE_WRITE_LOCKOWNER) ? write_in->lock_owner : 0;
 
+	invalidate_block_cache(inode);
+	drop_readahead(openfile);
+
+	/* data of other handles first, then combine small writes (invalidated again when written) */
+
+	flush_writeback_inode(inode, openfile);
+	if (buffer_writeback(openfile, request, buffer, write_in->size, write_in->offset, write_in->flags, lock_owner)==1) return;
+
 	(* inode->fs->type.nondir.write) (openfile, request, buffer, write_in->size, write_in->offset, write_in->flags, lock_owner);
 
+	/* reads send during the write may have the old data: not cached */
+
+	invalidate_block_cache(inode);
+
     } else {
 
 	reply_VFS_error(request, EIO);
@@ -584,6 +648,14 @@ void fuse_fs_flush(struct fuse_request_s *request)
 
     if (openfile) {
 	struct inode_s *inode=openfile->inode;
+	unsigned int error=flush_writeback(openfile);
+
+	if (error>0) {
+
+	    reply_VFS_error(request, error);
+	    return;
+
+	}
 
 	(* inode->fs->type.nondir.flush) (openfile, request, flush_in->lock_owner);
 
@@ -602,6 +674,14 @@ void fuse_fs_fsync(struct fuse_request_s *request)
 
     if (openfile) {
 	struct inode_s *inode=openfile->inode;
+	unsigned int error=flush_writeback(openfile);
+
+	if (error>0) {
+
+	    reply_VFS_error(request, error);
+	    return;
+
+	}
 
 	(* inode->fs->type.nondir.fsync) (openfile, request, fsync_in->fsync_flags & 1);
 
@@ -622,8 +702,11 @@ void fuse_fs_release(struct fuse_request_s *request)
 	struct inode_s *inode=openfile->inode;
 	uint64_t lock_owner=(release_in->release_flags & FUSE_RELEASE_FLOCK_UNLOCK) ? release_in->lock_owner : 0;
 
+	free_readahead(openfile);
+	free_writeback(openfile);
 	(* inode->fs->type.nondir.release) (openfile, request, release_in->release_flags, lock_owner);
 
+	if (openfile->inode) __atomic_sub_fetch(&openfile->inode->nopen, 1, __ATOMIC_RELAXED);
 	free(openfile);
 	openfile=NULL;
 
@@ -657,13 +740,17 @@ void fuse_fs_create(struct fuse_request_s *request)
 	    openfile->inode=inode;
 	    openfile->error=0;
 	    openfile->flock=0;
+	    create_writeback(openfile, request, create_in->flags);
 
 	    (* inode->fs->type.dir.create)(openfile, request, name, len, create_in->flags, create_in->mode, create_in->umask);
 
+	    /* the subcall sets the inode of the new file and counts the handle (nopen) before it replies */
+
 	    if (openfile->error>0) {
 
 		/* subcall has send a reply to VFS already, here only free */
 
+		free_writeback(openfile);
 		free(openfile);
 		openfile=NULL;
 
@@ -709,6 +796,7 @@ void _fuse_fs_opendir(struct service_context_s *context, struct inode_s *inode,
 	opendir->readdirplus=inode->fs->type.dir.readdirplus;
 	opendir->releasedir=inode->fs->type.dir.releasedir;
 	opendir->fsyncdir=inode->fs->type.dir.fsyncdir;
+	opendir->dirents=NULL;
 	opendir->data=NULL;
 
 	opendir->skip_file=skip_file_default;
@@ -716,12 +804,14 @@ void _fuse_fs_opendir(struct service_context_s *context, struct inode_s *inode,
 	//logoutput_info("_fuse_fs_opendir: fs defined %s", (inode->fs) ? "yes" : "no");
 	//if (inode->fs) logoutput_info("_fuse_fs_opendir: opendir defined %s", (inode->fs->type.dir.opendir) ? "yes" : "no");
 
+	__atomic_add_fetch(&inode->nopen, 1, __ATOMIC_RELAXED);
 	(* inode->fs->type.dir.opendir)(opendir, request, open_in->flags);
 
 	if (opendir->error>0) {
 
 	    /* subcall has send a reply to VFS already, here only free */
 
+	    __atomic_sub_fetch(&inode->nopen, 1, __ATOMIC_RELAXED);
 	    free(opendir);
 	    opendir=NULL;
 
@@ -818,7 +908,9 @@ void fuse_fs_releasedir(struct fuse_request_s *request)
 	struct inode_s *inode=opendir->inode;
 
 	(* opendir->releasedir)(opendir, request);
+	if (opendir->dirents) put_dirent_cache(opendir->dirents);
 
+	if (inode) __atomic_sub_fetch(&inode->nopen, 1, __ATOMIC_RELAXED);
 	free(opendir);
 	opendir=NULL;
 	release_in->fh=0;
@@ -903,6 +995,9 @@ static void _fuse_fs_flock_lock(struct fuse_openfile_s *openfile, struct fuse_re
 	    break;
     }
 
+    /* buffered writes go before the lock changes */
+
+    flush_writeback_inode(inode, NULL);
     (* inode->fs->type.nondir.flock) (openfile, request, type);
 
 }
@@ -918,6 +1013,9 @@ static void _fuse_fs_posix_lock(struct fuse_openfile_s *openfile, struct fuse_re
     flock.l_len=(lk_in->lk.end==OFFSET_MAX) ? 0 : lk_in->lk.end - lk_in->lk.start + 1;
     flock.l_pid=lk_in->lk.pid;
 
+    /* buffered writes go before the lock changes */
+
+    flush_writeback_inode(inode, NULL);
     (* inode->fs->type.nondir.setlock) (openfile, request, &flock);
 
 }
@@ -933,6 +1031,9 @@ static void _fuse_fs_posix_lock_wait(struct fuse_openfile_s *openfile, struct fu
     flock.l_len=(lk_in->lk.end==OFFSET_MAX) ? 0 : lk_in->lk.end - lk_in->lk.start + 1;
     flock.l_pid=lk_in->lk.pid;
 
+    /* buffered writes go before the lock changes */
+
+    flush_writeback_inode(inode, NULL);
     (* inode->fs->type.nondir.setlockw) (openfile, request, &flock);
 
 }
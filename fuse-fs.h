@@ -34,11 +34,19 @@
 #define _FUSE_READDIR_MODE_NONEMPTY				2
 #define _FUSE_READDIR_MODE_INCOMPLETE				4
 
+struct fuse_readahead_s;
+struct fuse_writeback_s;
+struct dirent_cache_s;
+
 struct fuse_openfile_s {
     struct service_context_s 			*context;
     struct inode_s				*inode;
     unsigned char				flock;
     unsigned int				error;
+    uint64_t					readnext;
+    unsigned int				sequential;
+    struct fuse_readahead_s			*readahead;
+    struct fuse_writeback_s			*writeback;
     union {
 	uint64_t				fd;
 	void					*ptr;
@@ -70,6 +78,7 @@ struct fuse_opendir_s {
 	    char				*name;
 	} name;
     } handle;
+    struct dirent_cache_s			*dirents;
     void					*data;
 };
 
@@ -0,0 +1,676 @@
+/*
+  2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017 Stef Bon <stefbon@gmail.com>
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include "global-defines.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+
+#include <inttypes.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include "logging.h"
+
+#include "epoch.h"
+#include "workerthreads.h"
+#include "fuse-dentry.h"
+#include "fuse-inode-hashtable.h"
+
+static struct inode_hashtable_shard_s shards[INODE_HASHTABLE_SHARDS];
+static pthread_once_t shards_once=PTHREAD_ONCE_INIT;
+
+static struct epoch_s epoch;
+
+/* what is retired is freed after the next grace period, by whoever waits for it */
+
+static pthread_mutex_t retired_mutex=PTHREAD_MUTEX_INITIALIZER;
+static struct inode_hashtable_retired_s *retired=NULL;
+static unsigned int retired_count=0;
+static unsigned char retired_thread=0;
+
+static void init_shards()
+{
+
+    for (unsigned int i=0; i<INODE_HASHTABLE_SHARDS; i++) {
+
+	pthread_mutex_init(&shards[i].mutex, NULL);
+	shards[i].table=NULL;
+	shards[i].copied=0;
+	shards[i].count=0;
+
+    }
+
+}
+
+static struct inode_hashtable_shard_s *get_shard(uint64_t ino)
+{
+    pthread_once(&shards_once, init_shards);
+    return &shards[ino % INODE_HASHTABLE_SHARDS];
+}
+
+/*
+    readers announce themselves in the stripe of the thread, in the counter of the current epoch
+    also used outside this file to keep an inode (and its entry) found by a lookup from being freed
+*/
+
+unsigned int *enter_inode_hashtable_epoch()
+{
+    return enter_epoch(&epoch);
+}
+
+void leave_inode_hashtable_epoch(unsigned int *readers)
+{
+    leave_epoch(readers);
+}
+
+/* wait till every lookup active at the moment of calling has left */
+
+static void _wait_inode_hashtable_grace()
+{
+    wait_epoch_grace(&epoch);
+}
+
+/* wait for a grace period, and free what was retired before it started */
+
+void wait_inode_hashtable_grace()
+{
+    struct inode_hashtable_retired_s *list=NULL;
+
+    pthread_mutex_lock(&retired_mutex);
+    list=retired;
+    retired=NULL;
+    retired_count=0;
+    pthread_mutex_unlock(&retired_mutex);
+
+    _wait_inode_hashtable_grace();
+
+    while (list) {
+	struct inode_hashtable_retired_s *next=list->next;
+
+	(* list->cb)(list->ptr);
+	free(list);
+	list=next;
+
+    }
+
+}
+
+static void retired_inode_hashtable_thread(void *ptr)
+{
+
+    pthread_mutex_lock(&retired_mutex);
+    retired_thread=0;
+    pthread_mutex_unlock(&retired_mutex);
+
+    wait_inode_hashtable_grace();
+
+}
+
+/*
+    free ptr (with cb) after a grace period without waiting for it, so it can be called with locks held
+    when too much is waiting a workerthread waits for a grace period
+    only when out of memory the wait is done here
+*/
+
+void retire_inode_hashtable(void *ptr, void (* cb)(void *ptr))
+{
+    struct inode_hashtable_retired_s *r=malloc(sizeof(struct inode_hashtable_retired_s));
+    unsigned char start=0;
+
+    if (r==NULL) {
+
+	_wait_inode_hashtable_grace();
+	(* cb)(ptr);
+	return;
+
+    }
+
+    r->ptr=ptr;
+    r->cb=cb;
+
+    pthread_mutex_lock(&retired_mutex);
+    r->next=retired;
+    retired=r;
+    retired_count++;
+
+    if (retired_count>=INODE_HASHTABLE_RETIRE_MAX && retired_thread==0) {
+
+	retired_thread=1;
+	start=1;
+
+    }
+
+    pthread_mutex_unlock(&retired_mutex);
+
+    if (start) {
+	unsigned int error=0;
+
+	work_workerthread(NULL, 0, retired_inode_hashtable_thread, NULL, &error);
+
+	if (error>0) {
+
+	    pthread_mutex_lock(&retired_mutex);
+	    retired_thread=0;
+	    pthread_mutex_unlock(&retired_mutex);
+
+	}
+
+    }
+
+}
+
+static struct inode_hashtable_array_s *create_inode_array(unsigned int size)
+{
+    struct inode_hashtable_array_s *array=NULL;
+
+    array=malloc(sizeof(struct inode_hashtable_array_s) + size * sizeof(struct inode_hashtable_slot_s));
+
+    if (array) {
+
+	memset(array, 0, sizeof(struct inode_hashtable_array_s) + size * sizeof(struct inode_hashtable_slot_s));
+	array->old=NULL;
+	array->size=size;
+	array->used=0;
+
+    }
+
+    return array;
+
+}
+
+/* the inos in a shard differ by a multiple of the number of shards: divide that out before spreading */
+
+static inline unsigned int get_inode_slot(struct inode_hashtable_array_s *array, uint64_t ino)
+{
+    return (unsigned int) (((ino / INODE_HASHTABLE_SHARDS) * 0x9E3779B97F4A7C15ULL) >> 32) & (array->size - 1);
+}
+
+/*
+    probe an array for ino, used by readers
+
+    a slot found with the right ino may be reused for another inode (after a remove) before the
+    inode pointer is read, so check the ino of the inode itself: if it differs the ino is removed
+*/
+
+static struct inode_s *probe_inode_array(struct inode_hashtable_array_s *array, uint64_t ino)
+{
+    unsigned int mask=array->size - 1;
+    unsigned int pos=get_inode_slot(array, ino);
+
+    for (unsigned int i=0; i<array->size; i++) {
+	uint64_t key=__atomic_load_n(&array->slots[pos].ino, __ATOMIC_ACQUIRE);
+
+	if (key==ino) {
+	    struct inode_s *inode=__atomic_load_n(&array->slots[pos].inode, __ATOMIC_ACQUIRE);
+
+	    return (inode && inode->st.st_ino==ino) ? inode : NULL;
+
+	} else if (key==0) {
+
+	    break;
+
+	}
+
+	pos=(pos + 1) & mask;
+
+    }
+
+    return NULL;
+
+}
+
+/* find the slot of ino, used by writers (with the shard mutex) */
+
+static struct inode_hashtable_slot_s *find_inode_slot(struct inode_hashtable_array_s *array, uint64_t ino)
+{
+    unsigned int mask=array->size - 1;
+    unsigned int pos=get_inode_slot(array, ino);
+
+    for (unsigned int i=0; i<array->size; i++) {
+
+	if (array->slots[pos].ino==ino) return &array->slots[pos];
+	if (array->slots[pos].ino==0) break;
+	pos=(pos + 1) & mask;
+
+    }
+
+    return NULL;
+
+}
+
+/* store an inode in the first free or removed slot: the inode before the ino, readers start with the ino */
+
+static int store_inode_array(struct inode_hashtable_array_s *array, uint64_t ino, struct inode_s *inode)
+{
+    unsigned int mask=array->size - 1;
+    unsigned int pos=get_inode_slot(array, ino);
+
+    for (unsigned int i=0; i<array->size; i++) {
+	struct inode_hashtable_slot_s *slot=&array->slots[pos];
+
+	if (slot->ino==0 || slot->ino==INODE_HASHTABLE_REMOVED) {
+
+	    if (slot->ino==0) array->used++;
+
+	    __atomic_store_n(&slot->inode, inode, __ATOMIC_RELEASE);
+	    __atomic_store_n(&slot->ino, ino, __ATOMIC_RELEASE);
+	    return 0;
+
+	}
+
+	pos=(pos + 1) & mask;
+
+    }
+
+    return -1;
+
+}
+
+/*
+    copy a number of slots from the old to the new array
+    the old array is not changed by copying, lookups which started before the new array was published
+    still find everything there
+    when all is copied the old array is detached and retired: freed after a grace period, without waiting
+    for it here with the shard mutex held
+*/
+
+static void copy_inode_array(struct inode_hashtable_shard_s *shard, unsigned int max)
+{
+    struct inode_hashtable_array_s *table=shard->table;
+    struct inode_hashtable_array_s *old=table->old;
+
+    while (max>0 && shard->copied < old->size) {
+	struct inode_hashtable_slot_s *slot=&old->slots[shard->copied];
+
+	if (slot->ino!=0 && slot->ino!=INODE_HASHTABLE_REMOVED) store_inode_array(table, slot->ino, slot->inode);
+	shard->copied++;
+	max--;
+
+    }
+
+    if (shard->copied==old->size) {
+
+	__atomic_store_n(&table->old, NULL, __ATOMIC_RELEASE);
+	retire_inode_hashtable((void *) old, free);
+	shard->copied=0;
+
+    }
+
+}
+
+/*
+    start a resize when the array is more than 3/4 used (removed slots count as used)
+    the new size leaves the live inodes at 1/4 or less, which may also be the same size: that
+    only clears the removed slots
+*/
+
+static void resize_inode_hashtable(struct inode_hashtable_shard_s *shard)
+{
+    struct inode_hashtable_array_s *table=shard->table;
+
+    if (table->old) {
+
+	/* still copying: if the new array fills up before that's done (should not happen) finish it now */
+
+	copy_inode_array(shard, (4 * table->used >= 3 * table->size) ? table->old->size : INODE_HASHTABLE_MIGRATE);
+
+    } else if (4 * table->used >= 3 * table->size) {
+	struct inode_hashtable_array_s *array=NULL;
+	unsigned int size=INODE_HASHTABLE_MINSIZE;
+
+	while (size < 4 * shard->count) size=2 * size;
+	array=create_inode_array(size);
+
+	if (array==NULL) {
+
+	    logoutput_warning("resize_inode_hashtable: unable to allocate %i slots", size);
+	    return;
+
+	}
+
+	array->old=table;
+	shard->copied=0;
+	__atomic_store_n(&shard->table, array, __ATOMIC_RELEASE);
+	copy_inode_array(shard, INODE_HASHTABLE_MIGRATE);
+
+    }
+
+}
+
+int init_inode_hashtable(unsigned int *error)
+{
+
+    pthread_once(&shards_once, init_shards);
+
+    for (unsigned int i=0; i<INODE_HASHTABLE_SHARDS; i++) {
+	struct inode_hashtable_shard_s *shard=&shards[i];
+
+	pthread_mutex_lock(&shard->mutex);
+
+	if (shard->table==NULL) {
+
+	    shard->table=create_inode_array(INODE_HASHTABLE_MINSIZE);
+
+	    if (shard->table==NULL) {
+
+		pthread_mutex_unlock(&shard->mutex);
+		*error=ENOMEM;
+		return -1;
+
+	    }
+
+	}
+
+	pthread_mutex_unlock(&shard->mutex);
+
+    }
+
+    return 0;
+
+}
+
+void free_inode_hashtable()
+{
+
+    pthread_once(&shards_once, init_shards);
+
+    for (unsigned int i=0; i<INODE_HASHTABLE_SHARDS; i++) {
+	struct inode_hashtable_shard_s *shard=&shards[i];
+	struct inode_hashtable_array_s *table=NULL;
+
+	pthread_mutex_lock(&shard->mutex);
+	table=shard->table;
+	__atomic_store_n(&shard->table, NULL, __ATOMIC_RELEASE);
+	shard->copied=0;
+	shard->count=0;
+	pthread_mutex_unlock(&shard->mutex);
+
+	if (table) {
+
+	    wait_inode_hashtable_grace();
+	    if (table->old) free(table->old);
+	    free(table);
+
+	}
+
+    }
+
+}
+
+/* add an inode, the ino (inode->st.st_ino) must be set and unique */
+
+int insert_inode_hashtable(struct inode_s *inode, unsigned int *error)
+{
+    uint64_t ino=(uint64_t) inode->st.st_ino;
+    struct inode_hashtable_shard_s *shard=get_shard(ino);
+    int result=-1;
+
+    pthread_mutex_lock(&shard->mutex);
+
+    if (shard->table==NULL) {
+
+	shard->table=create_inode_array(INODE_HASHTABLE_MINSIZE);
+
+	if (shard->table==NULL) {
+
+	    *error=ENOMEM;
+	    goto unlock;
+
+	}
+
+    }
+
+    resize_inode_hashtable(shard);
+
+    if (store_inode_array(shard->table, ino, inode)==0) {
+
+	shard->count++;
+	result=0;
+
+    } else {
+
+	*error=ENOSPC;
+
+    }
+
+    unlock:
+
+    pthread_mutex_unlock(&shard->mutex);
+    return result;
+
+}
+
+/*
+    remove an inode from the table
+    lookups may still hold the inode: wait for a grace period before freeing it
+*/
+
+void remove_inode_hashtable(struct inode_s *inode)
+{
+    uint64_t ino=(uint64_t) inode->st.st_ino;
+    struct inode_hashtable_shard_s *shard=get_shard(ino);
+    struct inode_hashtable_array_s *table=NULL;
+    struct inode_hashtable_slot_s *slot=NULL;
+    unsigned char found=0;
+
+    pthread_mutex_lock(&shard->mutex);
+    table=shard->table;
+    if (table==NULL) goto unlock;
+
+    slot=find_inode_slot(table, ino);
+
+    if (slot && slot->inode==inode) {
+
+	__atomic_store_n(&slot->ino, INODE_HASHTABLE_REMOVED, __ATOMIC_RELEASE);
+	found=1;
+
+    }
+
+    /* while copying it may (also) be in the old array */
+
+    if (table->old) {
+
+	slot=find_inode_slot(table->old, ino);
+
+	if (slot && slot->inode==inode) {
+
+	    __atomic_store_n(&slot->ino, INODE_HASHTABLE_REMOVED, __ATOMIC_RELEASE);
+	    found=1;
+
+	}
+
+    }
+
+    if (found) shard->count--;
+    resize_inode_hashtable(shard);
+
+    unlock:
+
+    pthread_mutex_unlock(&shard->mutex);
+
+}
+
+/* an inode has been moved in memory (realloc): point the slots with the same ino to the new one */
+
+void replace_inode_hashtable(struct inode_s *inode)
+{
+    uint64_t ino=(uint64_t) inode->st.st_ino;
+    struct inode_hashtable_shard_s *shard=get_shard(ino);
+    struct inode_hashtable_array_s *table=NULL;
+    struct inode_hashtable_slot_s *slot=NULL;
+
+    pthread_mutex_lock(&shard->mutex);
+    table=shard->table;
+
+    if (table) {
+
+	slot=find_inode_slot(table, ino);
+	if (slot) __atomic_store_n(&slot->inode, inode, __ATOMIC_RELEASE);
+
+	if (table->old) {
+
+	    slot=find_inode_slot(table->old, ino);
+	    if (slot) __atomic_store_n(&slot->inode, inode, __ATOMIC_RELEASE);
+
+	}
+
+    }
+
+    pthread_mutex_unlock(&shard->mutex);
+
+}
+
+/*
+    lookup an inode without locking
+    the old array is read before the new one is searched: when it's already detached at that moment
+    the copy is complete, and when it's not it's kept till this lookup has left the epoch
+*/
+
+struct inode_s *lookup_inode_hashtable(uint64_t ino)
+{
+    struct inode_hashtable_shard_s *shard=get_shard(ino);
+    struct inode_hashtable_array_s *table=NULL;
+    struct inode_s *inode=NULL;
+    unsigned int *readers=enter_inode_hashtable_epoch();
+
+    table=__atomic_load_n(&shard->table, __ATOMIC_ACQUIRE);
+
+    if (table) {
+	struct inode_hashtable_array_s *old=__atomic_load_n(&table->old, __ATOMIC_ACQUIRE);
+
+	inode=probe_inode_array(table, ino);
+	if (inode==NULL && old) inode=probe_inode_array(old, ino);
+
+    }
+
+    leave_inode_hashtable_epoch(readers);
+    return inode;
+
+}
+
+/*
+    look up many inos at once, best sorted by shard: the epoch is entered once for all, and the table
+    of a shard is loaded once for every run of inos in that shard
+*/
+
+void lookup_inode_hashtable_batch(uint64_t *inos, struct inode_s **inodes, unsigned int count)
+{
+    struct inode_hashtable_shard_s *shard=NULL;
+    struct inode_hashtable_array_s *table=NULL;
+    struct inode_hashtable_array_s *old=NULL;
+    unsigned int *readers=enter_inode_hashtable_epoch();
+
+    for (unsigned int i=0; i<count; i++) {
+	struct inode_hashtable_shard_s *tmp=get_shard(inos[i]);
+
+	if (tmp != shard) {
+
+	    shard=tmp;
+	    table=__atomic_load_n(&shard->table, __ATOMIC_ACQUIRE);
+	    old=(table) ? __atomic_load_n(&table->old, __ATOMIC_ACQUIRE) : NULL;
+
+	}
+
+	inodes[i]=NULL;
+
+	if (table) {
+
+	    inodes[i]=probe_inode_array(table, inos[i]);
+	    if (inodes[i]==NULL && old) inodes[i]=probe_inode_array(old, inos[i]);
+
+	}
+
+    }
+
+    leave_inode_hashtable_epoch(readers);
+
+}
+
+/*
+    move the hand over the slots of the table and call cb for every inode, at most max slots further
+    when the hand passes the last shard it starts again at the first, and rounds is increased
+    cb is called inside the epoch: it may look at the inode and change flags, but not free it or wait
+    inodes not yet copied from an old array are skipped, it's a sweep, not a snapshot
+    returns the number of slots visited
+*/
+
+unsigned int sweep_inode_hashtable(struct inode_hashtable_hand_s *hand, unsigned int max, void (* cb)(struct inode_s *inode, void *ptr), void *ptr)
+{
+    unsigned int visited=0;
+
+    pthread_once(&shards_once, init_shards);
+
+    while (visited<max) {
+	struct inode_hashtable_shard_s *shard=&shards[hand->shard % INODE_HASHTABLE_SHARDS];
+	struct inode_hashtable_array_s *table=NULL;
+	unsigned int *readers=enter_inode_hashtable_epoch();
+	unsigned int size=0;
+
+	table=__atomic_load_n(&shard->table, __ATOMIC_ACQUIRE);
+
+	if (table) {
+
+	    size=table->size;
+
+	    while (hand->slot < size && visited<max) {
+		uint64_t ino=__atomic_load_n(&table->slots[hand->slot].ino, __ATOMIC_ACQUIRE);
+
+		if (ino>0 && ino!=INODE_HASHTABLE_REMOVED) {
+		    struct inode_s *inode=__atomic_load_n(&table->slots[hand->slot].inode, __ATOMIC_ACQUIRE);
+
+		    if (inode && inode->st.st_ino==ino) (* cb)(inode, ptr);
+
+		}
+
+		hand->slot++;
+		visited++;
+
+	    }
+
+	} else {
+
+	    /* an empty shard counts as one slot, so a sweep over an empty table ends */
+
+	    visited++;
+
+	}
+
+	leave_inode_hashtable_epoch(readers);
+
+	if (hand->slot >= size) {
+
+	    hand->slot=0;
+	    hand->shard=(hand->shard + 1) % INODE_HASHTABLE_SHARDS;
+	    if (hand->shard==0) hand->rounds++;
+
+	}
+
+    }
+
+    return visited;
+
+}
@@ -0,0 +1,94 @@
+/*
+  2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017 Stef Bon <stefbon@gmail.com>
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#ifndef SB_COMMON_UTILS_FUSE_INODE_HASHTABLE_H
+#define SB_COMMON_UTILS_FUSE_INODE_HASHTABLE_H
+
+#define INODE_HASHTABLE_SHARDS				64		/* power of 2 */
+#define INODE_HASHTABLE_MINSIZE				256		/* slots per shard, power of 2 */
+#define INODE_HASHTABLE_MIGRATE				64		/* slots copied per write while resizing */
+#define INODE_HASHTABLE_RETIRE_MAX			64		/* retired waiting for a grace period before a thread waits */
+
+#define INODE_HASHTABLE_REMOVED				((uint64_t) -1)
+
+/*
+    table of inodes by ino
+
+    the table is divided in shards (by ino), every shard has an array of slots with open addressing
+    lookups do not take any lock: they read the slots with atomic loads inside an epoch (see epoch.h)
+    writers are serialized per shard by a mutex
+
+    when an array becomes too full a new one is published which points to the old one, and every write copies
+    a few slots from the old to the new array; lookups look in both till the copy is complete
+    an old array and a removed inode are only freed after a grace period
+*/
+
+struct inode_hashtable_slot_s {
+    uint64_t					ino;
+    struct inode_s				*inode;
+};
+
+struct inode_hashtable_array_s {
+    struct inode_hashtable_array_s		*old;
+    unsigned int				size;
+    unsigned int				used;
+    struct inode_hashtable_slot_s		slots[];
+};
+
+struct inode_hashtable_shard_s {
+    pthread_mutex_t				mutex;
+    struct inode_hashtable_array_s		*table;
+    unsigned int				copied;
+    unsigned int				count;
+} __attribute__((aligned(64)));
+
+/* something to free after a grace period */
+
+struct inode_hashtable_retired_s {
+    struct inode_hashtable_retired_s		*next;
+    void					*ptr;
+    void					(* cb)(void *ptr);
+};
+
+/* position of a sweep over the table, like the hand of a clock */
+
+struct inode_hashtable_hand_s {
+    unsigned int				shard;
+    unsigned int				slot;
+    unsigned int				rounds;
+};
+
+/* prototypes */
+
+int init_inode_hashtable(unsigned int *error);
+void free_inode_hashtable();
+
+int insert_inode_hashtable(struct inode_s *inode, unsigned int *error);
+void remove_inode_hashtable(struct inode_s *inode);
+void replace_inode_hashtable(struct inode_s *inode);
+struct inode_s *lookup_inode_hashtable(uint64_t ino);
+void lookup_inode_hashtable_batch(uint64_t *inos, struct inode_s **inodes, unsigned int count);
+unsigned int sweep_inode_hashtable(struct inode_hashtable_hand_s *hand, unsigned int max, void (* cb)(struct inode_s *inode, void *ptr), void *ptr);
+
+unsigned int *enter_inode_hashtable_epoch();
+void leave_inode_hashtable_epoch(unsigned int *readers);
+void wait_inode_hashtable_grace();
+void retire_inode_hashtable(void *ptr, void (* cb)(void *ptr));
+
+#endif
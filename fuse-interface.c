@@ -54,6 +54,7 @@
 #include "fuse-dentry.h"
 #include "workspace-interface.h"
 #include "fuse-interface.h"
+#include "fuse-singleflight.h"
 
 #define FUSEPARAM_STATUS_CONNECTING				1
 #define FUSEPARAM_STATUS_CONNECTED				2
@@ -64,6 +65,11 @@
 
 #define FUSEPARAM_QUEUE_HASHSIZE				128
 
+#define FUSEPARAM_FLAG_INLINE					1
+#define FUSEPARAM_FLAG_ADAPTIVE					2
+
+#define FUSEPARAM_TIMEOUT_MAX					60		/* seconds, max of an adaptive timeout */
+
 typedef void (* fuse_cb_t)(struct fuse_request_s *request);
 
 /* index for queue */
@@ -88,9 +94,12 @@ struct fuseparam_s {
     size_t 					size;
     size_t					read;
     unsigned char				status;
+    unsigned char				flags;
     struct timespec				attr_timeout;
     struct timespec				entry_timeout;
     struct timespec				negative_timeout;
+    uint64_t					getattrs;
+    uint64_t					lookups;
     struct context_interface_s			*interface;
     struct fs_connection_s			connection;
     unsigned int				size_cb;
@@ -108,6 +117,7 @@ static pthread_mutex_t				datahash_mutex=PTHREAD_MUTEX_INITIALIZER;
 
 static unsigned int				size_in_header=sizeof(struct fuse_in_header);
 static unsigned int				size_out_header=sizeof(struct fuse_out_header);
+static uint64_t					internal_unique=0;
 
 void notify_VFS_delete(void *ptr, uint64_t pino, uint64_t ino, char *name, unsigned int len)
 {
@@ -146,6 +156,42 @@ void notify_VFS_delete(void *ptr, uint64_t pino, uint64_t ino, char *name, unsig
 #endif
 
 
+}
+
+/*
+    tell the VFS to drop the dentry of name in pino, when it's not in use the VFS forgets the inode
+    the name is send with the terminating zero, the kernel checks it
+*/
+
+void notify_VFS_inval_entry(void *ptr, uint64_t pino, char *name, unsigned int len)
+{
+    struct fuseparam_s *fuseparam=(struct fuseparam_s *) ptr;
+    struct fs_connection_s *conn=&fuseparam->connection;
+    struct fuse_ops_s *fops=conn->io.fuse.fops;
+    ssize_t alreadywritten=0;
+    struct iovec iov[3];
+    struct fuse_out_header oh;
+    struct fuse_notify_inval_entry_out out;
+
+    oh.len=size_out_header + sizeof(struct fuse_notify_inval_entry_out) + len + 1;
+    oh.error=FUSE_NOTIFY_INVAL_ENTRY;
+    oh.unique=0;
+
+    memset(&out, 0, sizeof(struct fuse_notify_inval_entry_out));
+    out.parent=pino;
+    out.namelen=len;
+
+    iov[0].iov_base=(void *) &oh;
+    iov[0].iov_len=size_out_header;
+
+    iov[1].iov_base=(void *) &out;
+    iov[1].iov_len=sizeof(struct fuse_notify_inval_entry_out);
+
+    iov[2].iov_base=(void *) name;
+    iov[2].iov_len=len + 1;
+
+    alreadywritten+=(* fops->writev)(&conn->io.fuse, iov, 3);
+
 }
 
 void notify_VFS_create(void *ptr, uint64_t pino, char *name)
@@ -202,8 +248,10 @@ size_t add_direntry_plus_buffer(void *ptr, char *buffer, size_t size, off_t offs
 
     if ( dirent_size_alligned < size) {
 	struct fuse_direntplus *direntplus=(struct fuse_direntplus *) buffer;
-	struct timespec *attr_timeout=get_fuse_interface_attr_timeout(ptr);
-	struct timespec *entry_timeout=get_fuse_interface_entry_timeout(ptr);
+	struct timespec attr_timeout;
+	struct timespec entry_timeout;
+
+	get_fuse_interface_timeouts(ptr, lookup_inode_hashtable(st->st_ino), &attr_timeout, &entry_timeout);
 
 	memset(buffer, 0, dirent_size_alligned); /* to be sure, the buffer should be zerod already */
 
@@ -216,10 +264,10 @@ size_t add_direntry_plus_buffer(void *ptr, char *buffer, size_t size, off_t offs
 	direntplus->entry_out.nodeid=st->st_ino;
 	direntplus->entry_out.generation=0; /* ???? */
 
-	direntplus->entry_out.entry_valid=entry_timeout->tv_sec;
-	direntplus->entry_out.entry_valid_nsec=entry_timeout->tv_nsec;
-	direntplus->entry_out.attr_valid=attr_timeout->tv_sec;
-	direntplus->entry_out.attr_valid_nsec=attr_timeout->tv_nsec;
+	direntplus->entry_out.entry_valid=entry_timeout.tv_sec;
+	direntplus->entry_out.entry_valid_nsec=entry_timeout.tv_nsec;
+	direntplus->entry_out.attr_valid=attr_timeout.tv_sec;
+	direntplus->entry_out.attr_valid_nsec=attr_timeout.tv_nsec;
 
 	direntplus->entry_out.attr.ino=st->st_ino;
 	direntplus->entry_out.attr.size=st->st_size;
@@ -341,6 +389,12 @@ void reply_VFS_data(struct fuse_request_s *request, char *buffer, size_t size)
     struct iovec iov[2];
     struct fuse_out_header oh;
 
+    /* the one who sent the request wants to see the data (like a read for the block cache) */
+
+    if (request->cb_data) (* request->cb_data)(request, buffer, size);
+    if (request->flight) land_fuse_flight(request, buffer, size, 0);
+    if (request->unique & FUSE_REQUEST_UNIQUE_INTERNAL) return;
+
     oh.len=size_out_header + size;
     oh.error=0;
     oh.unique=request->unique;
@@ -365,6 +419,19 @@ void reply_VFS_error(struct fuse_request_s *request, unsigned int error)
     struct fuse_out_header oh;
     struct iovec iov[1];
 
+    /* the one who sent the request wants to see the error first (like a lookup for a negative entry) */
+
+    if (request->cb_error) {
+	unsigned char (* cb_error)(struct fuse_request_s *request, unsigned int error)=request->cb_error;
+
+	request->cb_error=NULL;
+	if ((* cb_error)(request, error)==1) return;
+
+    }
+
+    if (request->flight) land_fuse_flight(request, NULL, 0, error);
+    if (request->unique & FUSE_REQUEST_UNIQUE_INTERNAL) return;
+
     oh.len=size_out_header;
     oh.error=-error;
     oh.unique=request->unique;
@@ -651,6 +718,16 @@ static void process_fusequeue(void *data)
 
 	if (request->opcode<=fuseparam->size_cb) {
 
+	    if (request->opcode==FUSE_GETATTR) {
+
+		__atomic_add_fetch(&fuseparam->getattrs, 1, __ATOMIC_RELAXED);
+
+	    } else if (request->opcode==FUSE_LOOKUP) {
+
+		__atomic_add_fetch(&fuseparam->lookups, 1, __ATOMIC_RELAXED);
+
+	    }
+
 	    _add_datahash(index, request->unique);
 	    (* fuseparam->fuse_cb[request->opcode])(request);
 	    _remove_datahash(index, request->unique);
@@ -684,6 +761,52 @@ static unsigned char fuse_request_interrupted_nonfuse(struct fuse_request_s *req
     return (fuseparam->status & FUSEPARAM_STATUS_DISCONNECT);
 }
 
+/*
+    a request made here and not by the VFS (like a readahead), for the same user and inode as from
+    the reply is only seen by the hooks (cb_data, cb_error), it's not written to the VFS
+*/
+
+struct fuse_request_s *create_fuse_request_internal(struct fuse_request_s *from, uint32_t opcode, unsigned int size)
+{
+    struct fuse_request_s *request=malloc(sizeof(struct fuse_request_s) + size);
+
+    if (request) {
+
+	memset(request, 0, sizeof(struct fuse_request_s) + size);
+
+	request->interface=from->interface;
+	request->opcode=opcode;
+	request->flags=0;
+	request->is_interrupted=fuse_request_interrupted_nonfuse;
+	request->cb_error=NULL;
+	request->cb_data=NULL;
+	request->data=NULL;
+	request->flight=NULL;
+	request->unique=FUSE_REQUEST_UNIQUE_INTERNAL | __atomic_add_fetch(&internal_unique, 1, __ATOMIC_RELAXED);
+	request->ino=from->ino;
+	request->uid=from->uid;
+	request->gid=from->gid;
+	request->pid=from->pid;
+	request->size=size;
+
+    }
+
+    return request;
+
+}
+
+/* process an internal request like one from the VFS: the backend can signal it by unique */
+
+void process_fuse_request_internal(struct fuse_request_s *request, void (* cb)(struct fuse_request_s *request, void *ptr), void *ptr)
+{
+    struct double_index_s index;
+
+    index.request=request;
+    _add_datahash(&index, request->unique);
+    (* cb)(request, ptr);
+    _remove_datahash(&index, request->unique);
+}
+
 static int read_fuse_event(int fd, void *ptr, uint32_t events)
 {
     struct fuseparam_s *fuseparam=(struct fuseparam_s *) ptr;
@@ -761,6 +884,10 @@ static int read_fuse_event(int fd, void *ptr, uint32_t events)
 	    request->opcode=in->opcode;
 	    request->flags=0;
 	    request->is_interrupted=fuse_request_interrupted_default;
+	    request->cb_error=NULL;
+	    request->cb_data=NULL;
+	    request->data=NULL;
+	    request->flight=NULL;
 	    request->unique=in->unique;
 	    request->ino=in->nodeid;
 	    request->uid=in->uid;
@@ -793,7 +920,19 @@ static int read_fuse_event(int fd, void *ptr, uint32_t events)
 	    pthread_mutex_unlock(&fuseparam->queue.mutex);
 
 	    error=0;
-	    work_workerthread(NULL, 0, process_fusequeue, (void *) fuseparam, &error);
+
+	    if ((fuseparam->flags & FUSEPARAM_FLAG_INLINE) && beventloop_is_busypoll(conn->io.fuse.xdata.loop) && xdata_has_loop_alone(&conn->io.fuse.xdata)) {
+
+		/* loop is dedicated to this fuse fs: process the request here, no handoff to a workerthread
+		    (a handler waiting for a backend is fine: replies of backends are read by other loops) */
+
+		process_fusequeue((void *) fuseparam);
+
+	    } else {
+
+		work_workerthread(NULL, 0, process_fusequeue, (void *) fuseparam, &error);
+
+	    }
 
 	    return 0;
 
@@ -881,6 +1020,7 @@ static struct fuseparam_s *create_fuse_interface()
 	fuseparam->size=size;
 	fuseparam->read=0;
 	fuseparam->status=0;
+	fuseparam->flags=0; /* adaptive timeouts only when asked for: set_fuse_interface_adaptive */
 	fuseparam->interface=NULL;
 	init_connection(&fuseparam->connection, FS_CONNECTION_TYPE_FUSE, FS_CONNECTION_ROLE_CLIENT);
 
@@ -895,6 +1035,9 @@ static struct fuseparam_s *create_fuse_interface()
 	fuseparam->negative_timeout.tv_sec=1;
 	fuseparam->negative_timeout.tv_nsec=0;
 
+	fuseparam->getattrs=0;
+	fuseparam->lookups=0;
+
 	fuseparam->size_cb=(sizeof(fuseparam->fuse_cb) / sizeof(fuseparam->fuse_cb[0]));
 
 	/* default various ops */
@@ -938,6 +1081,61 @@ void disable_masking_userspace(void *ptr)
     if (fuseparam) fuseparam->get_masked_perm=get_masked_perm_ignore;
 }
 
+/*
+    process requests in the thread of the eventloop, only when that loop is busy polling and serves
+    only the fuse fd: a handler may wait for a reply of a backend, and when that reply has to be read
+    by the same loop it would wait forever
+    refused (-1) when the fuse fd shares its loop, which is also checked at every request since
+    connections may be added to the loop later
+*/
+
+int set_fuse_interface_inline(void *ptr, unsigned char enable)
+{
+    struct fuseparam_s *fuseparam=(struct fuseparam_s *) ptr;
+
+    if (fuseparam==NULL) return -1;
+
+    if (enable) {
+
+	if (xdata_has_loop_alone(&fuseparam->connection.io.fuse.xdata)==0) {
+
+	    logoutput_warning("set_fuse_interface_inline: fuse fd shares its eventloop, not enabling inline mode");
+	    return -1;
+
+	}
+
+	fuseparam->flags |= FUSEPARAM_FLAG_INLINE;
+
+    } else {
+
+	fuseparam->flags &= ~FUSEPARAM_FLAG_INLINE;
+
+    }
+
+    return 0;
+
+}
+
+/* timeouts per inode depending on how often it changes, or only the timeouts of the mount (the default) */
+
+void set_fuse_interface_adaptive(void *ptr, unsigned char enable)
+{
+    struct fuseparam_s *fuseparam=(struct fuseparam_s *) ptr;
+
+    if (fuseparam==NULL) return;
+
+    if (enable) {
+
+	fuseparam->flags |= FUSEPARAM_FLAG_ADAPTIVE;
+
+    } else {
+
+	fuseparam->flags &= ~FUSEPARAM_FLAG_ADAPTIVE;
+
+    }
+
+}
+
 mode_t get_masked_permissions(void *ptr, mode_t perm, mode_t mask)
 {
     struct fuseparam_s *fuseparam=(struct fuseparam_s *) ptr;
@@ -974,6 +1172,53 @@ struct timespec *get_fuse_interface_negative_timeout(void *ptr)
     return &fuseparam->negative_timeout;
 }
 
+/* timeout of the mount times 2^(level - INODE_TIMEOUT_INIT) */
+
+static void scale_timeout(struct timespec *base, unsigned char level, struct timespec *timeout)
+{
+    uint64_t nsec=(uint64_t) base->tv_sec * 1000000000 + base->tv_nsec;
+    uint64_t max=(uint64_t) FUSEPARAM_TIMEOUT_MAX * 1000000000;
+
+    if (max < nsec) max=nsec;
+    nsec=(nsec << level) >> INODE_TIMEOUT_INIT;
+    if (nsec > max) nsec=max;
+
+    timeout->tv_sec=(time_t) (nsec / 1000000000);
+    timeout->tv_nsec=(long) (nsec % 1000000000);
+}
+
+/*
+    the attribute and entry timeouts for the VFS of an inode:
+    short when it changed recently, longer every time it did not change, inode may be NULL
+*/
+
+void get_fuse_interface_timeouts(void *ptr, struct inode_s *inode, struct timespec *attr_timeout, struct timespec *entry_timeout)
+{
+    struct fuseparam_s *fuseparam=(struct fuseparam_s *) ptr;
+
+    if (inode && (fuseparam->flags & FUSEPARAM_FLAG_ADAPTIVE)) {
+	unsigned char level=__atomic_load_n(&inode->timeout, __ATOMIC_RELAXED);
+
+	if (attr_timeout) scale_timeout(&fuseparam->attr_timeout, level, attr_timeout);
+	if (entry_timeout) scale_timeout(&fuseparam->entry_timeout, level, entry_timeout);
+
+    } else {
+
+	if (attr_timeout) memcpy(attr_timeout, &fuseparam->attr_timeout, sizeof(struct timespec));
+	if (entry_timeout) memcpy(entry_timeout, &fuseparam->entry_timeout, sizeof(struct timespec));
+
+    }
+
+}
+
+void get_fuse_interface_stat(void *ptr, struct fuse_interface_stat_s *stat)
+{
+    struct fuseparam_s *fuseparam=(struct fuseparam_s *) ptr;
+
+    stat->getattrs=__atomic_load_n(&fuseparam->getattrs, __ATOMIC_RELAXED);
+    stat->lookups=__atomic_load_n(&fuseparam->lookups, __ATOMIC_RELAXED);
+}
+
 
 void signal_fuse_interface(struct context_interface_s *interface, const char *what)
 {
@@ -26,11 +26,24 @@
 #define FUSEDATA_FLAG_RESPONSE			2
 #define FUSEDATA_FLAG_ERROR			4
 
+#define FUSE_REQUEST_UNIQUE_INTERNAL		(((uint64_t) 1) << 63)	/* request not from the VFS, the reply is not written */
+
+struct fuse_flight_s;
+
+struct fuse_interface_stat_s {
+    uint64_t					getattrs;
+    uint64_t					lookups;
+};
+
 struct fuse_request_s {
     struct context_interface_s			*interface;
     uint32_t					opcode;
     unsigned int				flags;
     unsigned char				(* is_interrupted)(struct fuse_request_s *request);
+    unsigned char				(* cb_error)(struct fuse_request_s *request, unsigned int error);
+    void					(* cb_data)(struct fuse_request_s *request, char *buffer, size_t size);
+    void					*data;
+    struct fuse_flight_s			*flight;
     unsigned int				error;
     uint64_t					unique;
     uint64_t					ino;
@@ -43,6 +56,7 @@ struct fuse_request_s {
 
 void notify_VFS_delete(void *ptr, uint64_t pino, uint64_t ino, char *name, unsigned int len);
 void notify_VFS_create(void *ptr, uint64_t pino, char *name);
+void notify_VFS_inval_entry(void *ptr, uint64_t pino, char *name, unsigned int len);
 void notify_VFS_change(void *ptr, uint64_t ino, uint32_t mask);
 void notify_VFS_fsnotify(void *ptr, uint64_t  ino, uint32_t mask);
 void notify_VFS_fsnotify_child(void *ptr, uint64_t ino, uint32_t mask, struct name_s *xname);
@@ -52,6 +66,8 @@ int init_fuse_interface(struct context_interface_s *interface);
 void register_fuse_function(void *ptr, uint32_t opcode, void (* func) (struct fuse_request_s *request));
 
 void disable_masking_userspace(void *ptr);
+int set_fuse_interface_inline(void *ptr, unsigned char enable);
+void set_fuse_interface_adaptive(void *ptr, unsigned char enable);
 mode_t get_masked_permissions(void *ptr, mode_t perm, mode_t mask);
 
 unsigned char set_request_interrupted(void *ptr, uint64_t unique);
@@ -63,6 +79,9 @@ pthread_mutex_t *get_fuse_pthread_mutex(struct context_interface_s *interface);
 pthread_cond_t *get_fuse_pthread_cond(struct context_interface_s *interface);
 uint64_t *get_fuse_interrupted_id(struct context_interface_s *interface);
 
+struct fuse_request_s *create_fuse_request_internal(struct fuse_request_s *from, uint32_t opcode, unsigned int size);
+void process_fuse_request_internal(struct fuse_request_s *request, void (* cb)(struct fuse_request_s *request, void *ptr), void *ptr);
+
 void reply_VFS_data(struct fuse_request_s *r, char *buffer, size_t size);
 void reply_VFS_error(struct fuse_request_s *r, unsigned int error);
 void reply_VFS_nosys(struct fuse_request_s *r);
@@ -71,6 +90,9 @@ void reply_VFS_xattr(struct fuse_request_s *r, size_t size);
 struct timespec *get_fuse_interface_attr_timeout(void *ptr);
 struct timespec *get_fuse_interface_entry_timeout(void *ptr);
 struct timespec *get_fuse_interface_negative_timeout(void *ptr);
+void get_fuse_interface_timeouts(void *ptr, struct inode_s *inode, struct timespec *attr_timeout, struct timespec *entry_timeout);
+
+void get_fuse_interface_stat(void *ptr, struct fuse_interface_stat_s *stat);
 
 size_t add_direntry_buffer(void *ptr, char *buffer, size_t size, off_t offset, struct name_s *xname, struct stat *st, unsigned int *error);
 size_t add_direntry_plus_buffer(void *ptr, char *buffer, size_t size, off_t offset, struct name_s *xname, struct stat *st, unsigned int *error);
@@ -40,6 +40,8 @@
 #define ENOATTR ENODATA        /* No such attribute */
 #endif
 
+#include "fuse-dentry.h"
+#include "fuse-block-cache.h"
 #include "fuse-netinfo.h"
 static struct simple_hash_s hash_netinfo;
 
@@ -109,6 +111,8 @@ int init_netinfo_hashtable()
 
     }
 
+    profile_simple_locking(&hash_netinfo.locking, "netinfo hash");
+
 }
 
 void free_netinfo_hashtable()
@@ -251,12 +255,27 @@ static signed char _send_fsnotify_event_vfs(struct workspace_mount_s *workspace,
     /* check already send to VFS */
     if (event->info.fsevent.flags&FUSE_FSNOTIFY_FLAG_VFS) return;
 
+    /* the watched inode changes: give it short timeouts for a while */
+
+    if (event->info.fsnotify.mask) {
+	struct inode_s *inode=lookup_inode_hashtable(event->info.fsnotify.unique);
+
+	if (inode) {
+
+	    mark_inode_changed(inode);
+	    invalidate_block_cache(inode);
+
+	}
+
+    }
+
     if (valid & FUSE_NETINFO_VALID_FILE) {
 	struct name_s xname;
 
 	xname.name=event->info.fsnotify.file.ptr;
 	xname.len=event->info.fsnotify.file.len;
 	xname.index=0;
+	xname.hash=0;
 
 	notify_VFS_fsnotify_child(interface->ptr, event->info.fsnotify.unique, event->info.fsnotify.mask, &xname);
 
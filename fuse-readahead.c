@@ -0,0 +1,389 @@
+/*
+  2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017 Stef Bon <stefbon@gmail.com>
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include "global-defines.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+
+#include <inttypes.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include "logging.h"
+#include "workerthreads.h"
+#include "fuse-dentry.h"
+#include "fuse-interface.h"
+#include "fuse-fs.h"
+#include "fuse-block-cache.h"
+#include "fuse-readahead.h"
+
+/* the data is only valid as long as the file has the same size, mtime and block cache generation as when read */
+
+static unsigned char check_readahead(struct fuse_readahead_s *readahead, struct inode_s *inode)
+{
+    return (readahead->cachegen==get_block_cache_generation(inode) && readahead->size==inode->st.st_size &&
+	    readahead->mtim.tv_sec==inode->st.st_mtim.tv_sec && readahead->mtim.tv_nsec==inode->st.st_mtim.tv_nsec);
+}
+
+static void clear_readahead_buffer(struct fuse_readahead_s *readahead)
+{
+
+    if (readahead->buffer) {
+
+	free(readahead->buffer);
+	readahead->buffer=NULL;
+
+    }
+
+    readahead->start=0;
+    readahead->len=0;
+
+}
+
+static struct fuse_readahead_s *get_readahead(struct fuse_openfile_s *openfile)
+{
+    struct fuse_readahead_s *readahead=__atomic_load_n(&openfile->readahead, __ATOMIC_ACQUIRE);
+    struct fuse_readahead_s *expected=NULL;
+
+    if (readahead) return readahead;
+
+    readahead=malloc(sizeof(struct fuse_readahead_s));
+    if (readahead==NULL) return NULL;
+
+    memset(readahead, 0, sizeof(struct fuse_readahead_s));
+    pthread_mutex_init(&readahead->mutex, NULL);
+    pthread_cond_init(&readahead->cond, NULL);
+    readahead->window=READAHEAD_WINDOW_MIN;
+
+    if (__atomic_compare_exchange_n(&openfile->readahead, &expected, readahead, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)==0) {
+
+	pthread_cond_destroy(&readahead->cond);
+	pthread_mutex_destroy(&readahead->mutex);
+	free(readahead);
+	readahead=expected;
+
+    }
+
+    return readahead;
+
+}
+
+/*
+    serve a read from the buffer, wait for the readahead in flight when that has the data
+    returns 1 when the reply is send, 0 when the read has to go to the backend
+*/
+
+int read_readahead(struct fuse_openfile_s *openfile, struct fuse_request_s *request, size_t size, off_t offset)
+{
+    struct fuse_readahead_s *readahead=__atomic_load_n(&openfile->readahead, __ATOMIC_ACQUIRE);
+    uint64_t start=(uint64_t) offset;
+    uint64_t end=start + size;
+    char *buffer=NULL;
+    unsigned int len=0;
+
+    if (readahead==NULL) return 0;
+
+    pthread_mutex_lock(&readahead->mutex);
+
+    if ((readahead->flags & READAHEAD_FLAG_INFLIGHT) && start >= readahead->rastart && start < readahead->rastart + readahead->rasize) {
+
+	readahead->waits++;
+	while (readahead->flags & READAHEAD_FLAG_INFLIGHT) pthread_cond_wait(&readahead->cond, &readahead->mutex);
+
+    }
+
+    if (readahead->len==0) goto miss;
+
+    if (check_readahead(readahead, openfile->inode)==0) {
+
+	clear_readahead_buffer(readahead);
+	goto miss;
+
+    }
+
+    /* the read ends in the buffer, or at the end of the file */
+
+    if (end > readahead->size) end=readahead->size;
+    if (start < readahead->start || start > end || end > readahead->start + readahead->len) goto miss;
+
+    len=(unsigned int) (end - start);
+
+    if (len>0) {
+
+	buffer=malloc(len);
+	if (buffer==NULL) goto miss;
+	memcpy(buffer, readahead->buffer + (start - readahead->start), len);
+
+    }
+
+    readahead->hits++;
+    pthread_mutex_unlock(&readahead->mutex);
+
+    reply_VFS_data(request, buffer, len);
+    if (buffer) free(buffer);
+    return 1;
+
+    miss:
+
+    readahead->misses++;
+    pthread_mutex_unlock(&readahead->mutex);
+    return 0;
+
+}
+
+/* data of the readahead from the backend: append it to what the reader did not read yet */
+
+static void cb_data_readahead(struct fuse_request_s *request, char *data, size_t size)
+{
+    struct fuse_openfile_s *openfile=(struct fuse_openfile_s *) request->data;
+    struct fuse_readahead_s *readahead=openfile->readahead;
+    struct inode_s *inode=openfile->inode;
+    uint64_t keep=0;
+    uint64_t keepstart=readahead->rastart;
+    char *buffer=NULL;
+
+    store_block_cache(inode, readahead->cachegen, readahead->rastart, data, size);
+
+    pthread_mutex_lock(&readahead->mutex);
+
+    if (readahead->cachegen!=get_block_cache_generation(inode)) {
+
+	/* written (with any handle) while reading: the data may be old */
+
+	clear_readahead_buffer(readahead);
+	pthread_mutex_unlock(&readahead->mutex);
+	return;
+
+    }
+
+    if (readahead->len>0 && readahead->start + readahead->len==readahead->rastart && check_readahead(readahead, inode)) {
+
+	keepstart=(readahead->reader > readahead->start) ? readahead->reader : readahead->start;
+	if (keepstart > readahead->rastart) keepstart=readahead->rastart;
+	keep=readahead->rastart - keepstart;
+
+    }
+
+    buffer=malloc(keep + size);
+
+    if (buffer) {
+
+	if (keep>0) memcpy(buffer, readahead->buffer + (keepstart - readahead->start), keep);
+	memcpy(buffer + keep, data, size);
+
+    }
+
+    clear_readahead_buffer(readahead);
+
+    if (buffer) {
+
+	readahead->buffer=buffer;
+	readahead->start=keepstart;
+	readahead->len=(unsigned int) (keep + size);
+	readahead->size=inode->st.st_size;
+	readahead->mtim.tv_sec=inode->st.st_mtim.tv_sec;
+	readahead->mtim.tv_nsec=inode->st.st_mtim.tv_nsec;
+
+    }
+
+    pthread_mutex_unlock(&readahead->mutex);
+
+}
+
+static void cb_read_readahead(struct fuse_request_s *request, void *ptr)
+{
+    struct fuse_openfile_s *openfile=(struct fuse_openfile_s *) ptr;
+    struct fuse_read_in *read_in=(struct fuse_read_in *) request->buffer;
+
+    (* openfile->inode->fs->type.nondir.read)(openfile, request, read_in->size, read_in->offset, 0, 0);
+}
+
+/* run in a workerthread */
+
+static void run_readahead(void *ptr)
+{
+    struct fuse_request_s *request=(struct fuse_request_s *) ptr;
+    struct fuse_openfile_s *openfile=(struct fuse_openfile_s *) request->data;
+    struct fuse_readahead_s *readahead=openfile->readahead;
+
+    request->cb_data=cb_data_readahead;
+    process_fuse_request_internal(request, cb_read_readahead, (void *) openfile);
+
+    pthread_mutex_lock(&readahead->mutex);
+    readahead->flags &= ~READAHEAD_FLAG_INFLIGHT;
+    pthread_cond_broadcast(&readahead->cond);
+    pthread_mutex_unlock(&readahead->mutex);
+
+    free(request);
+
+}
+
+/* after every read: follow the position of the reader, and start a readahead when it's sequential and close to the end */
+
+void update_readahead(struct fuse_openfile_s *openfile, struct fuse_request_s *request, size_t size, off_t offset)
+{
+    struct fuse_readahead_s *readahead=NULL;
+    struct fuse_request_s *rarequest=NULL;
+    struct fuse_read_in *read_in=NULL;
+    uint64_t reader=(uint64_t) offset + size;
+    uint64_t ahead=reader;
+    uint32_t cachegen=0;
+    unsigned int error=0;
+
+    if ((uint64_t) offset==openfile->readnext) {
+
+	if (openfile->sequential < READAHEAD_SEQUENTIAL) openfile->sequential++;
+
+    } else {
+
+	openfile->sequential=0;
+
+	readahead=__atomic_load_n(&openfile->readahead, __ATOMIC_ACQUIRE);
+
+	if (readahead) {
+
+	    /* random access: start again with a small window */
+
+	    pthread_mutex_lock(&readahead->mutex);
+	    readahead->window=READAHEAD_WINDOW_MIN;
+	    pthread_mutex_unlock(&readahead->mutex);
+
+	}
+
+    }
+
+    openfile->readnext=reader;
+    if (openfile->sequential < READAHEAD_SEQUENTIAL) return;
+
+    readahead=get_readahead(openfile);
+    if (readahead==NULL) return;
+
+    pthread_mutex_lock(&readahead->mutex);
+
+    readahead->reader=reader;
+    if (readahead->flags & (READAHEAD_FLAG_INFLIGHT | READAHEAD_FLAG_RELEASE)) goto unlock;
+
+    /* continue after the buffer when the reader is in it */
+
+    if (readahead->len>0 && reader >= readahead->start && reader <= readahead->start + readahead->len && check_readahead(readahead, openfile->inode)) {
+
+	ahead=readahead->start + readahead->len;
+
+    }
+
+    if (ahead >= openfile->inode->st.st_size || ahead - reader >= readahead->window / 2) goto unlock;
+
+    rarequest=create_fuse_request_internal(request, FUSE_READ, sizeof(struct fuse_read_in));
+    if (rarequest==NULL) goto unlock;
+
+    read_in=(struct fuse_read_in *) rarequest->buffer;
+    read_in->fh=(uint64_t) (uintptr_t) openfile;
+    read_in->offset=ahead;
+    read_in->size=readahead->window;
+    rarequest->data=(void *) openfile;
+
+    readahead->rastart=ahead;
+    readahead->rasize=readahead->window;
+
+    /* the buffer is of the generation of the readahead: drop it when it's of an older one */
+
+    cachegen=get_block_cache_generation(openfile->inode);
+
+    if (readahead->cachegen!=cachegen) {
+
+	clear_readahead_buffer(readahead);
+	readahead->cachegen=cachegen;
+
+    }
+
+    readahead->flags |= READAHEAD_FLAG_INFLIGHT;
+
+    /* next time twice as much */
+
+    if (readahead->window < READAHEAD_WINDOW_MAX) readahead->window=readahead->window << 1;
+
+    pthread_mutex_unlock(&readahead->mutex);
+
+    work_workerthread(NULL, 0, run_readahead, (void *) rarequest, &error);
+
+    if (error>0) {
+
+	logoutput("update_readahead: error %i starting readahead (%s)", error, strerror(error));
+
+	pthread_mutex_lock(&readahead->mutex);
+	readahead->flags &= ~READAHEAD_FLAG_INFLIGHT;
+	pthread_cond_broadcast(&readahead->cond);
+	pthread_mutex_unlock(&readahead->mutex);
+	free(rarequest);
+
+    }
+
+    return;
+
+    unlock:
+
+    pthread_mutex_unlock(&readahead->mutex);
+
+}
+
+/* the file is written with this handle: the data read ahead is not valid anymore */
+
+void drop_readahead(struct fuse_openfile_s *openfile)
+{
+    struct fuse_readahead_s *readahead=__atomic_load_n(&openfile->readahead, __ATOMIC_ACQUIRE);
+
+    if (readahead==NULL) return;
+
+    pthread_mutex_lock(&readahead->mutex);
+    while (readahead->flags & READAHEAD_FLAG_INFLIGHT) pthread_cond_wait(&readahead->cond, &readahead->mutex);
+    clear_readahead_buffer(readahead);
+    pthread_mutex_unlock(&readahead->mutex);
+
+}
+
+/* at release, before the handle is closed: wait for the readahead in flight */
+
+void free_readahead(struct fuse_openfile_s *openfile)
+{
+    struct fuse_readahead_s *readahead=openfile->readahead;
+
+    if (readahead==NULL) return;
+
+    pthread_mutex_lock(&readahead->mutex);
+    readahead->flags |= READAHEAD_FLAG_RELEASE;
+    while (readahead->flags & READAHEAD_FLAG_INFLIGHT) pthread_cond_wait(&readahead->cond, &readahead->mutex);
+    clear_readahead_buffer(readahead);
+    pthread_mutex_unlock(&readahead->mutex);
+
+    logoutput("free_readahead: hits %lu waits %lu misses %lu", (unsigned long) readahead->hits, (unsigned long) readahead->waits, (unsigned long) readahead->misses);
+
+    pthread_cond_destroy(&readahead->cond);
+    pthread_mutex_destroy(&readahead->mutex);
+    free(readahead);
+    openfile->readahead=NULL;
+
+}
@@ -0,0 +1,74 @@
+/*
+  2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017 Stef Bon <stefbon@gmail.com>
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#ifndef SB_COMMON_UTILS_FUSE_READAHEAD_H
+#define SB_COMMON_UTILS_FUSE_READAHEAD_H
+
+#define READAHEAD_WINDOW_MIN				131072
+#define READAHEAD_WINDOW_MAX				4194304
+#define READAHEAD_SEQUENTIAL				2		/* sequential reads before the readahead starts */
+
+#define READAHEAD_FLAG_INFLIGHT				1
+#define READAHEAD_FLAG_RELEASE				2
+
+/*
+    readahead of an open file
+
+    every read is compared with the end of the previous one, and after READAHEAD_SEQUENTIAL sequential reads
+    the next window is read from the backend in a workerthread, with an internal request (the reply is not
+    written to the VFS but kept in the buffer of the file, and the block cache)
+    a read for data in the buffer is served from memory, a read for data of the readahead in flight waits for it
+    a new readahead is started when the reader is less than half a window from the end of the buffer; the window
+    doubles with every readahead (from READAHEAD_WINDOW_MIN up to READAHEAD_WINDOW_MAX) and is reset by a random read
+    the buffer only keeps the data from the position of the reader, so it's at most twice the window
+
+    the data is only used when the file has the same size and mtime as when read, and the same block cache generation
+    (cachegen): a write with any handle makes it invalid, a write with the handle also drops it
+*/
+
+struct fuse_readahead_s {
+    pthread_mutex_t				mutex;
+    pthread_cond_t				cond;
+    unsigned char				flags;
+    unsigned int				window;
+    uint64_t					reader;
+    uint64_t					start;
+    unsigned int				len;
+    char					*buffer;
+    uint64_t					rastart;
+    unsigned int				rasize;
+    uint32_t					cachegen;
+    uint64_t					size;
+    struct inode_time_s				mtim;
+    uint64_t					hits;
+    uint64_t					waits;
+    uint64_t					misses;
+};
+
+struct fuse_openfile_s;
+struct fuse_request_s;
+
+/* prototypes */
+
+int read_readahead(struct fuse_openfile_s *openfile, struct fuse_request_s *request, size_t size, off_t offset);
+void update_readahead(struct fuse_openfile_s *openfile, struct fuse_request_s *request, size_t size, off_t offset);
+void drop_readahead(struct fuse_openfile_s *openfile);
+void free_readahead(struct fuse_openfile_s *openfile);
+
+#endif
@@ -0,0 +1,294 @@
+/*
+  2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017 Stef Bon <stefbon@gmail.com>
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include "global-defines.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+
+#include <inttypes.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include "logging.h"
+#include "utils.h"
+#include "fuse-dentry.h"
+#include "fuse-inode-hashtable.h"
+#include "fuse-interface.h"
+#include "fuse-singleflight.h"
+
+struct fuse_flight_bucket_s {
+    pthread_mutex_t				mutex;
+    struct fuse_flight_s			*flights;
+} __attribute__((aligned(64)));
+
+static struct fuse_flight_bucket_s flight_buckets[FUSE_FLIGHT_HASHSIZE] = {[0 ... FUSE_FLIGHT_HASHSIZE - 1] = {PTHREAD_MUTEX_INITIALIZER, NULL}};
+static struct fuse_flight_stat_s flight_stat={0, 0, 0};
+
+static unsigned int get_flight_hashvalue(struct fuse_flight_s *flight)
+{
+    uint64_t hash=14695981039346656037ULL ^ flight->opcode;
+    char *name=flight->name;
+    unsigned int len=flight->len;
+
+    hash=(hash ^ flight->ino) * 1099511628211ULL;
+    hash=(hash ^ (((uint64_t) flight->uid << 32) | flight->gid)) * 1099511628211ULL;
+    for (unsigned int i=0; i<len; i++) hash=(hash ^ (unsigned char) name[i]) * 1099511628211ULL;
+    return (unsigned int) (hash ^ (hash >> 32));
+}
+
+static struct fuse_flight_s *find_flight(struct fuse_flight_bucket_s *bucket, struct fuse_flight_s *flight)
+{
+    struct fuse_flight_s *tmp=bucket->flights;
+
+    while (tmp) {
+
+	if (tmp->hashvalue==flight->hashvalue && tmp->opcode==flight->opcode && tmp->ino==flight->ino && tmp->len==flight->len &&
+	    tmp->uid==flight->uid && tmp->gid==flight->gid) {
+
+	    if (tmp->len==0 || memcmp(tmp->name, flight->name, tmp->len)==0) break;
+
+	}
+
+	tmp=tmp->next;
+
+    }
+
+    return tmp;
+
+}
+
+static void remove_flight(struct fuse_flight_bucket_s *bucket, struct fuse_flight_s *flight)
+{
+    struct fuse_flight_s **p=&bucket->flights;
+
+    while (*p) {
+
+	if (*p==flight) {
+
+	    *p=flight->next;
+	    break;
+
+	}
+
+	p=&(*p)->next;
+
+    }
+
+    flight->next=NULL;
+
+}
+
+/*
+    join the flight of the same request when there is one, otherwise start one
+    returns 1 when the request is taken care of (the reply of another one is send),
+    0 when the caller has to go to the backend itself (and call end_fuse_flight afterwards)
+*/
+
+int start_fuse_flight(struct fuse_flight_s *flight, struct fuse_request_s *request, uint32_t opcode, uint64_t ino, char *name, unsigned int len)
+{
+    struct fuse_flight_bucket_s *bucket=NULL;
+    struct fuse_flight_s *leader=NULL;
+    struct timespec expire;
+    unsigned int error=0;
+    unsigned int size=0;
+    char data[FUSE_FLIGHT_MAXDATA];
+
+    flight->next=NULL;
+    flight->opcode=opcode;
+    flight->ino=ino;
+    flight->uid=request->uid;
+    flight->gid=request->gid;
+    flight->name=name;
+    flight->len=len;
+    flight->hashvalue=get_flight_hashvalue(flight);
+    flight->waiters=0;
+    flight->flags=0;
+    flight->error=0;
+    flight->size=0;
+
+    bucket=&flight_buckets[flight->hashvalue & (FUSE_FLIGHT_HASHSIZE - 1)];
+    pthread_mutex_lock(&bucket->mutex);
+
+    leader=find_flight(bucket, flight);
+
+    if (leader==NULL) {
+
+	/* first one: the leader */
+
+	pthread_cond_init(&flight->cond, NULL);
+	flight->next=bucket->flights;
+	bucket->flights=flight;
+	request->flight=flight;
+	pthread_mutex_unlock(&bucket->mutex);
+
+	__atomic_add_fetch(&flight_stat.leaders, 1, __ATOMIC_RELAXED);
+	return 0;
+
+    }
+
+    get_current_time(&expire);
+    expire.tv_sec+=FUSE_FLIGHT_TIMEOUT;
+
+    leader->waiters++;
+
+    while ((leader->flags & FUSE_FLIGHT_FLAG_DONE)==0) {
+
+	if (pthread_cond_timedwait(&leader->cond, &bucket->mutex, &expire)==ETIMEDOUT) break;
+
+    }
+
+    /* when not done the leader is too late: leave without the reply (and not counted in the lookups when it lands) */
+
+    if (leader->flags & FUSE_FLIGHT_FLAG_REPLIED) {
+
+	error=leader->error;
+	size=leader->size;
+	if (size>0) memcpy(data, leader->data, size);
+
+    }
+
+    leader->waiters--;
+    if (leader->waiters==0) pthread_cond_broadcast(&leader->cond);
+
+    if ((leader->flags & FUSE_FLIGHT_FLAG_REPLIED)==0) {
+
+	/* leader finished without a reply which can be shared, or did not finish in time */
+
+	pthread_mutex_unlock(&bucket->mutex);
+	__atomic_add_fetch(&flight_stat.fallbacks, 1, __ATOMIC_RELAXED);
+	request->flight=NULL;
+	return 0;
+
+    }
+
+    pthread_mutex_unlock(&bucket->mutex);
+
+    __atomic_add_fetch(&flight_stat.saved, 1, __ATOMIC_RELAXED);
+
+    if (error>0) {
+
+	reply_VFS_error(request, error);
+
+    } else {
+
+	reply_VFS_data(request, data, size);
+
+    }
+
+    return 1;
+
+}
+
+/*
+    called by the reply functions with the reply of the leader, before it's written
+    the followers get the same reply, the table does not accept new followers anymore
+*/
+
+void land_fuse_flight(struct fuse_request_s *request, char *buffer, size_t size, unsigned int error)
+{
+    struct fuse_flight_s *flight=request->flight;
+    struct fuse_flight_bucket_s *bucket=NULL;
+
+    if (flight==NULL || (flight->flags & FUSE_FLIGHT_FLAG_DONE)) return;
+
+    bucket=&flight_buckets[flight->hashvalue & (FUSE_FLIGHT_HASHSIZE - 1)];
+    pthread_mutex_lock(&bucket->mutex);
+
+    remove_flight(bucket, flight);
+
+    if (size<=FUSE_FLIGHT_MAXDATA) {
+
+	if (error==0 && size>0) memcpy(flight->data, buffer, size);
+	flight->size=(unsigned int) size;
+	flight->error=error;
+	flight->flags|=FUSE_FLIGHT_FLAG_REPLIED;
+
+	/* every follower of a found entry is a lookup for the VFS too */
+
+	if (flight->opcode==FUSE_LOOKUP && error==0 && size>=sizeof(struct fuse_entry_out) && flight->waiters>0) {
+	    struct fuse_entry_out *entry_out=(struct fuse_entry_out *) buffer;
+
+	    if (entry_out->nodeid>0) {
+		struct inode_s *inode=lookup_inode_hashtable(entry_out->nodeid);
+
+		if (inode) {
+
+		    __atomic_add_fetch(&inode->nlookup, flight->waiters, __ATOMIC_RELAXED);
+
+		} else {
+
+		    /* not possible to account the lookups: let the followers go to the backend */
+
+		    flight->flags&=~FUSE_FLIGHT_FLAG_REPLIED;
+
+		}
+
+	    }
+
+	}
+
+    }
+
+    flight->flags|=FUSE_FLIGHT_FLAG_DONE;
+    pthread_cond_broadcast(&flight->cond);
+    pthread_mutex_unlock(&bucket->mutex);
+
+}
+
+/* leader is finished with the backend: wait for the followers to take the reply */
+
+void end_fuse_flight(struct fuse_flight_s *flight, struct fuse_request_s *request)
+{
+    struct fuse_flight_bucket_s *bucket=NULL;
+
+    if (request->flight!=flight) return;
+
+    bucket=&flight_buckets[flight->hashvalue & (FUSE_FLIGHT_HASHSIZE - 1)];
+    pthread_mutex_lock(&bucket->mutex);
+
+    if ((flight->flags & FUSE_FLIGHT_FLAG_DONE)==0) {
+
+	remove_flight(bucket, flight);
+	flight->flags|=FUSE_FLIGHT_FLAG_DONE;
+	pthread_cond_broadcast(&flight->cond);
+
+    }
+
+    while (flight->waiters>0) pthread_cond_wait(&flight->cond, &bucket->mutex);
+    pthread_mutex_unlock(&bucket->mutex);
+
+    pthread_cond_destroy(&flight->cond);
+    request->flight=NULL;
+
+}
+
+void get_fuse_flight_stat(struct fuse_flight_stat_s *stat)
+{
+    stat->leaders=__atomic_load_n(&flight_stat.leaders, __ATOMIC_RELAXED);
+    stat->saved=__atomic_load_n(&flight_stat.saved, __ATOMIC_RELAXED);
+    stat->fallbacks=__atomic_load_n(&flight_stat.fallbacks, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,81 @@
+/*
+  2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017 Stef Bon <stefbon@gmail.com>
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#ifndef SB_COMMON_UTILS_FUSE_SINGLEFLIGHT_H
+#define SB_COMMON_UTILS_FUSE_SINGLEFLIGHT_H
+
+#include "fuse-interface.h"
+
+#define FUSE_FLIGHT_HASHSIZE				64		/* power of 2 */
+#define FUSE_FLIGHT_MAXDATA				256		/* larger replies are not shared */
+#define FUSE_FLIGHT_TIMEOUT				4		/* seconds a follower waits for the leader */
+
+#define FUSE_FLIGHT_FLAG_DONE				1
+#define FUSE_FLIGHT_FLAG_REPLIED			2
+
+/*
+    coalescing of identical requests (LOOKUP of a name in a directory, GETATTR of an inode) which are in progress
+    at the same time
+    requests are only identical for the same uid and gid: the backend may answer differently per user
+
+    the first request of a key is the leader: it registers a flight and goes to the backend as usual
+    requests for the same key arriving while the flight is registered wait for it, and when the leader replies
+    (reply_VFS_data/reply_VFS_error) the reply is copied and send to all of them with their own unique
+    the flight is removed from the table at the reply, later requests go to the backend again
+
+    the nlookup of the inode of a shared positive LOOKUP is increased for every follower before the leader replies,
+    so a FORGET from the VFS can never be earlier
+    when the leader did not reply within FUSE_FLIGHT_TIMEOUT seconds (or the reply is too big) the followers go to
+    the backend themselves
+
+    the flight lives on the stack of the leader
+*/
+
+struct fuse_flight_s {
+    struct fuse_flight_s			*next;
+    uint32_t					opcode;
+    uint64_t					ino;
+    uint32_t					uid;
+    uint32_t					gid;
+    char					*name;
+    unsigned int				len;
+    unsigned int				hashvalue;
+    pthread_cond_t				cond;
+    unsigned int				waiters;
+    unsigned int				flags;
+    unsigned int				error;
+    unsigned int				size;
+    char					data[FUSE_FLIGHT_MAXDATA];
+};
+
+struct fuse_flight_stat_s {
+    uint64_t					leaders;
+    uint64_t					saved;
+    uint64_t					fallbacks;
+};
+
+/* prototypes */
+
+int start_fuse_flight(struct fuse_flight_s *flight, struct fuse_request_s *request, uint32_t opcode, uint64_t ino, char *name, unsigned int len);
+void land_fuse_flight(struct fuse_request_s *request, char *buffer, size_t size, unsigned int error);
+void end_fuse_flight(struct fuse_flight_s *flight, struct fuse_request_s *request);
+
+void get_fuse_flight_stat(struct fuse_flight_stat_s *stat);
+
+#endif
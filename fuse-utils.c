@@ -50,6 +50,8 @@
 
 #include "fuse-dentry.h"
 #include "fuse-directory.h"
+#include "fuse-directory-btree.h"
+#include "fuse-directory-negative.h"
 #include "fuse-utils.h"
 #include "fuse-fs.h"
 #include "workspaces.h"
@@ -62,9 +64,11 @@ static struct directory_s dummy_directory;
 static struct dops_s dummy_dops;
 static struct dops_s default_dops;
 static struct dops_s removed_dops;
+static struct dops_s btree_dops;
+static struct dops_s removed_btree_dops;
 
-typedef struct entry_s *(*find_entry_cb)(struct entry_s *parent, struct name_s *xname, unsigned int *error);
-typedef void (*remove_entry_cb)(struct entry_s *entry, unsigned int *error);
+typedef struct entry_s *(*find_entry_cb)(struct directory_s *directory, struct name_s *xname, unsigned int *error);
+typedef void (*remove_entry_cb)(struct directory_s *directory, struct entry_s *entry, unsigned int *error);
 typedef struct entry_s *(*insert_entry_cb)(struct directory_s *directory, struct entry_s *entry, unsigned int *error, unsigned short flags);
 typedef struct entry_s *(*insert_entry_batch_cb)(struct directory_s *directory, struct entry_s *entry, unsigned int *error, unsigned short flags);
 
@@ -115,7 +119,7 @@ static struct directory_s *remove_directory_common(struct inode_s *inode, unsign
 {
     struct directory_s *directory=(struct directory_s *) inode->link.link.ptr;
     directory->flags|=_DIRECTORY_FLAG_REMOVE;
-    directory->dops=&removed_dops;
+    directory->dops=(directory->btree) ? &removed_btree_dops : &removed_dops;
     _remove_directory_hashtable(directory);
     directory->inode=NULL;
     set_directory_dump(inode, get_dummy_directory());
@@ -152,6 +156,59 @@ static struct dops_s removed_dops = {
     .remove_directory		= remove_directory_removed,
 };
 
+/* BTREE DIRECTORY OPS: entries are indexed by a btree instead of the skiplist */
+
+static struct dops_s btree_dops = {
+    .find_entry			= find_entry_btree,
+    .remove_entry		= remove_entry_btree,
+    .insert_entry		= insert_entry_btree,
+    .get_directory		= get_directory_common,
+    .remove_directory		= remove_directory_common,
+    .find_entry_batch		= find_entry_btree_batch,
+    .remove_entry_batch		= remove_entry_btree_batch,
+    .insert_entry_batch		= insert_entry_btree_batch,
+    .insert_entries_batch	= insert_entries_btree_batch,
+};
+
+static struct dops_s removed_btree_dops = {
+    .find_entry			= find_entry_btree,
+    .remove_entry		= remove_entry_btree,
+    .insert_entry		= insert_entry_btree,
+    .get_directory		= get_directory_removed,
+    .remove_directory		= remove_directory_removed,
+    .find_entry_batch		= find_entry_btree_batch,
+    .remove_entry_batch		= remove_entry_btree_batch,
+    .insert_entry_batch		= insert_entry_btree_batch,
+    .insert_entries_batch	= insert_entries_btree_batch,
+};
+
+/*
+    index the entries of a directory with a btree
+    only possible when the directory is still empty
+*/
+
+int set_directory_btree(struct directory_s *directory, unsigned int *error)
+{
+
+    if (directory->btree) {
+
+	return 0;
+
+    } else if (directory->dops!=&default_dops || directory->count>0 || directory->skiplist.lockfree) {
+
+	*error=EINVAL;
+	return -1;
+
+    }
+
+    directory->btree=create_directory_btree(error);
+    if (directory->btree==NULL) return -1;
+
+    directory->dops=&btree_dops;
+    return 0;
+
+}
+
 /* simple functions which call the right function for the directory */
 
 struct directory_s *get_directory(struct inode_s *inode, unsigned int *error)
@@ -195,6 +252,7 @@ struct directory_s *remove_directory(struct inode_s *inode, unsigned int *error)
 struct entry_s *find_entry(struct directory_s *directory, struct name_s *lookupname, unsigned int *error)
 {
     unsigned int row=0;
+    if (directory->dops && directory->dops->find_entry) return (* directory->dops->find_entry)(directory, lookupname, error);
     return (struct entry_s *) find_sl(&directory->skiplist, (void *) lookupname, &row, error);
 }
 
@@ -202,6 +260,14 @@ void remove_entry(struct directory_s *directory, struct entry_s *entry, unsigned
 {
     struct name_s *lookupname=&entry->name;
     unsigned int row=0;
+
+    if (directory->dops && directory->dops->remove_entry) {
+
+	(* directory->dops->remove_entry)(directory, entry, error);
+	return;
+
+    }
+
     delete_sl(&directory->skiplist, (void *) lookupname, &row, error);
 }
 
@@ -210,12 +276,28 @@ struct entry_s *insert_entry(struct directory_s *directory, struct entry_s *entr
     struct name_s *lookupname=&entry->name;
     unsigned int row=0;
     unsigned short sl_flags=(flags & _ENTRY_FLAG_TEMP) ? _SL_INSERT_FLAG_NOLANE : 0;
-    return (struct entry_s *)insert_sl(&directory->skiplist, (void *) lookupname, &row, error, (void *) entry, sl_flags);
+    struct entry_s *result=NULL;
+
+    if (directory->dops && directory->dops->insert_entry) {
+
+	result=(* directory->dops->insert_entry)(directory, entry, error, flags);
+
+    } else {
+
+	result=(struct entry_s *)insert_sl(&directory->skiplist, (void *) lookupname, &row, error, (void *) entry, sl_flags);
+
+    }
+
+    /* the name exists now */
+
+    if (result==entry) change_negative_cache(directory, lookupname);
+    return result;
 }
 
 struct entry_s *find_entry_batch(struct directory_s *directory, struct name_s *lookupname, unsigned int *error)
 {
     unsigned int row=0;
+    if (directory->dops && directory->dops->find_entry_batch) return (* directory->dops->find_entry_batch)(directory, lookupname, error);
     return (struct entry_s *) find_sl_batch(&directory->skiplist, (void *) lookupname, &row, error);
 }
 
@@ -223,6 +305,14 @@ void remove_entry_batch(struct directory_s *directory, struct entry_s *entry, un
 {
     struct name_s *lookupname=&entry->name;
     unsigned int row=0;
+
+    if (directory->dops && directory->dops->remove_entry_batch) {
+
+	(* directory->dops->remove_entry_batch)(directory, entry, error);
+	return;
+
+    }
+
     delete_sl_batch(&directory->skiplist, (void *) lookupname, &row, error);
 }
 
@@ -231,7 +321,115 @@ struct entry_s *insert_entry_batch(struct directory_s *directory, struct entry_s
     struct name_s *lookupname=&entry->name;
     unsigned int row=0;
     unsigned short sl_flags=(flags & _ENTRY_FLAG_TEMP) ? _SL_INSERT_FLAG_NOLANE : 0;
-    return (struct entry_s *) insert_sl_batch(&directory->skiplist, (void *) lookupname, &row, error, (void *) entry, sl_flags);
+    struct entry_s *result=NULL;
+
+    if (directory->dops && directory->dops->insert_entry_batch) {
+
+	result=(* directory->dops->insert_entry_batch)(directory, entry, error, flags);
+
+    } else {
+
+	result=(struct entry_s *) insert_sl_batch(&directory->skiplist, (void *) lookupname, &row, error, (void *) entry, sl_flags);
+
+    }
+
+    if (result==entry) change_negative_cache(directory, lookupname);
+    return result;
+}
+
+static int compare_entries_sort(const void *a, const void *b)
+{
+    struct entry_s *x=*((struct entry_s **) a);
+    struct entry_s *y=*((struct entry_s **) b);
+    return compare_entry_name(x, &y->name);
+}
+
+/* a batch is merged in one pass over the directory only when it holds at least 1/16 of the entries present */
+
+#define DIRECTORY_BATCH_BULK_RATIO			16
+
+/*
+    insert a batch of entries sorted by name (see compare_entry_name) in one pass, for example when populating
+    a directory from a readdir of the backend, the caller holds the write lock
+
+    result[i] is what insert_entry_batch would return for entries[i]: the entry itself when added,
+    the existing entry when the name is already there, NULL when it failed
+    returns the number of entries added
+    a small batch (compared to the entries present) is inserted entry by entry
+*/
+
+unsigned int insert_sorted_entries_batch(struct directory_s *directory, struct entry_s **entries, struct entry_s **result, unsigned int count, unsigned int *error)
+{
+    void **lookupdata=NULL;
+    unsigned int added=0;
+
+    *error=0;
+    if (count==0) return 0;
+
+    if (count * DIRECTORY_BATCH_BULK_RATIO < directory->count) {
+
+	/* a batch small compared to the directory: a search per entry is cheaper than walking all entries
+	    present and building the index again */
+
+	for (unsigned int i=0; i<count; i++) {
+	    unsigned int tmp=0;
+
+	    result[i]=insert_entry_batch(directory, entries[i], &tmp, 0);
+
+	    if (result[i]==entries[i]) {
+
+		added++;
+
+	    } else if (result[i]==NULL) {
+
+		*error=tmp;
+
+	    }
+
+	}
+
+	return added;
+
+    } else if (directory->dops && directory->dops->insert_entries_batch) {
+
+	added=(* directory->dops->insert_entries_batch)(directory, entries, result, count, error);
+
+    } else {
+
+	lookupdata=malloc(count * sizeof(void *));
+
+	if (lookupdata==NULL) {
+
+	    *error=ENOMEM;
+	    return 0;
+
+	}
+
+	for (unsigned int i=0; i<count; i++) lookupdata[i]=(void *) &entries[i]->name;
+	added=insert_sl_sorted_batch(&directory->skiplist, lookupdata, (void **) entries, (void **) result, count, error);
+	free(lookupdata);
+
+    }
+
+    /* one change for the whole batch, and do not look for every name: forget them all */
+
+    if (added>0) {
+
+	change_negative_cache(directory, NULL);
+	clear_negative_cache(directory);
+
+    }
+
+    return added;
+
+}
+
+/* as above, the array of entries is sorted first (in place) */
+
+unsigned int insert_entries_batch(struct directory_s *directory, struct entry_s **entries, struct entry_s **result, unsigned int count, unsigned int *error)
+{
+    qsort(entries, count, sizeof(struct entry_s *), compare_entries_sort);
+    return insert_sorted_entries_batch(directory, entries, result, count, error);
 }
 
 struct pathcalls_s *get_pathcalls(struct directory_s *d)
@@ -275,9 +473,9 @@ static struct entry_s *_cb_create_entry(struct entry_s *parent, struct name_s *n
 {
     return create_entry(parent, name);
 }
-static struct inode_s *_cb_create_inode(unsigned int s)
+static struct inode_s *_cb_create_inode(struct entry_s *entry, unsigned int s)
 {
-    return create_inode(s);
+    return create_inode_slabs(get_entry_slabs(entry), s);
 }
 static struct entry_s *_cb_insert_entry(struct directory_s *directory, struct entry_s *entry, unsigned int flags, unsigned int *error)
 {
@@ -322,15 +520,17 @@ static void _cb_created_default(struct entry_s *entry, struct create_entry_s *ce
     struct service_context_s *context=ce->context;
     struct inode_s *inode=entry->inode;
     struct entry_s *parent=entry->parent;
+    struct timespec synctime;
 
     // logoutput("_cb_created_default: name %s", entry->name.name);
 
-    inode->nlookup=1;
+    __atomic_store_n(&inode->nlookup, 1, __ATOMIC_RELAXED);
     inode->st.st_nlink=1;
 
-    get_current_time(&inode->stim); 							/* sync time */
-    memcpy(&parent->inode->st.st_ctim, &inode->stim, sizeof(struct timespec)); 		/* change the ctime of parent directory since it's attr are changed */
-    memcpy(&parent->inode->st.st_mtim, &inode->stim, sizeof(struct timespec)); 		/* change the mtime of parent directory since an entry is added */
+    get_current_time(&synctime);
+    set_inode_time(&inode->stim, &synctime); 						/* sync time */
+    set_inode_time(&parent->inode->st.st_ctim, &synctime); 				/* change the ctime of parent directory since it's attr are changed */
+    set_inode_time(&parent->inode->st.st_mtim, &synctime); 				/* change the mtime of parent directory since an entry is added */
 
     (* ce->cb_adjust_pathmax)(ce); 							/* adjust the maximum path len */
     (* ce->cb_cache_created)(entry, ce); 						/* create the inode stat and cache */
@@ -351,15 +551,19 @@ static void _cb_found_default(struct entry_s *entry, struct create_entry_s *ce)
     struct service_context_s *context=ce->context;
     struct stat *st=&ce->cache.st;
     struct inode_s *inode=entry->inode;
+    struct timespec synctime;
+    uint64_t nlookup=0;
 
     // logoutput("_cb_found_default: name %s", entry->name.name);
 
-    inode->nlookup++;
-    get_current_time(&inode->stim);
+    nlookup=__atomic_add_fetch(&inode->nlookup, 1, __ATOMIC_RELAXED);
+    touch_inode(inode);
+    get_current_time(&synctime);
+    set_inode_time(&inode->stim, &synctime);
 
     /* when just created (for example by readdir) adjust the pathcache */
 
-    if (inode->nlookup==1) (* ce->cb_adjust_pathmax)(ce); /* adjust the maximum path len */
+    if (nlookup==1) (* ce->cb_adjust_pathmax)(ce); /* adjust the maximum path len */
     (* ce->cb_cache_found)(entry, ce); /* get/set the inode stat cache */
     (* ce->cb_context_found)(ce, entry); /* context depending cb, like a FUSE reply and adding inode to context, set fs etc */
 
@@ -450,7 +654,7 @@ static struct entry_s *_create_entry_extended_common(struct create_entry_s *ce)
     parent=directory->inode->alias;
 
     entry=(* ce->cb_create_entry)(parent, ce->name);
-    inode=(* ce->cb_create_inode)(cache_size);
+    inode=(* ce->cb_create_inode)(entry, cache_size);
 
     if (entry && inode) {
 
@@ -475,7 +679,7 @@ static struct entry_s *_create_entry_extended_common(struct create_entry_s *ce)
 
 		destroy_entry(entry);
 		entry=result;
-		free(inode);
+		free_inode(inode);
 		inode=entry->inode;
 
 		error=0;
@@ -487,7 +691,7 @@ static struct entry_s *_create_entry_extended_common(struct create_entry_s *ce)
 		/* another error */
 
 		destroy_entry(entry);
-		free(inode);
+		free_inode(inode);
 		(* ce->cb_error) (parent, ce->name, ce, error);
 		return NULL;
 
@@ -500,7 +704,7 @@ static struct entry_s *_create_entry_extended_common(struct create_entry_s *ce)
 	/* unable to allocate entry and/or inode */
 
 	if (entry) destroy_entry(entry);
-	if (inode) free(inode);
+	if (inode) free_inode(inode);
 	(* ce->cb_error) (parent, ce->name, ce, error);
 	error=ENOMEM;
 	return NULL;
@@ -527,11 +731,47 @@ struct entry_s *create_entry_extended_batch(struct create_entry_s *ce)
     return _create_entry_extended_common(ce);
 }
 
+/*
+    take the inodes of the directory and all the directories below it out of the inode table
+    lookups may still be looking at them: the caller waits for one grace period before freeing them
+*/
+
+static void _unhash_directory(struct directory_s *directory)
+{
+    struct entry_s *entry=(struct entry_s *) directory->first;
+
+    while (entry) {
+	struct inode_s *inode=entry->inode;
+
+	if (inode) {
+
+	    if (inode->flags & INODE_FLAG_HASHED) {
+
+		remove_inode_hashtable(inode);
+		inode->flags-=INODE_FLAG_HASHED;
+
+	    }
+
+	    if (S_ISDIR(inode->st.st_mode)) {
+		struct directory_s *subdir=get_directory_dump(inode);
+
+		if (subdir && subdir!=get_dummy_directory()) _unhash_directory(subdir);
+
+	    }
+
+	}
+
+	entry=entry->name_next;
+
+    }
+
+}
+
 /*
     remove contents of directory and 
     clear the skiplist
-    remove from hash table
     destroy the directory
+    the inodes are out of the hash table already (_unhash_directory)
 
 */
 
@@ -591,10 +831,10 @@ static void _clear_directory(struct context_interface_s *i, struct directory_s *
 
 	    }
 
-	    /* remove and free inode */
+	    /* free inode */
 
 	    inode->alias=NULL;
-	    free(inode);
+	    free_inode(inode);
 	    entry->inode=NULL;
 
 	}
@@ -613,6 +853,12 @@ void clear_directory(struct context_interface_s *i, struct directory_s *director
     char path[workspace->pathmax];
 
     memset(path, 0, workspace->pathmax);
+
+    /* one grace period for the whole tree */
+
+    _unhash_directory(directory);
+    wait_inode_hashtable_grace();
+
     _clear_directory(i, directory, path, 0, 0);
 }
 
@@ -639,7 +885,7 @@ void set_inode_link_directory(struct inode_s *inode, struct inode_link_s *link)
 struct entry_s *walk_fuse_fs(struct entry_s *parent, char *path)
 {
     struct entry_s *entry=NULL;
-    struct name_s xname={NULL, 0, 0};
+    struct name_s xname={NULL, 0, 0, 0};
     unsigned int len=0;
     char *slash=NULL;
     unsigned int error=0;
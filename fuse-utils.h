@@ -29,7 +29,7 @@ struct create_entry_s {
     } tree;
     struct service_context_s		*context;
     struct entry_s 			*(*cb_create_entry)(struct entry_s *p, struct name_s *n);
-    struct inode_s			*(*cb_create_inode)(unsigned int size);
+    struct inode_s			*(*cb_create_inode)(struct entry_s *e, unsigned int size);
     struct entry_s			*(*cb_insert_entry)(struct directory_s *d, struct entry_s *e, unsigned int f, unsigned int *error);
     void				(*cb_created)(struct entry_s *e, struct create_entry_s *ce);
     void				(*cb_found)(struct entry_s *e, struct create_entry_s *ce);
@@ -60,11 +60,14 @@ struct entry_s *insert_entry(struct directory_s *directory, struct entry_s *entr
 struct entry_s *find_entry_batch(struct directory_s *directory, struct name_s *xname, unsigned int *error);
 void remove_entry_batch(struct directory_s *directory, struct entry_s *entry, unsigned int *error);
 struct entry_s *insert_entry_batch(struct directory_s *directory, struct entry_s *entry, unsigned int *error, unsigned short flags);
+unsigned int insert_sorted_entries_batch(struct directory_s *directory, struct entry_s **entries, struct entry_s **result, unsigned int count, unsigned int *error);
+unsigned int insert_entries_batch(struct directory_s *directory, struct entry_s **entries, struct entry_s **result, unsigned int count, unsigned int *error);
 
 struct directory_s *get_directory(struct inode_s *inode, unsigned int *error);
 struct directory_s *remove_directory(struct inode_s *inode, unsigned int *error);
 
 void init_directory_calls();
+int set_directory_btree(struct directory_s *directory, unsigned int *error);
 struct directory_s *get_dummy_directory();
 
 int get_inode_link_directory(struct inode_s *inode, struct inode_link_s *link);
@@ -0,0 +1,608 @@
+/*
+  2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017 Stef Bon <stefbon@gmail.com>
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "global-defines.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+
+#include <inttypes.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "logging.h"
+#include "utils.h"
+#include "workerthreads.h"
+#include "fuse-dentry.h"
+#include "fuse-block-cache.h"
+#include "fuse-interface.h"
+#include "fuse-fs.h"
+#include "fuse-writeback.h"
+
+/*
+    the buffers with data, oldest first, for the flush thread
+    and the buffers being written (taken from the list by the flush thread or a flush of the inode)
+    count is the number of buffers on both
+*/
+
+struct writeback_list_s {
+    pthread_mutex_t				mutex;
+    pthread_cond_t				cond;
+    struct fuse_writeback_s			*first;
+    struct fuse_writeback_s			*last;
+    struct fuse_writeback_s			*writing;
+    unsigned int				count;
+    unsigned char				running;
+    unsigned int				size;
+    unsigned int				age;
+    uint64_t					writes;
+    uint64_t					flushes;
+};
+
+static struct writeback_list_s writeback_list={PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL, NULL, 0, 0, 0, 0, 0, 0};
+
+struct writeback_result_s {
+    unsigned int				written;
+    unsigned int				error;
+};
+
+/* size of the buffer of every file (zero: no write-back), age in milliseconds */
+
+void set_fuse_writeback(unsigned int size, unsigned int age)
+{
+    pthread_mutex_lock(&writeback_list.mutex);
+    writeback_list.size=size;
+    writeback_list.age=age;
+    pthread_mutex_unlock(&writeback_list.mutex);
+}
+
+static void cb_data_writeback(struct fuse_request_s *request, char *buffer, size_t size)
+{
+    struct writeback_result_s *result=(struct writeback_result_s *) request->data;
+    if (size >= sizeof(struct fuse_write_out)) result->written=((struct fuse_write_out *) buffer)->size;
+}
+
+static unsigned char cb_error_writeback(struct fuse_request_s *request, unsigned int error)
+{
+    struct writeback_result_s *result=(struct writeback_result_s *) request->data;
+    result->error=error;
+    return 1;
+}
+
+static void cb_write_writeback(struct fuse_request_s *request, void *ptr)
+{
+    struct fuse_writeback_s *writeback=(struct fuse_writeback_s *) ptr;
+    struct fuse_openfile_s *openfile=writeback->openfile;
+
+    (* openfile->inode->fs->type.nondir.write)(openfile, request, writeback->buffer, writeback->len, writeback->start, writeback->write_flags, writeback->lock_owner);
+}
+
+/* write the buffer to the backend, with the mutex of the buffer locked */
+
+static void write_writeback(struct fuse_writeback_s *writeback)
+{
+    struct fuse_request_s *request=NULL;
+    struct fuse_write_in *write_in=NULL;
+    struct writeback_result_s result={0, 0};
+
+    if (writeback->len==0) return;
+
+    request=create_fuse_request_internal(writeback->from, FUSE_WRITE, sizeof(struct fuse_write_in));
+
+    if (request==NULL) {
+
+	writeback->error=ENOMEM;
+	writeback->len=0;
+	return;
+
+    }
+
+    write_in=(struct fuse_write_in *) request->buffer;
+    write_in->fh=(uint64_t) (uintptr_t) writeback->openfile;
+    write_in->offset=writeback->start;
+    write_in->size=writeback->len;
+    write_in->write_flags=(writeback->lock_owner>0) ? FUSE_WRITE_LOCKOWNER : 0;
+    write_in->lock_owner=writeback->lock_owner;
+    write_in->flags=writeback->write_flags;
+
+    request->cb_data=cb_data_writeback;
+    request->cb_error=cb_error_writeback;
+    request->data=(void *) &result;
+
+    process_fuse_request_internal(request, cb_write_writeback, (void *) writeback);
+
+    /* reads send during the write may have the old data: not cached */
+
+    invalidate_block_cache(writeback->openfile->inode);
+
+    if (result.error>0) {
+
+	writeback->error=result.error;
+
+    } else if (result.written < writeback->len) {
+
+	writeback->error=EIO;
+
+    }
+
+    writeback->len=0;
+    writeback->flushes++;
+    __atomic_add_fetch(&writeback_list.flushes, 1, __ATOMIC_RELAXED);
+    free(request);
+
+}
+
+/* list of buffers with data, with the mutex of the list locked */
+
+static void add_writeback_list(struct fuse_writeback_s *writeback)
+{
+    writeback->next=NULL;
+    writeback->prev=writeback_list.last;
+
+    if (writeback_list.last) {
+
+	writeback_list.last->next=writeback;
+
+    } else {
+
+	writeback_list.first=writeback;
+
+    }
+
+    writeback_list.last=writeback;
+    writeback_list.count++;
+    writeback->flags |= WRITEBACK_FLAG_DIRTY;
+}
+
+static void remove_writeback_list(struct fuse_writeback_s *writeback)
+{
+
+    if ((writeback->flags & WRITEBACK_FLAG_DIRTY)==0) return;
+
+    if (writeback->prev) {
+
+	writeback->prev->next=writeback->next;
+
+    } else {
+
+	writeback_list.first=writeback->next;
+
+    }
+
+    if (writeback->next) {
+
+	writeback->next->prev=writeback->prev;
+
+    } else {
+
+	writeback_list.last=writeback->prev;
+
+    }
+
+    writeback->next=NULL;
+    writeback->prev=NULL;
+    writeback_list.count--;
+    writeback->flags &= ~WRITEBACK_FLAG_DIRTY;
+
+}
+
+/* take a buffer from the list to write it, with the mutex of the list locked */
+
+static void start_writing_writeback(struct fuse_writeback_s *writeback)
+{
+
+    remove_writeback_list(writeback);
+
+    writeback->prev=NULL;
+    writeback->next=writeback_list.writing;
+    if (writeback_list.writing) writeback_list.writing->prev=writeback;
+    writeback_list.writing=writeback;
+
+    writeback_list.count++;
+    writeback->flags |= WRITEBACK_FLAG_WRITING;
+    writeback->refs++;
+
+}
+
+/* the write is done, with the mutex of the buffer and of the list locked */
+
+static void end_writing_writeback(struct fuse_writeback_s *writeback)
+{
+
+    if (writeback->prev) {
+
+	writeback->prev->next=writeback->next;
+
+    } else {
+
+	writeback_list.writing=writeback->next;
+
+    }
+
+    if (writeback->next) writeback->next->prev=writeback->prev;
+
+    writeback->next=NULL;
+    writeback->prev=NULL;
+    writeback_list.count--;
+    writeback->flags &= ~WRITEBACK_FLAG_WRITING;
+    writeback->refs--;
+    pthread_cond_broadcast(&writeback_list.cond);
+
+}
+
+/*
+    write a buffer taken from the list, with the mutex of the list locked (and unlocked while writing)
+    it's off the list of buffers being written only when the write is done, before another write can add data
+*/
+
+static void write_writeback_taken(struct fuse_writeback_s *writeback)
+{
+
+    start_writing_writeback(writeback);
+    pthread_mutex_unlock(&writeback_list.mutex);
+
+    pthread_mutex_lock(&writeback->mutex);
+    write_writeback(writeback);
+    pthread_mutex_lock(&writeback_list.mutex);
+    end_writing_writeback(writeback);
+    pthread_mutex_unlock(&writeback->mutex);
+
+}
+
+/* flush thread: write the buffers when they are older than the age, stop when there are none */
+
+static void writeback_thread(void *ptr)
+{
+
+    pthread_mutex_lock(&writeback_list.mutex);
+
+    while (writeback_list.first) {
+	struct fuse_writeback_s *writeback=writeback_list.first;
+	struct timespec expire;
+	struct timespec now;
+
+	get_current_time(&now);
+
+	if (get_msec_passed(&writeback->dirty, &now) < writeback_list.age) {
+
+	    expire.tv_sec=writeback->dirty.tv_sec + writeback_list.age / 1000;
+	    expire.tv_nsec=writeback->dirty.tv_nsec + (writeback_list.age % 1000) * 1000000;
+
+	    if (expire.tv_nsec >= 1000000000) {
+
+		expire.tv_sec++;
+		expire.tv_nsec-=1000000000;
+
+	    }
+
+	    pthread_cond_timedwait(&writeback_list.cond, &writeback_list.mutex, &expire);
+	    continue;
+
+	}
+
+	write_writeback_taken(writeback);
+
+    }
+
+    writeback_list.running=0;
+    pthread_mutex_unlock(&writeback_list.mutex);
+
+}
+
+/* the buffer has data now, with the mutex of the buffer locked (a buffer taken to write is written with the data) */
+
+static void set_writeback_dirty(struct fuse_writeback_s *writeback)
+{
+
+    pthread_mutex_lock(&writeback_list.mutex);
+
+    if ((writeback->flags & (WRITEBACK_FLAG_DIRTY | WRITEBACK_FLAG_RELEASE | WRITEBACK_FLAG_WRITING))==0) {
+
+	get_current_time(&writeback->dirty);
+	add_writeback_list(writeback);
+
+	if (writeback_list.running==0) {
+	    unsigned int error=0;
+
+	    writeback_list.running=1;
+	    work_workerthread(NULL, 0, writeback_thread, NULL, &error);
+	    if (error>0) writeback_list.running=0;
+
+	}
+
+    }
+
+    pthread_mutex_unlock(&writeback_list.mutex);
+
+}
+
+static void clear_writeback_dirty(struct fuse_writeback_s *writeback)
+{
+    pthread_mutex_lock(&writeback_list.mutex);
+    remove_writeback_list(writeback);
+    pthread_mutex_unlock(&writeback_list.mutex);
+}
+
+/* at open: a buffer when write-back is enabled and the file is written, but not synchronous */
+
+void create_writeback(struct fuse_openfile_s *openfile, struct fuse_request_s *request, unsigned int flags)
+{
+    struct fuse_writeback_s *writeback=NULL;
+    unsigned int size=__atomic_load_n(&writeback_list.size, __ATOMIC_RELAXED);
+
+    if (size==0 || (flags & O_ACCMODE)==O_RDONLY || (flags & (O_DIRECT | O_SYNC | O_DSYNC))) return;
+
+    writeback=malloc(sizeof(struct fuse_writeback_s));
+    if (writeback==NULL) return;
+
+    memset(writeback, 0, sizeof(struct fuse_writeback_s));
+    writeback->buffer=malloc(size);
+    writeback->from=malloc(sizeof(struct fuse_request_s));
+
+    if (writeback->buffer==NULL || writeback->from==NULL) {
+
+	if (writeback->buffer) free(writeback->buffer);
+	if (writeback->from) free(writeback->from);
+	free(writeback);
+	return;
+
+    }
+
+    /* keep who opened the file for the writes to the backend */
+
+    memcpy(writeback->from, request, sizeof(struct fuse_request_s));
+
+    pthread_mutex_init(&writeback->mutex, NULL);
+    writeback->openfile=openfile;
+    writeback->size=size;
+    openfile->writeback=writeback;
+
+}
+
+/*
+    keep a write in the buffer and answer the VFS
+    returns 1 when the request is taken care of, 0 when it has to go to the backend (buffer flushed already)
+*/
+
+int buffer_writeback(struct fuse_openfile_s *openfile, struct fuse_request_s *request, char *buffer, size_t size, off_t offset, unsigned int flags, uint64_t lock_owner)
+{
+    struct fuse_writeback_s *writeback=openfile->writeback;
+    uint64_t start=(uint64_t) offset;
+    uint64_t end=start + size;
+    struct fuse_write_out write_out;
+    unsigned int error=0;
+    unsigned char flush=0;
+
+    if (writeback==NULL) return 0;
+
+    pthread_mutex_lock(&writeback->mutex);
+
+    if (writeback->len>0) {
+	uint64_t wbend=writeback->start + writeback->len;
+	uint64_t newstart=(start < writeback->start) ? start : writeback->start;
+	uint64_t newend=(end > wbend) ? end : wbend;
+
+	/* only adjacent or overlapping writes of the same owner are combined */
+
+	if (lock_owner!=writeback->lock_owner || flags!=writeback->write_flags || start > wbend || end < writeback->start || newend - newstart > writeback->size ||
+	    (flags & (O_DIRECT | O_SYNC | O_DSYNC))) {
+
+	    write_writeback(writeback);
+	    clear_writeback_dirty(writeback);
+
+	}
+
+    }
+
+    if (writeback->error>0) {
+
+	/* report the error of an earlier write */
+
+	error=writeback->error;
+	writeback->error=0;
+	pthread_mutex_unlock(&writeback->mutex);
+	reply_VFS_error(request, error);
+	return 1;
+
+    }
+
+    /* a large write, or the file is made synchronous (fcntl): directly to the backend */
+
+    if (size > writeback->size || (flags & (O_DIRECT | O_SYNC | O_DSYNC))) {
+
+	pthread_mutex_unlock(&writeback->mutex);
+	return 0;
+
+    }
+
+    if (writeback->len==0) {
+
+	writeback->start=start;
+	writeback->len=(unsigned int) size;
+	writeback->lock_owner=lock_owner;
+	writeback->write_flags=flags;
+	memcpy(writeback->buffer, buffer, size);
+	set_writeback_dirty(writeback);
+
+    } else {
+
+	if (start < writeback->start) {
+	    unsigned int shift=(unsigned int) (writeback->start - start);
+
+	    memmove(writeback->buffer + shift, writeback->buffer, writeback->len);
+	    writeback->start=start;
+	    writeback->len+=shift;
+
+	}
+
+	memcpy(writeback->buffer + (start - writeback->start), buffer, size);
+	if (end > writeback->start + writeback->len) writeback->len=(unsigned int) (end - writeback->start);
+
+    }
+
+    writeback->writes++;
+    __atomic_add_fetch(&writeback_list.writes, 1, __ATOMIC_RELAXED);
+
+    if (writeback->len==writeback->size) {
+
+	flush=1;
+
+    } else if (writeback_list.age>0) {
+	struct timespec now;
+
+	get_current_time(&now);
+	if (get_msec_passed(&writeback->dirty, &now) >= writeback_list.age) flush=1;
+
+    }
+
+    pthread_mutex_unlock(&writeback->mutex);
+
+    write_out.size=(uint32_t) size;
+    write_out.padding=0;
+    reply_VFS_data(request, (char *) &write_out, sizeof(struct fuse_write_out));
+
+    if (flush) {
+
+	pthread_mutex_lock(&writeback->mutex);
+	write_writeback(writeback);
+	clear_writeback_dirty(writeback);
+	pthread_mutex_unlock(&writeback->mutex);
+
+    }
+
+    return 1;
+
+}
+
+/* write the buffer to the backend, returns the error of this or an earlier write */
+
+unsigned int flush_writeback(struct fuse_openfile_s *openfile)
+{
+    struct fuse_writeback_s *writeback=openfile->writeback;
+    unsigned int error=0;
+
+    if (writeback==NULL) return 0;
+
+    pthread_mutex_lock(&writeback->mutex);
+    write_writeback(writeback);
+    clear_writeback_dirty(writeback);
+    error=writeback->error;
+    writeback->error=0;
+    pthread_mutex_unlock(&writeback->mutex);
+
+    return error;
+
+}
+
+/*
+    write the buffers of other handles of the inode, the VFS is going to see the attributes or data
+    and wait for the buffers of the inode which are being written already
+*/
+
+void flush_writeback_inode(struct inode_s *inode, struct fuse_openfile_s *except)
+{
+    struct fuse_writeback_s *writeback=NULL;
+
+    if (__atomic_load_n(&writeback_list.count, __ATOMIC_RELAXED)==0) return;
+
+    pthread_mutex_lock(&writeback_list.mutex);
+    writeback=writeback_list.first;
+
+    while (writeback) {
+
+	if (writeback->openfile->inode==inode && writeback->openfile!=except) {
+
+	    write_writeback_taken(writeback);
+
+	    /* the list may be changed */
+
+	    writeback=writeback_list.first;
+	    continue;
+
+	}
+
+	writeback=writeback->next;
+
+    }
+
+    writeback=writeback_list.writing;
+
+    while (writeback) {
+
+	if (writeback->openfile->inode==inode && writeback->openfile!=except) {
+
+	    pthread_cond_wait(&writeback_list.cond, &writeback_list.mutex);
+	    writeback=writeback_list.writing;
+	    continue;
+
+	}
+
+	writeback=writeback->next;
+
+    }
+
+    pthread_mutex_unlock(&writeback_list.mutex);
+
+}
+
+/* at release, before the handle is closed */
+
+void free_writeback(struct fuse_openfile_s *openfile)
+{
+    struct fuse_writeback_s *writeback=openfile->writeback;
+
+    if (writeback==NULL) return;
+
+    pthread_mutex_lock(&writeback_list.mutex);
+    remove_writeback_list(writeback);
+    writeback->flags |= WRITEBACK_FLAG_RELEASE;
+    while (writeback->refs>0) pthread_cond_wait(&writeback_list.cond, &writeback_list.mutex);
+    pthread_mutex_unlock(&writeback_list.mutex);
+
+    pthread_mutex_lock(&writeback->mutex);
+    write_writeback(writeback);
+    if (writeback->error>0) logoutput("free_writeback: error %i writing buffer (%s)", writeback->error, strerror(writeback->error));
+    pthread_mutex_unlock(&writeback->mutex);
+
+    pthread_mutex_destroy(&writeback->mutex);
+    free(writeback->buffer);
+    free(writeback->from);
+    free(writeback);
+    openfile->writeback=NULL;
+
+}
+
+void get_fuse_writeback_stat(struct fuse_writeback_stat_s *stat)
+{
+    stat->writes=__atomic_load_n(&writeback_list.writes, __ATOMIC_RELAXED);
+    stat->flushes=__atomic_load_n(&writeback_list.flushes, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,85 @@
+/*
+  2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017 Stef Bon <stefbon@gmail.com>
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#ifndef SB_COMMON_UTILS_FUSE_WRITEBACK_H
+#define SB_COMMON_UTILS_FUSE_WRITEBACK_H
+
+#define WRITEBACK_FLAG_DIRTY				1		/* on the list of the flush thread */
+#define WRITEBACK_FLAG_RELEASE				2
+#define WRITEBACK_FLAG_WRITING				4		/* taken from that list, being written */
+
+/*
+    write-back buffer of an open file
+
+    writes are answered to the VFS at once and kept in the buffer when they are adjacent to or overlap with the
+    data already there, and have the same lock owner and file flags; other writes flush the buffer first, and
+    writes when the file is made synchronous (O_DIRECT, O_SYNC or O_DSYNC with fcntl) go to the backend directly
+    the buffer is written to the backend (with an internal request) when it's full, when the first write in it is
+    older than the age, at flush, fsync, release and locking of the file, and before a getattr, setattr or read
+    of the inode, and before a write with another handle, so the size and data seen by the VFS are right
+    a buffer taken from the list to be written is on the list of buffers being written until the write is done,
+    so these flushes of the inode wait for it
+    an error of a write to the backend is returned by the next write, flush or fsync
+
+    it's optional: only when enabled with set_fuse_writeback, and never for files opened with O_DIRECT, O_SYNC
+    or O_DSYNC
+*/
+
+struct fuse_writeback_s {
+    pthread_mutex_t				mutex;
+    struct fuse_openfile_s			*openfile;
+    struct fuse_request_s			*from;
+    struct fuse_writeback_s			*next;
+    struct fuse_writeback_s			*prev;
+    unsigned int				refs;
+    unsigned char				flags;
+    unsigned int				error;
+    uint64_t					lock_owner;
+    uint32_t					write_flags;
+    uint64_t					start;
+    unsigned int				len;
+    unsigned int				size;
+    struct timespec				dirty;
+    uint64_t					writes;
+    uint64_t					flushes;
+    char					*buffer;
+};
+
+struct fuse_writeback_stat_s {
+    uint64_t					writes;
+    uint64_t					flushes;
+};
+
+struct fuse_openfile_s;
+struct fuse_request_s;
+struct inode_s;
+
+/* prototypes */
+
+void set_fuse_writeback(unsigned int size, unsigned int age);
+
+void create_writeback(struct fuse_openfile_s *openfile, struct fuse_request_s *request, unsigned int flags);
+int buffer_writeback(struct fuse_openfile_s *openfile, struct fuse_request_s *request, char *buffer, size_t size, off_t offset, unsigned int flags, uint64_t lock_owner);
+unsigned int flush_writeback(struct fuse_openfile_s *openfile);
+void flush_writeback_inode(struct inode_s *inode, struct fuse_openfile_s *except);
+void free_writeback(struct fuse_openfile_s *openfile);
+
+void get_fuse_writeback_stat(struct fuse_writeback_stat_s *stat);
+
+#endif
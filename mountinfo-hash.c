@@ -135,7 +135,10 @@ struct mountentry_s *get_mountentry_unique(unsigned long unique)
 
 int init_mountinfo_hash()
 {
-    return initialize_group(&group_mounts, mount_hashfunction, 256, error);
+    int result=initialize_group(&group_mounts, mount_hashfunction, 256, error);
+
+    if (result==0) profile_simple_locking(&group_mounts.locking, "mounts hash");
+    return result;
 }
 
 void free_mountinfo_hash()
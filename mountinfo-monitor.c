@@ -158,6 +158,7 @@ int open_mountmonitor(struct bevent_xdata_s *xdata, unsigned int *error)
     }
 
     init_simple_locking(&mount_monitor.locking);
+    profile_simple_locking(&mount_monitor.locking, "mount monitor");
     init_list_header(&current_mounts, SIMPLE_LIST_TYPE_EMPTY, NULL);
     init_list_header(&removed_mounts, SIMPLE_LIST_TYPE_EMPTY, NULL);
 
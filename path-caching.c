@@ -52,18 +52,41 @@
 
 /*
     struct to store the pathcache
-    - pathinfo			cached path
-    - base_inode		root inode of this fs (like a server)
+    - context			context of the service the path is relative to
+    - inode			inode of the directory the path is of
+    - generation		generation of the paths when cached
     - type			temporary or permanent
+    - size			space for the path
+    - len			length of the path
+
+    every directory keeps the path it got the last time, a lookup in it costs one memcpy
+    a rename changes the paths of everything below it: instead of walking the tree it bumps one generation
+    number, and a path with an older generation is build again
+    removing a directory does not: the cache goes with the directory
 */
 
 struct pathcache_s {
     struct service_context_s	*context;
+    struct inode_s		*inode;
+    uint64_t			generation;
     unsigned char		type;
+    unsigned int		size;
     unsigned int		len;
     char 			path[];
 };
 
+static uint64_t pathcache_generation=1;
+
+void invalidate_pathcaches()
+{
+    __atomic_add_fetch(&pathcache_generation, 1, __ATOMIC_RELEASE);
+}
+
+static uint64_t get_pathcache_generation()
+{
+    return __atomic_load_n(&pathcache_generation, __ATOMIC_ACQUIRE);
+}
+
 /*
 
     get the path relative to a "root" inode of a service
@@ -131,28 +154,58 @@ void init_fuse_path(struct fuse_path_s *fpath, char *path, unsigned int len)
     *(fpath->pathstart)='\0';
 }
 
-/* determine the path for this directory the default way */
+/* store the path in the buffer from pathstart in the cache of the directory, the space is kept for later */
 
-static int get_service_path(struct directory_s *directory, void *ptr)
+static void store_pathcache(struct pathcalls_s *p, struct inode_s *inode, struct fuse_path_s *fpath, unsigned int len, uint64_t generation, unsigned char type)
 {
-    struct fuse_path_s *fpath=(struct fuse_path_s *) ptr;
-    return get_service_path_default(directory->inode, fpath);
+    struct pathcache_s *pathcache=(struct pathcache_s *) p->cache;
+
+    if (pathcache==NULL || pathcache->size < len) {
+	unsigned int size=(len + 64) & ~63;
+
+	if (pathcache) free(pathcache);
+	pathcache=malloc(sizeof(struct pathcache_s) + size);
+	p->cache=(void *) pathcache;
+	if (pathcache==NULL) return;
+	pathcache->size=size;
+
+    }
+
+    pathcache->context=fpath->context;
+    pathcache->inode=inode;
+    pathcache->generation=generation;
+    pathcache->type=type;
+    pathcache->len=len;
+    memcpy(pathcache->path, fpath->pathstart, len);
+
 }
 
-/* get the cached path for directory */
+/*
+    get the path for directory: from the cache when it's of the current generation, otherwise
+    the default way, and cache it
+    the caller has locked the pathcalls
+*/
 
-static int get_service_path_cached(struct directory_s *directory, void *ptr)
+static int get_service_path(struct directory_s *directory, void *ptr)
 {
-    struct pathcache_s *pathcache=(struct pathcache_s *) directory->pathcalls.cache;
+    struct pathcalls_s *p=&directory->pathcalls;
+    struct pathcache_s *pathcache=(struct pathcache_s *) p->cache;
     struct fuse_path_s *fpath=(struct fuse_path_s *) ptr;
+    uint64_t generation=get_pathcache_generation();
+    int len=0;
 
-    logoutput("get_service_path_cached");
+    if (pathcache && pathcache->generation==generation && pathcache->inode==directory->inode) {
 
-    fpath->context=pathcache->context;
-    fpath->pathstart-=pathcache->len;
-    memcpy(fpath->pathstart, pathcache->path, pathcache->len);
+	fpath->context=pathcache->context;
+	fpath->pathstart-=pathcache->len;
+	memcpy(fpath->pathstart, pathcache->path, pathcache->len);
+	return pathcache->len;
+
+    }
 
-    return pathcache->len;
+    len=get_service_path_default(directory->inode, fpath);
+    store_pathcache(p, directory->inode, fpath, (unsigned int) len, generation, (pathcache) ? pathcache->type : PATHCACHE_TYPE_PERM);
+    return len;
 
 }
 
@@ -174,58 +227,48 @@ void free_pathcache_dummy(struct pathcalls_s *pathcalls)
 {
 }
 
-void free_pathcache(struct pathcalls_s *p)
+/* release the cache when the directory is freed */
+
+static void release_pathcache(struct pathcalls_s *p)
 {
-    struct pathcache_s *pathcache=(struct pathcache_s *) p->cache;
 
-    if (pathcache && (pathcache->type & PATHCACHE_TYPE_TEMP)) {
+    if (p->cache) {
 
-	free(pathcache);
+	free(p->cache);
 	p->cache=NULL;
-	p->get_path=get_service_path;
-	p->free=free_pathcache_dummy;
 
     }
 
 }
 
+/* release a temporary cache, like the one of an open directory; permanent ones stay */
 
-/* create a pathcache using the path stored in pathinfo */
-
-void create_pathcache(struct pathcalls_s *p, struct fuse_path_s *fpath, unsigned char type)
+void free_pathcache(struct pathcalls_s *p)
 {
     struct pathcache_s *pathcache=(struct pathcache_s *) p->cache;
-    unsigned int len=0; 
-
-    if (pathcache) return;
-    len=(unsigned int) (fpath->path + fpath->len - fpath->pathstart); /* len of path in buffer from pathstart */
-    pathcache=malloc(sizeof(struct pathcache_s) + len);
 
-    if (pathcache) {
+    if (pathcache && (pathcache->type & PATHCACHE_TYPE_TEMP)) release_pathcache(p);
 
-	pathcache->context=fpath->context;
-	pathcache->type=type;
-	pathcache->len=len;
-	memcpy(pathcache->path, fpath->pathstart, len);
-	p->get_path=get_service_path_cached;
-	p->cache=(void *) pathcache;
-	p->free=free_pathcache;
+}
 
-    } else {
+/* create a pathcache using the path in fpath from pathstart to the end */
 
-	p->get_path=get_service_path;
+void create_pathcache(struct pathcalls_s *p, struct fuse_path_s *fpath, unsigned char type)
+{
+    struct directory_s *directory=(struct directory_s *) (((char *) p) - offsetof(struct directory_s, pathcalls));
+    unsigned int len=(unsigned int) (fpath->path + fpath->len - fpath->pathstart); /* len of path in buffer from pathstart */
 
-    }
+    if (p->cache) return;
+    store_pathcache(p, directory->inode, fpath, len, get_pathcache_generation(), type);
 
 }
 
-
 void init_pathcalls(struct pathcalls_s *p)
 {
     memset(p, 0, sizeof(struct pathcalls_s));
     p->cache=NULL;
     p->get_path=get_service_path;
-    p->free=free_pathcache_dummy;
+    p->free=release_pathcache;
     pthread_mutex_init(&p->mutex, NULL);
 }
 
@@ -36,5 +36,6 @@ void init_pathcalls_root(struct pathcalls_s *p);
 
 void create_pathcache(struct pathcalls_s *p, struct fuse_path_s *fpath, unsigned char type);
 void free_pathcache(struct pathcalls_s *p);
+void invalidate_pathcaches();
 
 #endif
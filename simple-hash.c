@@ -32,60 +32,152 @@
 #undef LOGGING
 #include "logging.h"
 
-static inline struct hash_element_s *get_hash_element(struct list_element_s *list)
+#define HASH_CTRL_EMPTY			0
+#define HASH_CTRL_DELETED		1
+#define HASH_CTRL_FULL			128
+
+static inline unsigned int get_hash_bucket(struct simple_hash_s *group, unsigned int hashvalue)
 {
-    return (struct hash_element_s *) ( ((char *) list) - offsetof(struct hash_element_s, list));
+    return hashvalue % group->len;
 }
 
-static struct hash_element_s *create_hash_element()
+/* one 32 bit hash per bucket (multiplicative, so different buckets below size get different homes):
+    the control tag is taken from the top 7 bits, the home slot from the bits below those,
+    so tag and slot never share bits (tables up to 2^25 slots) */
+
+#define HASH_TAG_SHIFT			25
+#define HASH_SLOT_MASK			((1U << HASH_TAG_SHIFT) - 1)
+
+static inline unsigned int mix_hash_bucket(unsigned int bucket)
 {
-    struct hash_element_s *element=NULL;
+    return bucket * 0x9E3779B1;
+}
 
-    element=malloc(sizeof(struct hash_element_s));
+/* all data with the same bucket starts probing at the same slot */
 
-    if (element) {
+static inline unsigned int get_hash_home(struct simple_hash_s *group, unsigned int mixed)
+{
+    return (mixed & HASH_SLOT_MASK) & (group->size - 1);
+}
 
-	element->data=NULL;
-	init_list_element(&element->list, NULL);
+static inline unsigned char get_hash_tag(unsigned int mixed)
+{
+    return (unsigned char) (HASH_CTRL_FULL | (mixed >> HASH_TAG_SHIFT));
+}
+
+static int alloc_hash_slots(struct simple_hash_s *group, unsigned int size)
+{
+    unsigned char *ctrl=malloc(size);
+    struct hash_slot_s *slots=malloc(size * sizeof(struct hash_slot_s));
+
+    if (ctrl==NULL || slots==NULL) {
+
+	if (ctrl) free(ctrl);
+	if (slots) free(slots);
+	return -1;
 
     }
 
-    return element;
+    memset(ctrl, HASH_CTRL_EMPTY, size);
+    memset(slots, 0, size * sizeof(struct hash_slot_s));
+
+    group->ctrl=ctrl;
+    group->slots=slots;
+    group->size=size;
+    group->count=0;
+    group->deleted=0;
+    return 0;
 
 }
 
-static void insert_in_hash(struct simple_hash_s *group, struct hash_element_s *element)
+/* put data in the first free slot, there is always one free since the table is never full */
+
+static void insert_in_hash(struct simple_hash_s *group, unsigned int hashvalue, void *data)
 {
-    unsigned int i=((*group->hashfunction)(element->data) % group->len);
-    add_list_element_last(&group->hash[i], &element->list);
+    unsigned int mixed=mix_hash_bucket(get_hash_bucket(group, hashvalue));
+    unsigned int mask=group->size - 1;
+    unsigned int pos=get_hash_home(group, mixed);
+
+    while (group->ctrl[pos] & HASH_CTRL_FULL) pos=(pos + 1) & mask;
+
+    if (group->ctrl[pos]==HASH_CTRL_DELETED) group->deleted--;
+
+    group->ctrl[pos]=get_hash_tag(mixed);
+    group->slots[pos].hashvalue=hashvalue;
+    group->slots[pos].data=data;
+    group->count++;
 }
 
-static void move_from_hash(struct simple_hash_s *group, struct hash_element_s *element)
+/* move everything to a new table with size slots, this also clears the deleted slots */
+
+static int rehash_simple_hash(struct simple_hash_s *group, unsigned int size)
 {
-    unsigned int i=((*group->hashfunction) (element->data) % group->len);
-    remove_list_element(&element->list);
+    unsigned char *ctrl=group->ctrl;
+    struct hash_slot_s *slots=group->slots;
+    unsigned int oldsize=group->size;
+
+    if (alloc_hash_slots(group, size)==-1) return -1;
+
+    for (unsigned int i=0; i<oldsize; i++) {
+
+	if (ctrl[i] & HASH_CTRL_FULL) insert_in_hash(group, slots[i].hashvalue, slots[i].data);
+
+    }
+
+    free(ctrl);
+    free(slots);
+    return 0;
+
 }
 
-struct hash_element_s *lookup_simple_hash(struct simple_hash_s *group, void *data)
+/* find the slot of data */
+
+static int lookup_simple_hash(struct simple_hash_s *group, void *data)
 {
-    struct list_element_s *list=NULL;
-    unsigned int i=0;
-    struct hash_element_s *element=NULL;
+    unsigned int mixed=0;
+    unsigned int mask=0;
+    unsigned int pos=0;
+    unsigned char tag=0;
 
-    i=((*group->hashfunction) (data) % group->len);
+    if (group->slots==NULL) return -1;
 
-    list=group->hash[i].head;
+    mixed=mix_hash_bucket(get_hash_bucket(group, (*group->hashfunction)(data)));
+    mask=group->size - 1;
+    pos=get_hash_home(group, mixed);
+    tag=get_hash_tag(mixed);
 
-    while (list) {
+    for (unsigned int i=0; i<group->size; i++) {
+	unsigned char c=group->ctrl[pos];
 
-	element=get_hash_element(list);
-	if (element->data==data) break;
-	list=list->n;
-	element=NULL; /* element has an invalid value... forget it otherwise this will be returned */
+	if (c==HASH_CTRL_EMPTY) break;
+	if (c==tag && group->slots[pos].data==data) return (int) pos;
+	pos=(pos + 1) & mask;
 
     }
 
-    return element;
+    return -1;
+
+}
+
+static void remove_hash_slot(struct simple_hash_s *group, unsigned int pos)
+{
+    unsigned int mask=group->size - 1;
+
+    group->slots[pos].data=NULL;
+    group->count--;
+
+    /* when the next one is empty no probe goes past this slot: it can be made empty too */
+
+    if (group->ctrl[(pos + 1) & mask]==HASH_CTRL_EMPTY) {
+
+	group->ctrl[pos]=HASH_CTRL_EMPTY;
+
+    } else {
+
+	group->ctrl[pos]=HASH_CTRL_DELETED;
+	group->deleted++;
+
+    }
 
 }
 
@@ -111,24 +203,25 @@ void init_wlock_hashtable(struct simple_hash_s *group, struct simple_lock_s *loc
 
 int initialize_group(struct simple_hash_s *group, unsigned int (*hashfunction) (void *data), unsigned int len, unsigned int *error)
 {
-    int result=0;
+    unsigned int size=SIMPLE_HASH_MINSIZE;
 
     *error=ENOMEM;
 
-    if (init_simple_locking(&group->locking)==-1) goto error;
+    if (init_simple_locking_scalable(&group->locking)==-1) goto error;
+
+    if (len==0) len=SIMPLE_HASH_HASHSIZE;
 
     group->hashfunction=hashfunction;
     group->len=len;
-    group->hash=NULL;
+    group->size=0;
+    group->count=0;
+    group->deleted=0;
+    group->ctrl=NULL;
+    group->slots=NULL;
 
-    if (len>0) {
-
-	group->hash=(struct list_header_s *) malloc(len * sizeof(struct list_header_s));
-	if (! group->hash) goto error;
-	*error=0;
-	for (unsigned int i=0;i<len;i++) init_list_header(&group->hash[i], SIMPLE_LIST_TYPE_EMPTY, NULL);
-
-    }
+    while (size < len) size = 2 * size;
+    if (alloc_hash_slots(group, size)==-1) goto error;
+    *error=0;
 
     out:
 
@@ -147,30 +240,21 @@ void free_group(struct simple_hash_s *group, void (*free_data) (void *data))
     init_wlock_hashtable(group, &wlock);
     lock_hashtable(&wlock);
 
-    if (group->hash) {
-	struct list_element_s *list=NULL;
-	struct hash_element_s *element=NULL;
-
-	for (unsigned int i=0;i<group->len;i++) {
-
-	    list=group->hash[i].head;
-
-	    while(element) {
-
-		group->hash[i].head=list->n;
-
-		element=get_hash_element(list);
-		if (free_data && element->data) free_data(element->data);
-		free(element);
+    if (group->slots) {
 
-		list=group->hash[i].head;
+	for (unsigned int i=0;i<group->size;i++) {
 
-	    }
+	    if ((group->ctrl[i] & HASH_CTRL_FULL) && free_data && group->slots[i].data) free_data(group->slots[i].data);
 
 	}
 
-	free(group->hash);
-	group->hash=NULL;
+	free(group->slots);
+	group->slots=NULL;
+	free(group->ctrl);
+	group->ctrl=NULL;
+	group->size=0;
+	group->count=0;
+	group->deleted=0;
 
     }
 
@@ -179,66 +263,87 @@ void free_group(struct simple_hash_s *group, void (*free_data) (void *data))
 
 }
 
+/* get the next data with hashvalue, start with *index NULL
+    index points to the slot found */
 
 void *get_next_hashed_value(struct simple_hash_s *group, void **index, unsigned int hashvalue)
 {
-    struct hash_element_s *element=NULL;
+    struct hash_slot_s *slot=(struct hash_slot_s *) *index;
+    unsigned int bucket=0;
+    unsigned int mixed=0;
+    unsigned int mask=0;
+    unsigned int pos=0;
+    unsigned char tag=0;
 
-    if (*index) {
+    *index=NULL;
+    if (group->slots==NULL) return NULL;
 
-	element=(struct hash_element_s *) *index;
-	element=(element->list.n) ? get_hash_element(element->list.n) : NULL;
+    bucket=get_hash_bucket(group, hashvalue);
+    mixed=mix_hash_bucket(bucket);
+    mask=group->size - 1;
+    pos=(slot) ? (((unsigned int) (slot - group->slots) + 1) & mask) : get_hash_home(group, mixed);
+    tag=get_hash_tag(mixed);
 
-    } else {
+    for (unsigned int i=0; i<group->size; i++) {
+	unsigned char c=group->ctrl[pos];
+
+	if (c==HASH_CTRL_EMPTY) break;
+
+	if (c==tag && get_hash_bucket(group, group->slots[pos].hashvalue)==bucket) {
 
-	hashvalue=hashvalue % group->len;
-	element=(group->hash[hashvalue].head) ? get_hash_element(group->hash[hashvalue].head) : NULL;
+	    *index=(void *) &group->slots[pos];
+	    return group->slots[pos].data;
+
+	}
+
+	pos=(pos + 1) & mask;
 
     }
 
-    *index=(void *) element;
-    return (element) ? element->data : NULL;
+    return NULL;
 }
 
 void add_data_to_hash(struct simple_hash_s *group, void *data)
 {
-    struct hash_element_s *element=create_hash_element();
+    unsigned int hashvalue=(*group->hashfunction)(data);
+
+    if (group->slots==NULL) return;
+
+    /* keep at least one eight of the slots empty, otherwise probes get too long */
+
+    if (8 * (group->count + group->deleted + 1) > 7 * group->size) {
+	unsigned int size=(4 * (group->count + 1) > group->size) ? 2 * group->size : group->size;
 
-    if (element) {
+	if (rehash_simple_hash(group, size)==-1) {
 
-	element->data=data;
-	init_list_element(&element->list, NULL);
-	insert_in_hash(group, element);
+	    logoutput_warning("add_data_to_hash: unable to grow hash table to %i slots", size);
+	    if (group->count + group->deleted + 1 >= group->size) return;
+
+	}
 
     }
 
+    insert_in_hash(group, hashvalue, data);
+
 }
 
 void remove_data_from_hash(struct simple_hash_s *group, void *data)
 {
-    struct hash_element_s *element=lookup_simple_hash(group, data);
+    int pos=lookup_simple_hash(group, data);
 
     logoutput("remove_data_from_hash");
 
-    if (element) {
-
-	move_from_hash(group, element);
-	element->data=NULL;
-	free(element);
-
-    }
+    if (pos>=0) remove_hash_slot(group, (unsigned int) pos);
 
 }
 
 void remove_data_from_hash_index(struct simple_hash_s *group, void **index)
 {
-    struct hash_element_s *element=(struct hash_element_s *) *index;
+    struct hash_slot_s *slot=(struct hash_slot_s *) *index;
 
-    if (element) {
-
-	move_from_hash(group, element);
-	free(element);
+    if (slot) {
 
+	remove_hash_slot(group, (unsigned int) (slot - group->slots));
 	*index=NULL;
 
     }
@@ -247,7 +352,6 @@ void remove_data_from_hash_index(struct simple_hash_s *group, void **index)
 
 unsigned int get_hashvalue_index(void *index, struct simple_hash_s *group)
 {
-    struct hash_element_s *element=(struct hash_element_s *) index;
-    return (element) ? (((*group->hashfunction) (element->data)) % group->len) : 0;
+    struct hash_slot_s *slot=(struct hash_slot_s *) index;
+    return (slot) ? get_hash_bucket(group, slot->hashvalue) : 0;
 }
-
@@ -25,18 +25,29 @@
 #include "simple-locking.h"
 #define SIMPLE_HASH_HASHSIZE	512
 
-struct hash_element_s {
+#define SIMPLE_HASH_MINSIZE	16
+
+/* open addressing: a slot holds the data and the hashvalue of it, so the hashfunction is not called again
+    next to the slots there is an array of control bytes: empty, deleted or a tag of the hashvalue
+    probing goes through the control bytes, only when a tag matches the slot is read
+
+    len is the number of hashvalues as seen by the callers (hashvalue % len),
+    size is the number of slots (always a power of two) */
+
+struct hash_slot_s {
+    unsigned int		hashvalue;
     void 			*data;
-    struct list_element_s 	list;
 };
 
-/* TODO: add "add", "remove" and "lookup" functions as cb */
-
 struct simple_hash_s {
     struct simple_locking_s	locking;
     unsigned int 		(*hashfunction) (void *data);
     int 			len;
-    struct list_header_s 	*hash;
+    unsigned int		size;
+    unsigned int		count;
+    unsigned int		deleted;
+    unsigned char		*ctrl;
+    struct hash_slot_s		*slots;
 };
 
 /* prototypes */
@@ -506,3 +506,249 @@ struct list_element_s *get_prev_element(struct list_element_s *e)
 {
     return (e) ? e->p : NULL;
 }
+
+/* COMPACT list
+    the position dependent work is done by the ops of the header, which are switched
+    when the list becomes empty, holds one element or more than one, like the list above
+    elements do not have ops of their own */
+
+static void insert_clist_after_empty(struct clist_header_s *h, struct clist_element_s *a, struct clist_element_s *e);
+static void insert_clist_after_one(struct clist_header_s *h, struct clist_element_s *a, struct clist_element_s *e);
+static void insert_clist_after_default(struct clist_header_s *h, struct clist_element_s *a, struct clist_element_s *e);
+static void delete_clist_empty(struct clist_header_s *h, struct clist_element_s *e);
+static void delete_clist_one(struct clist_header_s *h, struct clist_element_s *e);
+static void delete_clist_default(struct clist_header_s *h, struct clist_element_s *e);
+
+struct clist_header_ops_s empty_clist_header_ops = {
+    .insert_after			= insert_clist_after_empty,
+    .delete				= delete_clist_empty,
+};
+
+static struct clist_header_ops_s one_clist_header_ops = {
+    .insert_after			= insert_clist_after_one,
+    .delete				= delete_clist_one,
+};
+
+static struct clist_header_ops_s default_clist_header_ops = {
+    .insert_after			= insert_clist_after_default,
+    .delete				= delete_clist_default,
+};
+
+/* EMPTY: a is ignored, e becomes head and tail */
+
+static void insert_clist_after_empty(struct clist_header_s *h, struct clist_element_s *a, struct clist_element_s *e)
+{
+    e->n=NULL;
+    e->p=NULL;
+    h->head=e;
+    h->tail=e;
+    h->count=1;
+    h->ops=&one_clist_header_ops;
+}
+
+static void delete_clist_empty(struct clist_header_s *h, struct clist_element_s *e)
+{
+    /* delete in an empty list: not possible */
+}
+
+/* ONE: a NULL means before the only element, otherwise after it */
+
+static void insert_clist_after_one(struct clist_header_s *h, struct clist_element_s *a, struct clist_element_s *e)
+{
+    struct clist_element_s *o=h->head;
+
+    if (a) {
+
+	o->n=e;
+	e->p=o;
+	e->n=NULL;
+	h->tail=e;
+
+    } else {
+
+	o->p=e;
+	e->n=o;
+	e->p=NULL;
+	h->head=e;
+
+    }
+
+    h->count=2;
+    h->ops=&default_clist_header_ops;
+}
+
+static void delete_clist_one(struct clist_header_s *h, struct clist_element_s *e)
+{
+
+    if (h->head==e) {
+
+	h->head=NULL;
+	h->tail=NULL;
+	h->count=0;
+	h->ops=&empty_clist_header_ops;
+
+    }
+
+}
+
+/* DEFAULT: two or more elements */
+
+static void insert_clist_after_default(struct clist_header_s *h, struct clist_element_s *a, struct clist_element_s *e)
+{
+    struct clist_element_s *n=(a) ? a->n : h->head;
+
+    e->p=a;
+    e->n=n;
+
+    if (a) {
+
+	a->n=e;
+
+    } else {
+
+	h->head=e;
+
+    }
+
+    if (n) {
+
+	n->p=e;
+
+    } else {
+
+	h->tail=e;
+
+    }
+
+    h->count++;
+}
+
+static void delete_clist_default(struct clist_header_s *h, struct clist_element_s *e)
+{
+
+    if (e->p) {
+
+	e->p->n=e->n;
+
+    } else if (h->head==e) {
+
+	h->head=e->n;
+
+    } else {
+
+	/* not part of this list */
+	return;
+
+    }
+
+    if (e->n) {
+
+	e->n->p=e->p;
+
+    } else {
+
+	h->tail=e->p;
+
+    }
+
+    e->n=NULL;
+    e->p=NULL;
+    h->count--;
+    if (h->count==1) h->ops=&one_clist_header_ops;
+}
+
+void init_clist_element(struct clist_element_s *e)
+{
+    e->n=NULL;
+    e->p=NULL;
+}
+
+void init_clist_header(struct clist_header_s *h, char *name)
+{
+    h->count=0;
+    h->head=NULL;
+    h->tail=NULL;
+    h->ops=&empty_clist_header_ops;
+    h->name=name;
+}
+
+/* insert e after p, p NULL means insert as head */
+
+void add_clist_element_after(struct clist_header_s *h, struct clist_element_s *p, struct clist_element_s *e)
+{
+    (* h->ops->insert_after)(h, p, e);
+}
+
+/* insert e before n, n NULL means insert as tail */
+
+void add_clist_element_before(struct clist_header_s *h, struct clist_element_s *n, struct clist_element_s *e)
+{
+    (* h->ops->insert_after)(h, (n) ? n->p : h->tail, e);
+}
+
+void add_clist_element_last(struct clist_header_s *h, struct clist_element_s *e)
+{
+    (* h->ops->insert_after)(h, h->tail, e);
+}
+
+void add_clist_element_first(struct clist_header_s *h, struct clist_element_s *e)
+{
+    (* h->ops->insert_after)(h, NULL, e);
+}
+
+void remove_clist_element(struct clist_header_s *h, struct clist_element_s *e)
+{
+    (* h->ops->delete)(h, e);
+}
+
+struct clist_element_s *get_clist_head(struct clist_header_s *h, unsigned char flags)
+{
+    struct clist_element_s *e=h->head;
+    if (e && (flags & SIMPLE_LIST_FLAG_REMOVE)) (* h->ops->delete)(h, e);
+    return e;
+}
+
+struct clist_element_s *get_clist_tail(struct clist_header_s *h, unsigned char flags)
+{
+    struct clist_element_s *e=h->tail;
+    if (e && (flags & SIMPLE_LIST_FLAG_REMOVE)) (* h->ops->delete)(h, e);
+    return e;
+}
+
+struct clist_element_s *search_clist_element_forw(struct clist_header_s *h, int (* condition)(struct clist_element_s *list, void *ptr), void *ptr)
+{
+    struct clist_element_s *e=h->head;
+
+    while (e) {
+
+	if (condition(e, ptr)==0) break;
+	e=e->n;
+
+    }
+
+    return e;
+}
+
+struct clist_element_s *search_clist_element_back(struct clist_header_s *h, int (* condition)(struct clist_element_s *list, void *ptr), void *ptr)
+{
+    struct clist_element_s *e=h->tail;
+
+    while (e) {
+
+	if (condition(e, ptr)==0) break;
+	e=e->p;
+
+    }
+
+    return e;
+}
+
+signed char clist_element_is_first(struct clist_header_s *h, struct clist_element_s *e)
+{
+    return (h->head==e) ? 0 : -1;
+}
+
+signed char clist_element_is_last(struct clist_header_s *h, struct clist_element_s *e)
+{
+    return (h->tail==e) ? 0 : -1;
+}
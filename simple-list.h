@@ -83,4 +83,50 @@ signed char list_element_is_last(struct list_element_s *e);
 struct list_element_s *get_next_element(struct list_element_s *e);
 struct list_element_s *get_prev_element(struct list_element_s *e);
 
+/* compact list: an element is only two pointers, no timestamp and no ops per element
+    all operations go through the ops of the header, so the header has to be known by the caller */
+
+struct clist_element_s;
+struct clist_header_s;
+
+struct clist_header_ops_s {
+    void			(* insert_after)(struct clist_header_s *h, struct clist_element_s *a, struct clist_element_s *e);
+    void			(* delete)(struct clist_header_s *h, struct clist_element_s *e);
+};
+
+struct clist_element_s {
+    struct clist_element_s	*n;
+    struct clist_element_s	*p;
+};
+
+struct clist_header_s {
+    uint64_t			count;
+    struct clist_element_s	*head;
+    struct clist_element_s	*tail;
+    struct clist_header_ops_s	*ops;
+    char			*name;
+};
+
+extern struct clist_header_ops_s empty_clist_header_ops;
+
+#define				INIT_CLIST_HEADER		{ 0, NULL, NULL, &empty_clist_header_ops, NULL }
+
+void init_clist_element(struct clist_element_s *e);
+void init_clist_header(struct clist_header_s *h, char *name);
+
+void add_clist_element_last(struct clist_header_s *h, struct clist_element_s *e);
+void add_clist_element_first(struct clist_header_s *h, struct clist_element_s *e);
+void add_clist_element_after(struct clist_header_s *h, struct clist_element_s *p, struct clist_element_s *e);
+void add_clist_element_before(struct clist_header_s *h, struct clist_element_s *n, struct clist_element_s *e);
+void remove_clist_element(struct clist_header_s *h, struct clist_element_s *e);
+
+struct clist_element_s *get_clist_head(struct clist_header_s *h, unsigned char flags);
+struct clist_element_s *get_clist_tail(struct clist_header_s *h, unsigned char flags);
+
+struct clist_element_s *search_clist_element_forw(struct clist_header_s *h, int (* condition)(struct clist_element_s *list, void *ptr), void *ptr);
+struct clist_element_s *search_clist_element_back(struct clist_header_s *h, int (* condition)(struct clist_element_s *list, void *ptr), void *ptr);
+
+signed char clist_element_is_first(struct clist_header_s *h, struct clist_element_s *e);
+signed char clist_element_is_last(struct clist_header_s *h, struct clist_element_s *e);
+
 #endif
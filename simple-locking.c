@@ -27,8 +27,12 @@
 #include <err.h>
 
 #include <pthread.h>
+#include <time.h>
+#include <inttypes.h>
+
 #include "simple-list.h"
 #include "simple-locking.h"
+#include "epoch.h"
 #undef LOGGING
 #include "logging.h"
 
@@ -42,6 +46,28 @@ int init_simple_locking(struct simple_locking_s *locking)
     init_list_header(&locking->writelocks, SIMPLE_LIST_TYPE_EMPTY, NULL);
     locking->readers=0;
     locking->writers=0;
+    locking->scalable=NULL;
+    locking->profile=NULL;
+    return 0;
+}
+
+/* use the scalable locks, worth it for locks with many concurrent readers like the hashtables */
+
+int init_simple_locking_scalable(struct simple_locking_s *locking)
+{
+    void *ptr=NULL;
+
+    init_simple_locking(locking);
+
+    if (posix_memalign(&ptr, 64, sizeof(struct simple_locking_scalable_s))!=0) {
+
+	logoutput_warning("init_simple_locking_scalable: unable to allocate stripes, using default locking");
+	return 0;
+
+    }
+
+    memset(ptr, 0, sizeof(struct simple_locking_scalable_s));
+    locking->scalable=(struct simple_locking_scalable_s *) ptr;
     return 0;
 }
 
@@ -52,6 +78,13 @@ void clear_simple_locking(struct simple_locking_s *locking)
     pthread_mutex_destroy(&locking->mutex);
     pthread_cond_destroy(&locking->cond);
 
+    if (locking->scalable) {
+
+	free(locking->scalable);
+	locking->scalable=NULL;
+
+    }
+
     list=get_list_head(&locking->readlocks, SIMPLE_LIST_FLAG_REMOVE);
 
     while (list) {
@@ -320,12 +353,250 @@ static int _simple_prereadlock(struct simple_lock_s *rlock)
     pthread_mutex_unlock(&locking->mutex);
     return 0;
 }
+/* scalable read lock */
+
+static unsigned int count_scalable_readers(struct simple_locking_scalable_s *scalable)
+{
+    unsigned int readers=0;
+
+    for (unsigned int i=0; i<SIMPLE_LOCKING_STRIPES; i++) readers+=__atomic_load_n(&scalable->stripes[i].readers, __ATOMIC_SEQ_CST);
+    return readers;
+}
+
+static int _scalable_readlock(struct simple_lock_s *rlock)
+{
+    struct simple_locking_s *locking=rlock->locking;
+    struct simple_locking_scalable_s *scalable=locking->scalable;
+    unsigned int *readers=NULL;
+
+    if (rlock->flags & SIMPLE_LOCK_FLAG_EFFECTIVE) return 0;
+
+    rlock->thread=pthread_self();
+    rlock->stripe=(unsigned char) (get_thread_stripe() % SIMPLE_LOCKING_STRIPES);
+    readers=&scalable->stripes[rlock->stripe].readers;
+
+    while (1) {
+
+	if (__atomic_load_n(&scalable->pending, __ATOMIC_SEQ_CST)==0) {
+
+	    __atomic_add_fetch(readers, 1, __ATOMIC_SEQ_CST);
+
+	    /* check again: a writer may have set pending in the meantime and not seen this reader */
+
+	    if (__atomic_load_n(&scalable->pending, __ATOMIC_SEQ_CST)==0) break;
+	    __atomic_sub_fetch(readers, 1, __ATOMIC_SEQ_CST);
+
+	    pthread_mutex_lock(&locking->mutex);
+	    pthread_cond_broadcast(&locking->cond);
+	    pthread_mutex_unlock(&locking->mutex);
+
+	}
+
+	pthread_mutex_lock(&locking->mutex);
+	while (scalable->pending>0) pthread_cond_wait(&locking->cond, &locking->mutex);
+	pthread_mutex_unlock(&locking->mutex);
+
+    }
+
+    rlock->flags|=SIMPLE_LOCK_FLAG_EFFECTIVE;
+    return 0;
+
+}
+
+/* leave the stripe, wake up a writer when it's waiting */
+
+static void leave_scalable_stripe(struct simple_lock_s *rlock)
+{
+    struct simple_locking_s *locking=rlock->locking;
+    struct simple_locking_scalable_s *scalable=locking->scalable;
+
+    __atomic_sub_fetch(&scalable->stripes[rlock->stripe].readers, 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&scalable->pending, __ATOMIC_SEQ_CST)>0) {
+
+	pthread_mutex_lock(&locking->mutex);
+	pthread_cond_broadcast(&locking->cond);
+	pthread_mutex_unlock(&locking->mutex);
+
+    }
+
+}
+
+static int _scalable_readunlock(struct simple_lock_s *rlock)
+{
+
+    if (rlock->flags & SIMPLE_LOCK_FLAG_EFFECTIVE) {
+
+	leave_scalable_stripe(rlock);
+	rlock->flags -= SIMPLE_LOCK_FLAG_EFFECTIVE;
+
+    }
+
+    return 0;
+}
+
+/* become the owner, with mutex locked
+    returns -1 when the lock is a read lock and another writer is owner: that writer waits for this reader */
+
+static int get_scalable_owner(struct simple_lock_s *lock, unsigned char reader)
+{
+    struct simple_locking_s *locking=lock->locking;
+    struct simple_locking_scalable_s *scalable=locking->scalable;
+
+    if (scalable->owner==lock) return 0;
+
+    if (scalable->owner) {
+
+	if (reader) return -1;
+
+	scalable->waiting++;
+	__atomic_store_n(&scalable->pending, 1, __ATOMIC_SEQ_CST);
+	while (scalable->owner) pthread_cond_wait(&locking->cond, &locking->mutex);
+	scalable->waiting--;
+
+    }
+
+    scalable->owner=lock;
+    __atomic_store_n(&scalable->pending, 1, __ATOMIC_SEQ_CST);
+    return 0;
+}
+
+static void wait_scalable_readers(struct simple_lock_s *wlock)
+{
+    struct simple_locking_s *locking=wlock->locking;
+    struct simple_locking_scalable_s *scalable=locking->scalable;
+
+    while (count_scalable_readers(scalable)>0) pthread_cond_wait(&locking->cond, &locking->mutex);
+    wlock->flags |= SIMPLE_LOCK_FLAG_EFFECTIVE;
+}
+
+static int _scalable_writelock(struct simple_lock_s *wlock)
+{
+    struct simple_locking_s *locking=wlock->locking;
+
+    wlock->thread=pthread_self();
+    pthread_mutex_lock(&locking->mutex);
+
+    get_scalable_owner(wlock, 0);
+    wlock->flags |= SIMPLE_LOCK_FLAG_LIST;
+    if ((wlock->flags & SIMPLE_LOCK_FLAG_EFFECTIVE)==0) wait_scalable_readers(wlock);
+
+    pthread_mutex_unlock(&locking->mutex);
+    return 0;
+
+}
+
+static int _scalable_writeunlock(struct simple_lock_s *wlock)
+{
+    struct simple_locking_s *locking=wlock->locking;
+    struct simple_locking_scalable_s *scalable=locking->scalable;
+
+    pthread_mutex_lock(&locking->mutex);
+
+    if (scalable->owner==wlock) {
+
+	scalable->owner=NULL;
+
+	/* hand over to the next writer: keep readers out */
+
+	if (scalable->waiting==0) __atomic_store_n(&scalable->pending, 0, __ATOMIC_SEQ_CST);
+
+    }
+
+    wlock->flags &= ~(SIMPLE_LOCK_FLAG_LIST | SIMPLE_LOCK_FLAG_EFFECTIVE | SIMPLE_LOCK_FLAG_UPGRADED);
+    pthread_cond_broadcast(&locking->cond);
+    pthread_mutex_unlock(&locking->mutex);
+    return 0;
+}
+
+static int _scalable_prewritelock(struct simple_lock_s *wlock)
+{
+    struct simple_locking_s *locking=wlock->locking;
+
+    wlock->thread=pthread_self();
+    pthread_mutex_lock(&locking->mutex);
+    get_scalable_owner(wlock, 0);
+    wlock->flags |= SIMPLE_LOCK_FLAG_LIST;
+    pthread_mutex_unlock(&locking->mutex);
+    return 0;
+}
+
+static void set_scalable_writelock_ops(struct simple_lock_s *lock)
+{
+    lock->type=SIMPLE_LOCK_TYPE_WRITE;
+    lock->lock=_scalable_writelock;
+    lock->unlock=_scalable_writeunlock;
+    lock->upgrade=_simple_upgrade_writelock;
+    lock->prelock=_scalable_prewritelock;
+}
+
+/* turn a read lock into a write lock, fails when another writer is already owner */
+
+static int _scalable_upgrade_readlock(struct simple_lock_s *rlock)
+{
+    struct simple_locking_s *locking=rlock->locking;
+
+    pthread_mutex_lock(&locking->mutex);
+
+    if (get_scalable_owner(rlock, 1)==-1) {
+
+	pthread_mutex_unlock(&locking->mutex);
+	return -1;
+
+    }
+
+    if (rlock->flags & SIMPLE_LOCK_FLAG_EFFECTIVE) {
+
+	__atomic_sub_fetch(&locking->scalable->stripes[rlock->stripe].readers, 1, __ATOMIC_SEQ_CST);
+	rlock->flags -= SIMPLE_LOCK_FLAG_EFFECTIVE;
+
+    }
+
+    set_scalable_writelock_ops(rlock);
+    rlock->flags |= (SIMPLE_LOCK_FLAG_LIST | SIMPLE_LOCK_FLAG_UPGRADED);
+    wait_scalable_readers(rlock);
+
+    pthread_mutex_unlock(&locking->mutex);
+    return 0;
+}
+
+/* turn a read lock into a pre write lock: new readers are blocked, existing readers may finish */
+
+static int _scalable_prereadlock(struct simple_lock_s *rlock)
+{
+    struct simple_locking_s *locking=rlock->locking;
+
+    pthread_mutex_lock(&locking->mutex);
+
+    if (get_scalable_owner(rlock, 1)==-1) {
+
+	pthread_mutex_unlock(&locking->mutex);
+	return -1;
+
+    }
+
+    if (rlock->flags & SIMPLE_LOCK_FLAG_EFFECTIVE) {
+
+	__atomic_sub_fetch(&locking->scalable->stripes[rlock->stripe].readers, 1, __ATOMIC_SEQ_CST);
+	rlock->flags -= SIMPLE_LOCK_FLAG_EFFECTIVE;
+
+    }
+
+    set_scalable_writelock_ops(rlock);
+    rlock->flags |= SIMPLE_LOCK_FLAG_LIST;
+
+    pthread_mutex_unlock(&locking->mutex);
+    return 0;
+}
+
 void init_simple_nonelock(struct simple_locking_s *locking, struct simple_lock_s *lock)
 {
     lock->type=SIMPLE_LOCK_TYPE_NONE;
     lock->thread=0;
     init_list_element(&lock->list, NULL);
     lock->flags=0;
+    lock->stripe=0;
+    lock->locked=0;
     lock->locking=locking;
     lock->lock=_simple_nonelock;
     lock->unlock=_simple_noneunlock;
@@ -338,11 +609,26 @@ void init_simple_readlock(struct simple_locking_s *locking, struct simple_lock_s
     rlock->thread=0;
     init_list_element(&rlock->list, NULL);
     rlock->flags=0;
+    rlock->stripe=0;
+    rlock->locked=0;
     rlock->locking=locking;
-    rlock->lock=_simple_readlock;
-    rlock->unlock=_simple_readunlock;
-    rlock->upgrade=_simple_upgrade_readlock;
-    rlock->prelock=_simple_prereadlock;
+
+    if (locking->scalable) {
+
+	rlock->lock=_scalable_readlock;
+	rlock->unlock=_scalable_readunlock;
+	rlock->upgrade=_scalable_upgrade_readlock;
+	rlock->prelock=_scalable_prereadlock;
+
+    } else {
+
+	rlock->lock=_simple_readlock;
+	rlock->unlock=_simple_readunlock;
+	rlock->upgrade=_simple_upgrade_readlock;
+	rlock->prelock=_simple_prereadlock;
+
+    }
+
 }
 void init_simple_writelock(struct simple_locking_s *locking, struct simple_lock_s *wlock)
 {
@@ -350,22 +636,217 @@ void init_simple_writelock(struct simple_locking_s *locking, struct simple_lock_
     wlock->thread=0;
     init_list_element(&wlock->list, NULL);
     wlock->flags=0;
+    wlock->stripe=0;
+    wlock->locked=0;
     wlock->locking=locking;
-    wlock->lock=_simple_writelock;
-    wlock->unlock=_simple_writeunlock;
-    wlock->upgrade=_simple_upgrade_writelock;
-    wlock->prelock=_simple_prewritelock;
+
+    if (locking->scalable) {
+
+	set_scalable_writelock_ops(wlock);
+
+    } else {
+
+	wlock->lock=_simple_writelock;
+	wlock->unlock=_simple_writeunlock;
+	wlock->upgrade=_simple_upgrade_writelock;
+	wlock->prelock=_simple_prewritelock;
+
+    }
+
+}
+
+/* profiling */
+
+static unsigned char profiling=0;
+static struct simple_locking_profile_s *profiles=NULL;
+static pthread_mutex_t profiles_mutex=PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t get_profile_time()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static unsigned int get_profile_bucket(uint64_t nsec)
+{
+    unsigned int bucket=63 - __builtin_clzll(nsec | 1);
+    return (bucket < SIMPLE_LOCKING_PROFILE_BUCKETS) ? bucket : SIMPLE_LOCKING_PROFILE_BUCKETS - 1;
+}
+
+static void profile_add(uint64_t *counter, uint64_t value)
+{
+    __atomic_add_fetch(counter, value, __ATOMIC_RELAXED);
+}
+
+static void profile_wait(struct simple_locking_profile_s *profile, uint64_t wait)
+{
+    if (wait < SIMPLE_LOCKING_PROFILE_WAIT) return;
+    profile_add(&profile->waits, 1);
+    profile_add(&profile->waittime, wait);
+    profile_add(&profile->waithist[get_profile_bucket(wait)], 1);
+}
+
+/* profiling has to be enabled before the lockings are created, lockings created before are not profiled */
+
+void set_simple_locking_profiling(unsigned char enable)
+{
+    profiling=enable;
+}
+
+void profile_simple_locking(struct simple_locking_s *locking, char *name)
+{
+    struct simple_locking_profile_s *profile=NULL;
+
+    if (profiling==0 || name==NULL) return;
+
+    pthread_mutex_lock(&profiles_mutex);
+
+    profile=profiles;
+
+    while (profile) {
+
+	if (strncmp(profile->name, name, SIMPLE_LOCKING_PROFILE_NAMELEN - 1)==0) break;
+	profile=profile->next;
+
+    }
+
+    if (profile==NULL) {
+
+	profile=malloc(sizeof(struct simple_locking_profile_s));
+
+	if (profile) {
+
+	    memset(profile, 0, sizeof(struct simple_locking_profile_s));
+	    strncpy(profile->name, name, SIMPLE_LOCKING_PROFILE_NAMELEN - 1);
+	    profile->next=profiles;
+	    profiles=profile;
+
+	} else {
+
+	    logoutput_warning("profile_simple_locking: unable to allocate profile for %s", name);
+
+	}
+
+    }
+
+    locking->profile=profile;
+    pthread_mutex_unlock(&profiles_mutex);
+
+}
+
+static void dump_profile_histogram(FILE *fp, const char *what, uint64_t *hist)
+{
+    fprintf(fp, "  %s:", what);
+
+    for (unsigned int i=0; i<SIMPLE_LOCKING_PROFILE_BUCKETS; i++) {
+
+	if (hist[i]>0) fprintf(fp, " <2^%u:%" PRIu64, i + 1, hist[i]);
+
+    }
+
+    fprintf(fp, "\n");
+}
+
+int dump_simple_locking_profiles(char *path, unsigned int *error)
+{
+    struct simple_locking_profile_s *profile=NULL;
+    FILE *fp=fopen(path, "w");
+
+    if (fp==NULL) {
+
+	*error=errno;
+	logoutput_warning("dump_simple_locking_profiles: error %i opening %s (%s)", errno, path, strerror(errno));
+	return -1;
+
+    }
+
+    pthread_mutex_lock(&profiles_mutex);
+
+    profile=profiles;
+
+    while (profile) {
+	uint64_t locks=profile->readlocks + profile->writelocks;
+
+	fprintf(fp, "%s: read %" PRIu64 " write %" PRIu64 " waited %" PRIu64 " (total %" PRIu64 " nsec)\n", profile->name, profile->readlocks, profile->writelocks, profile->waits, profile->waittime);
+	fprintf(fp, "  hold: total %" PRIu64 " nsec avg %" PRIu64 " nsec max %" PRIu64 " nsec\n", profile->holdtime, (locks>0) ? profile->holdtime / locks : 0, profile->holdmax);
+	fprintf(fp, "  upgrade: %" PRIu64 " waited %" PRIu64 " failed %" PRIu64 "\n", profile->upgrades, profile->upgradewaits, profile->upgradefails);
+	dump_profile_histogram(fp, "wait", profile->waithist);
+	dump_profile_histogram(fp, "hold", profile->holdhist);
+	profile=profile->next;
+
+    }
+
+    pthread_mutex_unlock(&profiles_mutex);
+    fclose(fp);
+    *error=0;
+    return 0;
+
+}
+
+static int profile_simple_lock(struct simple_locking_profile_s *profile, struct simple_lock_s *lock)
+{
+    uint64_t start=get_profile_time();
+    int result=(* lock->lock)(lock);
+
+    lock->locked=get_profile_time();
+    profile_add((lock->type==SIMPLE_LOCK_TYPE_WRITE) ? &profile->writelocks : &profile->readlocks, 1);
+    profile_wait(profile, lock->locked - start);
+    return result;
+}
+
+static int profile_simple_unlock(struct simple_locking_profile_s *profile, struct simple_lock_s *lock)
+{
+    int result=(* lock->unlock)(lock);
+
+    if (lock->locked>0) {
+	uint64_t hold=get_profile_time() - lock->locked;
+	uint64_t max=__atomic_load_n(&profile->holdmax, __ATOMIC_RELAXED);
+
+	profile_add(&profile->holdtime, hold);
+	profile_add(&profile->holdhist[get_profile_bucket(hold)], 1);
+	while (hold > max && ! __atomic_compare_exchange_n(&profile->holdmax, &max, hold, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	lock->locked=0;
+
+    }
+
+    return result;
+}
+
+static int profile_simple_upgradelock(struct simple_locking_profile_s *profile, struct simple_lock_s *lock)
+{
+    uint64_t start=get_profile_time();
+    int result=(* lock->upgrade)(lock);
+    uint64_t wait=get_profile_time() - start;
+
+    profile_add(&profile->upgrades, 1);
+
+    if (result==-1) {
+
+	profile_add(&profile->upgradefails, 1);
+
+    } else if (wait >= SIMPLE_LOCKING_PROFILE_WAIT) {
+
+	profile_add(&profile->upgradewaits, 1);
+	profile_wait(profile, wait);
+
+    }
+
+    return result;
 }
 
 int simple_lock(struct simple_lock_s *lock)
 {
     // logoutput("simple_lock");
+    if (lock->locking && lock->locking->profile) return profile_simple_lock(lock->locking->profile, lock);
     return (* lock->lock)(lock);
 }
 
 int simple_unlock(struct simple_lock_s *lock)
 {
     // logoutput("simple_unlock");
+    if (lock->locking && lock->locking->profile) return profile_simple_unlock(lock->locking->profile, lock);
     return (* lock->unlock)(lock);
 }
 
@@ -378,5 +859,6 @@ int simple_prelock(struct simple_lock_s *lock)
 int simple_upgradelock(struct simple_lock_s *lock)
 {
     // logoutput("simple_upgradelock");
+    if (lock->locking && lock->locking->profile) return profile_simple_upgradelock(lock->locking->profile, lock);
     return (* lock->upgrade)(lock);
 }
@@ -35,6 +35,49 @@
 
 #define SIMPLE_LOCKING_FLAG_UPGRADE	1
 
+#define SIMPLE_LOCKING_STRIPES		16
+
+/* scalable locking: readers only increase a counter in a stripe (each stripe on its own cacheline)
+    a writer becomes owner, sets pending to stop new readers and waits till all the stripes are zero
+    when unlocking and another writer is waiting pending stays set: writers get the lock first */
+
+struct simple_locking_stripe_s {
+    unsigned int			readers;
+    char				pad[60];
+} __attribute__((aligned(64)));
+
+struct simple_lock_s;
+
+struct simple_locking_scalable_s {
+    struct simple_locking_stripe_s	stripes[SIMPLE_LOCKING_STRIPES];
+    unsigned int			pending;
+    unsigned int			waiting;
+    struct simple_lock_s		*owner;
+};
+
+/* profiling: counters per name of the owner (like "directory"), shared by all lockings with that name
+    histograms are log2 of the time in nsec */
+
+#define SIMPLE_LOCKING_PROFILE_BUCKETS	32
+#define SIMPLE_LOCKING_PROFILE_NAMELEN	32
+#define SIMPLE_LOCKING_PROFILE_WAIT	1000
+
+struct simple_locking_profile_s {
+    char				name[SIMPLE_LOCKING_PROFILE_NAMELEN];
+    uint64_t				readlocks;
+    uint64_t				writelocks;
+    uint64_t				waits;
+    uint64_t				waittime;
+    uint64_t				waithist[SIMPLE_LOCKING_PROFILE_BUCKETS];
+    uint64_t				holdtime;
+    uint64_t				holdmax;
+    uint64_t				holdhist[SIMPLE_LOCKING_PROFILE_BUCKETS];
+    uint64_t				upgrades;
+    uint64_t				upgradewaits;
+    uint64_t				upgradefails;
+    struct simple_locking_profile_s	*next;
+};
+
 struct simple_locking_s {
     unsigned int			flags;
     pthread_mutex_t			mutex;
@@ -43,6 +86,8 @@ struct simple_locking_s {
     unsigned int			readers;
     struct list_header_s		writelocks;
     unsigned int			writers;
+    struct simple_locking_scalable_s	*scalable;
+    struct simple_locking_profile_s	*profile;
 };
 
 struct simple_lock_s {
@@ -50,6 +95,8 @@ struct simple_lock_s {
     struct list_element_s		list;
     pthread_t				thread;
     unsigned char			flags;
+    unsigned char			stripe;
+    uint64_t				locked;
     struct simple_locking_s		*locking;
     int					(* lock)(struct simple_lock_s *l);
     int					(* unlock)(struct simple_lock_s *l);
@@ -64,6 +111,7 @@ void init_simple_readlock(struct simple_locking_s *locking, struct simple_lock_s
 void init_simple_writelock(struct simple_locking_s *locking, struct simple_lock_s *wlock);
 
 int init_simple_locking(struct simple_locking_s *locking);
+int init_simple_locking_scalable(struct simple_locking_s *locking);
 void clear_simple_locking(struct simple_locking_s *locking);
 
 int simple_lock(struct simple_lock_s *lock);
@@ -71,4 +119,8 @@ int simple_unlock(struct simple_lock_s *lock);
 int simple_prelock(struct simple_lock_s *lock);
 int simple_upgradelock(struct simple_lock_s *lock);
 
+void set_simple_locking_profiling(unsigned char enable);
+void profile_simple_locking(struct simple_locking_s *locking, char *name);
+int dump_simple_locking_profiles(char *path, unsigned int *error);
+
 #endif
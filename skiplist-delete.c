@@ -41,6 +41,7 @@
 
 #include "skiplist.h"
 #include "skiplist-delete.h"
+#include "skiplist-lockfree.h"
 #define LOGGING
 #include "logging.h"
 
@@ -505,6 +506,13 @@ void delete_sl(struct skiplist_struct *sl, void *lookupdata, unsigned int *row,
 {
     unsigned int count=0;
 
+    if (sl->lockfree) {
+
+	delete_sl_lockfree(sl, lookupdata, row, error, 0);
+	return;
+
+    }
+
     while(count<10) {
 
 	delete_nonempty_sl(sl, lookupdata, row, error);
@@ -705,6 +713,13 @@ static void delete_nonempty_sl_batch(struct skiplist_struct *sl, void *lookupdat
 void delete_sl_batch(struct skiplist_struct *sl, void *lookupdata, unsigned int *row, unsigned int *error)
 {
 
+    if (sl->lockfree) {
+
+	delete_sl_lockfree(sl, lookupdata, row, error, 1);
+	return;
+
+    }
+
     delete_nonempty_sl_batch(sl, lookupdata, row, error);
 
 }
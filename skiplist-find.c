@@ -41,6 +41,7 @@
 
 #include "skiplist.h"
 #include "skiplist-find.h"
+#include "skiplist-lockfree.h"
 #include "logging.h"
 
 static void *find_nonempty_sl(struct skiplist_struct *sl, void *lookupdata, unsigned int *row, unsigned int *error)
@@ -298,6 +299,7 @@ void *find_sl(struct skiplist_struct *sl, void *lookupdata, unsigned int *row, u
     unsigned char count=0;
 
     if (row) *row=0;
+    if (sl->lockfree) return find_sl_lockfree(sl, lookupdata, row, error);
 
     // logoutput("find_sl");
 
@@ -513,5 +515,6 @@ static void *find_nonempty_sl_batch(struct skiplist_struct *sl, void *lookupdata
 void *find_sl_batch(struct skiplist_struct *sl, void *lookupdata, unsigned int *row, unsigned int *error)
 {
     if (row) *row=0;
+    if (sl->lockfree) return find_sl_lockfree(sl, lookupdata, row, error);
     return find_nonempty_sl_batch(sl, lookupdata, row, error);
 }
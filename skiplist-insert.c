@@ -43,6 +43,7 @@
 
 #include "skiplist.h"
 #include "skiplist-insert.h"
+#include "skiplist-lockfree.h"
 #include "logging.h"
 
 /*
@@ -228,6 +229,7 @@ static unsigned int add_dirnode_sl(struct skiplist_struct *sl, struct vector_dir
 	    struct dirnode_struct *new_dirnode=NULL;
 
 	    newlevel=resize_head_dirnode(dirnode, newlevel);
+	    dn_count=(unsigned *) dirnode->data; /* may have been moved by resize */
 	    new_dirnode=create_dirnode(newlevel);
 
 	    if (new_dirnode) {
@@ -749,6 +751,7 @@ void *insert_sl(struct skiplist_struct *sl, void *lookupdata, unsigned int *row,
     void *found=NULL;
 
     if (row) *row=0;
+    if (sl->lockfree) return insert_sl_lockfree(sl, lookupdata, row, error, data, flags, 0);
 
     // logoutput("insert_entry_sl");
 
@@ -1019,6 +1022,7 @@ void *insert_sl_batch(struct skiplist_struct *sl, void *lookupdata, unsigned int
     int newlevel=-1;
 
     if (row) *row=0;
+    if (sl->lockfree) return insert_sl_lockfree(sl, lookupdata, row, error, data, flags, 1);
 
     if (! (flags & _SL_INSERT_FLAG_NOLANE)) {
 
@@ -1037,3 +1041,72 @@ void *insert_sl_batch(struct skiplist_struct *sl, void *lookupdata, unsigned int
 
 }
 
+
+/*
+    insert a batch of data sorted in ascending order in one pass, the caller holds an exclusive lock
+    the data is merged in the list of the owner by walking both at the same time, after that the fast lanes
+    are built again (see build_dirnodes_sl)
+
+    result[i] is data[i] when added, the data already present otherwise
+    returns the number of data added
+*/
+
+unsigned int insert_sl_sorted_batch(struct skiplist_struct *sl, void **lookupdata, void **data, void **result, unsigned int count, unsigned int *error)
+{
+    void *search=NULL, *last=NULL;
+    unsigned int added=0;
+
+    *error=0;
+    if (sl->lockfree) return insert_sl_lockfree_sorted(sl, lookupdata, data, result, count, error);
+
+    search=sl->ops.first(sl);
+
+    for (unsigned int i=0; i<count; i++) {
+	int diff=1;
+
+	/* same as the previous one in the batch */
+
+	if (last && sl->ops.compare(last, lookupdata[i])==0) {
+
+	    result[i]=last;
+	    continue;
+
+	}
+
+	while (search) {
+
+	    diff=sl->ops.compare(search, lookupdata[i]);
+	    if (diff>=0) break;
+	    search=sl->ops.next(search);
+
+	}
+
+	if (search && diff==0) {
+
+	    result[i]=search;
+
+	} else {
+
+	    if (search) {
+
+		sl->ops.insert_before(data[i], search, sl);
+
+	    } else {
+
+		sl->ops.insert_after(data[i], NULL, sl);
+
+	    }
+
+	    result[i]=data[i];
+	    added++;
+
+	}
+
+	last=result[i];
+
+    }
+
+    if (added>0 && build_dirnodes_sl(sl)==-1) logoutput_warning("insert_sl_sorted_batch: unable to build the fast lanes");
+    return added;
+
+}
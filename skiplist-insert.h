@@ -28,5 +28,6 @@
 
 void *insert_sl(struct skiplist_struct *sl, void *lookupdata, unsigned int *row, unsigned int *error, void *data, unsigned short flags);
 void *insert_sl_batch(struct skiplist_struct *sl, void *lookupdata, unsigned int *row, unsigned int *error, void *data, unsigned short flags);
+unsigned int insert_sl_sorted_batch(struct skiplist_struct *sl, void **lookupdata, void **data, void **result, unsigned int count, unsigned int *error);
 
 #endif
@@ -0,0 +1,481 @@
+/*
+  2010, 2011, 2012, 2013, 2014, 2015, 2016 Stef Bon <stefbon@gmail.com>
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include "global-defines.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+
+#include <inttypes.h>
+#include <ctype.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/param.h>
+#include <pthread.h>
+
+#include "skiplist.h"
+#include "skiplist-insert.h"
+#include "skiplist-lockfree.h"
+#include "logging.h"
+
+static __thread unsigned int thread_seed=0;
+
+static struct skiplist_lockfree_node_s *create_lockfree_node(void *data, unsigned short level)
+{
+    struct skiplist_lockfree_node_s *node=NULL;
+
+    node=malloc(sizeof(struct skiplist_lockfree_node_s) + (level + 1) * sizeof(struct skiplist_lockfree_node_s *));
+
+    if (node) {
+
+	memset(node, 0, sizeof(struct skiplist_lockfree_node_s) + (level + 1) * sizeof(struct skiplist_lockfree_node_s *));
+	node->data=data;
+	node->level=level;
+
+    }
+
+    return node;
+
+}
+
+/* level of a new node: every level up has a chance of 1/prob */
+
+static unsigned short get_lockfree_level(struct skiplist_struct *sl)
+{
+    unsigned short level=0;
+    unsigned int prob=(sl->prob > 1) ? sl->prob : 2;
+
+    if (thread_seed==0) thread_seed=(unsigned int) (((uintptr_t) &thread_seed) >> 4) ^ (unsigned int) pthread_self() ^ 0x9E3779B9;
+
+    while (level < _SKIPLIST_LOCKFREE_MAXLEVEL - 1) {
+
+	/* xorshift */
+
+	thread_seed^=thread_seed << 13;
+	thread_seed^=thread_seed >> 17;
+	thread_seed^=thread_seed << 5;
+
+	if ((thread_seed % prob) != 0) break;
+	level++;
+
+    }
+
+    return level;
+
+}
+
+/*
+    walk the lanes from the highest level down to find lookupdata
+    when preds is defined the predecessor in every lane is stored (used by writers)
+    returns the node with an exact match if any
+*/
+
+static struct skiplist_lockfree_node_s *search_lockfree(struct skiplist_struct *sl, struct skiplist_lockfree_s *lf, void *lookupdata, struct skiplist_lockfree_node_s **preds)
+{
+    struct skiplist_lockfree_node_s *pred=lf->head, *next=NULL;
+    int level=(int) __atomic_load_n(&lf->level, __ATOMIC_ACQUIRE);
+    int diff=1;
+
+    if (preds) {
+
+	for (int i=_SKIPLIST_LOCKFREE_MAXLEVEL - 1; i>level; i--) preds[i]=lf->head;
+
+    }
+
+    while (level>=0) {
+
+	next=__atomic_load_n(&pred->next[level], __ATOMIC_ACQUIRE);
+
+	while (next) {
+
+	    diff=sl->ops.compare(next->data, lookupdata);
+	    if (diff>=0) break;
+
+	    pred=next;
+	    next=__atomic_load_n(&pred->next[level], __ATOMIC_ACQUIRE);
+
+	}
+
+	if (preds) {
+
+	    preds[level]=pred;
+
+	} else if (next && diff==0) {
+
+	    /* readers can stop at the first match */
+
+	    return next;
+
+	}
+
+	level--;
+
+    }
+
+    return (next && diff==0) ? next : NULL;
+
+}
+
+/* add a new node after the predecessors found by search_lockfree */
+
+static void link_lockfree_node(struct skiplist_struct *sl, struct skiplist_lockfree_s *lf, struct skiplist_lockfree_node_s **preds, struct skiplist_lockfree_node_s *node)
+{
+
+    /* add to the list of the owner */
+
+    if (preds[0]==lf->head) {
+
+	if (lf->head->next[0]) {
+
+	    sl->ops.insert_before(node->data, lf->head->next[0]->data, sl);
+
+	} else {
+
+	    sl->ops.insert_after(node->data, NULL, sl);
+
+	}
+
+    } else {
+
+	sl->ops.insert_after(node->data, preds[0]->data, sl);
+
+    }
+
+    /* link the node bottom up: first make it complete, then publish it */
+
+    for (unsigned short i=0; i<=node->level; i++) node->next[i]=preds[i]->next[i];
+    for (unsigned short i=0; i<=node->level; i++) __atomic_store_n(&preds[i]->next[i], node, __ATOMIC_RELEASE);
+
+    if (node->level > lf->level) __atomic_store_n(&lf->level, node->level, __ATOMIC_RELEASE);
+
+}
+
+int set_skiplist_lockfree(struct skiplist_struct *sl, unsigned int *error)
+{
+    struct skiplist_lockfree_s *lf=NULL;
+    int result=-1;
+
+    pthread_mutex_lock(&sl->mutex);
+
+    if (sl->lockfree) {
+
+	result=0;
+	goto unlock;
+
+    } else if (sl->dirnode || sl->ops.count(sl)>0) {
+
+	/* switching is only possible when empty */
+
+	*error=EBUSY;
+	goto unlock;
+
+    }
+
+    if (posix_memalign((void **) &lf, 64, sizeof(struct skiplist_lockfree_s))!=0) {
+
+	*error=ENOMEM;
+	goto unlock;
+
+    }
+
+    memset(lf, 0, sizeof(struct skiplist_lockfree_s));
+    init_epoch(&lf->epoch);
+    lf->head=create_lockfree_node(NULL, _SKIPLIST_LOCKFREE_MAXLEVEL - 1);
+
+    if (lf->head==NULL) {
+
+	free(lf);
+	*error=ENOMEM;
+	goto unlock;
+
+    }
+
+    sl->lockfree=lf;
+    result=0;
+
+    unlock:
+
+    pthread_mutex_unlock(&sl->mutex);
+    return result;
+
+}
+
+/* remove all nodes, the owner has to make sure there are no readers anymore */
+
+void clear_skiplist_lockfree(struct skiplist_struct *sl)
+{
+    struct skiplist_lockfree_s *lf=sl->lockfree;
+
+    if (lf) {
+	struct skiplist_lockfree_node_s *node=lf->head->next[0], *next=NULL;
+
+	while (node) {
+
+	    next=node->next[0];
+	    free(node);
+	    node=next;
+
+	}
+
+	memset(lf->head->next, 0, _SKIPLIST_LOCKFREE_MAXLEVEL * sizeof(struct skiplist_lockfree_node_s *));
+	lf->level=0;
+
+    }
+
+}
+
+void free_skiplist_lockfree(struct skiplist_struct *sl)
+{
+    struct skiplist_lockfree_s *lf=sl->lockfree;
+
+    if (lf) {
+
+	clear_skiplist_lockfree(sl);
+	free(lf->head);
+	free(lf);
+	sl->lockfree=NULL;
+
+    }
+
+}
+
+void *find_sl_lockfree(struct skiplist_struct *sl, void *lookupdata, unsigned int *row, unsigned int *error)
+{
+    struct skiplist_lockfree_s *lf=sl->lockfree;
+    struct skiplist_lockfree_node_s *node=NULL;
+    unsigned int *readers=NULL;
+    void *found=NULL;
+
+    /* rows are not maintained in the lockfree variant */
+
+    if (row) *row=0;
+
+    readers=enter_epoch(&lf->epoch);
+    node=search_lockfree(sl, lf, lookupdata, NULL);
+    if (node) found=node->data;
+    leave_epoch(readers);
+
+    *error=(found) ? 0 : ENOENT;
+    return found;
+
+}
+
+/*
+    insert data
+    writers are serialized by the lock of the owner (this also protects the list of data maintained by the owner)
+    and by the mutex of the skiplist
+    with batch the caller already holds the lock of the owner
+*/
+
+void *insert_sl_lockfree(struct skiplist_struct *sl, void *lookupdata, unsigned int *row, unsigned int *error, void *data, unsigned short flags, unsigned char batch)
+{
+    struct skiplist_lockfree_s *lf=sl->lockfree;
+    struct skiplist_lockfree_node_s *preds[_SKIPLIST_LOCKFREE_MAXLEVEL];
+    struct skiplist_lockfree_node_s *node=NULL;
+    unsigned short level=(flags & _SL_INSERT_FLAG_NOLANE) ? 0 : get_lockfree_level(sl);
+    void *ptr=NULL;
+    void *found=NULL;
+
+    if (row) *row=0;
+
+    if (batch==0) {
+
+	ptr=sl->ops.create_wlock(sl);
+
+	if (ptr==NULL) {
+
+	    *error=EAGAIN;
+	    return NULL;
+
+	}
+
+    }
+
+    pthread_mutex_lock(&sl->mutex);
+
+    node=search_lockfree(sl, lf, lookupdata, preds);
+
+    if (node) {
+
+	*error=EEXIST;
+	found=node->data;
+	goto unlock;
+
+    }
+
+    node=create_lockfree_node(data, level);
+
+    if (node==NULL) {
+
+	*error=ENOMEM;
+	goto unlock;
+
+    }
+
+    link_lockfree_node(sl, lf, preds, node);
+    *error=0;
+    found=data;
+
+    unlock:
+
+    pthread_mutex_unlock(&sl->mutex);
+    if (ptr) sl->ops.unlock(sl, ptr);
+    return found;
+
+}
+
+/*
+    insert a batch of data sorted in ascending order, the caller holds the lock of the owner
+    the search for the next data starts at the predecessor in the top lane of the previous one,
+    since the batch is sorted it never has to go back
+*/
+
+unsigned int insert_sl_lockfree_sorted(struct skiplist_struct *sl, void **lookupdata, void **data, void **result, unsigned int count, unsigned int *error)
+{
+    struct skiplist_lockfree_s *lf=sl->lockfree;
+    struct skiplist_lockfree_node_s *preds[_SKIPLIST_LOCKFREE_MAXLEVEL];
+    struct skiplist_lockfree_node_s *node=NULL;
+    unsigned int added=0;
+
+    pthread_mutex_lock(&sl->mutex);
+
+    for (unsigned int i=0; i<_SKIPLIST_LOCKFREE_MAXLEVEL; i++) preds[i]=lf->head;
+
+    for (unsigned int i=0; i<count; i++) {
+	struct skiplist_lockfree_node_s *pred=preds[_SKIPLIST_LOCKFREE_MAXLEVEL - 1];
+	struct skiplist_lockfree_node_s *next=NULL;
+	int diff=1;
+
+	for (int level=_SKIPLIST_LOCKFREE_MAXLEVEL - 1; level>=0; level--) {
+
+	    next=pred->next[level];
+	    diff=1;
+
+	    while (next) {
+
+		diff=sl->ops.compare(next->data, lookupdata[i]);
+		if (diff>=0) break;
+
+		pred=next;
+		next=pred->next[level];
+
+	    }
+
+	    preds[level]=pred;
+
+	}
+
+	if (next && diff==0) {
+
+	    result[i]=next->data;
+	    continue;
+
+	}
+
+	node=create_lockfree_node(data[i], get_lockfree_level(sl));
+
+	if (node==NULL) {
+
+	    *error=ENOMEM;
+	    result[i]=NULL;
+	    continue;
+
+	}
+
+	link_lockfree_node(sl, lf, preds, node);
+	result[i]=data[i];
+	added++;
+
+    }
+
+    pthread_mutex_unlock(&sl->mutex);
+    return added;
+
+}
+
+/*
+    delete data
+    the node is unlinked from the top lane down, readers still in the node can continue since the links
+    of the node itself stay valid
+    the node is freed after a grace period, so when this returns no reader is using the data anymore
+*/
+
+void delete_sl_lockfree(struct skiplist_struct *sl, void *lookupdata, unsigned int *row, unsigned int *error, unsigned char batch)
+{
+    struct skiplist_lockfree_s *lf=sl->lockfree;
+    struct skiplist_lockfree_node_s *preds[_SKIPLIST_LOCKFREE_MAXLEVEL];
+    struct skiplist_lockfree_node_s *node=NULL;
+    void *ptr=NULL;
+
+    if (row) *row=0;
+
+    if (batch==0) {
+
+	ptr=sl->ops.create_wlock(sl);
+
+	if (ptr==NULL) {
+
+	    *error=EAGAIN;
+	    return;
+
+	}
+
+    }
+
+    pthread_mutex_lock(&sl->mutex);
+
+    node=search_lockfree(sl, lf, lookupdata, preds);
+
+    if (node==NULL) {
+
+	*error=ENOENT;
+	goto unlock;
+
+    }
+
+    for (int i=node->level; i>=0; i--) {
+
+	if (preds[i]->next[i]==node) __atomic_store_n(&preds[i]->next[i], node->next[i], __ATOMIC_RELEASE);
+
+    }
+
+    while (lf->level>0 && lf->head->next[lf->level]==NULL) __atomic_store_n(&lf->level, lf->level - 1, __ATOMIC_RELEASE);
+
+    sl->ops.delete(node->data, sl);
+    *error=0;
+
+    unlock:
+
+    pthread_mutex_unlock(&sl->mutex);
+    if (ptr) sl->ops.unlock(sl, ptr);
+
+    if (node) {
+
+	wait_epoch_grace(&lf->epoch);
+	free(node);
+
+    }
+
+}
@@ -0,0 +1,60 @@
+/*
+  2010, 2011, 2012, 2013, 2014, 2015, 2016 Stef Bon <stefbon@gmail.com>
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#ifndef SB_COMMON_UTILS_SKIPLIST_LOCKFREE_H
+#define SB_COMMON_UTILS_SKIPLIST_LOCKFREE_H
+
+#include "epoch.h"
+
+#define _SKIPLIST_LOCKFREE_MAXLEVEL			24
+
+/*
+    lockfree variant of the skiplist
+
+    readers do not take any lock: they walk the lanes using atomic loads and announce themselves
+    in an epoch (see epoch.h)
+    writers are serialized (by the lock of the owner and the mutex of the skiplist), publish nodes with
+    atomic stores and free an unlinked node only after a grace period: all readers which could
+    have seen the node have left
+*/
+
+struct skiplist_lockfree_node_s {
+    void				*data;
+    unsigned short			level;
+    struct skiplist_lockfree_node_s	*next[];
+};
+
+struct skiplist_lockfree_s {
+    struct epoch_s			epoch;
+    unsigned short			level;
+    struct skiplist_lockfree_node_s	*head;
+};
+
+/* prototypes */
+
+int set_skiplist_lockfree(struct skiplist_struct *sl, unsigned int *error);
+void clear_skiplist_lockfree(struct skiplist_struct *sl);
+void free_skiplist_lockfree(struct skiplist_struct *sl);
+
+void *find_sl_lockfree(struct skiplist_struct *sl, void *lookupdata, unsigned int *row, unsigned int *error);
+void *insert_sl_lockfree(struct skiplist_struct *sl, void *lookupdata, unsigned int *row, unsigned int *error, void *data, unsigned short flags, unsigned char batch);
+unsigned int insert_sl_lockfree_sorted(struct skiplist_struct *sl, void **lookupdata, void **data, void **result, unsigned int count, unsigned int *error);
+void delete_sl_lockfree(struct skiplist_struct *sl, void *lookupdata, unsigned int *row, unsigned int *error, unsigned char batch);
+
+#endif
@@ -40,6 +40,7 @@
 #endif
 
 #include "skiplist.h"
+#include "skiplist-lockfree.h"
 #include "logging.h"
 
 static struct vector_dirnode_struct zero_vector;
@@ -167,6 +168,7 @@ int init_skiplist(struct skiplist_struct *sl, unsigned char prob,
 
 	sl->prob=prob;
 	sl->dirnode=NULL;
+	sl->lockfree=NULL;
 
 	pthread_mutex_init(&sl->mutex, NULL);
 	pthread_cond_init(&sl->cond, NULL);
@@ -230,17 +232,20 @@ void clear_skiplist(struct skiplist_struct *sl)
 
     }
 
+    if (sl->lockfree) clear_skiplist_lockfree(sl);
+
 }
 
 void destroy_lock_skiplist(struct skiplist_struct *sl)
 {
+    free_skiplist_lockfree(sl);
     pthread_mutex_destroy(&sl->mutex);
     pthread_cond_destroy(&sl->cond);
 }
 
 void destroy_skiplist(struct skiplist_struct *sl)
 {
-    if (sl->dirnode) clear_skiplist(sl);
+    if (sl->dirnode || sl->lockfree) clear_skiplist(sl);
     destroy_lock_skiplist(sl);
     free(sl);
 }
@@ -289,6 +294,113 @@ struct dirnode_struct *create_dirnode(unsigned short level)
 
 }
 
+/*
+    build the fast lanes from scratch for the data in the list (the caller holds an exclusive lock)
+    in one linear pass: the levels are chosen directly from the position instead of random,
+    every prob-th data gets a dirnode, every prob^2-th a dirnode with level 1, etc
+    on failure there are no fast lanes, which is still a valid (but slow) skiplist
+*/
+
+int build_dirnodes_sl(struct skiplist_struct *sl)
+{
+    unsigned int count=sl->ops.count(sl);
+    struct dirnode_struct *last[32];
+    unsigned int lastpos[32];
+    struct dirnode_struct *head=NULL;
+    unsigned short maxlevel=0;
+    unsigned long step=sl->prob;
+    unsigned *dn_count=NULL;
+    unsigned int pos=0;
+    void *data=NULL;
+
+    clear_skiplist(sl);
+    if (sl->prob<2 || count<=sl->prob) return 0;
+
+    /* highest level with at least one dirnode */
+
+    while (maxlevel<31 && step * sl->prob < count) {
+
+	step*=sl->prob;
+	maxlevel++;
+
+    }
+
+    head=create_head_dirnode(maxlevel);
+    if (head==NULL) return -1;
+
+    head->type=_DIRNODE_TYPE_START;
+    dn_count=(unsigned *) head->data;
+
+    for (unsigned short i=0; i<=maxlevel; i++) {
+
+	last[i]=head;
+	lastpos[i]=0;
+
+    }
+
+    sl->dirnode=head;
+    data=sl->ops.first(sl);
+    pos=1;
+
+    while (data && pos<count) {
+
+	if ((pos % sl->prob)==0) {
+	    struct dirnode_struct *dirnode=NULL;
+	    unsigned short level=0;
+
+	    step=sl->prob * sl->prob;
+
+	    while (level<maxlevel && (pos % step)==0) {
+
+		level++;
+		step*=sl->prob;
+
+	    }
+
+	    dirnode=create_dirnode(level);
+	    if (dirnode==NULL) goto error;
+
+	    dirnode->data=data;
+	    dirnode->type=_DIRNODE_TYPE_BETWEEN;
+
+	    for (unsigned short i=0; i<=level; i++) {
+
+		last[i]->junction[i].next=dirnode;
+		last[i]->junction[i].count=pos - lastpos[i];
+		dirnode->junction[i].prev=last[i];
+
+		last[i]=dirnode;
+		lastpos[i]=pos;
+		dn_count[i]++;
+
+	    }
+
+	}
+
+	data=sl->ops.next(data);
+	pos++;
+
+    }
+
+    /* close the lanes: the head is at position count + 1 */
+
+    for (unsigned short i=0; i<=maxlevel; i++) {
+
+	last[i]->junction[i].next=head;
+	last[i]->junction[i].count=count + 1 - lastpos[i];
+	head->junction[i].prev=last[i];
+
+    }
+
+    return 0;
+
+    error:
+
+    clear_skiplist(sl);
+    return -1;
+
+}
+
 struct dirnode_struct *create_head_dirnode(unsigned short level)
 {
     struct dirnode_struct *dirnode=NULL;
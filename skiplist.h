@@ -64,6 +64,7 @@ struct dirnode_struct {
 };
 
 struct skiplist_struct;
+struct skiplist_lockfree_s;
 
 struct slops_struct {
     void 					*(* next) (void *data);
@@ -89,6 +90,7 @@ struct skiplist_struct {
     unsigned 				prob;
     pthread_mutex_t			mutex;
     pthread_cond_t			cond;
+    struct skiplist_lockfree_s		*lockfree;
 };
 
 struct vector_lane_struct {
@@ -139,6 +141,7 @@ struct dirnode_struct *create_dirnode(unsigned short level);
 void destroy_dirnode(struct dirnode_struct *dirnode);
 
 struct dirnode_struct *create_head_dirnode(unsigned short level);
+int build_dirnodes_sl(struct skiplist_struct *sl);
 unsigned short resize_head_dirnode(struct dirnode_struct *dirnode, unsigned short level);
 
 #endif
@@ -0,0 +1,233 @@
+/*
+  2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017 Stef Bon <stefbon@gmail.com>
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include "global-defines.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+
+#include <inttypes.h>
+#include <sys/types.h>
+#include <pthread.h>
+
+#include "logging.h"
+#include "simple-list.h"
+#include "slab-cache.h"
+
+#define SLAB_HEADER_SIZE			(((sizeof(struct slab_s) + SLAB_CACHE_ALIGN - 1) / SLAB_CACHE_ALIGN) * SLAB_CACHE_ALIGN)
+
+static struct slab_s *get_slab(void *ptr)
+{
+    return (struct slab_s *) (((uintptr_t) ptr) & ~((uintptr_t) SLAB_CACHE_SLABSIZE - 1));
+}
+
+static struct slab_s *get_slab_list(struct clist_element_s *list)
+{
+    return (struct slab_s *) (((char *) list) - offsetof(struct slab_s, list));
+}
+
+void init_slab_cache(struct slab_cache_s *cache, unsigned int size, void *data)
+{
+
+    if (size < sizeof(void *)) size=sizeof(void *);
+    size=((size + SLAB_CACHE_ALIGN - 1) / SLAB_CACHE_ALIGN) * SLAB_CACHE_ALIGN;
+
+    pthread_mutex_init(&cache->mutex, NULL);
+    cache->size=size;
+    cache->perslab=(SLAB_CACHE_SLABSIZE - SLAB_HEADER_SIZE) / size;
+    init_clist_header(&cache->partial, NULL);
+    init_clist_header(&cache->full, NULL);
+    cache->empty=NULL;
+    cache->inuse=0;
+    cache->nrslabs=0;
+    cache->data=data;
+
+}
+
+static struct slab_s *create_slab(struct slab_cache_s *cache)
+{
+    struct slab_s *slab=NULL;
+
+    if (posix_memalign((void **) &slab, SLAB_CACHE_SLABSIZE, SLAB_CACHE_SLABSIZE)!=0) return NULL;
+
+    slab->cache=cache;
+    init_clist_element(&slab->list);
+    slab->free=NULL;
+    slab->inuse=0;
+    slab->carved=0;
+    slab->objects=((char *) slab) + SLAB_HEADER_SIZE;
+    cache->nrslabs++;
+
+    return slab;
+
+}
+
+/* release all slabs, also the ones with objects still in use */
+
+void clear_slab_cache(struct slab_cache_s *cache)
+{
+    struct clist_element_s *list=NULL;
+
+    pthread_mutex_lock(&cache->mutex);
+
+    while ((list=get_clist_head(&cache->partial, SIMPLE_LIST_FLAG_REMOVE))) free(get_slab_list(list));
+    while ((list=get_clist_head(&cache->full, SIMPLE_LIST_FLAG_REMOVE))) free(get_slab_list(list));
+
+    if (cache->empty) {
+
+	free(cache->empty);
+	cache->empty=NULL;
+
+    }
+
+    cache->inuse=0;
+    cache->nrslabs=0;
+
+    pthread_mutex_unlock(&cache->mutex);
+
+}
+
+/*
+    take an object from the first slab with free objects
+    objects never used before are carved from the end of the used part of the slab, so a new slab is
+    not walked to build a free list
+*/
+
+void *alloc_slab_object(struct slab_cache_s *cache)
+{
+    struct clist_element_s *list=NULL;
+    struct slab_s *slab=NULL;
+    void *ptr=NULL;
+
+    pthread_mutex_lock(&cache->mutex);
+
+    list=get_clist_head(&cache->partial, 0);
+
+    if (list) {
+
+	slab=get_slab_list(list);
+
+    } else {
+
+	if (cache->empty) {
+
+	    slab=cache->empty;
+	    cache->empty=NULL;
+
+	} else {
+
+	    slab=create_slab(cache);
+	    if (slab==NULL) goto unlock;
+
+	}
+
+	add_clist_element_first(&cache->partial, &slab->list);
+
+    }
+
+    if (slab->free) {
+
+	ptr=slab->free;
+	slab->free=*((void **) ptr);
+
+    } else {
+
+	ptr=slab->objects + slab->carved * cache->size;
+	slab->carved++;
+
+    }
+
+    slab->inuse++;
+    cache->inuse++;
+
+    if (slab->inuse==cache->perslab) {
+
+	remove_clist_element(&cache->partial, &slab->list);
+	add_clist_element_first(&cache->full, &slab->list);
+
+    }
+
+    unlock:
+
+    pthread_mutex_unlock(&cache->mutex);
+    return ptr;
+
+}
+
+void free_slab_object(void *ptr)
+{
+    struct slab_s *slab=get_slab(ptr);
+    struct slab_cache_s *cache=slab->cache;
+
+    pthread_mutex_lock(&cache->mutex);
+
+    *((void **) ptr)=slab->free;
+    slab->free=ptr;
+
+    if (slab->inuse==cache->perslab) {
+
+	remove_clist_element(&cache->full, &slab->list);
+	add_clist_element_first(&cache->partial, &slab->list);
+
+    }
+
+    slab->inuse--;
+    cache->inuse--;
+
+    if (slab->inuse==0) {
+
+	remove_clist_element(&cache->partial, &slab->list);
+
+	/* keep one empty slab, reset it so it's carved again */
+
+	slab->free=NULL;
+	slab->carved=0;
+
+	if (cache->empty) {
+
+	    free(slab);
+	    cache->nrslabs--;
+
+	} else {
+
+	    cache->empty=slab;
+
+	}
+
+    }
+
+    pthread_mutex_unlock(&cache->mutex);
+
+}
+
+struct slab_cache_s *get_slab_cache(void *ptr)
+{
+    return get_slab(ptr)->cache;
+}
+
+uint64_t get_slab_cache_memory(struct slab_cache_s *cache)
+{
+    return cache->nrslabs * SLAB_CACHE_SLABSIZE;
+}
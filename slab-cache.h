@@ -0,0 +1,72 @@
+/*
+  2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017 Stef Bon <stefbon@gmail.com>
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#ifndef SB_COMMON_UTILS_SLAB_CACHE_H
+#define SB_COMMON_UTILS_SLAB_CACHE_H
+
+#include "simple-list.h"
+
+#define SLAB_CACHE_SLABSIZE				65536		/* power of 2, a slab is aligned to its size */
+#define SLAB_CACHE_ALIGN				16
+
+/*
+    cache of objects of one size
+
+    objects are taken from slabs of SLAB_CACHE_SLABSIZE bytes, aligned to that size, so the slab (and the cache)
+    of an object is found by masking its address: freeing does not need the cache
+    every slab has its own list of free objects, the cache keeps the slabs with free objects in front
+    a slab which becomes empty is returned to the system, except one which is kept to avoid thrashing
+    clear_slab_cache releases all slabs at once, without looking at the objects
+*/
+
+struct slab_cache_s;
+
+struct slab_s {
+    struct slab_cache_s				*cache;
+    struct clist_element_s			list;
+    void					*free;
+    unsigned int				inuse;
+    unsigned int				carved;
+    char					*objects;
+};
+
+struct slab_cache_s {
+    pthread_mutex_t				mutex;
+    unsigned int				size;
+    unsigned int				perslab;
+    struct clist_header_s			partial;
+    struct clist_header_s			full;
+    struct slab_s				*empty;
+    uint64_t					inuse;
+    uint64_t					nrslabs;
+    void					*data;
+};
+
+/* prototypes */
+
+void init_slab_cache(struct slab_cache_s *cache, unsigned int size, void *data);
+void clear_slab_cache(struct slab_cache_s *cache);
+
+void *alloc_slab_object(struct slab_cache_s *cache);
+void free_slab_object(void *ptr);
+struct slab_cache_s *get_slab_cache(void *ptr);
+
+uint64_t get_slab_cache_memory(struct slab_cache_s *cache);
+
+#endif
@@ -126,6 +126,14 @@ void get_current_time(struct timespec *rightnow)
     int res=clock_gettime(CLOCK_REALTIME, rightnow);
 }
 
+/* milliseconds from one time to a later one, zero when it's not later */
+
+uint64_t get_msec_passed(struct timespec *from, struct timespec *to)
+{
+    int64_t msec=(int64_t) (to->tv_sec - from->tv_sec) * 1000 + (to->tv_nsec - from->tv_nsec) / 1000000;
+    return (msec>0) ? (uint64_t) msec : 0;
+}
+
 
 int compare_stat_time(struct stat *ast, struct stat *bst, unsigned char ntype)
 {
@@ -24,6 +24,7 @@
 #define UTILS_CONVERT_TOLOWER	2
 
 #include <sys/stat.h>
+#include <stdint.h>
 #include <time.h>
 
 struct common_buffer_s {
@@ -48,6 +49,7 @@ int compare_stat_time(struct stat *ast, struct stat *bst, unsigned char ntype);
 void copy_stat_times(struct stat *st_to, struct stat *st_from);
 void copy_stat(struct stat *st_to, struct stat *st_from);
 void get_current_time(struct timespec *rightnow);
+uint64_t get_msec_passed(struct timespec *from, struct timespec *to);
 
 unsigned char issubdirectory(const char *path1, const char *path2, unsigned char maybethesame);
 char *check_path(char *path);
@@ -73,7 +73,10 @@ static unsigned int context_hash_function(void *data)
 int initialize_context_hashtable()
 {
     unsigned int error=0;
-    return initialize_group(&context_hash, context_hash_function, 128, &error);
+    int result=initialize_group(&context_hash, context_hash_function, 128, &error);
+
+    if (result==0) profile_simple_locking(&context_hash.locking, "context hash");
+    return result;
 }
 
 void free_service_context(struct service_context_s *context);
@@ -0,0 +1,256 @@
+/*
+  2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017 Stef Bon <stefbon@gmail.com>
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include "global-defines.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+
+#include <inttypes.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "utils.h"
+#include "fuse-dentry.h"
+#include "fuse-directory.h"
+#include "fuse-interface.h"
+#include "fuse-fs.h"
+#include "workspaces.h"
+#include "workspace-eviction.h"
+
+#include "logging.h"
+
+#define WORKSPACE_EVICTION_INVALIDATE			128		/* dentries the VFS is asked to drop per step */
+
+struct eviction_sweep_s {
+    struct dentry_slabs_s			*slabs;
+    unsigned int				count;
+    unsigned int				ninval;
+    uint64_t					inos[WORKSPACE_EVICTION_SWEEP];
+    uint64_t					inval[WORKSPACE_EVICTION_INVALIDATE];
+};
+
+void init_workspace_eviction(struct workspace_eviction_s *eviction)
+{
+    eviction->budget=0;
+    eviction->evictions=0;
+    eviction->invalidations=0;
+    eviction->flags=0;
+    eviction->hand.shard=0;
+    eviction->hand.slot=0;
+    eviction->hand.rounds=0;
+}
+
+/* the memory of the objects in use in the slabs of the workspace, without own slabs this is not known */
+
+uint64_t get_workspace_resident(struct workspace_mount_s *workspace)
+{
+    return (workspace->slabs) ? get_dentry_slabs_resident(workspace->slabs) : 0;
+}
+
+/* set the budget in bytes, zero is no limit */
+
+int set_workspace_budget(struct workspace_mount_s *workspace, uint64_t budget, unsigned int *error)
+{
+
+    if (workspace->slabs==NULL && budget>0) {
+
+	*error=EINVAL;
+	return -1;
+
+    }
+
+    __atomic_store_n(&workspace->eviction.budget, budget, __ATOMIC_RELAXED);
+    check_workspace_budget(workspace);
+    return 0;
+
+}
+
+void get_workspace_eviction_stat(struct workspace_mount_s *workspace, struct workspace_eviction_stat_s *stat)
+{
+    struct workspace_eviction_s *eviction=&workspace->eviction;
+
+    stat->budget=__atomic_load_n(&eviction->budget, __ATOMIC_RELAXED);
+    stat->resident=get_workspace_resident(workspace);
+    stat->evictions=__atomic_load_n(&eviction->evictions, __ATOMIC_RELAXED);
+    stat->invalidations=__atomic_load_n(&eviction->invalidations, __ATOMIC_RELAXED);
+}
+
+/*
+    look at one inode of the sweep, only the ones in the slabs of the workspace
+    an inode used since the last pass gets a second chance: its bit is cleared
+    others are candidates: to evict when the VFS does not know them, otherwise to ask the VFS to drop them
+*/
+
+static void cb_sweep_inode(struct inode_s *inode, void *ptr)
+{
+    struct eviction_sweep_s *sweep=(struct eviction_sweep_s *) ptr;
+    struct entry_s *entry=inode->alias;
+
+    if (entry==NULL || entry->parent==NULL || get_entry_slabs(entry)!=sweep->slabs) return;
+
+    if (__atomic_load_n(&inode->clock, __ATOMIC_RELAXED)>0) {
+
+	__atomic_store_n(&inode->clock, 0, __ATOMIC_RELAXED);
+	return;
+
+    }
+
+    if (__atomic_load_n(&inode->nopen, __ATOMIC_RELAXED)>0) return;
+
+    if (__atomic_load_n(&inode->nlookup, __ATOMIC_RELAXED)==0) {
+
+	if (sweep->count < WORKSPACE_EVICTION_SWEEP) sweep->inos[sweep->count++]=inode->st.st_ino;
+
+    } else if (S_ISDIR(inode->st.st_mode)==0) {
+
+	/* directories are left to the VFS, dropping those drops everything below */
+
+	if (sweep->ninval < WORKSPACE_EVICTION_INVALIDATE) sweep->inval[sweep->ninval++]=inode->st.st_ino;
+
+    }
+
+}
+
+/*
+    ask the VFS to drop the dentries of candidates still not used, when it does it sends a forget
+    the inode, its entry and the parent are only looked at inside the epoch of the inode table (they are
+    freed after a grace period), the parent ino and the name are copied to notify after leaving it
+*/
+
+static void invalidate_workspace_entries(struct workspace_mount_s *workspace, struct eviction_sweep_s *sweep)
+{
+    struct service_context_s *context=workspace->context;
+
+    if (context==NULL) return;
+
+    for (unsigned int i=0; i<sweep->ninval; i++) {
+	char name[NAME_MAX + 1];
+	unsigned int len=0;
+	uint64_t pino=0;
+	unsigned int *readers=enter_inode_hashtable_epoch();
+	struct inode_s *inode=lookup_inode_hashtable(sweep->inval[i]);
+	struct entry_s *entry=(inode) ? inode->alias : NULL;
+
+	if (entry && entry->parent && entry->parent->inode && entry->name.len <= NAME_MAX &&
+	    __atomic_load_n(&inode->clock, __ATOMIC_RELAXED)==0 && __atomic_load_n(&inode->nopen, __ATOMIC_RELAXED)==0) {
+
+	    pino=(uint64_t) entry->parent->inode->st.st_ino;
+	    len=entry->name.len;
+	    memcpy(name, entry->name.name, len);
+	    name[len]='\0';
+
+	}
+
+	leave_inode_hashtable_epoch(readers);
+	if (pino==0) continue;
+
+	notify_VFS_inval_entry(context->interface.ptr, pino, name, len);
+	__atomic_add_fetch(&workspace->eviction.invalidations, 1, __ATOMIC_RELAXED);
+
+    }
+
+}
+
+/*
+    the background job, it runs in the thread which forgets inodes
+    sweep till the memory in use is below the low mark, or the hand has gone around twice: after that
+    every candidate has been seen without its bit and what's left is in use
+*/
+
+static void evict_workspace_inodes(void *ptr)
+{
+    struct workspace_mount_s *workspace=(struct workspace_mount_s *) ptr;
+    struct workspace_eviction_s *eviction=&workspace->eviction;
+    uint64_t budget=__atomic_load_n(&eviction->budget, __ATOMIC_RELAXED);
+    uint64_t low=budget - budget / WORKSPACE_EVICTION_LOWMARK;
+    unsigned int rounds=eviction->hand.rounds;
+    struct eviction_sweep_s *sweep=NULL;
+    uint64_t evictions=eviction->evictions;
+
+    sweep=malloc(sizeof(struct eviction_sweep_s));
+    if (sweep==NULL) goto out;
+    sweep->slabs=workspace->slabs;
+
+    while ((__atomic_load_n(&eviction->flags, __ATOMIC_ACQUIRE) & WORKSPACE_EVICTION_FLAG_STOP)==0) {
+
+	if (budget==0 || sweep->slabs==NULL || get_dentry_slabs_resident(sweep->slabs) <= low) break;
+	if (eviction->hand.rounds - rounds > 2) break;
+
+	sweep->count=0;
+	sweep->ninval=0;
+	sweep_inode_hashtable(&eviction->hand, WORKSPACE_EVICTION_SWEEP, cb_sweep_inode, (void *) sweep);
+
+	if (sweep->count>0) __atomic_add_fetch(&eviction->evictions, evict_inodes(sweep->inos, sweep->count), __ATOMIC_RELAXED);
+	if (sweep->ninval>0 && get_dentry_slabs_resident(sweep->slabs) > low) invalidate_workspace_entries(workspace, sweep);
+
+    }
+
+    logoutput("evict_workspace_inodes: evicted %li, resident %li budget %li", (long) (eviction->evictions - evictions), (long) get_workspace_resident(workspace), (long) budget);
+    free(sweep);
+
+    out:
+
+    __atomic_and_fetch(&eviction->flags, ~WORKSPACE_EVICTION_FLAG_QUEUED, __ATOMIC_RELEASE);
+
+}
+
+/* start the background job when over the budget, and not started already */
+
+void check_workspace_budget(struct workspace_mount_s *workspace)
+{
+    struct workspace_eviction_s *eviction=&workspace->eviction;
+    uint64_t budget=__atomic_load_n(&eviction->budget, __ATOMIC_RELAXED);
+    unsigned int flags=0;
+
+    if (budget==0 || get_workspace_resident(workspace) <= budget) return;
+
+    flags=__atomic_fetch_or(&eviction->flags, WORKSPACE_EVICTION_FLAG_QUEUED, __ATOMIC_ACQ_REL);
+
+    if (flags & WORKSPACE_EVICTION_FLAG_STOP) {
+
+	if ((flags & WORKSPACE_EVICTION_FLAG_QUEUED)==0) __atomic_and_fetch(&eviction->flags, ~WORKSPACE_EVICTION_FLAG_QUEUED, __ATOMIC_RELEASE);
+
+    } else if ((flags & WORKSPACE_EVICTION_FLAG_QUEUED)==0) {
+
+	if (queue_inode_2forget_cb(evict_workspace_inodes, (void *) workspace)==-1) __atomic_and_fetch(&eviction->flags, ~WORKSPACE_EVICTION_FLAG_QUEUED, __ATOMIC_RELEASE);
+
+    }
+
+}
+
+/* stop evicting and wait for a queued job, before the tree of the workspace is cleared */
+
+void stop_workspace_eviction(struct workspace_mount_s *workspace)
+{
+    struct workspace_eviction_s *eviction=&workspace->eviction;
+
+    __atomic_fetch_or(&eviction->flags, WORKSPACE_EVICTION_FLAG_STOP, __ATOMIC_ACQ_REL);
+    while (__atomic_load_n(&eviction->flags, __ATOMIC_ACQUIRE) & WORKSPACE_EVICTION_FLAG_QUEUED) sched_yield();
+
+}
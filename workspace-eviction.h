@@ -0,0 +1,72 @@
+/*
+  2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017 Stef Bon <stefbon@gmail.com>
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#ifndef SB_COMMON_UTILS_WORKSPACE_EVICTION_H
+#define SB_COMMON_UTILS_WORKSPACE_EVICTION_H
+
+#include "fuse-inode-hashtable.h"
+
+#define WORKSPACE_EVICTION_FLAG_QUEUED			1
+#define WORKSPACE_EVICTION_FLAG_STOP			2
+
+#define WORKSPACE_EVICTION_CHECK			64		/* check the budget every so many new inodes */
+#define WORKSPACE_EVICTION_SWEEP			1024		/* slots looked at per step of the sweep */
+#define WORKSPACE_EVICTION_LOWMARK			8		/* evict till 1/8 below the budget */
+
+/*
+    memory budget of the cached entries, inodes, directories and names of a workspace
+
+    when the memory in use of the slabs of the workspace is over the budget, inodes not known by the VFS and
+    without open handles are evicted, in a background job, by an approximate LRU (CLOCK):
+    the sweep walks the inode table, an inode used since the last pass (find_inode sets the bit) gets a second chance,
+    others are evicted
+    when that's not enough, the VFS is asked to drop unused dentries (notify_VFS_inval_entry), the forgets it sends
+    then free the inodes the normal way
+
+    only workspaces with their own slabs (set_workspace_slabs) have a budget, a budget of zero means no limit
+*/
+
+struct workspace_eviction_s {
+    uint64_t					budget;
+    uint64_t					evictions;
+    uint64_t					invalidations;
+    unsigned int				flags;
+    struct inode_hashtable_hand_s		hand;
+};
+
+struct workspace_eviction_stat_s {
+    uint64_t					budget;
+    uint64_t					resident;
+    uint64_t					evictions;
+    uint64_t					invalidations;
+};
+
+struct workspace_mount_s;
+
+/* prototypes */
+
+void init_workspace_eviction(struct workspace_eviction_s *eviction);
+int set_workspace_budget(struct workspace_mount_s *workspace, uint64_t budget, unsigned int *error);
+void check_workspace_budget(struct workspace_mount_s *workspace);
+void stop_workspace_eviction(struct workspace_mount_s *workspace);
+
+uint64_t get_workspace_resident(struct workspace_mount_s *workspace);
+void get_workspace_eviction_stat(struct workspace_mount_s *workspace, struct workspace_eviction_stat_s *stat);
+
+#endif
@@ -226,6 +226,8 @@ int initialize_fuse_users(unsigned int *error)
 
     }
 
+    profile_simple_locking(&fuse_users_hash.locking, "fuse users hash");
+
     return 0;
 
 }
@@ -78,6 +78,7 @@ void clear_workspace_mount(struct workspace_mount_s *workspace)
     struct directory_s *directory=remove_directory(&workspace->rootinode, &error);
 
     logoutput("clear_workspace_mount: mountpoint %s", workspace->mountpoint.path);
+    stop_workspace_eviction(workspace);
 
     if (directory) {
 	struct service_context_s *context=workspace->context;
@@ -91,6 +92,19 @@ void clear_workspace_mount(struct workspace_mount_s *workspace)
 
 void free_workspace_mount(struct workspace_mount_s *workspace)
 {
+
+    stop_workspace_eviction(workspace);
+
+    /* release what's left of the entries, inodes and directories at once */
+
+    if (workspace->slabs) {
+
+	wait_inode_hashtable_grace();
+	free_dentry_slabs(workspace->slabs);
+	workspace->slabs=NULL;
+
+    }
+
     free_path_pathinfo(&workspace->mountpoint);
     pthread_mutex_destroy(&workspace->mutex);
     free(workspace);
@@ -99,9 +113,15 @@ void free_workspace_mount(struct workspace_mount_s *workspace)
 void increase_inodes_workspace(void *data)
 {
     struct workspace_mount_s *workspace=(struct workspace_mount_s *) data;
+    unsigned long long nrinodes=0;
+
     pthread_mutex_lock(&workspace->mutex);
-    workspace->nrinodes++;
+    nrinodes=++workspace->nrinodes;
     pthread_mutex_unlock(&workspace->mutex);
+
+    /* see once in a while if the cache is over its budget */
+
+    if ((nrinodes % WORKSPACE_EVICTION_CHECK)==0) check_workspace_budget(workspace);
 }
 
 void decrease_inodes_workspace(void *data)
@@ -115,9 +135,10 @@ void decrease_inodes_workspace(void *data)
 int init_workspace_mount(struct workspace_mount_s *workspace, unsigned int *error)
 {
     struct entry_s *rootentry=NULL;
-    struct name_s xname={NULL, 0, 0};
+    struct name_s xname={NULL, 0, 0, 0};
     struct inode_s *rootinode=&workspace->rootinode;
-    struct stat *st=&rootinode->st;
+    struct inode_attr_s *st=&rootinode->st;
+    struct timespec now;
 
     memset(workspace, 0, sizeof(struct workspace_mount_s));
 
@@ -126,6 +147,8 @@ int init_workspace_mount(struct workspace_mount_s *workspace, unsigned int *erro
     workspace->user=NULL;
 
     workspace->nrinodes=1;
+    workspace->slabs=NULL;
+    init_workspace_eviction(&workspace->eviction);
     workspace->mountpoint.path=NULL;
     workspace->mountpoint.len=0;
     workspace->mountpoint.flags=0;
@@ -146,12 +169,10 @@ int init_workspace_mount(struct workspace_mount_s *workspace, unsigned int *erro
     st->st_uid=0;
     st->st_gid=0;
     st->st_size=_INODE_DIRECTORY_SIZE;
-    st->st_blksize=1024;
-    st->st_blocks=(unsigned int) (st->st_size / st->st_blksize) + ((st->st_size % st->st_blksize)==0) ? 1 : 0;
 
-    get_current_time(&st->st_mtim);
-    st->st_ctim.tv_sec=st->st_mtim.tv_sec;
-    st->st_ctim.tv_nsec=st->st_mtim.tv_nsec;
+    get_current_time(&now);
+    set_inode_time(&st->st_mtim, &now);
+    set_inode_time(&st->st_ctim, &now);
     st->st_ino=FUSE_ROOT_ID;
 
     rootinode->nlookup=1;
@@ -182,6 +203,53 @@ int init_workspace_mount(struct workspace_mount_s *workspace, unsigned int *erro
 
 }
 
+/*
+    let the workspace have its own slabs for entries, inodes, directories and names, instead of the global ones
+    everything is released at once when the workspace is freed, and the memory used is known per workspace
+    the inodes freed are counted with decrease_inodes_workspace
+
+    call this after init_workspace_mount and before the root directory is created: the root entry is moved to the new slabs
+*/
+
+int set_workspace_slabs(struct workspace_mount_s *workspace, unsigned int *error)
+{
+    struct inode_s *rootinode=&workspace->rootinode;
+    struct entry_s *rootentry=rootinode->alias;
+    struct dentry_slabs_s *slabs=NULL;
+    struct entry_s *entry=NULL;
+
+    if (workspace->slabs) return 0;
+
+    if (rootentry==NULL || rootinode->link.type==INODE_LINK_TYPE_DIRECTORY) {
+
+	*error=EINVAL;
+	return -1;
+
+    }
+
+    slabs=create_dentry_slabs((void *) workspace, decrease_inodes_workspace, error);
+    if (slabs==NULL) return -1;
+
+    entry=create_entry_slabs(slabs, NULL, &rootentry->name);
+
+    if (entry==NULL) {
+
+	free_dentry_slabs(slabs);
+	*error=ENOMEM;
+	return -1;
+
+    }
+
+    rootinode->alias=entry;
+    entry->inode=rootinode;
+    rootentry->inode=NULL;
+    destroy_entry(rootentry);
+
+    workspace->slabs=slabs;
+    return 0;
+
+}
+
 int mount_workspace_mount(struct service_context_s *context, char *source, char *name, unsigned int *error)
 {
     struct workspace_mount_s *workspace=context->workspace;
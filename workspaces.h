@@ -26,6 +26,7 @@
 #include "beventloop.h"
 #include "fuse-dentry.h"
 #include "fuse-directory.h"
+#include "workspace-eviction.h"
 #include "workspace-interface.h"
 #include "fuse-interface.h"
 #include "fuse-fs.h"
@@ -187,6 +188,8 @@ struct workspace_mount_s {
     dev_t					dev;
     struct inode_s 				rootinode;
     unsigned long long 				nrinodes;
+    struct dentry_slabs_s			*slabs;
+    struct workspace_eviction_s			eviction;
     unsigned int				pathmax;
     pthread_mutex_t				mutex;
     struct pathinfo_s 				mountpoint;
@@ -210,6 +213,7 @@ struct fuse_path_s {
 
 void increase_inodes_workspace(void *data);
 void decrease_inodes_workspace(void *data);
+int set_workspace_slabs(struct workspace_mount_s *workspace, unsigned int *error);
 
 void adjust_pathmax(struct workspace_mount_s *w, unsigned int len);
 unsigned int get_pathmax(struct workspace_mount_s *w);